@@ -0,0 +1,94 @@
+// ey.gellis@gmail.com
+#include "arena.hpp"
+#include "squaremat.hpp"
+#include <algorithm>
+#include <cstdint>
+
+using namespace matrix;
+
+namespace {
+	thread_local std::pmr::memory_resource* threadResource = nullptr;
+
+	// Chunks are aligned to a cache line so matrix buffers inside them are too
+	constexpr std::size_t chunkAlignment = 64;
+}
+
+namespace matrix {
+	std::pmr::memory_resource* currentResource() {
+		return threadResource ? threadResource : std::pmr::get_default_resource();
+	}
+}
+
+ScratchArena::ScratchArena(std::size_t initialBytes, std::pmr::memory_resource* up)
+	: upstream(up), current(0), offset(0), upstreamAllocations(0) {
+	chunks.push_back({nullptr, initialBytes});
+}
+
+ScratchArena::~ScratchArena() {
+	releaseChunks();
+}
+
+void ScratchArena::releaseChunks() {
+	for (const Chunk& chunk : chunks)
+		if (chunk.base)
+			upstream->deallocate(chunk.base, chunk.capacity, chunkAlignment);
+	chunks.clear();
+}
+
+void* ScratchArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+	while (true) {
+		Chunk& chunk = chunks[current];
+		if (!chunk.base) {
+			chunk.capacity = std::max(chunk.capacity, bytes + alignment);
+			chunk.base = static_cast<std::byte*>(upstream->allocate(chunk.capacity, chunkAlignment));
+			++upstreamAllocations;
+		}
+		std::uintptr_t start = reinterpret_cast<std::uintptr_t>(chunk.base) + offset;
+		std::size_t padding = (alignment - start % alignment) % alignment;
+		if (offset + padding + bytes <= chunk.capacity) {
+			offset += padding + bytes;
+			return chunk.base + offset - bytes;
+		}
+		if (current + 1 == chunks.size())
+			chunks.push_back({nullptr, std::max(2 * chunk.capacity, bytes + alignment)});
+		++current;
+		offset = 0;
+	}
+}
+
+void ScratchArena::do_deallocate(void*, std::size_t, std::size_t) {}
+
+bool ScratchArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	return this == &other;
+}
+
+void ScratchArena::reset() {
+	if (chunks.size() > 1) {
+		std::size_t total = capacity();
+		releaseChunks();
+		chunks.push_back({static_cast<std::byte*>(upstream->allocate(total, chunkAlignment)), total});
+		++upstreamAllocations;
+	}
+	current = 0;
+	offset = 0;
+}
+
+std::size_t ScratchArena::capacity() const {
+	std::size_t total = 0;
+	for (const Chunk& chunk : chunks)
+		total += chunk.capacity;
+	return total;
+}
+
+ScratchArena& ScratchArena::local() {
+	thread_local ScratchArena arena;
+	return arena;
+}
+
+ResourceScope::ResourceScope(std::pmr::memory_resource* resource) : previous(threadResource) {
+	threadResource = resource;
+}
+
+ResourceScope::~ResourceScope() {
+	threadResource = previous;
+}
@@ -0,0 +1,97 @@
+// ey.gellis@gmail.com
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief Bump-pointer scratch arena for matrix temporaries
+	 *
+	 * Deallocation is a no-op; reset() rewinds the arena in O(1) while keeping its
+	 * memory, so a loop that resets once per iteration reaches a steady state with
+	 * no system allocations. Not thread-safe: use one arena per thread (local()).
+	 * Every matrix allocated from the arena must be destroyed or reassigned before
+	 * reset() or the arena's destruction.
+	 */
+	class ScratchArena : public std::pmr::memory_resource {
+	private:
+		struct Chunk {
+			std::byte* base;
+			std::size_t capacity;
+		};
+
+		std::pmr::memory_resource* upstream;
+		std::vector<Chunk> chunks;
+		std::size_t current;
+		std::size_t offset;
+		std::size_t upstreamAllocations;
+
+		void releaseChunks();
+
+	protected:
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+		void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	public:
+		/**
+		 * @brief Creates an empty arena
+		 * @param initialBytes Size of the first chunk, allocated lazily
+		 * @param upstream Resource chunks are obtained from
+		 */
+		explicit ScratchArena(std::size_t initialBytes = 1 << 20,
+			std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+		ScratchArena(const ScratchArena&) = delete;
+		ScratchArena& operator=(const ScratchArena&) = delete;
+
+		~ScratchArena();
+
+		/**
+		 * @brief Makes all memory handed out so far available again
+		 *
+		 * If the last cycle spilled into several chunks they are merged into one of
+		 * the combined size, so the next identical cycle fits in a single chunk.
+		 */
+		void reset();
+
+		/**
+		 * @brief Total bytes owned by the arena
+		 * @return Capacity in bytes
+		 */
+		std::size_t capacity() const;
+
+		/**
+		 * @brief Number of chunks requested from the upstream resource so far
+		 * @return Upstream allocation count
+		 */
+		std::size_t systemAllocations() const { return upstreamAllocations; }
+
+		/**
+		 * @brief Arena owned by the calling thread
+		 * @return Reference to the thread's scratch arena
+		 */
+		static ScratchArena& local();
+	};
+
+	/**
+	 * @brief RAII guard redirecting currentResource() on this thread
+	 *
+	 * While the scope is alive every SquareMat created without an explicit resource,
+	 * including operator temporaries, allocates from the given resource.
+	 */
+	class ResourceScope {
+	private:
+		std::pmr::memory_resource* previous;
+
+	public:
+		explicit ResourceScope(std::pmr::memory_resource* resource);
+		ResourceScope(const ResourceScope&) = delete;
+		ResourceScope& operator=(const ResourceScope&) = delete;
+		~ResourceScope();
+	};
+}
+#endif
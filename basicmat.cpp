@@ -0,0 +1,884 @@
+// ey.gellis@gmail.com
+#include "basicmat.hpp"
+#include "kernels.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace matrix;
+using detail::ElementTraits;
+
+namespace {
+	// Elements widened to float per pass over 16-bit storage
+	constexpr std::size_t WIDEN_CHUNK = 512;
+	// Product blocking: rows of B kept hot per pass, and columns per row segment
+	constexpr int DEPTH_BLOCK = 256;
+	constexpr int COLUMN_BLOCK = 512;
+	// Tile edge of the blocked transpose
+	constexpr int TRANSPOSE_BLOCK = 32;
+
+	/**
+	 * @brief Vector kernels for one element type and instruction set
+	 *
+	 * Written with GCC vector extensions so one body serves float, int32 and
+	 * int64 at each width; out may alias the inputs. axpy adds s * b to c.
+	 */
+	template <typename T>
+	struct GenericKernels {
+		void (*add)(const T* a, const T* b, T* out, std::size_t n);
+		void (*sub)(const T* a, const T* b, T* out, std::size_t n);
+		void (*neg)(const T* a, T* out, std::size_t n);
+		void (*addScalar)(const T* a, T sc, T* out, std::size_t n);
+		void (*mulScalar)(const T* a, T sc, T* out, std::size_t n);
+		void (*axpy)(T* c, const T* b, T s, std::size_t n);
+	};
+
+	// Unaligned vector loads and stores go through memcpy, which compiles to
+	// a single move
+#define MATRIX_GENERIC_BINARY(NAME, ATTR, BYTES, OP) \
+	template <typename T> \
+	ATTR void NAME(const T* a, const T* b, T* out, std::size_t n) { \
+		typedef T V __attribute__((vector_size(BYTES))); \
+		constexpr std::size_t width = BYTES / sizeof(T); \
+		std::size_t i = 0; \
+		for (; i + width <= n; i += width) { \
+			V x, y; \
+			__builtin_memcpy(&x, a + i, BYTES); \
+			__builtin_memcpy(&y, b + i, BYTES); \
+			x = x OP y; \
+			__builtin_memcpy(out + i, &x, BYTES); \
+		} \
+		for (; i < n; ++i) \
+			out[i] = a[i] OP b[i]; \
+	}
+
+#define MATRIX_GENERIC_SCALAR(NAME, ATTR, BYTES, OP) \
+	template <typename T> \
+	ATTR void NAME(const T* a, T sc, T* out, std::size_t n) { \
+		typedef T V __attribute__((vector_size(BYTES))); \
+		constexpr std::size_t width = BYTES / sizeof(T); \
+		std::size_t i = 0; \
+		for (; i + width <= n; i += width) { \
+			V x; \
+			__builtin_memcpy(&x, a + i, BYTES); \
+			x = x OP sc; \
+			__builtin_memcpy(out + i, &x, BYTES); \
+		} \
+		for (; i < n; ++i) \
+			out[i] = a[i] OP sc; \
+	}
+
+#define MATRIX_DEFINE_GENERIC_KERNELS(SUFFIX, ATTR, BYTES) \
+	MATRIX_GENERIC_BINARY(add##SUFFIX, ATTR, BYTES, +) \
+	MATRIX_GENERIC_BINARY(sub##SUFFIX, ATTR, BYTES, -) \
+	MATRIX_GENERIC_SCALAR(addScalar##SUFFIX, ATTR, BYTES, +) \
+	MATRIX_GENERIC_SCALAR(mulScalar##SUFFIX, ATTR, BYTES, *) \
+	template <typename T> \
+	ATTR void neg##SUFFIX(const T* a, T* out, std::size_t n) { \
+		typedef T V __attribute__((vector_size(BYTES))); \
+		constexpr std::size_t width = BYTES / sizeof(T); \
+		std::size_t i = 0; \
+		for (; i + width <= n; i += width) { \
+			V x; \
+			__builtin_memcpy(&x, a + i, BYTES); \
+			x = -x; \
+			__builtin_memcpy(out + i, &x, BYTES); \
+		} \
+		for (; i < n; ++i) \
+			out[i] = -a[i]; \
+	} \
+	template <typename T> \
+	ATTR void axpy##SUFFIX(T* c, const T* b, T s, std::size_t n) { \
+		typedef T V __attribute__((vector_size(BYTES))); \
+		constexpr std::size_t width = BYTES / sizeof(T); \
+		std::size_t j = 0; \
+		for (; j + width <= n; j += width) { \
+			V x, y; \
+			__builtin_memcpy(&x, c + j, BYTES); \
+			__builtin_memcpy(&y, b + j, BYTES); \
+			x += s * y; \
+			__builtin_memcpy(c + j, &x, BYTES); \
+		} \
+		for (; j < n; ++j) \
+			c[j] += s * b[j]; \
+	} \
+	template <typename T> \
+	const GenericKernels<T> generic##SUFFIX = {add##SUFFIX<T>, sub##SUFFIX<T>, neg##SUFFIX<T>, \
+		addScalar##SUFFIX<T>, mulScalar##SUFFIX<T>, axpy##SUFFIX<T>};
+
+	MATRIX_DEFINE_GENERIC_KERNELS(Base, , 16)
+#if defined(__x86_64__) || defined(__i386__)
+	MATRIX_DEFINE_GENERIC_KERNELS(Avx2, __attribute__((target("avx2,fma"))), 32)
+	MATRIX_DEFINE_GENERIC_KERNELS(Avx512, __attribute__((target("avx512f,avx512dq"))), 64)
+#endif
+
+	/**
+	 * @brief Vector kernels for T at the instruction set kernels() uses
+	 */
+	template <typename T>
+	const GenericKernels<T>& genericKernels() {
+		switch (detail::activeIsa()) {
+#if defined(__x86_64__) || defined(__i386__)
+		case detail::Isa::AVX512:
+			return genericAvx512<T>;
+		case detail::Isa::AVX2:
+			return genericAvx2<T>;
+#endif
+		default:
+			return genericBase<T>;
+		}
+	}
+
+	/**
+	 * @brief Runs a float computation over 16-bit storage chunk by chunk
+	 *
+	 * body(x, y, len) sees a and b widened to float (y is null without b) and
+	 * leaves the result in x, which is rounded into out.
+	 */
+	template <typename T, typename F>
+	void widened(const T* a, const T* b, T* out, std::size_t n, F&& body) {
+		float x[WIDEN_CHUNK];
+		float y[WIDEN_CHUNK];
+		for (std::size_t first = 0; first < n; first += WIDEN_CHUNK) {
+			const std::size_t len = std::min(WIDEN_CHUNK, n - first);
+			for (std::size_t i = 0; i < len; ++i)
+				x[i] = a[first + i];
+			if (b)
+				for (std::size_t i = 0; i < len; ++i)
+					y[i] = b[first + i];
+			body(x, b ? y : nullptr, len);
+			for (std::size_t i = 0; i < len; ++i)
+				out[first + i] = x[i];
+		}
+	}
+
+	template <typename T>
+	void addElements(const T* a, const T* b, T* out, std::size_t n) {
+		if constexpr (ElementTraits<T>::simd)
+			genericKernels<T>().add(a, b, out, n);
+		else if constexpr (ElementTraits<T>::widened)
+			widened(a, b, out, n, [](float* x, const float* y, std::size_t len) { genericKernels<float>().add(x, y, x, len); });
+		else
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = a[i] + b[i];
+	}
+
+	template <typename T>
+	void subElements(const T* a, const T* b, T* out, std::size_t n) {
+		if constexpr (ElementTraits<T>::simd)
+			genericKernels<T>().sub(a, b, out, n);
+		else if constexpr (ElementTraits<T>::widened)
+			widened(a, b, out, n, [](float* x, const float* y, std::size_t len) { genericKernels<float>().sub(x, y, x, len); });
+		else
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = a[i] - b[i];
+	}
+
+	template <typename T>
+	void negElements(const T* a, T* out, std::size_t n) {
+		if constexpr (ElementTraits<T>::simd)
+			genericKernels<T>().neg(a, out, n);
+		else if constexpr (ElementTraits<T>::widened)
+			widened(a, static_cast<const T*>(nullptr), out, n,
+				[](float* x, const float*, std::size_t len) { genericKernels<float>().neg(x, x, len); });
+		else
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = -a[i];
+	}
+
+	template <typename T, typename S>
+	void addScalarElements(const T* a, S sc, T* out, std::size_t n) {
+		if constexpr (ElementTraits<T>::simd)
+			genericKernels<T>().addScalar(a, sc, out, n);
+		else if constexpr (ElementTraits<T>::widened)
+			widened(a, static_cast<const T*>(nullptr), out, n,
+				[sc](float* x, const float*, std::size_t len) { genericKernels<float>().addScalar(x, sc, x, len); });
+		else
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = a[i] + sc;
+	}
+
+	template <typename T, typename S>
+	void mulScalarElements(const T* a, S sc, T* out, std::size_t n) {
+		if constexpr (ElementTraits<T>::simd)
+			genericKernels<T>().mulScalar(a, sc, out, n);
+		else if constexpr (ElementTraits<T>::widened)
+			widened(a, static_cast<const T*>(nullptr), out, n,
+				[sc](float* x, const float*, std::size_t len) { genericKernels<float>().mulScalar(x, sc, x, len); });
+		else
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = a[i] * sc;
+	}
+
+	template <typename T, typename S>
+	void divScalarElements(const T* a, S sc, T* out, std::size_t n) {
+		// -1 is special-cased like in floorMod(): the minimum value / -1
+		// overflows, so the quotient is negated modulo 2^bits instead
+		if constexpr (std::is_integral_v<S>)
+			if (sc == -1) {
+				using U = std::make_unsigned_t<S>;
+				for (std::size_t i = 0; i < n; ++i)
+					out[i] = static_cast<S>(U(0) - static_cast<U>(a[i]));
+				return;
+			}
+		// Integer division has no vector instruction; floats divide exactly
+		// rather than multiplying by a rounded reciprocal
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = static_cast<S>(a[i]) / sc;
+	}
+
+	/**
+	 * @brief c = a * b for n x n row-major matrices of a type with an axpy
+	 *
+	 * Blocked so a DEPTH_BLOCK x COLUMN_BLOCK panel of b stays in cache while
+	 * every row of a streams past it; row blocks run in parallel (see
+	 * detail::forRows()).
+	 */
+	template <typename T>
+	void multiplyRows(int n, const T* a, const T* b, T* c) {
+		std::fill(c, c + static_cast<std::size_t>(n) * n, T());
+		const auto rows = [&](int first, int last) {
+			for (int jj = 0; jj < n; jj += COLUMN_BLOCK) {
+				const std::size_t width = static_cast<std::size_t>(std::min(COLUMN_BLOCK, n - jj));
+				for (int kk = 0; kk < n; kk += DEPTH_BLOCK) {
+					const int kEnd = std::min(kk + DEPTH_BLOCK, n);
+					for (int i = first; i < last; ++i) {
+						const T* ai = a + static_cast<std::size_t>(i) * n;
+						T* ci = c + static_cast<std::size_t>(i) * n + jj;
+						for (int k = kk; k < kEnd; ++k) {
+							const T* bk = b + static_cast<std::size_t>(k) * n + jj;
+							if constexpr (ElementTraits<T>::simd) {
+								genericKernels<T>().axpy(ci, bk, ai[k], width);
+							} else {
+								const T s = ai[k];
+								for (std::size_t j = 0; j < width; ++j)
+									ci[j] += s * bk[j];
+							}
+						}
+					}
+				}
+			}
+		};
+		detail::forRows(n, rows);
+	}
+
+	template <typename T>
+	void multiply(int n, const T* a, const T* b, T* c) {
+		if constexpr (ElementTraits<T>::widened) {
+			const std::size_t total = static_cast<std::size_t>(n) * n;
+			std::vector<float> wa(a, a + total);
+			std::vector<float> wb(b, b + total);
+			std::vector<float> wc(total);
+			multiplyRows(n, wa.data(), wb.data(), wc.data());
+			std::copy(wc.begin(), wc.end(), c);
+		} else {
+			multiplyRows(n, a, b, c);
+		}
+	}
+
+	template <typename T>
+	void transposeBlocked(int n, const T* in, T* out) {
+		for (int ii = 0; ii < n; ii += TRANSPOSE_BLOCK)
+			for (int jj = 0; jj < n; jj += TRANSPOSE_BLOCK)
+				for (int i = ii; i < std::min(ii + TRANSPOSE_BLOCK, n); ++i)
+					for (int j = jj; j < std::min(jj + TRANSPOSE_BLOCK, n); ++j)
+						out[static_cast<std::size_t>(j) * n + i] = in[static_cast<std::size_t>(i) * n + j];
+	}
+
+	template <typename T>
+	void transposeBlockedInPlace(int n, T* a) {
+		for (int ii = 0; ii < n; ii += TRANSPOSE_BLOCK)
+			for (int jj = ii; jj < n; jj += TRANSPOSE_BLOCK)
+				for (int i = ii; i < std::min(ii + TRANSPOSE_BLOCK, n); ++i)
+					for (int j = std::max(jj, i + 1); j < std::min(jj + TRANSPOSE_BLOCK, n); ++j)
+						std::swap(a[static_cast<std::size_t>(i) * n + j], a[static_cast<std::size_t>(j) * n + i]);
+	}
+
+	/**
+	 * @brief Remainder with the sign of the divisor (floored division)
+	 */
+	template <typename S>
+	S floorMod(S a, S b) {
+		if constexpr (std::is_integral_v<S>) {
+			// -1 is special-cased: the minimum value % -1 overflows
+			if (b == -1)
+				return 0;
+			S r = a % b;
+			if (r != 0 && ((r < 0) != (b < 0)))
+				r += b;
+			return r;
+		} else {
+			return a - b * std::floor(a / b);
+		}
+	}
+
+	/**
+	 * @brief Remainder with the sign of the dividend (truncated division)
+	 */
+	template <typename S>
+	S truncMod(S a, S b) {
+		if constexpr (std::is_integral_v<S>)
+			return b == -1 ? 0 : a % b;
+		else
+			return std::fmod(a, b);
+	}
+
+	/**
+	 * @brief Exact determinant by Bareiss' fraction-free elimination
+	 *
+	 * Every intermediate entry is a minor of the input, so the divisions are
+	 * exact; products are formed in 128 bits and must fit back in 64.
+	 */
+	template <typename T>
+	std::int64_t bareiss(int n, const T* m) {
+		std::vector<std::int64_t> a(m, m + static_cast<std::size_t>(n) * n);
+		const auto at = [&](int i, int j) -> std::int64_t& { return a[static_cast<std::size_t>(i) * n + j]; };
+		std::int64_t previous = 1;
+		int sign = 1;
+		for (int k = 0; k < n - 1; ++k) {
+			if (at(k, k) == 0) {
+				int pivot = k + 1;
+				while (pivot < n && at(pivot, k) == 0)
+					++pivot;
+				if (pivot == n)
+					return 0;
+				std::swap_ranges(&at(k, 0), &at(k, 0) + n, &at(pivot, 0));
+				sign = -sign;
+			}
+			for (int i = k + 1; i < n; ++i) {
+				for (int j = k + 1; j < n; ++j) {
+					const __int128 value = (static_cast<__int128>(at(i, j)) * at(k, k)
+						- static_cast<__int128>(at(i, k)) * at(k, j)) / previous;
+					if (value > std::numeric_limits<std::int64_t>::max() || value < std::numeric_limits<std::int64_t>::min())
+						throw std::overflow_error("Determinant does not fit in 64 bits");
+					at(i, j) = static_cast<std::int64_t>(value);
+				}
+			}
+			previous = at(k, k);
+		}
+		return sign * at(n - 1, n - 1);
+	}
+
+	/**
+	 * @brief Determinant by partial-pivoting LU in the accumulation type
+	 */
+	template <typename A, typename T>
+	A luDeterminant(int n, const T* m) {
+		std::vector<A> a(static_cast<std::size_t>(n) * n);
+		for (std::size_t i = 0; i < a.size(); ++i)
+			a[i] = static_cast<A>(static_cast<typename ElementTraits<T>::Compute>(m[i]));
+		A det = 1;
+		for (int k = 0; k < n; ++k) {
+			A* rowK = a.data() + static_cast<std::size_t>(k) * n;
+			int pivot = k;
+			double best = std::abs(rowK[k]);
+			for (int i = k + 1; i < n; ++i) {
+				const double candidate = std::abs(a[static_cast<std::size_t>(i) * n + k]);
+				if (candidate > best) {
+					best = candidate;
+					pivot = i;
+				}
+			}
+			if (best == 0.0)
+				return A(0);
+			if (pivot != k) {
+				std::swap_ranges(rowK, rowK + n, a.data() + static_cast<std::size_t>(pivot) * n);
+				det = -det;
+			}
+			det *= rowK[k];
+			for (int i = k + 1; i < n; ++i) {
+				A* rowI = a.data() + static_cast<std::size_t>(i) * n;
+				const A l = rowI[k] / rowK[k];
+				for (int j = k + 1; j < n; ++j)
+					rowI[j] -= l * rowK[j];
+			}
+		}
+		return det;
+	}
+
+	/**
+	 * @brief Parses one element token as written by operator<<
+	 */
+	template <typename S>
+	bool parseToken(const std::string& token, S& value) {
+		std::istringstream is(token);
+		is >> value;
+		return !is.fail() && is.peek() == std::char_traits<char>::eof();
+	}
+}
+
+namespace matrix {
+	template <typename T>
+	T* BasicSquareMat<T>::allocate(int n, std::pmr::memory_resource* resource) {
+		const std::size_t total = static_cast<std::size_t>(n) * n;
+		T* ptr = static_cast<T*>(resource->allocate(total * sizeof(T), alignment));
+		std::uninitialized_fill(ptr, ptr + total, T());
+		return ptr;
+	}
+
+	template <typename T>
+	void BasicSquareMat<T>::release() {
+		if (data)
+			memory->deallocate(data, count() * sizeof(T), alignment);
+		data = nullptr;
+	}
+
+	template <typename T>
+	void BasicSquareMat<T>::requireSameSize(const BasicSquareMat& b, const char* operation) const {
+		if (size != b.size)
+			throw std::invalid_argument(std::string("Matrix sizes must match for ") + operation);
+	}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat() : BasicSquareMat(1) {}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat(int n) : BasicSquareMat(n, currentResource()) {}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat(int n, std::pmr::memory_resource* resource) : memory(resource), data(nullptr), size(n) {
+		if (n <= 0)
+			throw std::invalid_argument("Matrix size is not > 0");
+		data = allocate(n, memory);
+	}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat(const std::vector<std::vector<T>>& mat)
+		: memory(currentResource()), data(nullptr), size(0) {
+		if (mat.empty())
+			throw std::invalid_argument("Input matrix cannot be empty");
+		const int n = static_cast<int>(mat.size());
+		for (const std::vector<T>& row : mat)
+			if (row.size() != static_cast<std::size_t>(n))
+				throw std::invalid_argument("Input matrix must be square");
+		size = n;
+		data = allocate(n, memory);
+		for (int i = 0; i < n; ++i)
+			std::copy(mat[i].begin(), mat[i].end(), data + static_cast<std::size_t>(i) * n);
+	}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat(const SquareMat& other) : BasicSquareMat(other.dim()) {
+		const double* in = other[0].data();
+		for (std::size_t i = 0; i < count(); ++i)
+			data[i] = static_cast<T>(static_cast<Scalar>(in[i]));
+	}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat(const BasicSquareMat& other)
+		: memory(currentResource()), data(allocate(other.size, memory)), size(other.size) {
+		std::copy(other.data, other.data + count(), data);
+	}
+
+	template <typename T>
+	BasicSquareMat<T>::BasicSquareMat(BasicSquareMat&& other) noexcept
+		: memory(other.memory), data(other.data), size(other.size) {
+		other.data = nullptr;
+		other.size = 0;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator=(const BasicSquareMat& other) {
+		if (this == &other)
+			return *this;
+		if (size != other.size) {
+			T* fresh = allocate(other.size, memory);
+			release();
+			data = fresh;
+			size = other.size;
+		}
+		std::copy(other.data, other.data + count(), data);
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator=(BasicSquareMat&& other) {
+		if (this == &other)
+			return *this;
+		// Keeps this matrix's resource, as SquareMat does
+		if (memory != other.memory)
+			return *this = static_cast<const BasicSquareMat&>(other);
+		release();
+		data = other.data;
+		size = other.size;
+		other.data = nullptr;
+		other.size = 0;
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>::~BasicSquareMat() {
+		release();
+	}
+
+	template <typename T>
+	RowView<T> BasicSquareMat<T>::operator[](int index) {
+		if (index < 0 || index >= size)
+			throw std::out_of_range("Row index out of range");
+		return RowView<T>(data + static_cast<std::size_t>(index) * size, size);
+	}
+
+	template <typename T>
+	RowView<const T> BasicSquareMat<T>::operator[](int index) const {
+		if (index < 0 || index >= size)
+			throw std::out_of_range("Row index out of range");
+		return RowView<const T>(data + static_cast<std::size_t>(index) * size, size);
+	}
+
+	template <typename T>
+	typename BasicSquareMat<T>::Accumulate BasicSquareMat<T>::sum() const {
+		Accumulate total = 0;
+		for (std::size_t i = 0; i < count(); ++i)
+			total += static_cast<Accumulate>(static_cast<Scalar>(data[i]));
+		return total;
+	}
+
+	template <typename T>
+	typename BasicSquareMat<T>::Accumulate BasicSquareMat<T>::trace() const {
+		Accumulate total = 0;
+		for (int i = 0; i < size; ++i)
+			total += static_cast<Accumulate>(static_cast<Scalar>(data[static_cast<std::size_t>(i) * (size + 1)]));
+		return total;
+	}
+
+	template <typename T>
+	double BasicSquareMat<T>::frobeniusNorm() const {
+		double total = 0.0;
+		for (std::size_t i = 0; i < count(); ++i) {
+			if constexpr (std::is_same_v<T, std::complex<double>>) {
+				total += std::norm(data[i]);
+			} else {
+				const double x = static_cast<double>(static_cast<Scalar>(data[i]));
+				total += x * x;
+			}
+		}
+		return std::sqrt(total);
+	}
+
+	template <typename T>
+	typename BasicSquareMat<T>::Scalar BasicSquareMat<T>::extreme(bool largest) const {
+		if constexpr (ordered) {
+			Scalar best = largest ? std::numeric_limits<Scalar>::lowest() : std::numeric_limits<Scalar>::max();
+			if constexpr (std::numeric_limits<Scalar>::has_infinity)
+				best = largest ? -std::numeric_limits<Scalar>::infinity() : std::numeric_limits<Scalar>::infinity();
+			for (std::size_t i = 0; i < count(); ++i) {
+				const Scalar x = data[i];
+				// Comparisons with NaN are false, so NaNs never replace best
+				if (largest ? x > best : x < best)
+					best = x;
+			}
+			return best;
+		} else {
+			(void)largest;
+			throw std::logic_error("Element type has no ordering");
+		}
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator+(const BasicSquareMat& b) const& {
+		requireSameSize(b, "addition");
+		BasicSquareMat result(size);
+		addElements(data, b.data, result.data, count());
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator+(const BasicSquareMat& b) && {
+		*this += b;
+		return std::move(*this);
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator-(const BasicSquareMat& b) const& {
+		requireSameSize(b, "subtraction");
+		BasicSquareMat result(size);
+		subElements(data, b.data, result.data, count());
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator-(const BasicSquareMat& b) && {
+		*this -= b;
+		return std::move(*this);
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator-() const& {
+		BasicSquareMat result(size);
+		negElements(data, result.data, count());
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator-() && {
+		negElements(data, data, count());
+		return std::move(*this);
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator*(const BasicSquareMat& b) const {
+		requireSameSize(b, "multiplication");
+		BasicSquareMat result(size);
+		multiply(size, data, b.data, result.data);
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator*(Scalar sc) const& {
+		BasicSquareMat result(size);
+		mulScalarElements(data, sc, result.data, count());
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator*(Scalar sc) && {
+		*this *= sc;
+		return std::move(*this);
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator/(Scalar sc) const& {
+		if (sc == Scalar(0))
+			throw std::invalid_argument("Division by zero is undefined");
+		BasicSquareMat result(size);
+		divScalarElements(data, sc, result.data, count());
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator/(Scalar sc) && {
+		*this /= sc;
+		return std::move(*this);
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::floorModulo(const BasicSquareMat& b) const {
+		requireSameSize(b, "modulo");
+		BasicSquareMat result(size);
+		if constexpr (ordered) {
+			for (std::size_t i = 0; i < count(); ++i) {
+				const Scalar divisor = b.data[i];
+				if (divisor == Scalar(0))
+					throw std::domain_error("Modulo by zero element in matrix");
+				result.data[i] = floorMod<Scalar>(data[i], divisor);
+			}
+		}
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::floorModulo(int sc) const {
+		if (sc == 0)
+			throw std::invalid_argument("Modulo by zero is undefined");
+		BasicSquareMat result(size);
+		if constexpr (ordered) {
+			const Scalar divisor = static_cast<Scalar>(sc);
+			for (std::size_t i = 0; i < count(); ++i)
+				result.data[i] = floorMod<Scalar>(data[i], divisor);
+		}
+		return result;
+	}
+
+	template <typename T>
+	void BasicSquareMat<T>::truncModulo(const BasicSquareMat& b) {
+		requireSameSize(b, "modulo");
+		if constexpr (ordered) {
+			for (std::size_t i = 0; i < count(); ++i) {
+				const Scalar divisor = b.data[i];
+				if (divisor == Scalar(0))
+					throw std::invalid_argument("Modulo by zero is undefined");
+				data[i] = truncMod<Scalar>(data[i], divisor);
+			}
+		}
+	}
+
+	template <typename T>
+	void BasicSquareMat<T>::truncModulo(int sc) {
+		if (sc == 0)
+			throw std::invalid_argument("Modulo by zero is undefined");
+		if constexpr (ordered) {
+			const Scalar divisor = static_cast<Scalar>(sc);
+			for (std::size_t i = 0; i < count(); ++i)
+				data[i] = truncMod<Scalar>(data[i], divisor);
+		}
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator^(unsigned int power) const {
+		BasicSquareMat result(size);
+		if (power == 0) {
+			for (int i = 0; i < size; ++i)
+				result.data[static_cast<std::size_t>(i) * (size + 1)] = static_cast<T>(Scalar(1));
+			return result;
+		}
+		// Left-to-right square-and-multiply, ping-ponging between result and work
+		std::copy(data, data + count(), result.data);
+		if (power == 1)
+			return result;
+		BasicSquareMat work(size);
+		int bit = 31;
+		while (!(power >> bit & 1u))
+			--bit;
+		for (--bit; bit >= 0; --bit) {
+			multiply(size, result.data, result.data, work.data);
+			std::swap(result.data, work.data);
+			if (power >> bit & 1u) {
+				multiply(size, result.data, data, work.data);
+				std::swap(result.data, work.data);
+			}
+		}
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator++() {
+		addScalarElements(data, Scalar(1), data, count());
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator++(int) {
+		BasicSquareMat next(size);
+		addScalarElements(data, Scalar(1), next.data, count());
+		std::swap(*this, next);
+		return next;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator--() {
+		addScalarElements(data, Scalar(-1), data, count());
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator--(int) {
+		BasicSquareMat next(size);
+		addScalarElements(data, Scalar(-1), next.data, count());
+		std::swap(*this, next);
+		return next;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator~() const& {
+		BasicSquareMat result(size);
+		transposeBlocked(size, data, result.data);
+		return result;
+	}
+
+	template <typename T>
+	BasicSquareMat<T> BasicSquareMat<T>::operator~() && {
+		transposeInPlace();
+		return std::move(*this);
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::transposeInPlace() {
+		transposeBlockedInPlace(size, data);
+		return *this;
+	}
+
+	template <typename T>
+	typename BasicSquareMat<T>::Accumulate BasicSquareMat<T>::operator!() const {
+		if constexpr (ElementTraits<T>::integral)
+			return bareiss(size, data);
+		else
+			return luDeterminant<Accumulate>(size, data);
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator+=(const BasicSquareMat& b) {
+		requireSameSize(b, "addition");
+		addElements(data, b.data, data, count());
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator-=(const BasicSquareMat& b) {
+		requireSameSize(b, "subtraction");
+		subElements(data, b.data, data, count());
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator*=(const BasicSquareMat& b) {
+		requireSameSize(b, "multiplication");
+		BasicSquareMat result(size);
+		multiply(size, data, b.data, result.data);
+		*this = std::move(result);
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator*=(Scalar sc) {
+		mulScalarElements(data, sc, data, count());
+		return *this;
+	}
+
+	template <typename T>
+	BasicSquareMat<T>& BasicSquareMat<T>::operator/=(Scalar sc) {
+		if (sc == Scalar(0))
+			throw std::invalid_argument("Division by zero is undefined");
+		divScalarElements(data, sc, data, count());
+		return *this;
+	}
+
+	template <typename T>
+	void BasicSquareMat<T>::write(std::ostream& os) const {
+		for (int i = 0; i < size; ++i) {
+			for (int j = 0; j < size; ++j) {
+				os << static_cast<Scalar>(data[static_cast<std::size_t>(i) * size + j]);
+				if (j + 1 < size)
+					os << " ";
+			}
+			os << "\n";
+		}
+	}
+
+	template <typename T>
+	void BasicSquareMat<T>::read(std::istream& is, BasicSquareMat& mat) {
+		std::string line, token;
+		std::vector<std::string> tokens;
+		while (tokens.empty()) {
+			if (!std::getline(is, line)) {
+				is.setstate(std::ios_base::failbit);
+				return;
+			}
+			std::istringstream words(line);
+			while (words >> token)
+				tokens.push_back(token);
+		}
+		const std::size_t n = tokens.size();
+		while (tokens.size() < n * n && std::getline(is, line)) {
+			std::istringstream words(line);
+			while (words >> token)
+				tokens.push_back(token);
+		}
+		if (tokens.size() != n * n) {
+			is.setstate(std::ios_base::failbit);
+			return;
+		}
+		BasicSquareMat result(static_cast<int>(n));
+		for (std::size_t i = 0; i < tokens.size(); ++i) {
+			Scalar value;
+			if (!parseToken(tokens[i], value)) {
+				is.setstate(std::ios_base::failbit);
+				return;
+			}
+			result.data[i] = static_cast<T>(value);
+		}
+		mat = std::move(result);
+	}
+
+	template class BasicSquareMat<float>;
+	template class BasicSquareMat<std::int32_t>;
+	template class BasicSquareMat<std::int64_t>;
+	template class BasicSquareMat<std::complex<double>>;
+	template class BasicSquareMat<Half>;
+	template class BasicSquareMat<BFloat16>;
+}
@@ -0,0 +1,272 @@
+// ey.gellis@gmail.com
+#ifndef BASICMAT_H
+#define BASICMAT_H
+
+#include "squaremat.hpp"
+#include "elements.hpp"
+#include <complex>
+#include <cstdint>
+#include <iostream>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief Square matrix with elements of type T
+	 *
+	 * The same operators as SquareMat (BasicSquareMat<double>), with semantics
+	 * following the element type: integer matrices divide and take remainders
+	 * exactly and have an exact (Bareiss) determinant; Half and BFloat16 store
+	 * 16 bits per element and compute in float; complex matrices have no
+	 * ordering, so <, >, <=, >=, %, min() and max() are not available for them.
+	 * Storage comes from a polymorphic memory resource exactly like SquareMat.
+	 * Instantiated in libmat for float, std::int32_t, std::int64_t,
+	 * std::complex<double>, Half and BFloat16.
+	 */
+	template <typename T>
+	class BasicSquareMat {
+	public:
+		/**
+		 * @brief Type scalars are given in and arithmetic runs in
+		 */
+		using Scalar = typename detail::ElementTraits<T>::Compute;
+
+		/**
+		 * @brief Type of sum(), trace() and the determinant
+		 */
+		using Accumulate = typename detail::ElementTraits<T>::Accumulate;
+
+	private:
+		static constexpr bool ordered = detail::ElementTraits<T>::ordered;
+
+		std::pmr::memory_resource* memory;
+		T* data;
+		int size;
+
+		static T* allocate(int n, std::pmr::memory_resource* resource);
+		void release();
+		std::size_t count() const { return static_cast<std::size_t>(size) * size; }
+		void requireSameSize(const BasicSquareMat& b, const char* operation) const;
+
+		// Bodies of the operators that only exist for ordered element types
+		BasicSquareMat floorModulo(const BasicSquareMat& b) const;
+		BasicSquareMat floorModulo(int sc) const;
+		void truncModulo(const BasicSquareMat& b);
+		void truncModulo(int sc);
+		Scalar extreme(bool largest) const;
+
+		void write(std::ostream& os) const;
+		static void read(std::istream& is, BasicSquareMat& mat);
+
+	public:
+		BasicSquareMat();
+
+		BasicSquareMat(int n);
+
+		/**
+		 * @brief Creates a zero matrix whose storage comes from the given resource
+		 * @param n Matrix dimension
+		 * @param resource Resource to allocate from; must outlive the matrix
+		 */
+		BasicSquareMat(int n, std::pmr::memory_resource* resource);
+
+		BasicSquareMat(const std::vector<std::vector<T>>& mat);
+
+		/**
+		 * @brief Converts a double matrix element by element
+		 *
+		 * Integers truncate toward zero and 16-bit types round to nearest-even.
+		 * @param other Matrix to convert
+		 */
+		explicit BasicSquareMat(const SquareMat& other);
+
+		BasicSquareMat(const BasicSquareMat& other);
+
+		BasicSquareMat(BasicSquareMat&& other) noexcept;
+
+		BasicSquareMat& operator=(const BasicSquareMat& other);
+
+		BasicSquareMat& operator=(BasicSquareMat&& other);
+
+		~BasicSquareMat();
+
+		/**
+		 * @brief Alignment in bytes of the element buffer
+		 */
+		static constexpr std::size_t alignment = 64;
+
+		int dim() const { return size; }
+
+		std::pmr::memory_resource* resource() const { return memory; }
+
+		RowView<T> operator[](int index);
+
+		RowView<const T> operator[](int index) const;
+
+		/**
+		 * @brief Sum of all elements, accumulated in Accumulate
+		 * @return The sum of all matrix elements
+		 */
+		Accumulate sum() const;
+
+		/**
+		 * @brief Sum of the diagonal elements
+		 * @return Trace, accumulated in Accumulate
+		 */
+		Accumulate trace() const;
+
+		/**
+		 * @brief Square root of the sum of squared magnitudes, accumulated in double
+		 * @return Frobenius norm
+		 */
+		double frobeniusNorm() const;
+
+		/**
+		 * @brief Smallest element, ignoring NaNs
+		 * @return Minimum element
+		 */
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		Scalar min() const { return extreme(false); }
+
+		/**
+		 * @brief Largest element, ignoring NaNs
+		 * @return Maximum element
+		 */
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		Scalar max() const { return extreme(true); }
+
+		BasicSquareMat operator+(const BasicSquareMat& b) const&;
+		BasicSquareMat operator+(const BasicSquareMat& b) &&;
+		BasicSquareMat operator-(const BasicSquareMat& b) const&;
+		BasicSquareMat operator-(const BasicSquareMat& b) &&;
+		BasicSquareMat operator-() const&;
+		BasicSquareMat operator-() &&;
+
+		/**
+		 * @brief Multiplies two matrices; 16-bit types multiply in float
+		 * @param b Matrix to multiply with
+		 * @return Result of multiplication
+		 */
+		BasicSquareMat operator*(const BasicSquareMat& b) const;
+
+		BasicSquareMat operator*(Scalar sc) const&;
+		BasicSquareMat operator*(Scalar sc) &&;
+
+		friend BasicSquareMat operator*(Scalar sc, const BasicSquareMat& mat) { return mat * sc; }
+		friend BasicSquareMat operator*(Scalar sc, BasicSquareMat&& mat) { return std::move(mat) * sc; }
+
+		/**
+		 * @brief Divides by a scalar; integer matrices truncate toward zero, and
+		 * dividing by -1 wraps around, leaving the minimum value unchanged
+		 * @param sc Scalar value
+		 * @return Result of division
+		 */
+		BasicSquareMat operator/(Scalar sc) const&;
+		BasicSquareMat operator/(Scalar sc) &&;
+
+		/**
+		 * @brief Element-wise modulo whose result takes the sign of the divisor,
+		 * exact for integer matrices
+		 * @param b Matrix for modulo operation
+		 * @return Result of modulo operation
+		 */
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		BasicSquareMat operator%(const BasicSquareMat& b) const { return floorModulo(b); }
+
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		BasicSquareMat operator%(int sc) const { return floorModulo(sc); }
+
+		/**
+		 * @brief Raises the matrix to a power by repeated squaring
+		 * @param power Exponent value
+		 * @return Result of exponentiation
+		 */
+		BasicSquareMat operator^(unsigned int power) const;
+
+		BasicSquareMat& operator++();
+		BasicSquareMat operator++(int);
+		BasicSquareMat& operator--();
+		BasicSquareMat operator--(int);
+
+		BasicSquareMat operator~() const&;
+		BasicSquareMat operator~() &&;
+		BasicSquareMat& transposeInPlace();
+
+		/**
+		 * @brief Comparisons by sum(), like SquareMat
+		 */
+		bool operator==(const BasicSquareMat& b) const { return sum() == b.sum(); }
+		bool operator!=(const BasicSquareMat& b) const { return sum() != b.sum(); }
+
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		bool operator<(const BasicSquareMat& b) const { return sum() < b.sum(); }
+
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		bool operator>(const BasicSquareMat& b) const { return sum() > b.sum(); }
+
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		bool operator<=(const BasicSquareMat& b) const { return sum() <= b.sum(); }
+
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		bool operator>=(const BasicSquareMat& b) const { return sum() >= b.sum(); }
+
+		/**
+		 * @brief Calculates the determinant
+		 *
+		 * Integer matrices use fraction-free Bareiss elimination, which is exact
+		 * and throws std::overflow_error if a minor leaves std::int64_t; other
+		 * types factor with partial pivoting in Accumulate precision.
+		 * @return Determinant value
+		 */
+		Accumulate operator!() const;
+
+		BasicSquareMat& operator+=(const BasicSquareMat& b);
+		BasicSquareMat& operator-=(const BasicSquareMat& b);
+		BasicSquareMat& operator*=(const BasicSquareMat& b);
+		BasicSquareMat& operator*=(Scalar sc);
+		BasicSquareMat& operator/=(Scalar sc);
+
+		/**
+		 * @brief Element-wise modulo assignment with the sign of the dividend
+		 * (C++ % for integer matrices, std::fmod otherwise)
+		 * @param b Matrix for modulo operation
+		 * @return Reference to this matrix
+		 */
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		BasicSquareMat& operator%=(const BasicSquareMat& b) {
+			truncModulo(b);
+			return *this;
+		}
+
+		template <typename U = T, typename = std::enable_if_t<detail::ElementTraits<U>::ordered>>
+		BasicSquareMat& operator%=(int sc) {
+			truncModulo(sc);
+			return *this;
+		}
+
+		/**
+		 * @brief Writes rows of whitespace-separated elements, like SquareMat
+		 */
+		friend std::ostream& operator<<(std::ostream& os, const BasicSquareMat& mat) {
+			mat.write(os);
+			return os;
+		}
+
+		/**
+		 * @brief Reads the format operator<< writes; sets failbit on malformed input
+		 */
+		friend std::istream& operator>>(std::istream& is, BasicSquareMat& mat) {
+			read(is, mat);
+			return is;
+		}
+	};
+
+	extern template class BasicSquareMat<float>;
+	extern template class BasicSquareMat<std::int32_t>;
+	extern template class BasicSquareMat<std::int64_t>;
+	extern template class BasicSquareMat<std::complex<double>>;
+	extern template class BasicSquareMat<Half>;
+	extern template class BasicSquareMat<BFloat16>;
+}
+#endif
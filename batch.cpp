@@ -0,0 +1,222 @@
+// ey.gellis@gmail.com
+#include "batch.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace matrix;
+
+namespace {
+	typedef double vec2 __attribute__((vector_size(16)));
+	// The product kernel below keeps four two-double accumulators per (i, j)
+	constexpr std::size_t LANES = SquareMatBatch::LANES;
+	static_assert(LANES == 8, "kernels assume eight interleaved matrices");
+	// Groups handed to one pool task
+	constexpr std::size_t GROUPS_PER_TASK = 512;
+	// Batches with fewer elements than this stay on the calling thread
+	constexpr std::size_t PARALLEL_ELEMENTS = 1 << 16;
+
+	inline vec2 load(const double* p) {
+		vec2 v;
+		__builtin_memcpy(&v, p, sizeof(v));
+		return v;
+	}
+}
+
+template <typename Body>
+void SquareMatBatch::forGroups(Body body) const {
+	const std::size_t groups = groupCount();
+	if (groups * LANES * n * n < PARALLEL_ELEMENTS) {
+		for (std::size_t g = 0; g < groups; ++g)
+			body(g);
+		return;
+	}
+	const int tasks = static_cast<int>((groups + GROUPS_PER_TASK - 1) / GROUPS_PER_TASK);
+	detail::parallelFor(tasks, [&](int task) {
+		std::size_t begin = static_cast<std::size_t>(task) * GROUPS_PER_TASK;
+		std::size_t end = std::min(groups, begin + GROUPS_PER_TASK);
+		for (std::size_t g = begin; g < end; ++g)
+			body(g);
+	});
+}
+
+SquareMatBatch::SquareMatBatch(int dim, std::size_t count) : n(dim), batch(count) {
+	if (dim <= 0)
+		throw std::invalid_argument("Matrix size is not > 0");
+	elems.assign(groupCount() * groupStride(), 0.0);
+}
+
+void SquareMatBatch::set(std::size_t b, const SquareMat& mat) {
+	if (mat.dim() != n)
+		throw std::invalid_argument("Matrix size must match the batch");
+	if (b >= batch)
+		throw std::out_of_range("Batch index out of range");
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j)
+			(*this)(b, i, j) = mat[i][j];
+}
+
+SquareMat SquareMatBatch::get(std::size_t b) const {
+	if (b >= batch)
+		throw std::out_of_range("Batch index out of range");
+	SquareMat mat(n);
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j)
+			mat[i][j] = (*this)(b, i, j);
+	return mat;
+}
+
+SquareMatBatch SquareMatBatch::operator+(const SquareMatBatch& other) const {
+	if (n != other.n || batch != other.batch)
+		throw std::invalid_argument("Batch shapes must match for addition");
+
+	SquareMatBatch result(n, batch);
+	const std::size_t stride = groupStride();
+	forGroups([&](std::size_t g) {
+		const double* a = group(g);
+		const double* b = other.group(g);
+		double* c = result.group(g);
+		for (std::size_t i = 0; i < stride; ++i)
+			c[i] = a[i] + b[i];
+	});
+	return result;
+}
+
+SquareMatBatch SquareMatBatch::operator*(const SquareMatBatch& other) const {
+	if (n != other.n || batch != other.batch)
+		throw std::invalid_argument("Batch shapes must match for multiplication");
+
+	SquareMatBatch result(n, batch);
+	forGroups([&](std::size_t g) {
+		const double* a = group(g);
+		const double* b = other.group(g);
+		double* c = result.group(g);
+		// Every (i, j) accumulates all LANES matrices at once in registers
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < n; ++j) {
+				vec2 acc0 = {}, acc1 = {}, acc2 = {}, acc3 = {};
+				const double* ak = a + static_cast<std::size_t>(i) * n * LANES;
+				const double* bk = b + static_cast<std::size_t>(j) * LANES;
+				for (int k = 0; k < n; ++k) {
+					acc0 += load(ak) * load(bk);
+					acc1 += load(ak + 2) * load(bk + 2);
+					acc2 += load(ak + 4) * load(bk + 4);
+					acc3 += load(ak + 6) * load(bk + 6);
+					ak += LANES;
+					bk += static_cast<std::size_t>(n) * LANES;
+				}
+				double* out = c + (static_cast<std::size_t>(i) * n + j) * LANES;
+				__builtin_memcpy(out, &acc0, sizeof(vec2));
+				__builtin_memcpy(out + 2, &acc1, sizeof(vec2));
+				__builtin_memcpy(out + 4, &acc2, sizeof(vec2));
+				__builtin_memcpy(out + 6, &acc3, sizeof(vec2));
+			}
+	});
+	return result;
+}
+
+SquareMatBatch SquareMatBatch::operator~() const {
+	SquareMatBatch result(n, batch);
+	forGroups([&](std::size_t g) {
+		const double* src = group(g);
+		double* dst = result.group(g);
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < n; ++j)
+				std::copy(src + (static_cast<std::size_t>(i) * n + j) * LANES,
+					src + (static_cast<std::size_t>(i) * n + j + 1) * LANES,
+					dst + (static_cast<std::size_t>(j) * n + i) * LANES);
+	});
+	return result;
+}
+
+SquareMatBatch SquareMatBatch::operator^(unsigned int power) const {
+	SquareMatBatch result(n, batch);
+	if (power == 0) {
+		for (std::size_t g = 0; g < groupCount(); ++g)
+			for (int i = 0; i < n; ++i)
+				std::fill_n(result.group(g) + (static_cast<std::size_t>(i) * n + i) * LANES, LANES, 1.0);
+		return result;
+	}
+
+	SquareMatBatch base = *this;
+	bool haveResult = false;
+	while (true) {
+		if (power & 1) {
+			result = haveResult ? result * base : base;
+			haveResult = true;
+		}
+		power >>= 1;
+		if (power == 0)
+			break;
+		base = base * base;
+	}
+	return result;
+}
+
+std::vector<double> SquareMatBatch::determinants() const {
+	std::vector<double> dets(groupCount() * LANES);
+	forGroups([&](std::size_t g) {
+		const double* src = group(g);
+		auto m = [&](int i, int j) { return src + (static_cast<std::size_t>(i) * n + j) * LANES; };
+		double* det = dets.data() + g * LANES;
+		if (n == 1) {
+			std::copy(m(0, 0), m(0, 0) + LANES, det);
+			return;
+		}
+		if (n == 2) {
+			for (std::size_t l = 0; l < LANES; ++l)
+				det[l] = m(0, 0)[l] * m(1, 1)[l] - m(0, 1)[l] * m(1, 0)[l];
+			return;
+		}
+		if (n == 3) {
+			for (std::size_t l = 0; l < LANES; ++l)
+				det[l] = m(0, 0)[l] * (m(1, 1)[l] * m(2, 2)[l] - m(1, 2)[l] * m(2, 1)[l])
+					- m(0, 1)[l] * (m(1, 0)[l] * m(2, 2)[l] - m(1, 2)[l] * m(2, 0)[l])
+					+ m(0, 2)[l] * (m(1, 0)[l] * m(2, 1)[l] - m(1, 1)[l] * m(2, 0)[l]);
+			return;
+		}
+
+		// Partial-pivoting elimination on a group-local copy
+		thread_local std::vector<double> work;
+		work.assign(src, src + groupStride());
+		auto at = [&](int i, int j) { return work.data() + (static_cast<std::size_t>(i) * n + j) * LANES; };
+		double scale[LANES];
+		std::fill_n(det, LANES, 1.0);
+
+		for (int k = 0; k < n; ++k) {
+			// Pivot choice and row swaps differ per lane but cost only O(n) each
+			for (std::size_t l = 0; l < LANES; ++l) {
+				int pivot = k;
+				for (int i = k + 1; i < n; ++i)
+					if (std::fabs(at(i, k)[l]) > std::fabs(at(pivot, k)[l]))
+						pivot = i;
+				if (pivot != k) {
+					for (int j = 0; j < n; ++j)
+						std::swap(at(k, j)[l], at(pivot, j)[l]);
+					det[l] = -det[l];
+				}
+				const double p = at(k, k)[l];
+				det[l] *= p;
+				// A zero pivot already zeroed det; a zero scale keeps the lane finite
+				scale[l] = p == 0.0 ? 0.0 : 1.0 / p;
+			}
+			// The O(n^2) trailing update is identical across lanes and vectorizes
+			for (int i = k + 1; i < n; ++i) {
+				double* lik = at(i, k);
+				for (std::size_t l = 0; l < LANES; ++l)
+					lik[l] *= scale[l];
+				for (int j = k + 1; j < n; ++j) {
+					double* dst = at(i, j);
+					const double* src = at(k, j);
+					for (std::size_t l = 0; l < LANES / 2; ++l) {
+						vec2 v = load(dst + 2 * l) - load(lik + 2 * l) * load(src + 2 * l);
+						__builtin_memcpy(dst + 2 * l, &v, sizeof(v));
+					}
+				}
+			}
+		}
+	});
+	dets.resize(batch);
+	return dets;
+}
@@ -0,0 +1,116 @@
+// ey.gellis@gmail.com
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "squaremat.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief A batch of same-sized small square matrices in interleaved layout
+	 *
+	 * Matrices are stored in groups of LANES. Within a group, element (i, j) of
+	 * all LANES matrices is contiguous, so matrix b's element lives at
+	 * [((b / LANES) * n * n + i * n + j) * LANES + b % LANES]. Kernels loop over
+	 * the matrices of a group innermost and vectorize across the batch rather than
+	 * within one small matrix, while each group stays within a few cache lines.
+	 * Large batches are split into runs of groups on the library thread pool.
+	 */
+	class SquareMatBatch {
+	public:
+		/**
+		 * @brief Matrices interleaved per group
+		 */
+		static constexpr std::size_t LANES = 8;
+
+	private:
+		int n;
+		std::size_t batch;
+		std::vector<double> elems;
+
+		std::size_t groupCount() const { return (batch + LANES - 1) / LANES; }
+		std::size_t groupStride() const { return static_cast<std::size_t>(n) * n * LANES; }
+		double* group(std::size_t g) { return elems.data() + g * groupStride(); }
+		const double* group(std::size_t g) const { return elems.data() + g * groupStride(); }
+		std::size_t index(std::size_t b, int i, int j) const {
+			return (b / LANES) * groupStride() + (static_cast<std::size_t>(i) * n + j) * LANES + b % LANES;
+		}
+
+		/**
+		 * @brief Runs body(g) for every group, in parallel for large batches
+		 */
+		template <typename Body>
+		void forGroups(Body body) const;
+
+	public:
+		/**
+		 * @brief Creates a batch of zero matrices
+		 * @param n Dimension of every matrix
+		 * @param count Number of matrices
+		 */
+		SquareMatBatch(int n, std::size_t count);
+
+		int dim() const { return n; }
+		std::size_t size() const { return batch; }
+
+		/**
+		 * @brief Element access
+		 * @param b Matrix index within the batch
+		 * @param i Row index
+		 * @param j Column index
+		 * @return Reference to the element
+		 */
+		double& operator()(std::size_t b, int i, int j) { return elems[index(b, i, j)]; }
+		double operator()(std::size_t b, int i, int j) const { return elems[index(b, i, j)]; }
+
+		/**
+		 * @brief Copies a matrix into the batch
+		 * @param b Matrix index within the batch
+		 * @param mat Matrix of dimension dim()
+		 */
+		void set(std::size_t b, const SquareMat& mat);
+
+		/**
+		 * @brief Copies one matrix out of the batch
+		 * @param b Matrix index within the batch
+		 * @return The matrix
+		 */
+		SquareMat get(std::size_t b) const;
+
+		/**
+		 * @brief Element-wise addition of corresponding matrices
+		 * @param other Batch of the same shape
+		 * @return Batch of sums
+		 */
+		SquareMatBatch operator+(const SquareMatBatch& other) const;
+
+		/**
+		 * @brief Multiplies corresponding matrices
+		 * @param other Batch of the same shape
+		 * @return Batch of products
+		 */
+		SquareMatBatch operator*(const SquareMatBatch& other) const;
+
+		/**
+		 * @brief Transposes every matrix
+		 * @return Batch of transposes
+		 */
+		SquareMatBatch operator~() const;
+
+		/**
+		 * @brief Raises every matrix to the same power
+		 * @param power Exponent value
+		 * @return Batch of powers
+		 */
+		SquareMatBatch operator^(unsigned int power) const;
+
+		/**
+		 * @brief Determinant of every matrix, by partial-pivoting elimination run
+		 * across lanes (closed forms up to 3 x 3)
+		 * @return One determinant per matrix
+		 */
+		std::vector<double> determinants() const;
+	};
+}
+#endif
@@ -0,0 +1,439 @@
+// ey.gellis@gmail.com
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory_resource>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Header-only micro-benchmark harness in the spirit of Google Benchmark.
+ *
+ * Each case is timed over a growing number of iterations until it runs for
+ * at least the minimum time, and reports ns/op, GFLOP/s, GB/s and the number
+ * of matrix allocations per op. Results can be written as JSON and compared
+ * against a stored baseline, flagging cases that got slower.
+ */
+namespace bench {
+    /**
+     * @brief Keeps the compiler from discarding a computed value
+     */
+    template <typename T>
+    inline void doNotOptimize(const T& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    /**
+     * @brief Memory resource that counts allocations before forwarding them
+     *
+     * Installed as the default resource while a Suite is alive, so every matrix
+     * buffer allocated through currentResource() is counted.
+     */
+    class CountingResource : public std::pmr::memory_resource {
+    private:
+        std::pmr::memory_resource* upstream;
+        std::atomic<long> allocations{0};
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            return upstream->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+            upstream->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+    public:
+        explicit CountingResource(std::pmr::memory_resource* up) : upstream(up) {}
+
+        long count() const { return allocations.load(std::memory_order_relaxed); }
+    };
+
+    /**
+     * @brief Measurement of one benchmark case
+     */
+    struct Result {
+        std::string name;
+        int n = 0;
+        long iterations = 0;
+        double nsPerOp = 0.0;
+        double gflops = 0.0;
+        double gbytes = 0.0;
+        double allocsPerOp = 0.0;
+    };
+
+    /**
+     * @brief Command-line options of a benchmark binary
+     */
+    struct Options {
+        double minTime = 0.1;        // Seconds each case runs for at least
+        int minSize = 2;             // Smallest matrix dimension
+        int maxSize = 4096;          // Largest matrix dimension
+        std::string filter;          // Only cases whose name contains this
+        std::string json;            // File to write results to
+        std::string baseline;        // JSON results to compare against
+        double threshold = 0.10;     // Relative slowdown reported as a regression
+
+        /**
+         * @brief Parses --min-time, --min-size, --max-size, --filter, --json,
+         * --baseline and --threshold, each followed by its value
+         */
+        static Options parse(int argc, char** argv) {
+            Options options;
+            for (int i = 1; i < argc; ++i) {
+                const std::string flag = argv[i];
+                if (i + 1 >= argc)
+                    throw std::invalid_argument("Missing value for " + flag);
+                const std::string value = argv[++i];
+                if (flag == "--min-time")
+                    options.minTime = std::stod(value);
+                else if (flag == "--min-size")
+                    options.minSize = std::stoi(value);
+                else if (flag == "--max-size")
+                    options.maxSize = std::stoi(value);
+                else if (flag == "--filter")
+                    options.filter = value;
+                else if (flag == "--json")
+                    options.json = value;
+                else if (flag == "--baseline")
+                    options.baseline = value;
+                else if (flag == "--threshold")
+                    options.threshold = std::stod(value);
+                else
+                    throw std::invalid_argument("Unknown option " + flag);
+            }
+            return options;
+        }
+    };
+
+    namespace json {
+        inline void skipSpace(const char*& p, const char* end) {
+            while (p != end && std::strchr(" \t\r\n", *p))
+                ++p;
+        }
+
+        inline void expect(const char*& p, const char* end, char c) {
+            skipSpace(p, end);
+            if (p == end || *p != c)
+                throw std::runtime_error(std::string("Malformed benchmark JSON: expected '") + c + "'");
+            ++p;
+        }
+
+        inline std::string parseString(const char*& p, const char* end) {
+            expect(p, end, '"');
+            std::string out;
+            while (p != end && *p != '"') {
+                if (*p == '\\' && p + 1 != end)
+                    ++p;
+                out.push_back(*p++);
+            }
+            expect(p, end, '"');
+            return out;
+        }
+
+        /**
+         * @brief Skips any JSON value, or parses a string or number into text
+         */
+        inline std::string parseValue(const char*& p, const char* end) {
+            skipSpace(p, end);
+            if (p == end)
+                throw std::runtime_error("Malformed benchmark JSON: unexpected end");
+            if (*p == '"')
+                return parseString(p, end);
+            if (*p == '{' || *p == '[') {
+                const char close = *p == '{' ? '}' : ']';
+                ++p;
+                skipSpace(p, end);
+                while (p != end && *p != close) {
+                    if (close == '}') {
+                        parseString(p, end);
+                        expect(p, end, ':');
+                    }
+                    parseValue(p, end);
+                    skipSpace(p, end);
+                    if (p != end && *p == ',')
+                        ++p;
+                    skipSpace(p, end);
+                }
+                expect(p, end, close);
+                return std::string();
+            }
+            const char* start = p;
+            while (p != end && !std::strchr(",}] \t\r\n", *p))
+                ++p;
+            return std::string(start, p);
+        }
+
+        inline std::string escape(const std::string& s) {
+            std::string out;
+            for (char c : s) {
+                if (c == '"' || c == '\\')
+                    out.push_back('\\');
+                out.push_back(c);
+            }
+            return out;
+        }
+    }
+
+    /**
+     * @brief Writes results as {"context": {...}, "benchmarks": [...]}
+     */
+    inline void writeJson(std::ostream& os, const std::vector<Result>& results,
+        const std::vector<std::pair<std::string, std::string>>& context) {
+        os << "{\n  \"context\": {";
+        for (std::size_t i = 0; i < context.size(); ++i)
+            os << (i ? ", " : "") << '"' << json::escape(context[i].first) << "\": \""
+               << json::escape(context[i].second) << '"';
+        os << "},\n  \"benchmarks\": [\n";
+        os << std::setprecision(6);
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            os << "    {\"name\": \"" << json::escape(r.name) << "\", \"n\": " << r.n
+               << ", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.nsPerOp
+               << ", \"gflops\": " << r.gflops << ", \"gbytes_per_s\": " << r.gbytes
+               << ", \"allocs_per_op\": " << r.allocsPerOp << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n}\n";
+    }
+
+    /**
+     * @brief Reads the "benchmarks" array of a file written by writeJson()
+     */
+    inline std::vector<Result> readJson(std::istream& is) {
+        std::stringstream buffer;
+        buffer << is.rdbuf();
+        const std::string text = buffer.str();
+        const char* p = text.data();
+        const char* end = p + text.size();
+
+        std::vector<Result> results;
+        json::expect(p, end, '{');
+        json::skipSpace(p, end);
+        while (p != end && *p != '}') {
+            const std::string key = json::parseString(p, end);
+            json::expect(p, end, ':');
+            if (key != "benchmarks") {
+                json::parseValue(p, end);
+            } else {
+                json::expect(p, end, '[');
+                json::skipSpace(p, end);
+                while (p != end && *p != ']') {
+                    Result r;
+                    json::expect(p, end, '{');
+                    json::skipSpace(p, end);
+                    while (p != end && *p != '}') {
+                        const std::string field = json::parseString(p, end);
+                        json::expect(p, end, ':');
+                        const std::string value = json::parseValue(p, end);
+                        if (field == "name")
+                            r.name = value;
+                        else if (field == "n")
+                            r.n = std::stoi(value);
+                        else if (field == "iterations")
+                            r.iterations = std::stol(value);
+                        else if (field == "ns_per_op")
+                            r.nsPerOp = std::stod(value);
+                        else if (field == "gflops")
+                            r.gflops = std::stod(value);
+                        else if (field == "gbytes_per_s")
+                            r.gbytes = std::stod(value);
+                        else if (field == "allocs_per_op")
+                            r.allocsPerOp = std::stod(value);
+                        json::skipSpace(p, end);
+                        if (p != end && *p == ',')
+                            ++p;
+                        json::skipSpace(p, end);
+                    }
+                    json::expect(p, end, '}');
+                    results.push_back(r);
+                    json::skipSpace(p, end);
+                    if (p != end && *p == ',')
+                        ++p;
+                    json::skipSpace(p, end);
+                }
+                json::expect(p, end, ']');
+            }
+            json::skipSpace(p, end);
+            if (p != end && *p == ',')
+                ++p;
+            json::skipSpace(p, end);
+        }
+        return results;
+    }
+
+    /**
+     * @brief Compares results with a baseline and prints every case whose time
+     * moved by more than threshold, or whose allocation count changed
+     * @return Number of regressions: slower cases and cases allocating more
+     */
+    inline int compare(const std::vector<Result>& current, const std::vector<Result>& baseline,
+        double threshold, std::ostream& os) {
+        std::map<std::pair<std::string, int>, const Result*> old;
+        for (const Result& r : baseline)
+            old[{r.name, r.n}] = &r;
+
+        int regressions = 0;
+        os << std::fixed << std::setprecision(2);
+        for (const Result& r : current) {
+            auto it = old.find({r.name, r.n});
+            if (it == old.end())
+                continue;
+            const Result& b = *it->second;
+            const double ratio = r.nsPerOp / b.nsPerOp;
+            const bool slower = ratio > 1.0 + threshold;
+            const bool faster = ratio < 1.0 - threshold;
+            const bool allocs = r.allocsPerOp > b.allocsPerOp + 1e-9;
+            if (!slower && !faster && !allocs)
+                continue;
+            regressions += slower || allocs;
+            os << (slower || allocs ? "REGRESSION " : "improved   ") << std::setw(24) << std::left << r.name
+               << std::right << std::setw(6) << r.n << std::setw(14) << b.nsPerOp << " -> "
+               << std::setw(14) << r.nsPerOp << " ns/op (" << ratio << "x)";
+            if (r.allocsPerOp != b.allocsPerOp)
+                os << ", allocs/op " << b.allocsPerOp << " -> " << r.allocsPerOp;
+            os << "\n";
+        }
+        return regressions;
+    }
+
+    /**
+     * @brief Runs and records benchmark cases
+     */
+    class Suite {
+    private:
+        Options options;
+        CountingResource counter;
+        std::pmr::memory_resource* previous;
+        std::vector<Result> results;
+
+    public:
+        explicit Suite(const Options& opts)
+            : options(opts), counter(std::pmr::new_delete_resource()),
+              previous(std::pmr::set_default_resource(&counter)) {
+            std::cout << std::setw(24) << std::left << "benchmark" << std::right << std::setw(6) << "n"
+                      << std::setw(14) << "ns/op" << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s"
+                      << std::setw(10) << "allocs" << std::setw(12) << "iterations" << "\n";
+        }
+
+        ~Suite() {
+            std::pmr::set_default_resource(previous);
+        }
+
+        Suite(const Suite&) = delete;
+        Suite& operator=(const Suite&) = delete;
+
+        /**
+         * @brief Dimensions from the options' range: powers of two from minSize to maxSize
+         */
+        std::vector<int> sizes() const {
+            std::vector<int> out;
+            for (int n = 2; n <= options.maxSize; n *= 2)
+                if (n >= options.minSize)
+                    out.push_back(n);
+            return out;
+        }
+
+        /**
+         * @brief Checks whether a case passes the name filter
+         */
+        bool selected(const std::string& name) const {
+            return options.filter.empty() || name.find(options.filter) != std::string::npos;
+        }
+
+        /**
+         * @brief Times fn and records the result
+         *
+         * Iterations grow (at most tenfold per batch) until one batch runs for
+         * minTime; that batch is reported.
+         * @param name Case name
+         * @param n Matrix dimension
+         * @param flops Floating-point operations per call
+         * @param bytes Bytes read and written per call, at the minimum
+         * @param fn Operation to time
+         */
+        template <typename F>
+        void run(const std::string& name, int n, double flops, double bytes, F&& fn) {
+            if (!selected(name))
+                return;
+            using clock = std::chrono::steady_clock;
+            // The first batch doubles as warm-up; it is only reported when a single
+            // call already takes minTime, which spares the largest cases a second run
+            long iterations = 1;
+            while (true) {
+                const long allocsBefore = counter.count();
+                const auto start = clock::now();
+                for (long i = 0; i < iterations; ++i)
+                    fn();
+                const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+                const long allocs = counter.count() - allocsBefore;
+                if (elapsed >= options.minTime || iterations >= 1000000000L) {
+                    Result r;
+                    r.name = name;
+                    r.n = n;
+                    r.iterations = iterations;
+                    r.nsPerOp = elapsed * 1e9 / iterations;
+                    r.gflops = flops / r.nsPerOp;
+                    r.gbytes = bytes / r.nsPerOp;
+                    r.allocsPerOp = static_cast<double>(allocs) / iterations;
+                    report(r);
+                    results.push_back(r);
+                    return;
+                }
+                const double target = options.minTime * 1.4 / std::max(elapsed, 1e-9) * iterations;
+                iterations = std::max(iterations + 1, std::min(static_cast<long>(target), iterations * 10));
+            }
+        }
+
+        const std::vector<Result>& measurements() const { return results; }
+
+        /**
+         * @brief Writes the JSON file and compares against the baseline, if requested
+         * @param context Key/value pairs describing the run (threads, ISA, ...)
+         * @return Process exit code: 1 if the baseline comparison found regressions
+         */
+        int finish(const std::vector<std::pair<std::string, std::string>>& context) const {
+            if (!options.json.empty()) {
+                std::ofstream out(options.json);
+                writeJson(out, results, context);
+                if (!out)
+                    throw std::runtime_error("Failed to write " + options.json);
+            }
+            if (options.baseline.empty())
+                return 0;
+            std::ifstream in(options.baseline);
+            if (!in)
+                throw std::runtime_error("Cannot open baseline " + options.baseline);
+            std::cout << "\nCompared with " << options.baseline << " (threshold "
+                      << options.threshold * 100 << "%):\n";
+            const int regressions = compare(results, readJson(in), options.threshold, std::cout);
+            std::cout << regressions << " regression(s)\n";
+            return regressions ? 1 : 0;
+        }
+
+    private:
+        static void report(const Result& r) {
+            std::cout << std::fixed << std::setw(24) << std::left << r.name << std::right << std::setw(6) << r.n
+                      << std::setprecision(1) << std::setw(14) << r.nsPerOp << std::setprecision(2)
+                      << std::setw(10) << r.gflops << std::setw(10) << r.gbytes
+                      << std::setw(10) << r.allocsPerOp << std::setw(12) << r.iterations << std::endl;
+        }
+    };
+}
+#endif
@@ -0,0 +1,167 @@
+// ey.gellis@gmail.com
+#include "binaryio.hpp"
+#include "squaremat.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATRIX_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace matrix;
+
+namespace matrix {
+	namespace detail {
+		FileHeader makeHeader(int n, std::uint32_t layout) {
+			FileHeader header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+			header.version = FILE_VERSION;
+			header.headerBytes = sizeof(FileHeader);
+			header.dtype = DTYPE_FLOAT64;
+			header.layout = layout;
+			header.size = static_cast<std::uint64_t>(n);
+			header.byteOrder = BYTE_ORDER_MARK;
+			return header;
+		}
+
+		int checkHeader(const FileHeader& header, std::uint32_t layout) {
+			if (std::memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0)
+				throw std::invalid_argument("Not a SquareMat binary file");
+			if (header.byteOrder != BYTE_ORDER_MARK)
+				throw std::invalid_argument("Matrix file was written with a different byte order");
+			if (header.version != FILE_VERSION || header.headerBytes != sizeof(FileHeader))
+				throw std::invalid_argument("Unsupported matrix file version");
+			if (header.dtype != DTYPE_FLOAT64 || header.layout != layout)
+				throw std::invalid_argument("Unsupported matrix element type or layout");
+			if ((layout == LAYOUT_TILED) != (header.tileSize != 0))
+				throw std::invalid_argument("Matrix file has an invalid tile size");
+			if (header.size == 0 || header.size > static_cast<std::uint64_t>(INT_MAX))
+				throw std::invalid_argument("Matrix file has an invalid size");
+			return static_cast<int>(header.size);
+		}
+
+		std::uint64_t checksum(const double* payload, std::size_t count) {
+			constexpr std::uint64_t prime = 0x100000001b3ULL;
+			std::uint64_t lanes[4] = {
+				0xcbf29ce484222325ULL, 0xcbf29ce484222325ULL ^ 1, 0xcbf29ce484222325ULL ^ 2, 0xcbf29ce484222325ULL ^ 3
+			};
+			std::size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				std::uint64_t words[4];
+				std::memcpy(words, payload + i, sizeof(words));
+				for (int l = 0; l < 4; ++l)
+					lanes[l] = (lanes[l] ^ words[l]) * prime;
+			}
+			for (; i < count; ++i) {
+				std::uint64_t word;
+				std::memcpy(&word, payload + i, sizeof(word));
+				lanes[i % 4] = (lanes[i % 4] ^ word) * prime;
+			}
+			std::uint64_t hash = lanes[0];
+			for (int l = 1; l < 4; ++l)
+				hash = (hash ^ lanes[l]) * prime;
+			return (hash ^ count) * prime;
+		}
+
+		void unmapFile(void* base, std::size_t bytes) {
+#ifdef MATRIX_POSIX
+			munmap(base, bytes);
+#else
+			(void)base;
+			(void)bytes;
+#endif
+		}
+	}
+}
+
+void SquareMat::writeBinary(std::ostream& os) const {
+	detail::FileHeader header = detail::makeHeader(size);
+	header.checksum = detail::checksum(data, count());
+	os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	os.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count() * sizeof(double)));
+	if (!os)
+		throw std::runtime_error("Failed to write matrix");
+}
+
+void SquareMat::save(const std::string& path) const {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+	writeBinary(file);
+	file.close();
+	if (!file)
+		throw std::runtime_error("Failed to write matrix to " + path);
+}
+
+SquareMat SquareMat::readBinary(std::istream& is) {
+	detail::FileHeader header;
+	if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		throw std::invalid_argument("Matrix file is truncated");
+	SquareMat result(detail::checkHeader(header));
+	if (!is.read(reinterpret_cast<char*>(result.data), static_cast<std::streamsize>(result.count() * sizeof(double))))
+		throw std::invalid_argument("Matrix file is truncated");
+	if (detail::checksum(result.data, result.count()) != header.checksum)
+		throw std::runtime_error("Matrix file checksum mismatch");
+	return result;
+}
+
+SquareMat SquareMat::mapFile(const std::string& path, MapMode mode, bool verify) {
+#ifdef MATRIX_POSIX
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+
+	detail::FileHeader header;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+		::close(fd);
+		throw std::invalid_argument("Matrix file is truncated");
+	}
+	int n;
+	try {
+		n = detail::checkHeader(header);
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+	const std::size_t bytes = sizeof(header) + static_cast<std::size_t>(n) * n * sizeof(double);
+	if (static_cast<std::size_t>(info.st_size) < bytes) {
+		::close(fd);
+		throw std::invalid_argument("Matrix file is truncated");
+	}
+
+	const int protection = mode == MapMode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+	const int flags = mode == MapMode::ReadOnly ? MAP_SHARED : MAP_PRIVATE;
+	void* base = mmap(nullptr, bytes, protection, flags, fd, 0);
+	const int error = errno;
+	::close(fd);
+	if (base == MAP_FAILED)
+		throw std::system_error(error, std::generic_category(), "Cannot map " + path);
+
+	// Swap the placeholder buffer for the mapping; from here the destructor unmaps
+	SquareMat result(1);
+	result.release();
+	result.mapping = base;
+	result.mappedBytes = bytes;
+	result.data = reinterpret_cast<double*>(static_cast<char*>(base) + sizeof(header));
+	result.size = n;
+	result.readOnly = mode == MapMode::ReadOnly;
+	if (verify && detail::checksum(result.data, result.count()) != header.checksum)
+		throw std::runtime_error("Matrix file checksum mismatch");
+	return result;
+#else
+	(void)path;
+	(void)mode;
+	(void)verify;
+	throw std::runtime_error("Memory-mapped matrix files are not supported on this platform");
+#endif
+}
@@ -0,0 +1,78 @@
+// ey.gellis@gmail.com
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace matrix {
+	namespace detail {
+		/**
+		 * @brief On-disk header of a binary matrix file
+		 *
+		 * The file is this 64-byte header followed by size * size row-major doubles
+		 * in the producer's byte order, which byteOrder records so readers can reject
+		 * foreign files. Mappings start on a page boundary, so the payload of a
+		 * mapped file keeps SquareMat::alignment.
+		 */
+		struct FileHeader {
+			char magic[8];             // "SQMATBIN"
+			std::uint32_t version;     // FILE_VERSION
+			std::uint32_t headerBytes; // sizeof(FileHeader); the payload starts here
+			std::uint32_t dtype;       // DTYPE_FLOAT64
+			std::uint32_t layout;      // LAYOUT_ROW_MAJOR
+			std::uint64_t size;        // Matrix dimension
+			std::uint64_t checksum;    // checksum() of the payload
+			std::uint32_t byteOrder;   // BYTE_ORDER_MARK as written by the producer
+			std::uint32_t tileSize;    // Tile dimension for LAYOUT_TILED, 0 otherwise
+			std::uint8_t reserved[16];
+		};
+		static_assert(sizeof(FileHeader) == 64, "FileHeader must stay 64 bytes");
+
+		constexpr char FILE_MAGIC[8] = {'S', 'Q', 'M', 'A', 'T', 'B', 'I', 'N'};
+		constexpr std::uint32_t FILE_VERSION = 1;
+		constexpr std::uint32_t DTYPE_FLOAT64 = 1;
+		constexpr std::uint32_t LAYOUT_ROW_MAJOR = 0;
+		constexpr std::uint32_t LAYOUT_TILED = 1;
+		constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+		/**
+		 * @brief Builds the header of an n x n matrix; the caller fills in checksum
+		 * (and tileSize for LAYOUT_TILED)
+		 * @param n Matrix dimension
+		 * @param layout Payload layout
+		 * @return Filled header
+		 */
+		FileHeader makeHeader(int n, std::uint32_t layout = LAYOUT_ROW_MAJOR);
+
+		/**
+		 * @brief Validates everything in a header except the checksum
+		 *
+		 * Throws std::invalid_argument for foreign files, unsupported versions,
+		 * element types or byte orders, and for layouts other than the expected one.
+		 * @param header Header read from a file
+		 * @param layout Layout the caller can read
+		 * @return Matrix dimension
+		 */
+		int checkHeader(const FileHeader& header, std::uint32_t layout = LAYOUT_ROW_MAJOR);
+
+		/**
+		 * @brief 64-bit checksum of a payload
+		 *
+		 * FNV-1a over 8-byte words in four interleaved lanes, so it runs at memory
+		 * speed while still catching truncation, reordering and bit flips.
+		 * @param payload Elements
+		 * @param count Number of elements
+		 * @return Checksum
+		 */
+		std::uint64_t checksum(const double* payload, std::size_t count);
+
+		/**
+		 * @brief Releases a mapping created by SquareMat::mapFile()
+		 * @param base Start of the mapping
+		 * @param bytes Length of the mapping
+		 */
+		void unmapFile(void* base, std::size_t bytes);
+	}
+}
+#endif
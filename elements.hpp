@@ -0,0 +1,178 @@
+// ey.gellis@gmail.com
+#ifndef ELEMENTS_H
+#define ELEMENTS_H
+
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace matrix {
+	/**
+	 * @brief IEEE 754 binary16 storage type
+	 *
+	 * Holds the 16-bit encoding only; arithmetic converts to float, and results
+	 * are rounded back to nearest-even when stored.
+	 */
+	class Half {
+	private:
+		std::uint16_t value = 0;
+
+		static std::uint16_t encode(float f) {
+			std::uint32_t x;
+			std::memcpy(&x, &f, sizeof(x));
+			const std::uint16_t sign = static_cast<std::uint16_t>((x >> 16) & 0x8000);
+			x &= 0x7fffffff;
+			// At or above 65536 (including infinities and NaNs)
+			if (x >= 0x47800000)
+				return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+			// Below 2^-14 the result is subnormal; adding 0.5f lines the half's
+			// last mantissa bit up with the float's, so the FPU rounds for us
+			if (x < 0x38800000) {
+				float magnitude;
+				std::memcpy(&magnitude, &x, sizeof(x));
+				magnitude += 0.5f;
+				std::uint32_t bits;
+				std::memcpy(&bits, &magnitude, sizeof(bits));
+				return sign | static_cast<std::uint16_t>(bits - 0x3f000000);
+			}
+			// Rebias the exponent and round to nearest-even on the 13 dropped bits
+			const std::uint32_t odd = (x >> 13) & 1;
+			x += 0xc8000fff + odd;
+			return sign | static_cast<std::uint16_t>(x >> 13);
+		}
+
+		static float decode(std::uint16_t h) {
+			const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+			const std::uint32_t exponent = (h >> 10) & 0x1f;
+			const std::uint32_t mantissa = h & 0x3ff;
+			std::uint32_t bits;
+			if (exponent == 0) {
+				// Zero or subnormal: mantissa * 2^-24 is exact in float
+				const float magnitude = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+				return sign ? -magnitude : magnitude;
+			}
+			if (exponent == 31)
+				bits = sign | 0x7f800000 | (mantissa << 13);
+			else
+				bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+			float f;
+			std::memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+
+	public:
+		Half() = default;
+		Half(float f) : value(encode(f)) {}
+
+		operator float() const { return decode(value); }
+
+		/**
+		 * @brief Raw binary16 encoding
+		 */
+		std::uint16_t bits() const { return value; }
+
+		/**
+		 * @brief Builds a value from its binary16 encoding
+		 * @param bits Encoding
+		 * @return Value with that encoding
+		 */
+		static Half fromBits(std::uint16_t bits) {
+			Half h;
+			h.value = bits;
+			return h;
+		}
+	};
+
+	/**
+	 * @brief bfloat16 storage type: the upper half of a float
+	 *
+	 * Same range as float with an 8-bit significand; arithmetic converts to
+	 * float and results are rounded back to nearest-even when stored.
+	 */
+	class BFloat16 {
+	private:
+		std::uint16_t value = 0;
+
+		static std::uint16_t encode(float f) {
+			std::uint32_t x;
+			std::memcpy(&x, &f, sizeof(x));
+			// Keep NaNs quiet; rounding could otherwise carry them into infinity
+			if ((x & 0x7fffffff) > 0x7f800000)
+				return static_cast<std::uint16_t>((x >> 16) | 0x40);
+			x += 0x7fff + ((x >> 16) & 1);
+			return static_cast<std::uint16_t>(x >> 16);
+		}
+
+	public:
+		BFloat16() = default;
+		BFloat16(float f) : value(encode(f)) {}
+
+		operator float() const {
+			const std::uint32_t bits = static_cast<std::uint32_t>(value) << 16;
+			float f;
+			std::memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+
+		/**
+		 * @brief Raw bfloat16 encoding
+		 */
+		std::uint16_t bits() const { return value; }
+
+		/**
+		 * @brief Builds a value from its bfloat16 encoding
+		 * @param bits Encoding
+		 * @return Value with that encoding
+		 */
+		static BFloat16 fromBits(std::uint16_t bits) {
+			BFloat16 b;
+			b.value = bits;
+			return b;
+		}
+	};
+
+	namespace detail {
+		/**
+		 * @brief How BasicSquareMat computes with an element type
+		 *
+		 * Compute is the type arithmetic runs in and scalars are given in;
+		 * Accumulate holds sums, traces and determinants. simd types have
+		 * vector kernels; widened types are stored narrow and computed in float.
+		 */
+		template <typename T>
+		struct ElementTraits {
+			static_assert(std::is_arithmetic_v<T>, "Unsupported matrix element type");
+			using Compute = T;
+			using Accumulate = std::conditional_t<std::is_integral_v<T>, std::int64_t, double>;
+			static constexpr bool integral = std::is_integral_v<T>;
+			static constexpr bool ordered = true;
+			static constexpr bool simd = true;
+			static constexpr bool widened = false;
+		};
+
+		template <>
+		struct ElementTraits<std::complex<double>> {
+			using Compute = std::complex<double>;
+			using Accumulate = std::complex<double>;
+			static constexpr bool integral = false;
+			static constexpr bool ordered = false;
+			static constexpr bool simd = false;
+			static constexpr bool widened = false;
+		};
+
+		template <>
+		struct ElementTraits<Half> {
+			using Compute = float;
+			using Accumulate = double;
+			static constexpr bool integral = false;
+			static constexpr bool ordered = true;
+			static constexpr bool simd = false;
+			static constexpr bool widened = true;
+		};
+
+		template <>
+		struct ElementTraits<BFloat16> : ElementTraits<Half> {};
+	}
+}
+#endif
@@ -0,0 +1,214 @@
+// ey.gellis@gmail.com
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "squaremat.hpp"
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+namespace matrix {
+	/**
+	 * @brief CRTP base of every lazy matrix expression
+	 *
+	 * An expression only records the operation; no element is computed until it is
+	 * assigned to a SquareMat, at which point the whole element-wise tree runs as a
+	 * single loop writing straight into the destination.
+	 */
+	template <typename E>
+	class MatExpr {
+	public:
+		const E& self() const { return static_cast<const E&>(*this); }
+		int dim() const { return self().dim(); }
+		double at(std::size_t i) const { return self().at(i); }
+	};
+
+	/**
+	 * @brief Leaf referring to an existing matrix
+	 */
+	class MatRef : public MatExpr<MatRef> {
+	private:
+		const SquareMat* mat;
+		const double* elems;
+
+	public:
+		explicit MatRef(const SquareMat& m) : mat(&m), elems(m[0].data()) {}
+		int dim() const { return mat->dim(); }
+		double at(std::size_t i) const { return elems[i]; }
+		const SquareMat& matrix() const { return *mat; }
+	};
+
+	/**
+	 * @brief Matrix product inside an expression, materialized exactly once
+	 *
+	 * The result is shared so copying the node into an enclosing expression does
+	 * not copy the matrix.
+	 */
+	class ProductExpr : public MatExpr<ProductExpr> {
+	private:
+		std::shared_ptr<const SquareMat> result;
+		const double* elems;
+
+	public:
+		explicit ProductExpr(SquareMat&& product)
+			: result(std::make_shared<const SquareMat>(std::move(product))), elems((*result)[0].data()) {}
+		int dim() const { return result->dim(); }
+		double at(std::size_t i) const { return elems[i]; }
+		const SquareMat& matrix() const { return *result; }
+	};
+
+	template <typename L, typename R, typename Op>
+	class BinaryExpr : public MatExpr<BinaryExpr<L, R, Op>> {
+	private:
+		L lhs;
+		R rhs;
+
+	public:
+		BinaryExpr(const L& l, const R& r, const char* what) : lhs(l), rhs(r) {
+			if (l.dim() != r.dim())
+				throw std::invalid_argument(what);
+		}
+		int dim() const { return lhs.dim(); }
+		double at(std::size_t i) const { return Op::apply(lhs.at(i), rhs.at(i)); }
+	};
+
+	template <typename E, typename Op>
+	class ScalarExpr : public MatExpr<ScalarExpr<E, Op>> {
+	private:
+		E inner;
+		double sc;
+
+	public:
+		ScalarExpr(const E& e, double s) : inner(e), sc(s) {}
+		int dim() const { return inner.dim(); }
+		double at(std::size_t i) const { return Op::apply(inner.at(i), sc); }
+	};
+
+	template <typename E>
+	class NegateExpr : public MatExpr<NegateExpr<E>> {
+	private:
+		E inner;
+
+	public:
+		explicit NegateExpr(const E& e) : inner(e) {}
+		int dim() const { return inner.dim(); }
+		double at(std::size_t i) const { return -inner.at(i); }
+	};
+
+	namespace detail {
+		struct AddOp { static double apply(double a, double b) { return a + b; } };
+		struct SubOp { static double apply(double a, double b) { return a - b; } };
+		struct MulOp { static double apply(double a, double b) { return a * b; } };
+		struct DivOp { static double apply(double a, double b) { return a / b; } };
+		struct AssignOp { static double apply(double, double b) { return b; } };
+
+		// Leaves and products already hold a matrix; only element-wise trees are evaluated
+		inline const SquareMat& materialize(const MatExpr<MatRef>& e) { return e.self().matrix(); }
+		inline const SquareMat& materialize(const MatExpr<ProductExpr>& e) { return e.self().matrix(); }
+
+		template <typename E>
+		SquareMat materialize(const MatExpr<E>& expr) { return SquareMat(expr); }
+	}
+
+	/**
+	 * @brief Starts a lazy expression from an existing matrix
+	 *
+	 * Example: SquareMat r = lazy(a) + lazy(b) * 2.0 - lazy(c); runs one loop and
+	 * allocates only r. The referenced matrices must outlive the expression.
+	 * @param mat Matrix to reference
+	 * @return Leaf expression
+	 */
+	inline MatRef lazy(const SquareMat& mat) { return MatRef(mat); }
+	MatRef lazy(SquareMat&&) = delete;
+
+	template <typename L, typename R>
+	BinaryExpr<L, R, detail::AddOp> operator+(const MatExpr<L>& l, const MatExpr<R>& r) {
+		return BinaryExpr<L, R, detail::AddOp>(l.self(), r.self(), "Matrix sizes must match for addition");
+	}
+
+	template <typename L, typename R>
+	BinaryExpr<L, R, detail::SubOp> operator-(const MatExpr<L>& l, const MatExpr<R>& r) {
+		return BinaryExpr<L, R, detail::SubOp>(l.self(), r.self(), "Matrix sizes must match for subtraction");
+	}
+
+	template <typename E>
+	NegateExpr<E> operator-(const MatExpr<E>& e) {
+		return NegateExpr<E>(e.self());
+	}
+
+	template <typename E>
+	ScalarExpr<E, detail::MulOp> operator*(const MatExpr<E>& e, double sc) {
+		return ScalarExpr<E, detail::MulOp>(e.self(), sc);
+	}
+
+	template <typename E>
+	ScalarExpr<E, detail::MulOp> operator*(double sc, const MatExpr<E>& e) {
+		return ScalarExpr<E, detail::MulOp>(e.self(), sc);
+	}
+
+	template <typename E>
+	ScalarExpr<E, detail::DivOp> operator/(const MatExpr<E>& e, double sc) {
+		if (sc == 0.0)
+			throw std::invalid_argument("Division by zero is undefined");
+		return ScalarExpr<E, detail::DivOp>(e.self(), sc);
+	}
+
+	/**
+	 * @brief Matrix product of two expressions, evaluated immediately with the
+	 * blocked GEMM; element-wise sub-expressions are materialized first
+	 */
+	template <typename L, typename R>
+	ProductExpr operator*(const MatExpr<L>& l, const MatExpr<R>& r) {
+		return ProductExpr(detail::materialize(l) * detail::materialize(r));
+	}
+
+	template <typename E>
+	SquareMat::BasicSquareMat(const MatExpr<E>& expr)
+		: memory(currentResource()), data(allocate(expr.dim(), memory)), size(expr.dim()) {
+		const E& e = expr.self();
+		const std::size_t total = count();
+		for (std::size_t i = 0; i < total; ++i)
+			data[i] = e.at(i);
+	}
+
+	template <typename Op, typename E>
+	SquareMat& SquareMat::assignElements(const E& e) {
+		const std::size_t total = count();
+		// The expression's leaves hold pointers into our elements, which
+		// detach() would unmap under them
+		double* out = readOnly ? allocate(size, memory) : data;
+		for (std::size_t i = 0; i < total; ++i)
+			out[i] = Op::apply(data[i], e.at(i));
+		if (out != data) {
+			release();
+			data = out;
+		}
+		sumValid.store(false, std::memory_order_relaxed);
+		return *this;
+	}
+
+	template <typename E>
+	SquareMat& SquareMat::operator=(const MatExpr<E>& expr) {
+		const E& e = expr.self();
+		if (e.dim() != size)
+			return *this = SquareMat(expr);
+		return assignElements<detail::AssignOp>(e);
+	}
+
+	template <typename E>
+	SquareMat& SquareMat::operator+=(const MatExpr<E>& expr) {
+		const E& e = expr.self();
+		if (e.dim() != size)
+			throw std::invalid_argument("Matrix sizes must match for addition");
+		return assignElements<detail::AddOp>(e);
+	}
+
+	template <typename E>
+	SquareMat& SquareMat::operator-=(const MatExpr<E>& expr) {
+		const E& e = expr.self();
+		if (e.dim() != size)
+			throw std::invalid_argument("Matrix sizes must match for subtraction");
+		return assignElements<detail::SubOp>(e);
+	}
+}
+#endif
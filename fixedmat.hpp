@@ -0,0 +1,477 @@
+// ey.gellis@gmail.com
+#ifndef FIXEDMAT_H
+#define FIXEDMAT_H
+
+#include "squaremat.hpp"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+namespace matrix {
+	/**
+	 * @brief Square matrix whose dimension is a compile-time constant
+	 *
+	 * Elements live inline in a std::array, so small transforms need no heap
+	 * allocation, and every loop has a constant trip count the compiler unrolls.
+	 * Offers the same operator set as SquareMat and converts to and from it.
+	 * @tparam N Matrix dimension
+	 */
+	template <std::size_t N>
+	class FixedSquareMat {
+		static_assert(N > 0, "Matrix size is not > 0");
+
+	private:
+		std::array<double, N * N> elems;
+
+		template <std::size_t... K>
+		static constexpr double dot(const FixedSquareMat& a, const FixedSquareMat& b, std::size_t i, std::size_t j,
+			std::index_sequence<K...>) {
+			return ((a(i, K) * b(K, j)) + ...);
+		}
+
+		/**
+		 * @brief Determinant by Gaussian elimination with partial pivoting, for N > 4
+		 */
+		constexpr double determinantElimination() const {
+			FixedSquareMat m = *this;
+			double det = 1.0;
+			for (std::size_t k = 0; k < N; ++k) {
+				std::size_t pivot = k;
+				for (std::size_t i = k + 1; i < N; ++i)
+					if ((m(i, k) < 0 ? -m(i, k) : m(i, k)) > (m(pivot, k) < 0 ? -m(pivot, k) : m(pivot, k)))
+						pivot = i;
+				if (m(pivot, k) == 0.0)
+					return 0.0;
+				if (pivot != k) {
+					for (std::size_t j = 0; j < N; ++j) {
+						double tmp = m(k, j);
+						m(k, j) = m(pivot, j);
+						m(pivot, j) = tmp;
+					}
+					det = -det;
+				}
+				det *= m(k, k);
+				for (std::size_t i = k + 1; i < N; ++i) {
+					double l = m(i, k) / m(k, k);
+					for (std::size_t j = k; j < N; ++j)
+						m(i, j) -= l * m(k, j);
+				}
+			}
+			return det;
+		}
+
+		/**
+		 * @brief Inverse by Gauss-Jordan elimination with partial pivoting, for N > 4
+		 */
+		constexpr FixedSquareMat inverseElimination() const {
+			FixedSquareMat m = *this;
+			FixedSquareMat inv = identity();
+			for (std::size_t k = 0; k < N; ++k) {
+				std::size_t pivot = k;
+				for (std::size_t i = k + 1; i < N; ++i)
+					if ((m(i, k) < 0 ? -m(i, k) : m(i, k)) > (m(pivot, k) < 0 ? -m(pivot, k) : m(pivot, k)))
+						pivot = i;
+				if (m(pivot, k) == 0.0)
+					throw std::domain_error("Matrix is singular");
+				for (std::size_t j = 0; j < N; ++j) {
+					double tmp = m(k, j);
+					m(k, j) = m(pivot, j);
+					m(pivot, j) = tmp;
+					tmp = inv(k, j);
+					inv(k, j) = inv(pivot, j);
+					inv(pivot, j) = tmp;
+				}
+				const double scale = 1.0 / m(k, k);
+				for (std::size_t j = 0; j < N; ++j) {
+					m(k, j) *= scale;
+					inv(k, j) *= scale;
+				}
+				for (std::size_t i = 0; i < N; ++i) {
+					if (i == k)
+						continue;
+					const double f = m(i, k);
+					for (std::size_t j = 0; j < N; ++j) {
+						m(i, j) -= f * m(k, j);
+						inv(i, j) -= f * inv(k, j);
+					}
+				}
+			}
+			return inv;
+		}
+
+	public:
+		constexpr FixedSquareMat() : elems{} {}
+
+		/**
+		 * @brief Builds a matrix from its elements in row-major order
+		 * @param values N * N elements
+		 */
+		constexpr explicit FixedSquareMat(const std::array<double, N * N>& values) : elems(values) {}
+
+		/**
+		 * @brief Copies a dynamic matrix of matching size
+		 * @param mat Matrix to copy; its dimension must be N
+		 */
+		explicit FixedSquareMat(const SquareMat& mat) : elems{} {
+			if (mat.dim() != static_cast<int>(N))
+				throw std::invalid_argument("Matrix sizes must match for conversion");
+			for (std::size_t i = 0; i < N; ++i)
+				for (std::size_t j = 0; j < N; ++j)
+					elems[i * N + j] = mat[i][j];
+		}
+
+		/**
+		 * @brief Converts to a heap-allocated dynamic matrix
+		 * @return Equivalent SquareMat
+		 */
+		SquareMat toSquareMat() const {
+			SquareMat result(static_cast<int>(N));
+			for (std::size_t i = 0; i < N; ++i)
+				for (std::size_t j = 0; j < N; ++j)
+					result[i][j] = elems[i * N + j];
+			return result;
+		}
+
+		explicit operator SquareMat() const { return toSquareMat(); }
+
+		/**
+		 * @brief Identity matrix
+		 * @return N x N identity
+		 */
+		static constexpr FixedSquareMat identity() {
+			FixedSquareMat id;
+			for (std::size_t i = 0; i < N; ++i)
+				id(i, i) = 1.0;
+			return id;
+		}
+
+		static constexpr int dim() { return static_cast<int>(N); }
+
+		/**
+		 * @brief Unchecked element access
+		 * @param i Row index
+		 * @param j Column index
+		 * @return Reference to the element
+		 */
+		constexpr double& operator()(std::size_t i, std::size_t j) { return elems[i * N + j]; }
+		constexpr const double& operator()(std::size_t i, std::size_t j) const { return elems[i * N + j]; }
+
+		/**
+		 * @brief Access operator for matrix rows
+		 * @param index Row index
+		 * @return Pointer to the first element of the row
+		 */
+		constexpr double* operator[](int index) {
+			if (index < 0 || index >= static_cast<int>(N))
+				throw std::out_of_range("Row index out of range");
+			return &elems[index * N];
+		}
+
+		constexpr const double* operator[](int index) const {
+			if (index < 0 || index >= static_cast<int>(N))
+				throw std::out_of_range("Row index out of range");
+			return &elems[index * N];
+		}
+
+		/**
+		 * @brief Calculates the sum of all elements in the matrix
+		 * @return The sum of all matrix elements
+		 */
+		constexpr double sum() const {
+			double res = 0.0;
+			for (double v : elems)
+				res += v;
+			return res;
+		}
+
+		constexpr FixedSquareMat operator+(const FixedSquareMat& b) const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i)
+				result.elems[i] = elems[i] + b.elems[i];
+			return result;
+		}
+
+		constexpr FixedSquareMat operator-(const FixedSquareMat& b) const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i)
+				result.elems[i] = elems[i] - b.elems[i];
+			return result;
+		}
+
+		constexpr FixedSquareMat operator-() const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i)
+				result.elems[i] = -elems[i];
+			return result;
+		}
+
+		/**
+		 * @brief Matrix product; each element is a fold over k, fully unrolled
+		 * @param b Matrix to multiply with
+		 * @return Result of multiplication
+		 */
+		constexpr FixedSquareMat operator*(const FixedSquareMat& b) const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N; ++i)
+				for (std::size_t j = 0; j < N; ++j)
+					result(i, j) = dot(*this, b, i, j, std::make_index_sequence<N>());
+			return result;
+		}
+
+		constexpr FixedSquareMat operator*(double sc) const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i)
+				result.elems[i] = elems[i] * sc;
+			return result;
+		}
+
+		friend constexpr FixedSquareMat operator*(double sc, const FixedSquareMat& mat) { return mat * sc; }
+
+		constexpr FixedSquareMat operator/(double sc) const {
+			if (sc == 0.0)
+				throw std::invalid_argument("Division by zero is undefined");
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i)
+				result.elems[i] = elems[i] / sc;
+			return result;
+		}
+
+		FixedSquareMat operator%(const FixedSquareMat& b) const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i) {
+				if (b.elems[i] == 0.0)
+					throw std::domain_error("Modulo by zero element in matrix");
+				result.elems[i] = elems[i] - b.elems[i] * std::floor(elems[i] / b.elems[i]);
+			}
+			return result;
+		}
+
+		FixedSquareMat operator%(int sc) const {
+			if (sc == 0)
+				throw std::invalid_argument("Modulo by zero is undefined");
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N * N; ++i)
+				result.elems[i] = elems[i] - sc * std::floor(elems[i] / sc);
+			return result;
+		}
+
+		/**
+		 * @brief Raises matrix to a power by binary exponentiation
+		 * @param power Exponent value
+		 * @return Result of exponentiation
+		 */
+		constexpr FixedSquareMat operator^(unsigned int power) const {
+			FixedSquareMat result = identity();
+			FixedSquareMat base = *this;
+			while (power > 0) {
+				if (power & 1)
+					result = result * base;
+				power >>= 1;
+				if (power > 0)
+					base = base * base;
+			}
+			return result;
+		}
+
+		constexpr FixedSquareMat& operator++() {
+			for (double& v : elems)
+				++v;
+			return *this;
+		}
+
+		constexpr FixedSquareMat operator++(int) {
+			FixedSquareMat temp = *this;
+			++(*this);
+			return temp;
+		}
+
+		constexpr FixedSquareMat& operator--() {
+			for (double& v : elems)
+				--v;
+			return *this;
+		}
+
+		constexpr FixedSquareMat operator--(int) {
+			FixedSquareMat temp = *this;
+			--(*this);
+			return temp;
+		}
+
+		constexpr FixedSquareMat operator~() const {
+			FixedSquareMat result;
+			for (std::size_t i = 0; i < N; ++i)
+				for (std::size_t j = 0; j < N; ++j)
+					result(j, i) = (*this)(i, j);
+			return result;
+		}
+
+		constexpr bool operator==(const FixedSquareMat& b) const { return sum() == b.sum(); }
+		constexpr bool operator!=(const FixedSquareMat& b) const { return sum() != b.sum(); }
+		constexpr bool operator<(const FixedSquareMat& b) const { return sum() < b.sum(); }
+		constexpr bool operator>(const FixedSquareMat& b) const { return sum() > b.sum(); }
+		constexpr bool operator<=(const FixedSquareMat& b) const { return sum() <= b.sum(); }
+		constexpr bool operator>=(const FixedSquareMat& b) const { return sum() >= b.sum(); }
+
+		/**
+		 * @brief Calculates the determinant; closed form for N <= 4
+		 * @return Determinant value
+		 */
+		constexpr double operator!() const {
+			const FixedSquareMat& m = *this;
+			if constexpr (N == 1) {
+				return m(0, 0);
+			} else if constexpr (N == 2) {
+				return m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0);
+			} else if constexpr (N == 3) {
+				return m(0, 0) * (m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1))
+					- m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0))
+					+ m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
+			} else if constexpr (N == 4) {
+				// 2x2 minors of the bottom two rows, shared by the Laplace expansion
+				const double s0 = m(2, 0) * m(3, 1) - m(2, 1) * m(3, 0);
+				const double s1 = m(2, 0) * m(3, 2) - m(2, 2) * m(3, 0);
+				const double s2 = m(2, 0) * m(3, 3) - m(2, 3) * m(3, 0);
+				const double s3 = m(2, 1) * m(3, 2) - m(2, 2) * m(3, 1);
+				const double s4 = m(2, 1) * m(3, 3) - m(2, 3) * m(3, 1);
+				const double s5 = m(2, 2) * m(3, 3) - m(2, 3) * m(3, 2);
+				// Minors of row 1 against each column left out of the expansion
+				const double c0 = m(1, 0) * s3 - m(1, 1) * s1 + m(1, 2) * s0;
+				const double c1 = m(1, 0) * s4 - m(1, 1) * s2 + m(1, 3) * s0;
+				const double c2 = m(1, 0) * s5 - m(1, 2) * s2 + m(1, 3) * s1;
+				const double c3 = m(1, 1) * s5 - m(1, 2) * s4 + m(1, 3) * s3;
+				return m(0, 0) * c3 - m(0, 1) * c2 + m(0, 2) * c1 - m(0, 3) * c0;
+			} else {
+				return determinantElimination();
+			}
+		}
+
+		/**
+		 * @brief Matrix inverse; closed-form adjugate for N <= 4
+		 * @return Inverse matrix
+		 */
+		constexpr FixedSquareMat inverse() const {
+			if constexpr (N <= 4) {
+				const double det = !(*this);
+				if (det == 0.0)
+					throw std::domain_error("Matrix is singular");
+				const FixedSquareMat& m = *this;
+				FixedSquareMat inv;
+				if constexpr (N == 1) {
+					inv(0, 0) = 1.0;
+				} else if constexpr (N == 2) {
+					inv(0, 0) = m(1, 1);
+					inv(0, 1) = -m(0, 1);
+					inv(1, 0) = -m(1, 0);
+					inv(1, 1) = m(0, 0);
+				} else if constexpr (N == 3) {
+					inv(0, 0) = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1);
+					inv(0, 1) = m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2);
+					inv(0, 2) = m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1);
+					inv(1, 0) = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2);
+					inv(1, 1) = m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0);
+					inv(1, 2) = m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2);
+					inv(2, 0) = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+					inv(2, 1) = m(0, 1) * m(2, 0) - m(0, 0) * m(2, 1);
+					inv(2, 2) = m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0);
+				} else {
+					// Adjugate from the 2x2 minors of the top (s) and bottom (c) row pairs
+					const double s0 = m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1);
+					const double s1 = m(0, 0) * m(1, 2) - m(1, 0) * m(0, 2);
+					const double s2 = m(0, 0) * m(1, 3) - m(1, 0) * m(0, 3);
+					const double s3 = m(0, 1) * m(1, 2) - m(1, 1) * m(0, 2);
+					const double s4 = m(0, 1) * m(1, 3) - m(1, 1) * m(0, 3);
+					const double s5 = m(0, 2) * m(1, 3) - m(1, 2) * m(0, 3);
+					const double c5 = m(2, 2) * m(3, 3) - m(3, 2) * m(2, 3);
+					const double c4 = m(2, 1) * m(3, 3) - m(3, 1) * m(2, 3);
+					const double c3 = m(2, 1) * m(3, 2) - m(3, 1) * m(2, 2);
+					const double c2 = m(2, 0) * m(3, 3) - m(3, 0) * m(2, 3);
+					const double c1 = m(2, 0) * m(3, 2) - m(3, 0) * m(2, 2);
+					const double c0 = m(2, 0) * m(3, 1) - m(3, 0) * m(2, 1);
+					inv(0, 0) = m(1, 1) * c5 - m(1, 2) * c4 + m(1, 3) * c3;
+					inv(0, 1) = -m(0, 1) * c5 + m(0, 2) * c4 - m(0, 3) * c3;
+					inv(0, 2) = m(3, 1) * s5 - m(3, 2) * s4 + m(3, 3) * s3;
+					inv(0, 3) = -m(2, 1) * s5 + m(2, 2) * s4 - m(2, 3) * s3;
+					inv(1, 0) = -m(1, 0) * c5 + m(1, 2) * c2 - m(1, 3) * c1;
+					inv(1, 1) = m(0, 0) * c5 - m(0, 2) * c2 + m(0, 3) * c1;
+					inv(1, 2) = -m(3, 0) * s5 + m(3, 2) * s2 - m(3, 3) * s1;
+					inv(1, 3) = m(2, 0) * s5 - m(2, 2) * s2 + m(2, 3) * s1;
+					inv(2, 0) = m(1, 0) * c4 - m(1, 1) * c2 + m(1, 3) * c0;
+					inv(2, 1) = -m(0, 0) * c4 + m(0, 1) * c2 - m(0, 3) * c0;
+					inv(2, 2) = m(3, 0) * s4 - m(3, 1) * s2 + m(3, 3) * s0;
+					inv(2, 3) = -m(2, 0) * s4 + m(2, 1) * s2 - m(2, 3) * s0;
+					inv(3, 0) = -m(1, 0) * c3 + m(1, 1) * c1 - m(1, 2) * c0;
+					inv(3, 1) = m(0, 0) * c3 - m(0, 1) * c1 + m(0, 2) * c0;
+					inv(3, 2) = -m(3, 0) * s3 + m(3, 1) * s1 - m(3, 2) * s0;
+					inv(3, 3) = m(2, 0) * s3 - m(2, 1) * s1 + m(2, 2) * s0;
+				}
+				return inv / det;
+			} else {
+				return inverseElimination();
+			}
+		}
+
+		constexpr FixedSquareMat& operator+=(const FixedSquareMat& b) { return *this = *this + b; }
+		constexpr FixedSquareMat& operator-=(const FixedSquareMat& b) { return *this = *this - b; }
+		constexpr FixedSquareMat& operator*=(const FixedSquareMat& b) { return *this = *this * b; }
+		constexpr FixedSquareMat& operator*=(double sc) { return *this = *this * sc; }
+		constexpr FixedSquareMat& operator/=(double sc) { return *this = *this / sc; }
+
+		/**
+		 * @brief In-place modulo with SquareMat's sign rule: unlike %, the
+		 * result follows the dividend (std::fmod)
+		 */
+		FixedSquareMat& operator%=(const FixedSquareMat& b) {
+			for (std::size_t i = 0; i < N * N; ++i) {
+				if (b.elems[i] == 0.0)
+					throw std::invalid_argument("Modulo by zero is undefined");
+				elems[i] = std::fmod(elems[i], b.elems[i]);
+			}
+			return *this;
+		}
+
+		FixedSquareMat& operator%=(int sc) {
+			if (sc == 0)
+				throw std::invalid_argument("Modulo by zero is undefined");
+			for (std::size_t i = 0; i < N * N; ++i)
+				elems[i] = std::fmod(elems[i], static_cast<double>(sc));
+			return *this;
+		}
+
+		friend std::ostream& operator<<(std::ostream& os, const FixedSquareMat& mat) {
+			for (std::size_t i = 0; i < N; ++i) {
+				for (std::size_t j = 0; j < N; ++j) {
+					os << mat(i, j);
+					if (j + 1 < N)
+						os << " ";
+				}
+				os << "\n";
+			}
+			return os;
+		}
+	};
+
+	/**
+	 * @brief Mixed fixed/dynamic operators; the result is a dynamic SquareMat
+	 */
+	template <std::size_t N>
+	SquareMat operator+(const FixedSquareMat<N>& a, const SquareMat& b) { return a.toSquareMat() + b; }
+	template <std::size_t N>
+	SquareMat operator+(const SquareMat& a, const FixedSquareMat<N>& b) { return a + b.toSquareMat(); }
+	template <std::size_t N>
+	SquareMat operator-(const FixedSquareMat<N>& a, const SquareMat& b) { return a.toSquareMat() - b; }
+	template <std::size_t N>
+	SquareMat operator-(const SquareMat& a, const FixedSquareMat<N>& b) { return a - b.toSquareMat(); }
+	template <std::size_t N>
+	SquareMat operator*(const FixedSquareMat<N>& a, const SquareMat& b) { return a.toSquareMat() * b; }
+	template <std::size_t N>
+	SquareMat operator*(const SquareMat& a, const FixedSquareMat<N>& b) { return a * b.toSquareMat(); }
+
+	using Mat2 = FixedSquareMat<2>;
+	using Mat3 = FixedSquareMat<3>;
+	using Mat4 = FixedSquareMat<4>;
+	using Mat6 = FixedSquareMat<6>;
+}
+#endif
@@ -0,0 +1,193 @@
+// ey.gellis@gmail.com
+#include "gemm.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace {
+	// Register tile computed by the micro-kernel
+	constexpr int MR = 6;
+	constexpr int NR = 4;
+	// Cache blocks: an MC x KC panel of A stays in L2, a KC x NR sliver of B in L1,
+	// and a KC x NC panel of B in L3
+	constexpr int MC = 120;
+	constexpr int KC = 256;
+	constexpr int NC = 4096;
+	// Below this size packing costs more than it saves
+	constexpr int SMALL = 48;
+	// C tiles handed to the thread pool by parallel products
+	constexpr int TILE_M = 2 * MC;
+	constexpr int TILE_N = 512;
+
+	/**
+	 * @brief Read-only operand addressed through row and column strides
+	 *
+	 * Element (i, k) lives at p[i * rs + k * cs], so a transposed operand is the
+	 * same buffer with the strides swapped and the product needs no copy of it.
+	 */
+	struct Operand {
+		const double* p;
+		std::size_t rs;
+		std::size_t cs;
+
+		const double* at(int i, int k) const { return p + i * rs + k * cs; }
+		Operand block(int i, int k) const { return {at(i, k), rs, cs}; }
+	};
+
+	Operand operand(const double* p, std::size_t ld, bool trans) {
+		return trans ? Operand{p, 1, ld} : Operand{p, ld, 1};
+	}
+
+	/**
+	 * @brief Copies an mc x kc block of A into MR-row slivers, k-major, zero padded
+	 */
+	void packA(const Operand& a, int mc, int kc, double* out) {
+		for (int i = 0; i < mc; i += MR) {
+			int rows = std::min(MR, mc - i);
+			for (int k = 0; k < kc; ++k) {
+				const double* src = a.at(i, k);
+				for (int r = 0; r < rows; ++r)
+					out[r] = src[r * a.rs];
+				for (int r = rows; r < MR; ++r)
+					out[r] = 0.0;
+				out += MR;
+			}
+		}
+	}
+
+	/**
+	 * @brief Copies a kc x nc block of B into NR-column slivers, k-major, zero padded
+	 */
+	void packB(const Operand& b, int kc, int nc, double* out) {
+		for (int j = 0; j < nc; j += NR) {
+			int cols = std::min(NR, nc - j);
+			for (int k = 0; k < kc; ++k) {
+				const double* src = b.at(k, j);
+				for (int c = 0; c < cols; ++c)
+					out[c] = src[c * b.cs];
+				for (int c = cols; c < NR; ++c)
+					out[c] = 0.0;
+				out += NR;
+			}
+		}
+	}
+
+	// Two-double SIMD lane; SSE2 is the x86-64 baseline, and GCC lowers this
+	// portably on other targets
+	typedef double vec2 __attribute__((vector_size(16)));
+	constexpr int NV = NR / 2;
+
+	/**
+	 * @brief MR x NR register-tiled kernel over packed slivers; adds into C
+	 */
+	void microKernel(int kc, const double* a, const double* b, double* c, std::size_t ldc, int rows, int cols) {
+		vec2 acc[MR][NV] = {};
+		for (int k = 0; k < kc; ++k) {
+			vec2 bv[NV];
+			for (int j = 0; j < NV; ++j)
+				__builtin_memcpy(&bv[j], b + 2 * j, sizeof(vec2));
+			for (int r = 0; r < MR; ++r) {
+				const vec2 ar = {a[r], a[r]};
+				for (int j = 0; j < NV; ++j)
+					acc[r][j] += ar * bv[j];
+			}
+			a += MR;
+			b += NR;
+		}
+		for (int r = 0; r < rows; ++r)
+			for (int j = 0; j < cols; ++j)
+				c[r * ldc + j] += acc[r][j / 2][j % 2];
+	}
+
+	void gemmSmall(int n, const Operand& a, const Operand& b, double* c, std::size_t ldc) {
+		for (int i = 0; i < n; ++i) {
+			double* out = c + i * ldc;
+			for (int k = 0; k < n; ++k) {
+				const double aik = *a.at(i, k);
+				const double* brow = b.at(k, 0);
+				for (int j = 0; j < n; ++j)
+					out[j] += aik * brow[j * b.cs];
+			}
+		}
+	}
+
+	/**
+	 * @brief Blocked product of an m x nc tile: C += A * B with inner dimension kd
+	 *
+	 * a starts at the first row of the A tile, b at the first column of the B
+	 * tile and c at the top-left of the C tile.
+	 */
+	void gemmBlock(int m, int nc, int kd, const Operand& a, const Operand& b, double* c, std::size_t ldc) {
+		// Packing buffers are kept per thread so steady-state products do not allocate
+		thread_local std::vector<double> packedA;
+		thread_local std::vector<double> packedB;
+		packedA.resize(static_cast<std::size_t>(MC) * KC);
+		packedB.resize(static_cast<std::size_t>(KC) * ((std::min(NC, nc) + NR - 1) / NR * NR));
+
+		for (int jc = 0; jc < nc; jc += NC) {
+			int ncb = std::min(NC, nc - jc);
+			for (int pc = 0; pc < kd; pc += KC) {
+				int kc = std::min(KC, kd - pc);
+				packB(b.block(pc, jc), kc, ncb, packedB.data());
+				for (int ic = 0; ic < m; ic += MC) {
+					int mc = std::min(MC, m - ic);
+					packA(a.block(ic, pc), mc, kc, packedA.data());
+					for (int jr = 0; jr < ncb; jr += NR) {
+						int cols = std::min(NR, ncb - jr);
+						const double* bp = packedB.data() + static_cast<std::size_t>(jr) * kc;
+						for (int ir = 0; ir < mc; ir += MR) {
+							int rows = std::min(MR, mc - ir);
+							const double* ap = packedA.data() + static_cast<std::size_t>(ir) * kc;
+							microKernel(kc, ap, bp, c + (ic + ir) * ldc + jc + jr, ldc, rows, cols);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+namespace matrix {
+	namespace detail {
+		void gemm(int n, const double* a, const double* b, double* c) {
+			gemmStrided(n, a, n, b, n, c, n);
+		}
+
+		void gemmStrided(int n, const double* a, std::size_t lda, const double* b, std::size_t ldb,
+			double* c, std::size_t ldc) {
+			gemmStrided(n, a, lda, false, b, ldb, false, c, ldc);
+		}
+
+		void gemmStrided(int n, const double* a, std::size_t lda, bool transA, const double* b, std::size_t ldb,
+			bool transB, double* c, std::size_t ldc) {
+			const Operand opA = operand(a, lda, transA);
+			const Operand opB = operand(b, ldb, transB);
+			if (n <= SMALL) {
+				gemmSmall(n, opA, opB, c, ldc);
+				return;
+			}
+
+			if (n < parallelThreshold() || threadCount() == 1) {
+				gemmBlock(n, n, n, opA, opB, c, ldc);
+				return;
+			}
+
+			// Independent 2D tiles of C; each task packs its own panels
+			const int rowTiles = (n + TILE_M - 1) / TILE_M;
+			const int colTiles = (n + TILE_N - 1) / TILE_N;
+			parallelFor(rowTiles * colTiles, [&](int task) {
+				int i0 = (task / colTiles) * TILE_M;
+				int j0 = (task % colTiles) * TILE_N;
+				int m = std::min(TILE_M, n - i0);
+				int nc = std::min(TILE_N, n - j0);
+				gemmBlock(m, nc, n, opA.block(i0, 0), opB.block(0, j0), c + i0 * ldc + j0, ldc);
+			});
+		}
+
+		void gemmRect(int m, int n, int k, const double* a, std::size_t lda, const double* b, std::size_t ldb,
+			double* c, std::size_t ldc) {
+			gemmBlock(m, n, k, operand(a, lda, false), operand(b, ldb, false), c, ldc);
+		}
+	}
+}
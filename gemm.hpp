@@ -0,0 +1,69 @@
+// ey.gellis@gmail.com
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <cstddef>
+
+namespace matrix {
+	namespace detail {
+		/**
+		 * @brief Packed, cache-blocked matrix product C += A * B
+		 *
+		 * All three matrices are n x n, row-major and contiguous. The product is
+		 * accumulated into c, so callers wanting C = A * B pass a zeroed buffer.
+		 * c must not alias a or b.
+		 * @param n Matrix dimension
+		 * @param a Left operand
+		 * @param b Right operand
+		 * @param c Destination
+		 */
+		void gemm(int n, const double* a, const double* b, double* c);
+
+		/**
+		 * @brief gemm() on n x n blocks embedded in larger row-major arrays
+		 * @param n Block dimension
+		 * @param a Left operand
+		 * @param lda Row stride of a, in elements
+		 * @param b Right operand
+		 * @param ldb Row stride of b, in elements
+		 * @param c Destination, accumulated into
+		 * @param ldc Row stride of c, in elements
+		 */
+		void gemmStrided(int n, const double* a, std::size_t lda, const double* b, std::size_t ldb,
+			double* c, std::size_t ldc);
+
+		/**
+		 * @brief gemmStrided() with optionally transposed operands, C += op(A) * op(B)
+		 *
+		 * A transposed operand is read in place: only the packing order changes, so
+		 * A^T * B costs the same as A * B.
+		 * @param n Block dimension
+		 * @param a Left operand as stored
+		 * @param lda Row stride of a, in elements
+		 * @param transA Whether to multiply by the transpose of a
+		 * @param b Right operand as stored
+		 * @param ldb Row stride of b, in elements
+		 * @param transB Whether to multiply by the transpose of b
+		 * @param c Destination, accumulated into
+		 * @param ldc Row stride of c, in elements
+		 */
+		void gemmStrided(int n, const double* a, std::size_t lda, bool transA, const double* b, std::size_t ldb,
+			bool transB, double* c, std::size_t ldc);
+
+		/**
+		 * @brief Serial rectangular product C += A * B on strided row-major blocks
+		 * @param m Rows of a and c
+		 * @param n Columns of b and c
+		 * @param k Columns of a and rows of b
+		 * @param a Left operand, m x k
+		 * @param lda Row stride of a, in elements
+		 * @param b Right operand, k x n
+		 * @param ldb Row stride of b, in elements
+		 * @param c Destination, m x n, accumulated into
+		 * @param ldc Row stride of c, in elements
+		 */
+		void gemmRect(int m, int n, int k, const double* a, std::size_t lda, const double* b, std::size_t ldb,
+			double* c, std::size_t ldc);
+	}
+}
+#endif
@@ -0,0 +1,193 @@
+// ey.gellis@gmail.com
+#include "instrument.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+
+using namespace matrix;
+
+namespace {
+	constexpr std::size_t OP_COUNT = static_cast<std::size_t>(InstrumentedOp::Count);
+
+	// Metric names, in InstrumentedOp order
+	constexpr const char* OP_NAMES[OP_COUNT] = {
+		"add", "subtract", "negate", "multiply", "scale", "divide", "modulo", "power",
+		"increment", "decrement", "transpose", "determinant", "compare",
+		"sum", "min", "max", "frobenius_norm", "trace",
+		"add_assign", "subtract_assign", "multiply_assign", "scale_assign", "divide_assign", "modulo_assign",
+	};
+
+	enum Field { Calls, Nanoseconds, Bytes, Flops, FIELDS };
+
+	using Totals = std::array<std::array<std::uint64_t, FIELDS>, OP_COUNT>;
+
+	struct ThreadCounters;
+
+	/**
+	 * @brief Every live thread's counters plus the totals of threads that exited
+	 *
+	 * The lock is taken when a thread first records, when it exits and by
+	 * snapshots; recording itself never touches it. Leaked so thread-local
+	 * counters destroyed after static destruction can still retire into it.
+	 */
+	struct Registry {
+		std::mutex lock;
+		std::vector<ThreadCounters*> live;
+		Totals retired{};
+		Totals baseline{};
+	};
+
+	Registry& registry() {
+		static Registry* instance = new Registry;
+		return *instance;
+	}
+
+	struct ThreadCounters {
+		std::atomic<std::uint64_t> cells[OP_COUNT][FIELDS];
+		std::uint64_t allocated = 0;
+		int depth = 0;
+
+		ThreadCounters() {
+			for (auto& op : cells)
+				for (auto& cell : op)
+					cell.store(0, std::memory_order_relaxed);
+			Registry& r = registry();
+			std::lock_guard<std::mutex> guard(r.lock);
+			r.live.push_back(this);
+		}
+
+		~ThreadCounters() {
+			Registry& r = registry();
+			std::lock_guard<std::mutex> guard(r.lock);
+			addTo(r.retired);
+			r.live.erase(std::find(r.live.begin(), r.live.end(), this));
+		}
+
+		void add(InstrumentedOp op, Field field, std::uint64_t value) {
+			// Only the owning thread writes, so load + store cannot lose updates
+			std::atomic<std::uint64_t>& cell = cells[static_cast<std::size_t>(op)][field];
+			cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		void addTo(Totals& totals) const {
+			for (std::size_t op = 0; op < OP_COUNT; ++op)
+				for (int field = 0; field < FIELDS; ++field)
+					totals[op][field] += cells[op][field].load(std::memory_order_relaxed);
+		}
+	};
+
+	ThreadCounters& counters() {
+		thread_local ThreadCounters instance;
+		return instance;
+	}
+
+	std::uint64_t now() {
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	Totals currentTotals(Registry& r) {
+		Totals totals = r.retired;
+		for (const ThreadCounters* thread : r.live)
+			thread->addTo(totals);
+		return totals;
+	}
+
+	void writeMetric(std::ostream& os, const std::vector<OpStats>& stats, const char* name, const char* help,
+		std::uint64_t OpStats::*field, double scale) {
+		os << "# HELP " << name << " " << help << "\n";
+		os << "# TYPE " << name << " counter\n";
+		for (const OpStats& s : stats) {
+			os << name << "{op=\"" << s.name << "\"} ";
+			if (scale == 1.0)
+				os << s.*field;
+			else
+				os << static_cast<double>(s.*field) * scale;
+			os << "\n";
+		}
+	}
+}
+
+namespace matrix {
+	bool instrumentationEnabled() {
+#ifdef MATRIX_INSTRUMENT
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	std::vector<OpStats> instrumentationSnapshot() {
+		Registry& r = registry();
+		Totals totals;
+		{
+			std::lock_guard<std::mutex> guard(r.lock);
+			totals = currentTotals(r);
+			for (std::size_t op = 0; op < OP_COUNT; ++op)
+				for (int field = 0; field < FIELDS; ++field)
+					totals[op][field] -= r.baseline[op][field];
+		}
+		std::vector<OpStats> stats;
+		stats.reserve(OP_COUNT);
+		for (std::size_t op = 0; op < OP_COUNT; ++op)
+			stats.push_back({static_cast<InstrumentedOp>(op), OP_NAMES[op],
+				totals[op][Calls], totals[op][Nanoseconds], totals[op][Bytes], totals[op][Flops]});
+		return stats;
+	}
+
+	void resetInstrumentation() {
+		// Other threads' counters cannot be written from here without racing their
+		// owners, so a reset moves the baseline that snapshots subtract instead
+		Registry& r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		r.baseline = currentTotals(r);
+	}
+
+	void writePrometheus(std::ostream& os) {
+		const std::vector<OpStats> stats = instrumentationSnapshot();
+		writeMetric(os, stats, "matrix_op_calls_total", "Calls of each SquareMat operator.", &OpStats::calls, 1.0);
+		writeMetric(os, stats, "matrix_op_seconds_total", "Wall time spent in each SquareMat operator.",
+			&OpStats::nanoseconds, 1e-9);
+		writeMetric(os, stats, "matrix_op_allocated_bytes_total", "Matrix storage allocated by each SquareMat operator.",
+			&OpStats::bytesAllocated, 1.0);
+		writeMetric(os, stats, "matrix_op_flops_total", "Floating-point operations performed by each SquareMat operator.",
+			&OpStats::flops, 1.0);
+	}
+
+	std::string prometheusText() {
+		std::ostringstream os;
+		writePrometheus(os);
+		return os.str();
+	}
+
+	namespace detail {
+		OpScope::OpScope(InstrumentedOp op, double flops)
+			: op(op), flops(static_cast<std::uint64_t>(flops)), start(0), allocatedBefore(0), outermost(false) {
+			ThreadCounters& c = counters();
+			outermost = c.depth++ == 0;
+			if (!outermost)
+				return;
+			allocatedBefore = c.allocated;
+			start = now();
+		}
+
+		OpScope::~OpScope() {
+			ThreadCounters& c = counters();
+			--c.depth;
+			if (!outermost)
+				return;
+			const std::uint64_t elapsed = now() - start;
+			c.add(op, Calls, 1);
+			c.add(op, Nanoseconds, elapsed);
+			c.add(op, Bytes, c.allocated - allocatedBefore);
+			c.add(op, Flops, flops);
+		}
+
+		void countAllocation(std::size_t bytes) {
+			counters().allocated += bytes;
+		}
+	}
+}
@@ -0,0 +1,132 @@
+// ey.gellis@gmail.com
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief SquareMat operators tracked by the instrumentation layer
+	 */
+	enum class InstrumentedOp {
+		Add,
+		Subtract,
+		Negate,
+		Multiply,
+		Scale,
+		Divide,
+		Modulo,
+		Power,
+		Increment,
+		Decrement,
+		Transpose,
+		Determinant,
+		Compare,
+		Sum,
+		Min,
+		Max,
+		FrobeniusNorm,
+		Trace,
+		AddAssign,
+		SubtractAssign,
+		MultiplyAssign,
+		ScaleAssign,
+		DivideAssign,
+		ModuloAssign,
+		Count
+	};
+
+	/**
+	 * @brief Totals recorded for one operator across all threads
+	 */
+	struct OpStats {
+		InstrumentedOp op;
+		const char* name;
+		std::uint64_t calls;
+		std::uint64_t nanoseconds;
+		std::uint64_t bytesAllocated;
+		std::uint64_t flops;
+	};
+
+	/**
+	 * @brief Whether libmat was built with MATRIX_INSTRUMENT defined
+	 *
+	 * Without it the operators carry no counting code and every snapshot is zero.
+	 * @return True if operators are being counted
+	 */
+	bool instrumentationEnabled();
+
+	/**
+	 * @brief Totals per operator since start-up or the last reset
+	 *
+	 * Only the outermost operator on a thread is recorded, so `a + b` on an
+	 * rvalue counts as one addition rather than an addition and an `+=`, and the
+	 * totals add up to the time spent in the library. FLOPs are textbook counts
+	 * (2n^3 per product); bytes are matrix storage allocated during the call.
+	 * @return One entry per InstrumentedOp, in enum order
+	 */
+	std::vector<OpStats> instrumentationSnapshot();
+
+	/**
+	 * @brief Zeroes the totals reported by later snapshots
+	 */
+	void resetInstrumentation();
+
+	/**
+	 * @brief Writes the current snapshot in the Prometheus text exposition format
+	 * @param os Stream to write to
+	 */
+	void writePrometheus(std::ostream& os);
+
+	/**
+	 * @brief Current snapshot in the Prometheus text exposition format
+	 * @return Metrics text
+	 */
+	std::string prometheusText();
+
+	namespace detail {
+		/**
+		 * @brief Records one operator call on the calling thread: wall time from
+		 * construction to destruction, plus bytes passed to countAllocation() meanwhile
+		 *
+		 * Counters are per thread with a single writer, so recording is a plain
+		 * load and store with no locked instructions.
+		 */
+		class OpScope {
+		private:
+			InstrumentedOp op;
+			std::uint64_t flops;
+			std::uint64_t start;
+			std::uint64_t allocatedBefore;
+			bool outermost;
+
+		public:
+			OpScope(InstrumentedOp op, double flops);
+			OpScope(const OpScope&) = delete;
+			OpScope& operator=(const OpScope&) = delete;
+			~OpScope();
+		};
+
+		/**
+		 * @brief Adds matrix storage allocated by the calling thread
+		 * @param bytes Bytes allocated
+		 */
+		void countAllocation(std::size_t bytes);
+	}
+}
+
+#ifdef MATRIX_INSTRUMENT
+#define MATRIX_OP_CONCAT_(a, b) a##b
+#define MATRIX_OP_CONCAT(a, b) MATRIX_OP_CONCAT_(a, b)
+#define MATRIX_OP(op, flops) \
+	::matrix::detail::OpScope MATRIX_OP_CONCAT(matrixOpScope, __LINE__)(::matrix::InstrumentedOp::op, (flops))
+#define MATRIX_COUNT_ALLOCATION(bytes) ::matrix::detail::countAllocation(bytes)
+#else
+#define MATRIX_OP(op, flops) ((void)0)
+#define MATRIX_COUNT_ALLOCATION(bytes) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+// ey.gellis@gmail.com
+#include "kernels.hpp"
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATRIX_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+	using matrix::detail::Isa;
+	using matrix::detail::Kernels;
+
+	void addScalarRef(const double* a, const double* b, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = a[i] + b[i];
+	}
+	void subScalarRef(const double* a, const double* b, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = a[i] - b[i];
+	}
+	void negScalarRef(const double* a, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = -a[i];
+	}
+	void addScScalarRef(const double* a, double sc, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = a[i] + sc;
+	}
+	void mulScScalarRef(const double* a, double sc, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = a[i] * sc;
+	}
+	void divScScalarRef(const double* a, double sc, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = a[i] / sc;
+	}
+	void axpyScalarRef(const double* a, double sc, double* out, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			out[i] = out[i] + a[i] * sc;
+	}
+
+	using matrix::detail::REDUCE_LANES;
+
+	// Reference reductions; n need not be a multiple of REDUCE_LANES, but only
+	// the final call on a range may end part way through the lanes
+	void sumScalarRef(const double* a, std::size_t n, double* state) {
+		double* comp = state + REDUCE_LANES;
+		for (std::size_t i = 0; i < n; ++i) {
+			const std::size_t l = i % REDUCE_LANES;
+			const double y = a[i] - comp[l];
+			const double t = state[l] + y;
+			comp[l] = (t - state[l]) - y;
+			state[l] = t;
+		}
+	}
+	void sumSquaresScalarRef(const double* a, std::size_t n, double* state) {
+		double* comp = state + REDUCE_LANES;
+		for (std::size_t i = 0; i < n; ++i) {
+			const std::size_t l = i % REDUCE_LANES;
+			const double sq = a[i] * a[i];
+			const double y = sq - comp[l];
+			const double t = state[l] + y;
+			comp[l] = (t - state[l]) - y;
+			state[l] = t;
+		}
+	}
+	// x < m ? x : m is what minpd computes, NaN in x included
+	void minScalarRef(const double* a, std::size_t n, double* state) {
+		for (std::size_t i = 0; i < n; ++i) {
+			double& m = state[i % REDUCE_LANES];
+			m = a[i] < m ? a[i] : m;
+		}
+	}
+	void maxScalarRef(const double* a, std::size_t n, double* state) {
+		for (std::size_t i = 0; i < n; ++i) {
+			double& m = state[i % REDUCE_LANES];
+			m = a[i] > m ? a[i] : m;
+		}
+	}
+
+	const Kernels scalarKernels = {
+		addScalarRef, subScalarRef, negScalarRef, addScScalarRef, mulScScalarRef, divScScalarRef, axpyScalarRef,
+		sumScalarRef, sumSquaresScalarRef, minScalarRef, maxScalarRef
+	};
+
+#ifdef MATRIX_X86
+	// Stamps out the kernels for one instruction set. Each loop runs full
+	// vectors with unaligned loads/stores and finishes the tail with the scalar
+	// reference, so results match it bit for bit. CLEAN runs before that tail:
+	// GCC turns the call into a jump without vzeroupper, and legacy SSE code
+	// running with dirty upper halves stalls on every instruction. Reductions hold the
+	// REDUCE_LANES lanes in REDUCE_LANES / WIDTH registers, which also gives the
+	// Kahan loops that many independent dependency chains.
+#define MATRIX_DEFINE_KERNELS(SUFFIX, TARGET, VEC, WIDTH, LOAD, STORE, SET1, ADD, SUB, MUL, DIV, XOR, MIN, MAX, CLEAN) \
+	__attribute__((target(TARGET))) void add##SUFFIX(const double* a, const double* b, double* out, std::size_t n) { \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, ADD(LOAD(a + i), LOAD(b + i))); \
+		CLEAN(); \
+		addScalarRef(a + i, b + i, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void sub##SUFFIX(const double* a, const double* b, double* out, std::size_t n) { \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, SUB(LOAD(a + i), LOAD(b + i))); \
+		CLEAN(); \
+		subScalarRef(a + i, b + i, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void neg##SUFFIX(const double* a, double* out, std::size_t n) { \
+		const VEC sign = SET1(-0.0); \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, XOR(LOAD(a + i), sign)); \
+		CLEAN(); \
+		negScalarRef(a + i, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void addSc##SUFFIX(const double* a, double sc, double* out, std::size_t n) { \
+		const VEC s = SET1(sc); \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, ADD(LOAD(a + i), s)); \
+		CLEAN(); \
+		addScScalarRef(a + i, sc, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void mulSc##SUFFIX(const double* a, double sc, double* out, std::size_t n) { \
+		const VEC s = SET1(sc); \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, MUL(LOAD(a + i), s)); \
+		CLEAN(); \
+		mulScScalarRef(a + i, sc, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void divSc##SUFFIX(const double* a, double sc, double* out, std::size_t n) { \
+		const VEC s = SET1(sc); \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, DIV(LOAD(a + i), s)); \
+		CLEAN(); \
+		divScScalarRef(a + i, sc, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void axpy##SUFFIX(const double* a, double sc, double* out, std::size_t n) { \
+		const VEC s = SET1(sc); \
+		std::size_t i = 0; \
+		for (; i + WIDTH <= n; i += WIDTH) \
+			STORE(out + i, ADD(LOAD(out + i), MUL(LOAD(a + i), s))); \
+		CLEAN(); \
+		axpyScalarRef(a + i, sc, out + i, n - i); \
+	} \
+	__attribute__((target(TARGET))) void sum##SUFFIX(const double* a, std::size_t n, double* state) { \
+		constexpr int V = REDUCE_LANES / WIDTH; \
+		VEC s[V], c[V]; \
+		for (int v = 0; v < V; ++v) { \
+			s[v] = LOAD(state + v * WIDTH); \
+			c[v] = LOAD(state + REDUCE_LANES + v * WIDTH); \
+		} \
+		std::size_t i = 0; \
+		for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) \
+			for (int v = 0; v < V; ++v) { \
+				const VEC y = SUB(LOAD(a + i + v * WIDTH), c[v]); \
+				const VEC t = ADD(s[v], y); \
+				c[v] = SUB(SUB(t, s[v]), y); \
+				s[v] = t; \
+			} \
+		for (int v = 0; v < V; ++v) { \
+			STORE(state + v * WIDTH, s[v]); \
+			STORE(state + REDUCE_LANES + v * WIDTH, c[v]); \
+		} \
+		CLEAN(); \
+		sumScalarRef(a + i, n - i, state); \
+	} \
+	__attribute__((target(TARGET))) void sumSquares##SUFFIX(const double* a, std::size_t n, double* state) { \
+		constexpr int V = REDUCE_LANES / WIDTH; \
+		VEC s[V], c[V]; \
+		for (int v = 0; v < V; ++v) { \
+			s[v] = LOAD(state + v * WIDTH); \
+			c[v] = LOAD(state + REDUCE_LANES + v * WIDTH); \
+		} \
+		std::size_t i = 0; \
+		for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) \
+			for (int v = 0; v < V; ++v) { \
+				const VEC x = LOAD(a + i + v * WIDTH); \
+				const VEC y = SUB(MUL(x, x), c[v]); \
+				const VEC t = ADD(s[v], y); \
+				c[v] = SUB(SUB(t, s[v]), y); \
+				s[v] = t; \
+			} \
+		for (int v = 0; v < V; ++v) { \
+			STORE(state + v * WIDTH, s[v]); \
+			STORE(state + REDUCE_LANES + v * WIDTH, c[v]); \
+		} \
+		CLEAN(); \
+		sumSquaresScalarRef(a + i, n - i, state); \
+	} \
+	__attribute__((target(TARGET))) void min##SUFFIX(const double* a, std::size_t n, double* state) { \
+		constexpr int V = REDUCE_LANES / WIDTH; \
+		VEC m[V]; \
+		for (int v = 0; v < V; ++v) \
+			m[v] = LOAD(state + v * WIDTH); \
+		std::size_t i = 0; \
+		for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) \
+			for (int v = 0; v < V; ++v) \
+				m[v] = MIN(LOAD(a + i + v * WIDTH), m[v]); \
+		for (int v = 0; v < V; ++v) \
+			STORE(state + v * WIDTH, m[v]); \
+		CLEAN(); \
+		minScalarRef(a + i, n - i, state); \
+	} \
+	__attribute__((target(TARGET))) void max##SUFFIX(const double* a, std::size_t n, double* state) { \
+		constexpr int V = REDUCE_LANES / WIDTH; \
+		VEC m[V]; \
+		for (int v = 0; v < V; ++v) \
+			m[v] = LOAD(state + v * WIDTH); \
+		std::size_t i = 0; \
+		for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) \
+			for (int v = 0; v < V; ++v) \
+				m[v] = MAX(LOAD(a + i + v * WIDTH), m[v]); \
+		for (int v = 0; v < V; ++v) \
+			STORE(state + v * WIDTH, m[v]); \
+		CLEAN(); \
+		maxScalarRef(a + i, n - i, state); \
+	} \
+	const Kernels SUFFIX##Kernels = { \
+		add##SUFFIX, sub##SUFFIX, neg##SUFFIX, addSc##SUFFIX, mulSc##SUFFIX, divSc##SUFFIX, axpy##SUFFIX, \
+		sum##SUFFIX, sumSquares##SUFFIX, min##SUFFIX, max##SUFFIX \
+	};
+
+	inline void noClean() {}
+
+	// _mm512_min_pd/_mm512_max_pd merge into an undefined register, which GCC
+	// reports as maybe-uninitialized; with a full mask the merge source is unused
+	__attribute__((target("avx512f"))) inline __m512d min512(__m512d a, __m512d b) {
+		return _mm512_mask_min_pd(a, 0xFF, a, b);
+	}
+	__attribute__((target("avx512f"))) inline __m512d max512(__m512d a, __m512d b) {
+		return _mm512_mask_max_pd(a, 0xFF, a, b);
+	}
+
+	MATRIX_DEFINE_KERNELS(Sse2, "sse2", __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd,
+		_mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd, _mm_xor_pd, _mm_min_pd, _mm_max_pd, noClean)
+	MATRIX_DEFINE_KERNELS(Avx2, "avx2", __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd,
+		_mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd, _mm256_xor_pd, _mm256_min_pd, _mm256_max_pd, _mm256_zeroupper)
+	MATRIX_DEFINE_KERNELS(Avx512, "avx512f,avx512dq", __m512d, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd,
+		_mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd, _mm512_xor_pd, min512, max512, _mm256_zeroupper)
+
+#undef MATRIX_DEFINE_KERNELS
+#endif
+
+	std::atomic<Isa> selected{matrix::detail::detectIsa()};
+}
+
+namespace matrix {
+	namespace detail {
+		Isa detectIsa() {
+#ifdef MATRIX_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+				return Isa::AVX512;
+			if (__builtin_cpu_supports("avx2"))
+				return Isa::AVX2;
+			if (__builtin_cpu_supports("sse2"))
+				return Isa::SSE2;
+#endif
+			return Isa::Scalar;
+		}
+
+		bool isaSupported(Isa isa) {
+			return static_cast<int>(isa) <= static_cast<int>(detectIsa());
+		}
+
+		void setIsa(Isa isa) {
+			if (!isaSupported(isa))
+				throw std::invalid_argument("Instruction set is not supported by this CPU");
+			selected.store(isa, std::memory_order_relaxed);
+		}
+
+		Isa activeIsa() {
+			return selected.load(std::memory_order_relaxed);
+		}
+
+		const Kernels& kernels() {
+			return kernels(activeIsa());
+		}
+
+		const Kernels& kernels(Isa isa) {
+			switch (isa) {
+#ifdef MATRIX_X86
+			case Isa::AVX512:
+				return Avx512Kernels;
+			case Isa::AVX2:
+				return Avx2Kernels;
+			case Isa::SSE2:
+				return Sse2Kernels;
+#endif
+			default:
+				return scalarKernels;
+			}
+		}
+	}
+}
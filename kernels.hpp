@@ -0,0 +1,85 @@
+// ey.gellis@gmail.com
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+
+namespace matrix {
+	namespace detail {
+		/**
+		 * @brief Instruction sets the element-wise kernels are compiled for
+		 */
+		enum class Isa { Scalar, SSE2, AVX2, AVX512 };
+
+		/**
+		 * @brief Independent accumulators the reduction kernels fold elements into
+		 */
+		constexpr int REDUCE_LANES = 16;
+
+		/**
+		 * @brief Table of element-wise kernels for one instruction set
+		 *
+		 * Every kernel processes n contiguous doubles; out may alias the inputs.
+		 * The vector paths produce bit-identical results to the scalar ones.
+		 *
+		 * Reductions continue a running state: element i of a is folded into lane
+		 * i % REDUCE_LANES, so every instruction set performs the same operations in
+		 * the same order. sum and sumSquares keep REDUCE_LANES Kahan sums followed by
+		 * their REDUCE_LANES compensations; min and max keep REDUCE_LANES extrema and
+		 * skip NaNs.
+		 */
+		struct Kernels {
+			void (*add)(const double* a, const double* b, double* out, std::size_t n);
+			void (*sub)(const double* a, const double* b, double* out, std::size_t n);
+			void (*neg)(const double* a, double* out, std::size_t n);
+			void (*addScalar)(const double* a, double sc, double* out, std::size_t n);
+			void (*mulScalar)(const double* a, double sc, double* out, std::size_t n);
+			void (*divScalar)(const double* a, double sc, double* out, std::size_t n);
+			// out += a * sc, rounding the product before the sum (no fused multiply-add)
+			void (*axpy)(const double* a, double sc, double* out, std::size_t n);
+			void (*sum)(const double* a, std::size_t n, double* state);
+			void (*sumSquares)(const double* a, std::size_t n, double* state);
+			void (*min)(const double* a, std::size_t n, double* state);
+			void (*max)(const double* a, std::size_t n, double* state);
+		};
+
+		/**
+		 * @brief Best instruction set supported by the running CPU
+		 * @return Detected instruction set
+		 */
+		Isa detectIsa();
+
+		/**
+		 * @brief Checks whether the running CPU can execute the given instruction set
+		 * @param isa Instruction set to check
+		 * @return True if the kernels for isa may be used
+		 */
+		bool isaSupported(Isa isa);
+
+		/**
+		 * @brief Overrides the instruction set used by kernels()
+		 * @param isa Instruction set to use; must be supported
+		 */
+		void setIsa(Isa isa);
+
+		/**
+		 * @brief Instruction set currently selected by kernels()
+		 * @return Active instruction set
+		 */
+		Isa activeIsa();
+
+		/**
+		 * @brief Kernel table for the active instruction set
+		 * @return Reference to the dispatch table
+		 */
+		const Kernels& kernels();
+
+		/**
+		 * @brief Kernel table for a specific instruction set
+		 * @param isa Instruction set; must be supported
+		 * @return Reference to the dispatch table
+		 */
+		const Kernels& kernels(Isa isa);
+	}
+}
+#endif
@@ -0,0 +1,117 @@
+// ey.gellis@gmail.com
+#include "lu.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace matrix;
+
+LUDecomposition::LUDecomposition(const SquareMat& mat) : factors(mat), perm(mat.dim()), parity(1), singular(false) {
+	const int n = factors.dim();
+	for (int i = 0; i < n; ++i)
+		perm[i] = i;
+
+	for (int k = 0; k < n; ++k) {
+		int pivot = k;
+		double best = std::fabs(factors[k][k]);
+		for (int i = k + 1; i < n; ++i) {
+			double candidate = std::fabs(factors[i][k]);
+			if (candidate > best) {
+				best = candidate;
+				pivot = i;
+			}
+		}
+		if (best == 0.0) {
+			singular = true;
+			continue;
+		}
+		if (pivot != k) {
+			RowView<double> a = factors[k];
+			RowView<double> b = factors[pivot];
+			std::swap_ranges(a.begin(), a.end(), b.begin());
+			std::swap(perm[k], perm[pivot]);
+			parity = -parity;
+		}
+
+		const double* rowK = factors[k].data();
+		const double inv = 1.0 / rowK[k];
+		for (int i = k + 1; i < n; ++i) {
+			double* rowI = factors[i].data();
+			const double l = rowI[k] * inv;
+			rowI[k] = l;
+			if (l == 0.0)
+				continue;
+			for (int j = k + 1; j < n; ++j)
+				rowI[j] -= l * rowK[j];
+		}
+	}
+}
+
+double LUDecomposition::determinant() const {
+	if (singular)
+		return 0.0;
+	double det = parity;
+	for (int i = 0; i < factors.dim(); ++i)
+		det *= factors[i][i];
+	return det;
+}
+
+LogDeterminant LUDecomposition::logDeterminant() const {
+	if (singular)
+		return {0, -std::numeric_limits<double>::infinity()};
+	int sign = parity;
+	double logAbs = 0.0;
+	for (int i = 0; i < factors.dim(); ++i) {
+		double u = factors[i][i];
+		if (u < 0.0)
+			sign = -sign;
+		logAbs += std::log(std::fabs(u));
+	}
+	return {sign, logAbs};
+}
+
+SquareMat LUDecomposition::lower() const {
+	const int n = factors.dim();
+	SquareMat l(n);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < i; ++j)
+			l[i][j] = factors[i][j];
+		l[i][i] = 1.0;
+	}
+	return l;
+}
+
+SquareMat LUDecomposition::upper() const {
+	const int n = factors.dim();
+	SquareMat u(n);
+	for (int i = 0; i < n; ++i)
+		for (int j = i; j < n; ++j)
+			u[i][j] = factors[i][j];
+	return u;
+}
+
+std::vector<double> LUDecomposition::solve(const std::vector<double>& rhs) const {
+	const int n = factors.dim();
+	if (rhs.size() != static_cast<std::size_t>(n))
+		throw std::invalid_argument("Right-hand side size must match the matrix");
+	if (singular)
+		throw std::domain_error("Cannot solve with a singular matrix");
+
+	std::vector<double> x(n);
+	for (int i = 0; i < n; ++i) {
+		const double* row = factors[i].data();
+		double v = rhs[perm[i]];
+		for (int j = 0; j < i; ++j)
+			v -= row[j] * x[j];
+		x[i] = v;
+	}
+	for (int i = n - 1; i >= 0; --i) {
+		const double* row = factors[i].data();
+		double v = x[i];
+		for (int j = i + 1; j < n; ++j)
+			v -= row[j] * x[j];
+		x[i] = v / row[i];
+	}
+	return x;
+}
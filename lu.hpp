@@ -0,0 +1,88 @@
+// ey.gellis@gmail.com
+#ifndef LU_H
+#define LU_H
+
+#include "squaremat.hpp"
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief Sign and natural log of |det|, which stays finite where det itself
+	 * would overflow or underflow
+	 */
+	struct LogDeterminant {
+		int sign;      // -1, 0 or +1
+		double logAbs; // log(|det|); -infinity when sign is 0
+	};
+
+	/**
+	 * @brief Partial-pivoting LU factorization P * A = L * U
+	 *
+	 * L (unit diagonal, below the diagonal) and U (on and above it) share a single
+	 * n x n buffer that is allocated once; factoring performs no further allocation.
+	 */
+	class LUDecomposition {
+	private:
+		SquareMat factors;
+		std::vector<int> perm;
+		int parity;
+		bool singular;
+
+	public:
+		/**
+		 * @brief Factors the given matrix in O(n^3)
+		 * @param mat Matrix to factor
+		 */
+		explicit LUDecomposition(const SquareMat& mat);
+
+		/**
+		 * @brief Determinant computed as the signed product of U's diagonal
+		 * @return Determinant value
+		 */
+		double determinant() const;
+
+		/**
+		 * @brief Determinant as sign and log magnitude
+		 * @return Sign and log(|det|)
+		 */
+		LogDeterminant logDeterminant() const;
+
+		/**
+		 * @brief Whether an exactly zero pivot was encountered
+		 * @return True if the matrix is singular
+		 */
+		bool isSingular() const { return singular; }
+
+		/**
+		 * @brief Combined factors: strictly lower part is L, upper part is U
+		 * @return Reference to the packed factors
+		 */
+		const SquareMat& packed() const { return factors; }
+
+		/**
+		 * @brief Unit lower-triangular factor
+		 * @return L as a full matrix
+		 */
+		SquareMat lower() const;
+
+		/**
+		 * @brief Upper-triangular factor
+		 * @return U as a full matrix
+		 */
+		SquareMat upper() const;
+
+		/**
+		 * @brief Row permutation: row i of P * A is row permutation()[i] of A
+		 * @return Permutation vector
+		 */
+		const std::vector<int>& permutation() const { return perm; }
+
+		/**
+		 * @brief Solves A * x = rhs using the stored factors
+		 * @param rhs Right-hand side of length n
+		 * @return Solution vector
+		 */
+		std::vector<double> solve(const std::vector<double>& rhs) const;
+	};
+}
+#endif
@@ -0,0 +1,344 @@
+// ey.gellis@gmail.com
+#include "modmat.hpp"
+#include "kernels.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace matrix;
+
+namespace {
+	using u128 = unsigned __int128;
+
+	// Moduli below this use the vector path: two reduced products sum below 2^64
+	constexpr std::uint64_t VECTOR_MODULUS = std::uint64_t(1) << 31;
+	// Product blocking, as in basicmat.cpp
+	constexpr int DEPTH_BLOCK = 256;
+	constexpr int COLUMN_BLOCK = 512;
+
+	/**
+	 * @brief Remainders of 128-bit values below modulus * 2^64
+	 *
+	 * Möller and Granlund's division by an invariant integer: the modulus is
+	 * shifted until its top bit is set, and a precomputed reciprocal turns each
+	 * remainder into two multiplications and at most two corrections.
+	 */
+	class Reducer {
+	private:
+		std::uint64_t divisor;
+		std::uint64_t reciprocal;
+		int shift;
+
+	public:
+		explicit Reducer(std::uint64_t modulus) : shift(__builtin_clzll(modulus)) {
+			divisor = modulus << shift;
+			// floor((2^128 - 1) / divisor) - 2^64
+			reciprocal = static_cast<std::uint64_t>(((static_cast<u128>(~divisor) << 64) | ~std::uint64_t(0)) / divisor);
+		}
+
+		std::uint64_t reduce(u128 x) const {
+			const u128 u = x << shift;
+			const std::uint64_t high = static_cast<std::uint64_t>(u >> 64);
+			const std::uint64_t low = static_cast<std::uint64_t>(u);
+			const u128 q = static_cast<u128>(reciprocal) * high + ((static_cast<u128>(high + 1) << 64) | low);
+			std::uint64_t r = low - static_cast<std::uint64_t>(q >> 64) * divisor;
+			if (r > static_cast<std::uint64_t>(q))
+				r += divisor;
+			if (r >= divisor)
+				r -= divisor;
+			return r >> shift;
+		}
+	};
+
+	/**
+	 * @brief c += s * b with every lane kept below m2 = modulus^2
+	 *
+	 * Inputs are residues below 2^31, so each product fits in 62 bits and a
+	 * lane plus a product never wraps; subtracting m2 when a lane reaches it
+	 * keeps the invariant without dividing.
+	 */
+	void modAxpyBase(std::uint64_t* c, const std::uint64_t* b, std::uint64_t s, std::uint64_t m2, std::size_t n) {
+		typedef std::uint64_t V __attribute__((vector_size(16)));
+		std::size_t j = 0;
+		for (; j + 2 <= n; j += 2) {
+			V x, y;
+			__builtin_memcpy(&x, c + j, sizeof(V));
+			__builtin_memcpy(&y, b + j, sizeof(V));
+			x += s * y;
+			x = x >= m2 ? x - m2 : x;
+			__builtin_memcpy(c + j, &x, sizeof(V));
+		}
+		for (; j < n; ++j) {
+			const std::uint64_t x = c[j] + s * b[j];
+			c[j] = x >= m2 ? x - m2 : x;
+		}
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	// The vector paths multiply with mul_epu32, which forms exact 64-bit
+	// products of the low 32 bits; a full 64-bit multiply is several times slower.
+	// Lanes stay below 2^63, so AVX2's signed comparison orders them correctly.
+	__attribute__((target("avx2"))) void modAxpyAvx2(std::uint64_t* c, const std::uint64_t* b, std::uint64_t s,
+		std::uint64_t m2, std::size_t n) {
+		const __m256i scale = _mm256_set1_epi64x(static_cast<long long>(s));
+		const __m256i limit = _mm256_set1_epi64x(static_cast<long long>(m2));
+		std::size_t j = 0;
+		for (; j + 4 <= n; j += 4) {
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + j));
+			const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+			x = _mm256_add_epi64(x, _mm256_mul_epu32(y, scale));
+			const __m256i below = _mm256_cmpgt_epi64(limit, x);
+			x = _mm256_blendv_epi8(_mm256_sub_epi64(x, limit), x, below);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(c + j), x);
+		}
+		_mm256_zeroupper();
+		modAxpyBase(c + j, b + j, s, m2, n - j);
+	}
+
+	__attribute__((target("avx512f"))) void modAxpyAvx512(std::uint64_t* c, const std::uint64_t* b, std::uint64_t s,
+		std::uint64_t m2, std::size_t n) {
+		const __m512i scale = _mm512_set1_epi64(static_cast<long long>(s));
+		const __m512i limit = _mm512_set1_epi64(static_cast<long long>(m2));
+		std::size_t j = 0;
+		for (; j + 8 <= n; j += 8) {
+			__m512i x = _mm512_loadu_si512(c + j);
+			// The zero-masked form sidesteps a GCC 12 uninitialized warning on the
+			// unmasked intrinsic's undefined passthrough
+			x = _mm512_add_epi64(x, _mm512_maskz_mul_epu32(0xff, _mm512_loadu_si512(b + j), scale));
+			x = _mm512_mask_sub_epi64(x, _mm512_cmpge_epu64_mask(x, limit), x, limit);
+			_mm512_storeu_si512(c + j, x);
+		}
+		_mm256_zeroupper();
+		modAxpyBase(c + j, b + j, s, m2, n - j);
+	}
+#endif
+
+	using ModAxpy = void (*)(std::uint64_t*, const std::uint64_t*, std::uint64_t, std::uint64_t, std::size_t);
+
+	ModAxpy modAxpy() {
+		switch (detail::activeIsa()) {
+#if defined(__x86_64__) || defined(__i386__)
+		case detail::Isa::AVX512:
+			return modAxpyAvx512;
+		case detail::Isa::AVX2:
+			return modAxpyAvx2;
+#endif
+		default:
+			return modAxpyBase;
+		}
+	}
+
+	/**
+	 * @brief Rows [first, last) of c = a * b mod m for m below VECTOR_MODULUS
+	 */
+	void multiplyVector(int n, std::uint64_t m, const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* c,
+		int first, int last) {
+		const ModAxpy axpy = modAxpy();
+		const std::uint64_t m2 = m * m;
+		for (int jj = 0; jj < n; jj += COLUMN_BLOCK) {
+			const std::size_t width = static_cast<std::size_t>(std::min(COLUMN_BLOCK, n - jj));
+			for (int kk = 0; kk < n; kk += DEPTH_BLOCK) {
+				const int kEnd = std::min(kk + DEPTH_BLOCK, n);
+				for (int i = first; i < last; ++i) {
+					const std::uint64_t* ai = a + static_cast<std::size_t>(i) * n;
+					std::uint64_t* ci = c + static_cast<std::size_t>(i) * n + jj;
+					for (int k = kk; k < kEnd; ++k)
+						axpy(ci, b + static_cast<std::size_t>(k) * n + jj, ai[k], m2, width);
+				}
+			}
+		}
+		for (int i = first; i < last; ++i) {
+			std::uint64_t* ci = c + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < n; ++j)
+				ci[j] %= m;
+		}
+	}
+
+	/**
+	 * @brief Rows [first, last) of c = a * b mod m for any supported m
+	 *
+	 * Each row segment accumulates in 128 bits. A reduced lane plus chunk
+	 * products stays below m * 2^64, the reducer's input bound, as long as
+	 * chunk * m + 1 <= 2^64.
+	 */
+	void multiplyWide(int n, std::uint64_t m, const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* c,
+		int first, int last) {
+		const Reducer reducer(m);
+		const std::uint64_t chunk = (~std::uint64_t(0) - 1) / m;
+		std::vector<u128> acc(static_cast<std::size_t>(std::min(COLUMN_BLOCK, n)));
+		for (int i = first; i < last; ++i) {
+			const std::uint64_t* ai = a + static_cast<std::size_t>(i) * n;
+			for (int jj = 0; jj < n; jj += COLUMN_BLOCK) {
+				const int width = std::min(COLUMN_BLOCK, n - jj);
+				std::fill(acc.begin(), acc.begin() + width, 0);
+				std::uint64_t pending = 0;
+				for (int k = 0; k < n; ++k) {
+					const u128 s = ai[k];
+					const std::uint64_t* bk = b + static_cast<std::size_t>(k) * n + jj;
+					for (int j = 0; j < width; ++j)
+						acc[j] += s * bk[j];
+					if (++pending == chunk) {
+						for (int j = 0; j < width; ++j)
+							acc[j] = reducer.reduce(acc[j]);
+						pending = 0;
+					}
+				}
+				std::uint64_t* ci = c + static_cast<std::size_t>(i) * n + jj;
+				for (int j = 0; j < width; ++j)
+					ci[j] = reducer.reduce(acc[j]);
+			}
+		}
+	}
+
+	void multiply(int n, std::uint64_t m, const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* c) {
+		const bool vector = m < VECTOR_MODULUS;
+		if (vector)
+			std::fill(c, c + static_cast<std::size_t>(n) * n, 0);
+		const auto rows = [&](int first, int last) {
+			if (vector)
+				multiplyVector(n, m, a, b, c, first, last);
+			else
+				multiplyWide(n, m, a, b, c, first, last);
+		};
+		detail::forRows(n, rows);
+	}
+
+	std::uint64_t residue(std::int64_t value, std::uint64_t m) {
+		if (value >= 0)
+			return static_cast<std::uint64_t>(value) % m;
+		// Magnitude as unsigned avoids overflow at the minimum int64
+		const std::uint64_t r = (std::uint64_t(0) - static_cast<std::uint64_t>(value)) % m;
+		return r == 0 ? 0 : m - r;
+	}
+
+	void checkModulus(std::uint64_t modulus) {
+		if (modulus == 0 || modulus > ModMat::maxModulus)
+			throw std::invalid_argument("Modulus must be in [1, 2^63]");
+	}
+}
+
+namespace matrix {
+	ModMat::ModMat(int n, std::uint64_t modulus) : values(currentResource()), size(n), mod(modulus) {
+		if (n <= 0)
+			throw std::invalid_argument("Matrix size is not > 0");
+		checkModulus(modulus);
+		values.assign(static_cast<std::size_t>(n) * n, 0);
+	}
+
+	ModMat::ModMat(const SquareMat& mat, std::uint64_t modulus) : ModMat(mat.dim(), modulus) {
+		const double* in = mat[0].data();
+		for (std::size_t i = 0; i < values.size(); ++i) {
+			const double x = in[i];
+			// -2^63 converts exactly; 2^63 does not fit
+			if (std::floor(x) != x || x < -9223372036854775808.0 || x >= 9223372036854775808.0)
+				throw std::invalid_argument("Matrix elements must be integers below 2^63 in magnitude");
+			values[i] = residue(static_cast<std::int64_t>(x), mod);
+		}
+	}
+
+	ModMat::ModMat(const BasicSquareMat<std::int64_t>& mat, std::uint64_t modulus) : ModMat(mat.dim(), modulus) {
+		const std::int64_t* in = mat[0].data();
+		for (std::size_t i = 0; i < values.size(); ++i)
+			values[i] = residue(in[i], mod);
+	}
+
+	ModMat::ModMat(const ModMat& other) : values(other.values, currentResource()), size(other.size), mod(other.mod) {}
+
+	void ModMat::requireCompatible(const ModMat& b) const {
+		if (size != b.size)
+			throw std::invalid_argument("Matrix sizes must match");
+		if (mod != b.mod)
+			throw std::invalid_argument("Matrix moduli must match");
+	}
+
+	RowView<const std::uint64_t> ModMat::operator[](int index) const {
+		if (index < 0 || index >= size)
+			throw std::out_of_range("Row index out of range");
+		return RowView<const std::uint64_t>(values.data() + static_cast<std::size_t>(index) * size, size);
+	}
+
+	void ModMat::set(int i, int j, std::int64_t value) {
+		if (i < 0 || i >= size || j < 0 || j >= size)
+			throw std::out_of_range("Element index out of range");
+		values[static_cast<std::size_t>(i) * size + j] = residue(value, mod);
+	}
+
+	ModMat ModMat::operator+(const ModMat& b) const {
+		requireCompatible(b);
+		ModMat result(size, mod);
+		for (std::size_t i = 0; i < values.size(); ++i) {
+			// Both residues are below 2^63, so the sum cannot wrap
+			const std::uint64_t x = values[i] + b.values[i];
+			result.values[i] = x >= mod ? x - mod : x;
+		}
+		return result;
+	}
+
+	ModMat ModMat::operator-(const ModMat& b) const {
+		requireCompatible(b);
+		ModMat result(size, mod);
+		for (std::size_t i = 0; i < values.size(); ++i)
+			result.values[i] = values[i] >= b.values[i] ? values[i] - b.values[i] : values[i] + (mod - b.values[i]);
+		return result;
+	}
+
+	ModMat ModMat::operator*(const ModMat& b) const {
+		requireCompatible(b);
+		ModMat result(size, mod);
+		multiply(size, mod, values.data(), b.values.data(), result.values.data());
+		return result;
+	}
+
+	ModMat ModMat::operator^(unsigned long long exponent) const {
+		ModMat result(size, mod);
+		if (exponent == 0) {
+			for (int i = 0; i < size; ++i)
+				result.values[static_cast<std::size_t>(i) * (size + 1)] = 1 % mod;
+			return result;
+		}
+		result.values = values;
+		if (exponent == 1)
+			return result;
+		// Left-to-right square-and-multiply between result and one workspace
+		ModMat work(size, mod);
+		int bit = 63 - __builtin_clzll(exponent);
+		for (--bit; bit >= 0; --bit) {
+			multiply(size, mod, result.values.data(), result.values.data(), work.values.data());
+			result.values.swap(work.values);
+			if (exponent >> bit & 1u) {
+				multiply(size, mod, result.values.data(), values.data(), work.values.data());
+				result.values.swap(work.values);
+			}
+		}
+		return result;
+	}
+
+	SquareMat ModMat::toSquareMat() const {
+		if (mod > (std::uint64_t(1) << 53))
+			throw std::domain_error("Residues above 2^53 are not exact in double");
+		SquareMat result(size);
+		double* out = result[0].data();
+		for (std::size_t i = 0; i < values.size(); ++i)
+			out[i] = static_cast<double>(values[i]);
+		return result;
+	}
+
+	BasicSquareMat<std::int64_t> ModMat::toInt64() const {
+		BasicSquareMat<std::int64_t> result(size);
+		std::int64_t* out = result[0].data();
+		for (std::size_t i = 0; i < values.size(); ++i)
+			out[i] = static_cast<std::int64_t>(values[i]);
+		return result;
+	}
+
+	SquareMat SquareMat::powMod(unsigned long long exponent, std::uint64_t modulus) const {
+		if (modulus > (std::uint64_t(1) << 53))
+			throw std::invalid_argument("Modulus must be at most 2^53 for a double result");
+		return (ModMat(*this, modulus) ^ exponent).toSquareMat();
+	}
+}
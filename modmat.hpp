@@ -0,0 +1,120 @@
+// ey.gellis@gmail.com
+#ifndef MODMAT_H
+#define MODMAT_H
+
+#include "squaremat.hpp"
+#include "basicmat.hpp"
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief Square matrix of residues modulo a fixed modulus
+	 *
+	 * Elements are kept in [0, modulus) and every operation reduces as it goes,
+	 * so products and powers are exact at any exponent. Moduli below 2^31 use
+	 * vector kernels whose lanes fold each accumulated product back below
+	 * modulus^2; larger moduli, up to 2^63, accumulate products in 128 bits and
+	 * reduce with a precomputed reciprocal (Barrett-style division by an
+	 * invariant). Operands of binary operators must share size and modulus.
+	 */
+	class ModMat {
+	private:
+		std::pmr::vector<std::uint64_t> values;
+		int size;
+		std::uint64_t mod;
+
+		void requireCompatible(const ModMat& b) const;
+
+	public:
+		/**
+		 * @brief Largest supported modulus
+		 */
+		static constexpr std::uint64_t maxModulus = std::uint64_t(1) << 63;
+
+		/**
+		 * @brief Creates a zero matrix
+		 * @param n Matrix dimension
+		 * @param modulus Modulus in [1, maxModulus]
+		 */
+		ModMat(int n, std::uint64_t modulus);
+
+		/**
+		 * @brief Reduces an integer-valued double matrix
+		 * @param mat Matrix whose elements are integers of magnitude below 2^63
+		 * @param modulus Modulus in [1, maxModulus]
+		 */
+		ModMat(const SquareMat& mat, std::uint64_t modulus);
+
+		/**
+		 * @brief Reduces an integer matrix; negative elements map to their residues
+		 * @param mat Matrix to reduce
+		 * @param modulus Modulus in [1, maxModulus]
+		 */
+		ModMat(const BasicSquareMat<std::int64_t>& mat, std::uint64_t modulus);
+
+		ModMat(const ModMat& other);
+		ModMat(ModMat&& other) noexcept = default;
+		ModMat& operator=(const ModMat& other) = default;
+		ModMat& operator=(ModMat&& other) noexcept = default;
+
+		int dim() const { return size; }
+
+		std::uint64_t modulus() const { return mod; }
+
+		/**
+		 * @brief Read-only row access; use set() to write
+		 * @param index Row index
+		 * @return View of the row's residues
+		 */
+		RowView<const std::uint64_t> operator[](int index) const;
+
+		/**
+		 * @brief Stores the residue of value at (i, j)
+		 * @param i Row index
+		 * @param j Column index
+		 * @param value Any integer; negative values map to their residues
+		 */
+		void set(int i, int j, std::int64_t value);
+
+		ModMat operator+(const ModMat& b) const;
+		ModMat operator-(const ModMat& b) const;
+
+		/**
+		 * @brief Modular product, reduced during accumulation
+		 * @param b Matrix to multiply with
+		 * @return Product modulo modulus()
+		 */
+		ModMat operator*(const ModMat& b) const;
+
+		/**
+		 * @brief Modular power by square-and-multiply
+		 * @param exponent Exponent; 0 gives the identity
+		 * @return Power modulo modulus()
+		 */
+		ModMat operator^(unsigned long long exponent) const;
+
+		/**
+		 * @brief Checks element-wise equality of residues and moduli
+		 */
+		bool operator==(const ModMat& b) const { return size == b.size && mod == b.mod && values == b.values; }
+		bool operator!=(const ModMat& b) const { return !(*this == b); }
+
+		/**
+		 * @brief Residues as a double matrix
+		 *
+		 * Throws std::domain_error if the modulus exceeds 2^53, past which not
+		 * every residue is representable.
+		 * @return Matrix with elements in [0, modulus)
+		 */
+		SquareMat toSquareMat() const;
+
+		/**
+		 * @brief Residues as an int64 matrix
+		 * @return Matrix with elements in [0, modulus)
+		 */
+		BasicSquareMat<std::int64_t> toInt64() const;
+	};
+}
+#endif
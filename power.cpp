@@ -0,0 +1,231 @@
+// ey.gellis@gmail.com
+#include "power.hpp"
+#include "strassen.hpp"
+#include "structured.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using namespace matrix::detail;
+
+namespace {
+	// Exponents up to this may use Knuth's power tree
+	constexpr unsigned int TREE_LIMIT = 1024;
+	// Buffers a chain keeps intermediate powers in: out and the two workspaces
+	constexpr int BUFFERS = 3;
+
+	/**
+	 * @brief Addition chain for a^p
+	 *
+	 * Element 0 is a itself and step k computes element k + 1 as the product of
+	 * elements steps[k].first and steps[k].second; the last element is a^p.
+	 */
+	struct Chain {
+		std::vector<std::pair<int, int>> steps;
+		// Buffer holding each element, assigned by allocate(); unused for element 0
+		std::vector<int> slot;
+
+		int add(int left, int right) {
+			steps.emplace_back(left, right);
+			return static_cast<int>(steps.size());
+		}
+	};
+
+	/**
+	 * @brief Parent of every exponent in Knuth's power tree, built once
+	 *
+	 * The path from the root to p is an addition chain for p; it is optimal for
+	 * every p below 77 and close to optimal beyond.
+	 */
+	const std::vector<unsigned int>& powerTree() {
+		static const std::vector<unsigned int> parent = [] {
+			std::vector<unsigned int> tree(TREE_LIMIT + 1, 0);
+			std::vector<unsigned int> level{1}, next, path;
+			std::size_t found = 1;
+			while (found < TREE_LIMIT) {
+				next.clear();
+				for (unsigned int node : level) {
+					path.clear();
+					for (unsigned int e = node; e != 0; e = tree[e])
+						path.push_back(e);
+					for (auto it = path.rbegin(); it != path.rend(); ++it) {
+						const unsigned int child = node + *it;
+						if (child <= TREE_LIMIT && tree[child] == 0) {
+							tree[child] = node;
+							next.push_back(child);
+							++found;
+						}
+					}
+				}
+				level.swap(next);
+			}
+			return tree;
+		}();
+		return parent;
+	}
+
+	Chain treeChain(unsigned int p) {
+		const std::vector<unsigned int>& parent = powerTree();
+		std::vector<unsigned int> path;
+		for (unsigned int e = p; e != 0; e = parent[e])
+			path.push_back(e);
+		std::reverse(path.begin(), path.end());
+
+		Chain chain;
+		for (std::size_t k = 1; k < path.size(); ++k) {
+			const unsigned int other = path[k] - path[k - 1];
+			const int j = static_cast<int>(std::find(path.begin(), path.end(), other) - path.begin());
+			chain.add(static_cast<int>(k - 1), j);
+		}
+		return chain;
+	}
+
+	/**
+	 * @brief Left-to-right binary chain, or sliding windows of width 2 over the
+	 * odd digits 1 and 3 when window is set
+	 */
+	Chain windowChain(unsigned int p, bool window) {
+		Chain chain;
+		int cube = -1;
+		int cur = -1;
+		for (int i = 31 - __builtin_clz(p); i >= 0;) {
+			if (!(p >> i & 1)) {
+				cur = chain.add(cur, cur);
+				--i;
+				continue;
+			}
+			const int width = window && i >= 1 && (p >> (i - 1) & 1) ? 2 : 1;
+			int digit = 0;
+			if (width == 2) {
+				if (cube < 0)
+					cube = chain.add(chain.add(0, 0), 0);
+				digit = cube;
+			}
+			if (cur < 0) {
+				cur = digit;
+			} else {
+				for (int w = 0; w < width; ++w)
+					cur = chain.add(cur, cur);
+				cur = chain.add(cur, digit);
+			}
+			i -= width;
+		}
+		return chain;
+	}
+
+	/**
+	 * @brief Assigns every element a buffer, reusing those whose element is no
+	 * longer needed
+	 * @return False if the chain needs more than BUFFERS buffers
+	 */
+	bool allocate(Chain& chain) {
+		const int elements = static_cast<int>(chain.steps.size()) + 1;
+		std::vector<int> lastUse(elements, -1);
+		for (int k = 0; k < elements - 1; ++k) {
+			lastUse[chain.steps[k].first] = k;
+			lastUse[chain.steps[k].second] = k;
+		}
+		lastUse[elements - 1] = elements;
+
+		chain.slot.assign(elements, -1);
+		int holder[BUFFERS];
+		std::fill(holder, holder + BUFFERS, 0);
+		for (int k = 0; k < elements - 1; ++k) {
+			int free = 0;
+			while (free < BUFFERS && holder[free] != 0 && lastUse[holder[free]] >= k)
+				++free;
+			if (free == BUFFERS)
+				return false;
+			holder[free] = k + 1;
+			chain.slot[k + 1] = free;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Cheapest chain for p that fits in the buffers
+	 */
+	Chain plan(unsigned int p) {
+		Chain best = windowChain(p, false);
+		allocate(best);
+		Chain candidate = windowChain(p, true);
+		if (candidate.steps.size() < best.steps.size() && allocate(candidate))
+			best = std::move(candidate);
+		if (p <= TREE_LIMIT) {
+			candidate = treeChain(p);
+			if (candidate.steps.size() < best.steps.size() && allocate(candidate))
+				best = std::move(candidate);
+		}
+		return best;
+	}
+}
+
+namespace matrix {
+	namespace detail {
+		Structure structure(int n, const double* a) {
+			bool upper = true;
+			bool lower = true;
+			for (int i = 0; i < n && (upper || lower); ++i) {
+				const double* row = a + static_cast<std::size_t>(i) * n;
+				for (int j = 0; upper && j < i; ++j)
+					upper = row[j] == 0.0;
+				for (int j = i + 1; lower && j < n; ++j)
+					lower = row[j] == 0.0;
+			}
+			if (upper && lower)
+				return Structure::Diagonal;
+			if (upper)
+				return Structure::Upper;
+			return lower ? Structure::Lower : Structure::General;
+		}
+
+		int powerProducts(unsigned int p) {
+			return static_cast<int>(plan(p).steps.size());
+		}
+
+		void power(int n, const double* a, Structure s, unsigned int p, double* out, double* work1, double* work2) {
+			const std::size_t count = static_cast<std::size_t>(n) * n;
+			if (s == Structure::Diagonal) {
+				std::fill(out, out + count, 0.0);
+				for (int i = 0; i < n; ++i)
+					out[i * (n + std::size_t(1))] = std::pow(a[i * (n + std::size_t(1))], p);
+				return;
+			}
+			if (s != Structure::General && p >= static_cast<unsigned int>(n)) {
+				bool strict = true;
+				for (int i = 0; strict && i < n; ++i)
+					strict = a[i * (n + std::size_t(1))] == 0.0;
+				// A strictly triangular matrix is nilpotent: its n-th power is zero
+				if (strict) {
+					std::fill(out, out + count, 0.0);
+					return;
+				}
+			}
+			if (p == 1) {
+				std::copy(a, a + count, out);
+				return;
+			}
+
+			// The buffer holding the final power becomes out, so no copy is needed
+			const Chain chain = plan(p);
+			double* buffers[BUFFERS];
+			const int last = chain.slot.back();
+			double* spare[] = {work1, work2};
+			for (int b = 0, w = 0; b < BUFFERS; ++b)
+				buffers[b] = b == last ? out : spare[w++];
+			auto at = [&](int e) { return e == 0 ? a : static_cast<const double*>(buffers[chain.slot[e]]); };
+
+			for (std::size_t k = 0; k < chain.steps.size(); ++k) {
+				const double* left = at(chain.steps[k].first);
+				const double* right = at(chain.steps[k].second);
+				double* dst = buffers[chain.slot[k + 1]];
+				if (s == Structure::General)
+					multiply(n, left, right, dst);
+				else
+					structuredProduct(n, s, left, s, right, dst);
+			}
+		}
+	}
+}
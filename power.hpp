@@ -0,0 +1,55 @@
+// ey.gellis@gmail.com
+#ifndef POWER_H
+#define POWER_H
+
+namespace matrix {
+	namespace detail {
+		/**
+		 * @brief Zero pattern of a matrix, as far as powers are concerned
+		 */
+		enum class Structure {
+			General,
+			Diagonal, // Includes the identity and the zero matrix
+			Upper,    // Upper triangular
+			Lower     // Lower triangular
+		};
+
+		/**
+		 * @brief Classifies a matrix by which off-diagonal elements are zero
+		 * @param n Matrix dimension
+		 * @param a Row-major elements
+		 * @return Most specific structure that applies
+		 */
+		Structure structure(int n, const double* a);
+
+		/**
+		 * @brief Number of products power() performs for exponent p on a dense or
+		 * triangular matrix
+		 *
+		 * The cheapest of binary, width-2 sliding-window and (up to 1024) power-tree
+		 * addition chains that fits in the output plus two workspaces.
+		 * @param p Exponent, at least 1
+		 * @return Number of matrix products
+		 */
+		int powerProducts(unsigned int p);
+
+		/**
+		 * @brief out = a^p for p >= 1
+		 *
+		 * Diagonal matrices are raised element-wise in O(n) and strictly triangular
+		 * ones are zero from p = n on. Otherwise the addition chain of
+		 * powerProducts() is evaluated, with products restricted to the nonzero
+		 * blocks when a is triangular. Intermediate powers live only in out, work1
+		 * and work2.
+		 * @param n Matrix dimension
+		 * @param a Base; must not alias out or the workspaces
+		 * @param s structure(n, a)
+		 * @param p Exponent, at least 1
+		 * @param out Destination, overwritten
+		 * @param work1 n x n workspace; may be null when s is Diagonal
+		 * @param work2 n x n workspace; may be null when s is Diagonal
+		 */
+		void power(int n, const double* a, Structure s, unsigned int p, double* out, double* work1, double* work2);
+	}
+}
+#endif
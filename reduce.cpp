@@ -0,0 +1,148 @@
+// ey.gellis@gmail.com
+#include "reduce.hpp"
+#include "kernels.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace matrix::detail;
+
+namespace {
+	// Elements reduced per block; a multiple of REDUCE_LANES, and part of the
+	// result's definition, so it must not depend on the thread count
+	constexpr std::size_t BLOCK = 4096;
+	// Ranges of fewer elements are reduced serially
+	constexpr std::size_t PARALLEL_ELEMENTS = std::size_t(1) << 18;
+	// Strided elements gathered per kernel call
+	constexpr std::size_t GATHER = 256;
+	// Elements allFinite() checks between early exits
+	constexpr std::size_t FINITE_CHUNK = 1024;
+	static_assert(BLOCK % REDUCE_LANES == 0 && GATHER % REDUCE_LANES == 0, "Blocks must cover whole lanes");
+
+	/**
+	 * @brief Running reduction state in the layout the kernels expect
+	 */
+	struct LaneState {
+		double v[2 * REDUCE_LANES];
+
+		explicit LaneState(Reduction op) {
+			double init = 0.0;
+			if (op == Reduction::Min)
+				init = std::numeric_limits<double>::infinity();
+			else if (op == Reduction::Max)
+				init = -std::numeric_limits<double>::infinity();
+			std::fill(v, v + REDUCE_LANES, init);
+			std::fill(v + REDUCE_LANES, v + 2 * REDUCE_LANES, 0.0);
+		}
+	};
+
+	double combine(Reduction op, double x, double y) {
+		switch (op) {
+		case Reduction::Min:
+			return y < x ? y : x;
+		case Reduction::Max:
+			return y > x ? y : x;
+		default:
+			return x + y;
+		}
+	}
+
+	/**
+	 * @brief Combines value(first) ... value(last - 1) by recursive halving
+	 */
+	template <typename F>
+	double pairwise(Reduction op, std::size_t first, std::size_t last, const F& value) {
+		if (last - first == 1)
+			return value(first);
+		const std::size_t mid = first + (last - first) / 2;
+		return combine(op, pairwise(op, first, mid, value), pairwise(op, mid, last, value));
+	}
+
+	/**
+	 * @brief Folds the lanes into one value, applying the Kahan compensations
+	 */
+	double finish(Reduction op, const LaneState& state) {
+		const bool compensated = op == Reduction::Sum || op == Reduction::SumSquares;
+		return pairwise(op, 0, REDUCE_LANES, [&](std::size_t l) {
+			return compensated ? state.v[l] - state.v[REDUCE_LANES + l] : state.v[l];
+		});
+	}
+
+	void step(const Kernels& k, Reduction op, const double* a, std::size_t n, LaneState& state) {
+		switch (op) {
+		case Reduction::Sum:
+			k.sum(a, n, state.v);
+			break;
+		case Reduction::SumSquares:
+			k.sumSquares(a, n, state.v);
+			break;
+		case Reduction::Min:
+			k.min(a, n, state.v);
+			break;
+		case Reduction::Max:
+			k.max(a, n, state.v);
+			break;
+		}
+	}
+
+	double reduceBlock(const Kernels& k, Reduction op, const double* a, std::size_t n) {
+		LaneState state(op);
+		step(k, op, a, n, state);
+		return finish(op, state);
+	}
+}
+
+namespace matrix {
+	namespace detail {
+		double reduce(Reduction op, const double* a, std::size_t n) {
+			if (n == 0)
+				return finish(op, LaneState(op));
+			const Kernels& k = kernels();
+			const std::size_t blocks = (n + BLOCK - 1) / BLOCK;
+			auto block = [&](std::size_t b) {
+				return reduceBlock(k, op, a + b * BLOCK, std::min(BLOCK, n - b * BLOCK));
+			};
+			if (n < PARALLEL_ELEMENTS || threadCount() == 1)
+				return pairwise(op, 0, blocks, block);
+
+			// Each task reduces a contiguous run of blocks; only the schedule
+			// depends on the thread count, not the combination tree
+			std::vector<double> values(blocks);
+			const int tasks = static_cast<int>(std::min<std::size_t>(blocks, static_cast<std::size_t>(threadCount()) * 4));
+			parallelFor(tasks, [&](int task) {
+				const std::size_t first = blocks * task / tasks;
+				const std::size_t last = blocks * (task + 1) / tasks;
+				for (std::size_t b = first; b < last; ++b)
+					values[b] = block(b);
+			});
+			return pairwise(op, 0, blocks, [&](std::size_t b) { return values[b]; });
+		}
+
+		double reduceStrided(Reduction op, const double* a, std::size_t n, std::size_t stride) {
+			const Kernels& k = kernels();
+			LaneState state(op);
+			double gathered[GATHER];
+			for (std::size_t first = 0; first < n; first += GATHER) {
+				const std::size_t count = std::min(GATHER, n - first);
+				for (std::size_t i = 0; i < count; ++i)
+					gathered[i] = a[(first + i) * stride];
+				step(k, op, gathered, count, state);
+			}
+			return finish(op, state);
+		}
+
+		bool allFinite(const double* a, std::size_t n) {
+			for (std::size_t first = 0; first < n; first += FINITE_CHUNK) {
+				const std::size_t last = std::min(first + FINITE_CHUNK, n);
+				bool finite = true;
+				for (std::size_t i = first; i < last; ++i)
+					finite &= std::isfinite(a[i]);
+				if (!finite)
+					return false;
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+// ey.gellis@gmail.com
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <cstddef>
+
+namespace matrix {
+	namespace detail {
+		/**
+		 * @brief Reductions computed by reduce()
+		 */
+		enum class Reduction {
+			Sum,        // Compensated sum
+			SumSquares, // Compensated sum of squares
+			Min,        // Smallest element, NaNs skipped
+			Max         // Largest element, NaNs skipped
+		};
+
+		/**
+		 * @brief Reduces n contiguous doubles with the SIMD reduction kernels
+		 *
+		 * The range is cut into fixed blocks that are reduced independently (on the
+		 * thread pool for large ranges) and combined pairwise in a fixed tree, so
+		 * the result depends neither on the thread count nor on the instruction set.
+		 * @param op Reduction to compute
+		 * @param a First element
+		 * @param n Number of elements
+		 * @return Reduced value; 0 or the infinity min/max start from if n is 0
+		 */
+		double reduce(Reduction op, const double* a, std::size_t n);
+
+		/**
+		 * @brief Reduces n doubles spaced stride elements apart, e.g. a diagonal
+		 * @param op Reduction to compute
+		 * @param a First element
+		 * @param n Number of elements
+		 * @param stride Distance between consecutive elements
+		 * @return Reduced value
+		 */
+		double reduceStrided(Reduction op, const double* a, std::size_t n, std::size_t stride);
+
+		/**
+		 * @brief Whether none of n contiguous doubles is infinite or NaN
+		 *
+		 * Checked without branches a chunk at a time, stopping after the first
+		 * chunk that has one.
+		 * @param a First element
+		 * @param n Number of elements
+		 * @return True if every element is finite
+		 */
+		bool allFinite(const double* a, std::size_t n);
+	}
+}
+#endif
@@ -0,0 +1,469 @@
+// ey.gellis@gmail.com
+#include "sparsemat.hpp"
+#include "kernels.hpp"
+#include "reduce.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+
+using namespace matrix;
+
+namespace {
+	// Sparse-dense products beat the packed GEMM up to about half density here,
+	// dense-sparse ones (scalar gathers) up to about 0.3
+	std::atomic<double> sparseDensity{0.2};
+
+	using Offsets = std::pmr::vector<std::size_t>;
+	using Indices = std::pmr::vector<int>;
+	using Values = std::pmr::vector<double>;
+
+	/**
+	 * @brief Compresses the nonzeros of a row-major matrix
+	 *
+	 * Both layouts are filled in one row-major pass: CSC columns receive their
+	 * rows in increasing order, so no sorting is needed.
+	 */
+	void compress(int n, const double* a, SparseLayout layout, Offsets& offsets, Indices& indices, Values& values) {
+		const bool rows = layout == SparseLayout::CSR;
+		offsets.assign(static_cast<std::size_t>(n) + 1, 0);
+		for (int i = 0; i < n; ++i) {
+			const double* ai = a + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < n; ++j)
+				if (ai[j] != 0.0)
+					++offsets[(rows ? i : j) + 1];
+		}
+		for (int k = 0; k < n; ++k)
+			offsets[k + 1] += offsets[k];
+		indices.resize(offsets[n]);
+		values.resize(offsets[n]);
+		std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < n; ++i) {
+			const double* ai = a + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < n; ++j)
+				if (ai[j] != 0.0) {
+					const std::size_t p = next[rows ? i : j]++;
+					indices[p] = rows ? j : i;
+					values[p] = ai[j];
+				}
+		}
+	}
+
+	/**
+	 * @brief Recompresses along the other dimension by counting sort
+	 */
+	void transposeArrays(int n, const Offsets& inOffsets, const Indices& inIndices, const Values& inValues,
+		Offsets& offsets, Indices& indices, Values& values) {
+		offsets.assign(static_cast<std::size_t>(n) + 1, 0);
+		for (int index : inIndices)
+			++offsets[index + 1];
+		for (int k = 0; k < n; ++k)
+			offsets[k + 1] += offsets[k];
+		indices.resize(inIndices.size());
+		values.resize(inValues.size());
+		std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+		for (int k = 0; k < n; ++k)
+			for (std::size_t p = inOffsets[k]; p < inOffsets[k + 1]; ++p) {
+				const std::size_t q = next[inIndices[p]]++;
+				indices[q] = k;
+				values[q] = inValues[p];
+			}
+	}
+
+	/**
+	 * @brief Rows [first, last) of c += A * b for CSR A and row-major b
+	 */
+	void sparseDenseRows(int n, const std::size_t* offsets, const int* indices, const double* values, const double* b,
+		double* c, int first, int last) {
+		const auto axpy = detail::kernels().axpy;
+		for (int i = first; i < last; ++i) {
+			double* ci = c + static_cast<std::size_t>(i) * n;
+			for (std::size_t p = offsets[i]; p < offsets[i + 1]; ++p)
+				axpy(b + static_cast<std::size_t>(indices[p]) * n, values[p], ci, static_cast<std::size_t>(n));
+		}
+	}
+
+	/**
+	 * @brief Rows [first, last) of c = a * B for row-major a and CSC B; each
+	 * element is a dot product gathering from one row of a
+	 */
+	void denseSparseRows(int n, const double* a, const std::size_t* offsets, const int* indices, const double* values,
+		double* c, int first, int last) {
+		for (int i = first; i < last; ++i) {
+			const double* ai = a + static_cast<std::size_t>(i) * n;
+			double* ci = c + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < n; ++j) {
+				double s = 0.0;
+				for (std::size_t p = offsets[j]; p < offsets[j + 1]; ++p)
+					s += ai[indices[p]] * values[p];
+				ci[j] = s;
+			}
+		}
+	}
+
+	/**
+	 * @brief Gustavson's product of two matrices compressed along the same
+	 * dimension: each output row (CSR) scatters scaled rows of b into a dense
+	 * accumulator
+	 *
+	 * For CSC operands the same arrays describe transposes, and since
+	 * (A * B)^T = B^T * A^T, calling with the operands swapped yields the CSC
+	 * product.
+	 */
+	void gustavson(int n, const Offsets& aOffsets, const Indices& aIndices, const Values& aValues,
+		const Offsets& bOffsets, const Indices& bIndices, const Values& bValues, Offsets& offsets, Indices& indices,
+		Values& values) {
+		std::vector<double> acc(static_cast<std::size_t>(n));
+		std::vector<int> mark(static_cast<std::size_t>(n), -1);
+		std::vector<int> touched;
+		offsets.assign(static_cast<std::size_t>(n) + 1, 0);
+		indices.clear();
+		values.clear();
+		for (int i = 0; i < n; ++i) {
+			touched.clear();
+			for (std::size_t p = aOffsets[i]; p < aOffsets[i + 1]; ++p) {
+				const int k = aIndices[p];
+				const double v = aValues[p];
+				for (std::size_t q = bOffsets[k]; q < bOffsets[k + 1]; ++q) {
+					const int j = bIndices[q];
+					if (mark[j] != i) {
+						mark[j] = i;
+						touched.push_back(j);
+						acc[j] = v * bValues[q];
+					} else {
+						acc[j] += v * bValues[q];
+					}
+				}
+			}
+			std::sort(touched.begin(), touched.end());
+			for (int j : touched)
+				if (acc[j] != 0.0) {
+					indices.push_back(j);
+					values.push_back(acc[j]);
+				}
+			offsets[i + 1] = indices.size();
+		}
+	}
+
+	/**
+	 * @brief Whether an n x n matrix has fewer than limit nonzeros
+	 *
+	 * Rows are counted without branches and the limit checked between them, so
+	 * a dense operand is rejected after about limit elements.
+	 */
+	bool sparserThan(int n, const double* x, double limit) {
+		std::size_t nonzeros = 0;
+		for (int i = 0; i < n; ++i) {
+			const double* xi = x + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < n; ++j)
+				nonzeros += xi[j] != 0.0;
+			if (static_cast<double>(nonzeros) >= limit)
+				return false;
+		}
+		return true;
+	}
+}
+
+namespace matrix {
+	void setSparseThreshold(double density) {
+		if (!(density >= 0.0 && density <= 1.0))
+			throw std::invalid_argument("Sparse threshold must be in [0, 1]");
+		sparseDensity.store(density, std::memory_order_relaxed);
+	}
+
+	double sparseThreshold() {
+		return sparseDensity.load(std::memory_order_relaxed);
+	}
+
+	SparseMat::SparseMat(int n, SparseLayout layout)
+		: starts(currentResource()), positions(currentResource()), elements(currentResource()), size(n), order(layout) {
+		if (n <= 0)
+			throw std::invalid_argument("Matrix size is not > 0");
+		starts.assign(static_cast<std::size_t>(n) + 1, 0);
+	}
+
+	SparseMat::SparseMat(const SquareMat& mat, SparseLayout layout) : SparseMat(mat.dim(), layout) {
+		compress(size, mat[0].data(), order, starts, positions, elements);
+	}
+
+	SparseMat::SparseMat(int n, const std::vector<SparseEntry>& entries, SparseLayout layout) : SparseMat(n, layout) {
+		const bool rows = order == SparseLayout::CSR;
+		for (const SparseEntry& e : entries) {
+			if (e.row < 0 || e.row >= n || e.column < 0 || e.column >= n)
+				throw std::out_of_range("Element index out of range");
+			++starts[(rows ? e.row : e.column) + 1];
+		}
+		for (int k = 0; k < n; ++k)
+			starts[k + 1] += starts[k];
+		std::vector<std::pair<int, double>> bucketed(entries.size());
+		std::vector<std::size_t> next(starts.begin(), starts.end() - 1);
+		for (const SparseEntry& e : entries)
+			bucketed[next[rows ? e.row : e.column]++] = {rows ? e.column : e.row, e.value};
+
+		// Sort each row or column, then sum duplicates in the order they were given
+		std::size_t out = 0;
+		for (int k = 0; k < n; ++k) {
+			const auto first = bucketed.begin() + static_cast<std::ptrdiff_t>(starts[k]);
+			const auto last = bucketed.begin() + static_cast<std::ptrdiff_t>(starts[k + 1]);
+			std::stable_sort(first, last, [](const auto& x, const auto& y) { return x.first < y.first; });
+			starts[k] = out;
+			for (auto it = first; it != last;) {
+				const int index = it->first;
+				double value = 0.0;
+				for (; it != last && it->first == index; ++it)
+					value += it->second;
+				if (value != 0.0) {
+					bucketed[out++] = {index, value};
+				}
+			}
+		}
+		starts[n] = out;
+		positions.resize(out);
+		elements.resize(out);
+		for (std::size_t p = 0; p < out; ++p) {
+			positions[p] = bucketed[p].first;
+			elements[p] = bucketed[p].second;
+		}
+	}
+
+	SparseMat::SparseMat(const SparseMat& other)
+		: starts(other.starts, currentResource()), positions(other.positions, currentResource()),
+		  elements(other.elements, currentResource()), size(other.size), order(other.order) {}
+
+	void SparseMat::requireSameSize(int n) const {
+		if (size != n)
+			throw std::invalid_argument("Matrix sizes must match");
+	}
+
+	double SparseMat::at(int i, int j) const {
+		if (i < 0 || i >= size || j < 0 || j >= size)
+			throw std::out_of_range("Element index out of range");
+		const int outer = order == SparseLayout::CSR ? i : j;
+		const int inner = order == SparseLayout::CSR ? j : i;
+		const auto first = positions.begin() + static_cast<std::ptrdiff_t>(starts[outer]);
+		const auto last = positions.begin() + static_cast<std::ptrdiff_t>(starts[outer + 1]);
+		const auto it = std::lower_bound(first, last, inner);
+		return it != last && *it == inner ? elements[static_cast<std::size_t>(it - positions.begin())] : 0.0;
+	}
+
+	SparseMat SparseMat::toLayout(SparseLayout layout) const {
+		if (layout == order)
+			return *this;
+		SparseMat result(size, layout);
+		transposeArrays(size, starts, positions, elements, result.starts, result.positions, result.elements);
+		return result;
+	}
+
+	SquareMat SparseMat::toDense() const {
+		SquareMat result(size);
+		double* out = result[0].data();
+		const bool rows = order == SparseLayout::CSR;
+		for (int k = 0; k < size; ++k)
+			for (std::size_t p = starts[k]; p < starts[k + 1]; ++p) {
+				const std::size_t i = rows ? k : positions[p];
+				const std::size_t j = rows ? positions[p] : k;
+				out[i * size + j] = elements[p];
+			}
+		return result;
+	}
+
+	std::vector<double> SparseMat::operator*(const std::vector<double>& x) const {
+		if (x.size() != static_cast<std::size_t>(size))
+			throw std::invalid_argument("Vector length must match the matrix size");
+		std::vector<double> y(x.size(), 0.0);
+		if (order == SparseLayout::CSR) {
+			for (int i = 0; i < size; ++i) {
+				double s = 0.0;
+				for (std::size_t p = starts[i]; p < starts[i + 1]; ++p)
+					s += elements[p] * x[positions[p]];
+				y[i] = s;
+			}
+		} else {
+			for (int j = 0; j < size; ++j)
+				for (std::size_t p = starts[j]; p < starts[j + 1]; ++p)
+					y[positions[p]] += elements[p] * x[j];
+		}
+		return y;
+	}
+
+	SquareMat SparseMat::operator*(const SquareMat& b) const {
+		requireSameSize(b.dim());
+		// Columns of a CSC matrix would scatter into shared rows of the result
+		if (order == SparseLayout::CSC)
+			return toLayout(SparseLayout::CSR) * b;
+		SquareMat result(size);
+		const double* in = b[0].data();
+		double* out = result[0].data();
+		detail::forRows(size, [&](int first, int last) {
+			sparseDenseRows(size, starts.data(), positions.data(), elements.data(), in, out, first, last);
+		});
+		return result;
+	}
+
+	SquareMat operator*(const SquareMat& a, const SparseMat& b) {
+		b.requireSameSize(a.dim());
+		if (b.order == SparseLayout::CSR)
+			return a * b.toLayout(SparseLayout::CSC);
+		SquareMat result(b.size);
+		const double* in = a[0].data();
+		double* out = result[0].data();
+		detail::forRows(b.size, [&](int first, int last) {
+			denseSparseRows(b.size, in, b.starts.data(), b.positions.data(), b.elements.data(), out, first, last);
+		});
+		return result;
+	}
+
+	SparseMat SparseMat::operator*(const SparseMat& b) const {
+		requireSameSize(b.size);
+		if (b.order != order)
+			return *this * b.toLayout(order);
+		SparseMat result(size, order);
+		if (order == SparseLayout::CSR)
+			gustavson(size, starts, positions, elements, b.starts, b.positions, b.elements, result.starts,
+				result.positions, result.elements);
+		else
+			gustavson(size, b.starts, b.positions, b.elements, starts, positions, elements, result.starts,
+				result.positions, result.elements);
+		return result;
+	}
+
+	SparseMat SparseMat::operator*(double sc) const {
+		SparseMat result(size, order);
+		// Products can underflow to zero, which is not stored
+		for (int k = 0; k < size; ++k) {
+			for (std::size_t p = starts[k]; p < starts[k + 1]; ++p) {
+				const double v = elements[p] * sc;
+				if (v != 0.0) {
+					result.positions.push_back(positions[p]);
+					result.elements.push_back(v);
+				}
+			}
+			result.starts[k + 1] = result.elements.size();
+		}
+		return result;
+	}
+
+	SparseMat SparseMat::merged(const SparseMat& b, double sign) const {
+		requireSameSize(b.size);
+		if (b.order != order)
+			return merged(b.toLayout(order), sign);
+		SparseMat result(size, order);
+		const auto emit = [&result](int index, double value) {
+			if (value != 0.0) {
+				result.positions.push_back(index);
+				result.elements.push_back(value);
+			}
+		};
+		for (int k = 0; k < size; ++k) {
+			std::size_t p = starts[k], q = b.starts[k];
+			while (p < starts[k + 1] || q < b.starts[k + 1]) {
+				if (q == b.starts[k + 1] || (p < starts[k + 1] && positions[p] < b.positions[q])) {
+					emit(positions[p], elements[p]);
+					++p;
+				} else if (p == starts[k + 1] || b.positions[q] < positions[p]) {
+					emit(b.positions[q], sign * b.elements[q]);
+					++q;
+				} else {
+					emit(positions[p], sign > 0 ? elements[p] + b.elements[q] : elements[p] - b.elements[q]);
+					++p;
+					++q;
+				}
+			}
+			result.starts[k + 1] = result.elements.size();
+		}
+		return result;
+	}
+
+	SparseMat SparseMat::operator+(const SparseMat& b) const {
+		return merged(b, 1.0);
+	}
+
+	SparseMat SparseMat::operator-(const SparseMat& b) const {
+		return merged(b, -1.0);
+	}
+
+	SquareMat SparseMat::operator+(const SquareMat& b) const {
+		requireSameSize(b.dim());
+		SquareMat result(b);
+		double* out = result[0].data();
+		const bool rows = order == SparseLayout::CSR;
+		for (int k = 0; k < size; ++k)
+			for (std::size_t p = starts[k]; p < starts[k + 1]; ++p) {
+				const std::size_t i = rows ? k : positions[p];
+				const std::size_t j = rows ? positions[p] : k;
+				out[i * size + j] += elements[p];
+			}
+		return result;
+	}
+
+	SparseMat SparseMat::operator~() const {
+		SparseMat result(*this);
+		result.order = order == SparseLayout::CSR ? SparseLayout::CSC : SparseLayout::CSR;
+		return result;
+	}
+
+	SparseMat SparseMat::operator^(unsigned int power) const {
+		if (power == 0) {
+			SparseMat result(size, order);
+			result.positions.resize(static_cast<std::size_t>(size));
+			result.elements.assign(static_cast<std::size_t>(size), 1.0);
+			for (int k = 0; k < size; ++k) {
+				result.positions[k] = k;
+				result.starts[k + 1] = static_cast<std::size_t>(k) + 1;
+			}
+			return result;
+		}
+		// Left-to-right square-and-multiply
+		SparseMat result(*this);
+		int bit = 31 - __builtin_clz(power);
+		for (--bit; bit >= 0; --bit) {
+			result = result * result;
+			if (power >> bit & 1u)
+				result = result * *this;
+		}
+		return result;
+	}
+
+	bool SparseMat::operator==(const SparseMat& b) const {
+		if (size != b.size)
+			return false;
+		if (b.order != order)
+			return *this == b.toLayout(order);
+		return starts == b.starts && positions == b.positions && elements == b.elements;
+	}
+
+	namespace detail {
+		bool isSparse(int n, const double* x) {
+			const double density = sparseThreshold();
+			return density > 0.0 && sparserThan(n, x, density * static_cast<double>(n) * n);
+		}
+
+		bool sparseMultiply(int n, const double* a, const double* b, double* c) {
+			const double density = sparseThreshold();
+			if (density <= 0.0)
+				return false;
+			const std::size_t count = static_cast<std::size_t>(n) * n;
+			const double limit = density * static_cast<double>(count);
+			Offsets offsets(currentResource());
+			Indices indices(currentResource());
+			Values values(currentResource());
+			if (sparserThan(n, a, limit) && allFinite(b, count)) {
+				compress(n, a, SparseLayout::CSR, offsets, indices, values);
+				std::fill(c, c + count, 0.0);
+				forRows(n, [&](int first, int last) {
+					sparseDenseRows(n, offsets.data(), indices.data(), values.data(), b, c, first, last);
+				});
+				return true;
+			}
+			if (sparserThan(n, b, limit) && allFinite(a, count)) {
+				compress(n, b, SparseLayout::CSC, offsets, indices, values);
+				forRows(n, [&](int first, int last) {
+					denseSparseRows(n, a, offsets.data(), indices.data(), values.data(), c, first, last);
+				});
+				return true;
+			}
+			return false;
+		}
+	}
+}
@@ -0,0 +1,226 @@
+// ey.gellis@gmail.com
+#ifndef SPARSEMAT_H
+#define SPARSEMAT_H
+
+#include "squaremat.hpp"
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief Compression order of a SparseMat
+	 */
+	enum class SparseLayout {
+		CSR, // Compressed rows: offsets delimit rows, indices are columns
+		CSC  // Compressed columns: offsets delimit columns, indices are rows
+	};
+
+	/**
+	 * @brief One element given to SparseMat's entry constructor
+	 */
+	struct SparseEntry {
+		int row;
+		int column;
+		double value;
+	};
+
+	/**
+	 * @brief Sets the density below which SquareMat products use sparse kernels
+	 *
+	 * operator*, operator*= and operator^ count the nonzeros of each operand
+	 * (stopping as soon as the count passes the threshold) and multiply through
+	 * a compressed copy of the first one found below it. The other operand must
+	 * be finite, so skipped zeros cannot hide a 0 * inf.
+	 * @param density Fraction of nonzero elements in [0, 1]; 0 disables the dispatch
+	 */
+	void setSparseThreshold(double density);
+
+	/**
+	 * @brief Density below which SquareMat products use sparse kernels
+	 * @return Fraction of nonzero elements
+	 */
+	double sparseThreshold();
+
+	/**
+	 * @brief Square matrix storing only its nonzero elements, in CSR or CSC form
+	 *
+	 * offsets() has dim() + 1 entries; the elements of row (CSR) or column
+	 * (CSC) k are indices()[offsets()[k] .. offsets()[k + 1]) with the matching
+	 * values(). Indices are sorted within each row or column and zeros are never
+	 * stored, so every matrix has exactly one representation per layout.
+	 * Storage comes from currentResource(). Results of binary operations take
+	 * the left operand's layout; the right one is converted if it differs.
+	 */
+	class SparseMat {
+	private:
+		std::pmr::vector<std::size_t> starts;
+		std::pmr::vector<int> positions;
+		std::pmr::vector<double> elements;
+		int size;
+		SparseLayout order;
+
+		void requireSameSize(int n) const;
+		SparseMat merged(const SparseMat& b, double sign) const;
+
+	public:
+		/**
+		 * @brief Creates a zero matrix
+		 * @param n Matrix dimension
+		 * @param layout Compression order
+		 */
+		SparseMat(int n, SparseLayout layout = SparseLayout::CSR);
+
+		/**
+		 * @brief Compresses the nonzero elements of a dense matrix
+		 * @param mat Matrix to compress
+		 * @param layout Compression order
+		 */
+		explicit SparseMat(const SquareMat& mat, SparseLayout layout = SparseLayout::CSR);
+
+		/**
+		 * @brief Builds a matrix from (row, column, value) entries in any order
+		 *
+		 * Entries at the same position are summed; sums of zero are not stored.
+		 * @param n Matrix dimension
+		 * @param entries Entries with row and column in [0, n)
+		 * @param layout Compression order
+		 */
+		SparseMat(int n, const std::vector<SparseEntry>& entries, SparseLayout layout = SparseLayout::CSR);
+
+		SparseMat(const SparseMat& other);
+		SparseMat(SparseMat&& other) noexcept = default;
+		SparseMat& operator=(const SparseMat& other) = default;
+		SparseMat& operator=(SparseMat&& other) noexcept = default;
+
+		int dim() const { return size; }
+
+		SparseLayout layout() const { return order; }
+
+		/**
+		 * @brief Number of stored (nonzero) elements
+		 */
+		std::size_t nonZeros() const { return elements.size(); }
+
+		/**
+		 * @brief Fraction of elements that are nonzero
+		 */
+		double density() const { return static_cast<double>(elements.size()) / (static_cast<double>(size) * size); }
+
+		const std::pmr::vector<std::size_t>& offsets() const { return starts; }
+		const std::pmr::vector<int>& indices() const { return positions; }
+		const std::pmr::vector<double>& values() const { return elements; }
+
+		/**
+		 * @brief Element at (i, j), found by binary search
+		 * @param i Row index
+		 * @param j Column index
+		 * @return Stored value, or 0
+		 */
+		double at(int i, int j) const;
+
+		/**
+		 * @brief The same matrix compressed in the given order
+		 * @param layout Compression order
+		 * @return Converted copy
+		 */
+		SparseMat toLayout(SparseLayout layout) const;
+
+		/**
+		 * @brief Expands the matrix into a SquareMat
+		 * @return Dense copy
+		 */
+		SquareMat toDense() const;
+
+		/**
+		 * @brief Sparse matrix-vector product
+		 * @param x Vector of dim() elements
+		 * @return this * x
+		 */
+		std::vector<double> operator*(const std::vector<double>& x) const;
+
+		/**
+		 * @brief Sparse-dense product, one vectorized row update per nonzero
+		 * @param b Dense right operand
+		 * @return this * b
+		 */
+		SquareMat operator*(const SquareMat& b) const;
+
+		/**
+		 * @brief Dense-sparse product
+		 * @param a Dense left operand
+		 * @param b Sparse right operand
+		 * @return a * b
+		 */
+		friend SquareMat operator*(const SquareMat& a, const SparseMat& b);
+
+		/**
+		 * @brief Sparse-sparse product (Gustavson's row-by-row algorithm)
+		 * @param b Right operand
+		 * @return this * b, without the zeros cancellation produces
+		 */
+		SparseMat operator*(const SparseMat& b) const;
+
+		SparseMat operator*(double sc) const;
+
+		friend SparseMat operator*(double sc, const SparseMat& mat) { return mat * sc; }
+
+		SparseMat operator+(const SparseMat& b) const;
+		SparseMat operator-(const SparseMat& b) const;
+
+		/**
+		 * @brief Sparse-dense addition
+		 * @param b Dense operand
+		 * @return Dense sum
+		 */
+		SquareMat operator+(const SquareMat& b) const;
+
+		friend SquareMat operator+(const SquareMat& a, const SparseMat& b) { return b + a; }
+
+		/**
+		 * @brief Transposes by reinterpreting the arrays in the other layout
+		 *
+		 * The CSR arrays of a matrix are the CSC arrays of its transpose, so this
+		 * copies without reordering; use toLayout() to change the layout back.
+		 * @return Transpose, in the other layout
+		 */
+		SparseMat operator~() const;
+
+		/**
+		 * @brief Raises the matrix to a power by square-and-multiply with sparse products
+		 * @param power Exponent value; 0 gives the identity
+		 * @return Result of exponentiation
+		 */
+		SparseMat operator^(unsigned int power) const;
+
+		/**
+		 * @brief Element-wise equality, regardless of layout
+		 */
+		bool operator==(const SparseMat& b) const;
+		bool operator!=(const SparseMat& b) const { return !(*this == b); }
+	};
+
+	namespace detail {
+		/**
+		 * @brief C = A * B through the sparse kernels if either operand is below
+		 * sparseThreshold() and the other is finite
+		 *
+		 * Called by multiply() before the dense algorithms.
+		 * @param n Matrix dimension
+		 * @param a Left operand, row-major
+		 * @param b Right operand, row-major
+		 * @param c Destination; overwritten only when the call returns true
+		 * @return True if the product was computed
+		 */
+		bool sparseMultiply(int n, const double* a, const double* b, double* c);
+
+		/**
+		 * @brief Whether a matrix is sparse enough for sparseMultiply() to take it
+		 * @param n Matrix dimension
+		 * @param x Matrix, row-major
+		 * @return True if x has fewer nonzeros than sparseThreshold() allows
+		 */
+		bool isSparse(int n, const double* x);
+	}
+}
+#endif
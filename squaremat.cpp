@@ -1,162 +1,328 @@
 // ey.gellis@gmail.com
 #include "squaremat.hpp"
+#include "strassen.hpp"
+#include "transpose.hpp"
+#include "kernels.hpp"
+#include "lu.hpp"
+#include "binaryio.hpp"
+#include "reduce.hpp"
+#include "power.hpp"
+#include "instrument.hpp"
 using namespace matrix;
+#include <algorithm>
 #include <cmath>
+#include <new>
 #include <ostream>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <utility>
 
-SquareMat::SquareMat() : size(1), matrix(1, std::vector<double>(1, 0.0)) {}
+double* SquareMat::allocate(int n, std::pmr::memory_resource* resource) {
+	std::size_t count = static_cast<std::size_t>(n) * n;
+	double* ptr = static_cast<double*>(resource->allocate(count * sizeof(double), alignment));
+	std::fill(ptr, ptr + count, 0.0);
+	MATRIX_COUNT_ALLOCATION(count * sizeof(double));
+	return ptr;
+}
+
+void SquareMat::release() {
+	if (mapping)
+		detail::unmapFile(mapping, mappedBytes);
+	else if (data)
+		memory->deallocate(data, count() * sizeof(double), alignment);
+	mapping = nullptr;
+	mappedBytes = 0;
+	readOnly = false;
+	data = nullptr;
+}
+
+void SquareMat::detach() {
+	if (!readOnly)
+		return;
+	double* owned = allocate(size, memory);
+	std::copy(data, data + count(), owned);
+	release();
+	data = owned;
+}
 
-SquareMat::SquareMat(int n) : size(n), matrix(n, std::vector<double>(n, 0.0)) {
-	if(n == 0)
+SquareMat::BasicSquareMat() : memory(currentResource()), data(allocate(1, memory)), size(1) {}
+
+SquareMat::BasicSquareMat(int n) : SquareMat(n, currentResource()) {}
+
+SquareMat::BasicSquareMat(int n, std::pmr::memory_resource* resource) : memory(resource), data(nullptr), size(n) {
+	if(n <= 0)
 		throw std::invalid_argument("Matrix size is not > 0");
+	data = allocate(n, memory);
 }
 
-SquareMat::SquareMat(const std::vector<std::vector<double>>& mat) {
+SquareMat::BasicSquareMat(const std::vector<std::vector<double>>& mat) : memory(currentResource()), data(nullptr), size(0) {
 	if (mat.empty())
 		throw std::invalid_argument("Input matrix cannot be empty");
 
 	int n = mat.size();
 	for (const std::vector<double>& row : mat) {
-		if (row.size() != n)
+		if (row.size() != static_cast<std::size_t>(n))
 			throw std::invalid_argument("Input matrix must be square");
 	}
 
 	size = n;
-	matrix = mat;
-}
-
-double SquareMat::determinantRecursive(const std::vector<std::vector<double>>& mat) const {
-	int n = static_cast<int>(mat.size());
-
-	if (n == 1)
-		return mat[0][0];
-	if (n == 2)
-		return mat[0][0] * mat[1][1] - mat[0][1] * mat[1][0];
-
-	double det = 0.0;
-	for (int col = 0; col < n; ++col) {
-		std::vector<std::vector<double>> submat(n - 1, std::vector<double>(n - 1));
-		for (int i = 1; i < n; ++i) {
-			int subcol = 0;
-			for (int j = 0; j < n; ++j) {
-				if (j == col) continue;
-				submat[i - 1][subcol++] = mat[i][j];
-			}
-		}
-		double sign = (col % 2 == 0) ? 1.0 : -1.0;
-		det += sign * mat[0][col] * determinantRecursive(submat);
+	data = allocate(n, memory);
+	for (int i = 0; i < n; ++i)
+		std::copy(mat[i].begin(), mat[i].end(), data + static_cast<std::size_t>(i) * n);
+}
+
+SquareMat::BasicSquareMat(const SquareMat& other)
+	: memory(currentResource()), data(allocate(other.size, memory)), size(other.size) {
+	std::copy(other.data, other.data + other.count(), data);
+	copySum(other);
+}
+
+SquareMat::BasicSquareMat(const SquareMat& other, std::pmr::memory_resource* resource)
+	: memory(resource), data(allocate(other.size, memory)), size(other.size) {
+	std::copy(other.data, other.data + other.count(), data);
+	copySum(other);
+}
+
+SquareMat::BasicSquareMat(SquareMat&& other) noexcept
+	: memory(other.memory), data(other.data), size(other.size), mapping(other.mapping), mappedBytes(other.mappedBytes),
+	  readOnly(other.readOnly) {
+	copySum(other);
+	other.data = nullptr;
+	other.size = 0;
+	other.mapping = nullptr;
+	other.mappedBytes = 0;
+	other.readOnly = false;
+	other.sumValid.store(false, std::memory_order_relaxed);
+}
+
+SquareMat& SquareMat::operator=(const SquareMat& other) {
+	if (this == &other)
+		return *this;
+	// A mapped matrix gets fresh storage rather than writing through the mapping
+	if (size != other.size || mapping) {
+		double* fresh = allocate(other.size, memory);
+		release();
+		data = fresh;
+		size = other.size;
 	}
-	return det;
+	std::copy(other.data, other.data + other.count(), data);
+	copySum(other);
+	return *this;
 }
 
-std::vector<double>& SquareMat::operator[](int index) {
-	if (index >= size)
+SquareMat& SquareMat::operator=(SquareMat&& other) {
+	if (this == &other)
+		return *this;
+	// As with a pmr container, a buffer is only taken over from the same
+	// resource and copied into our own storage otherwise; a file mapping
+	// belongs to no resource and is always taken over
+	if (memory != other.memory && !other.mapping)
+		return *this = static_cast<const SquareMat&>(other);
+	release();
+	data = other.data;
+	size = other.size;
+	mapping = other.mapping;
+	mappedBytes = other.mappedBytes;
+	readOnly = other.readOnly;
+	copySum(other);
+	other.data = nullptr;
+	other.size = 0;
+	other.mapping = nullptr;
+	other.mappedBytes = 0;
+	other.readOnly = false;
+	other.sumValid.store(false, std::memory_order_relaxed);
+	return *this;
+}
+
+SquareMat::~BasicSquareMat() {
+	release();
+}
+
+void SquareMat::copySum(const SquareMat& other) {
+	cachedSum.store(other.cachedSum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	sumValid.store(other.sumValid.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+RowView<double> SquareMat::operator[](int index) {
+	if (index < 0 || index >= size)
 		throw std::out_of_range("Row index out of range");
-	return matrix[index];
+	// The view may be written through at any time after this
+	detach();
+	return RowView<double>(data + static_cast<std::size_t>(index) * size, size, &sumValid);
 }
 
-const std::vector<double>& SquareMat::operator[](int index) const {
-	if (index >= size)
+RowView<const double> SquareMat::operator[](int index) const {
+	if (index < 0 || index >= size)
 		throw std::out_of_range("Row index out of range");
-	return matrix[index];
+	return RowView<const double>(data + static_cast<std::size_t>(index) * size, size);
 }
 
-SquareMat SquareMat::operator+(const SquareMat& b) const {
+SquareMat SquareMat::operator+(const SquareMat& b) const& {
+	MATRIX_OP(Add, static_cast<double>(count()));
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for addition");
 
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			result.matrix[i][j] = matrix[i][j] + b.matrix[i][j];
+	detail::kernels().add(data, b.data, result.data, count());
 	return result;
 }
-SquareMat SquareMat::operator-(const SquareMat& b) const {
+SquareMat SquareMat::operator+(const SquareMat& b) && {
+	MATRIX_OP(Add, static_cast<double>(count()));
+	*this += b;
+	return std::move(*this);
+}
+SquareMat SquareMat::operator+(SquareMat&& b) const& {
+	MATRIX_OP(Add, static_cast<double>(count()));
+	if (size != b.size)
+		throw std::invalid_argument("Matrix sizes must match for addition");
+
+	b.beginWrite();
+	detail::kernels().add(data, b.data, b.data, count());
+	return std::move(b);
+}
+SquareMat SquareMat::operator+(SquareMat&& b) && {
+	MATRIX_OP(Add, static_cast<double>(count()));
+	*this += b;
+	return std::move(*this);
+}
+SquareMat SquareMat::operator-(const SquareMat& b) const& {
+	MATRIX_OP(Subtract, static_cast<double>(count()));
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for subtraction");
 
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			result.matrix[i][j] = matrix[i][j] - b.matrix[i][j];
+	detail::kernels().sub(data, b.data, result.data, count());
 	return result;
 }
-SquareMat SquareMat::operator-() const {
+SquareMat SquareMat::operator-(const SquareMat& b) && {
+	MATRIX_OP(Subtract, static_cast<double>(count()));
+	*this -= b;
+	return std::move(*this);
+}
+SquareMat SquareMat::operator-(SquareMat&& b) const& {
+	MATRIX_OP(Subtract, static_cast<double>(count()));
+	if (size != b.size)
+		throw std::invalid_argument("Matrix sizes must match for subtraction");
+
+	b.beginWrite();
+	detail::kernels().sub(data, b.data, b.data, count());
+	return std::move(b);
+}
+SquareMat SquareMat::operator-(SquareMat&& b) && {
+	MATRIX_OP(Subtract, static_cast<double>(count()));
+	*this -= b;
+	return std::move(*this);
+}
+SquareMat SquareMat::operator-() const& {
+	MATRIX_OP(Negate, static_cast<double>(count()));
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			result.matrix[i][j] = -matrix[i][j];
+	detail::kernels().neg(data, result.data, count());
 	return result;
 }
+SquareMat SquareMat::operator-() && {
+	MATRIX_OP(Negate, static_cast<double>(count()));
+	// Negation is exact and rounding is symmetric about zero, so a cached sum
+	// just changes sign
+	detach();
+	detail::kernels().neg(data, data, count());
+	cachedSum.store(-cachedSum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	return std::move(*this);
+}
 SquareMat SquareMat::operator*(const SquareMat& b) const {
+	MATRIX_OP(Multiply, 2.0 * count() * size);
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for multiplication");
 
 	SquareMat result(size);
-
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j) {
-			double sum = 0.0;
-			for (int k = 0; k < size; ++k)
-				sum += matrix[i][k] * b.matrix[k][j];
-			result.matrix[i][j] = sum;
-		}
-
+	detail::multiply(size, data, b.data, result.data);
 	return result;
 }
-SquareMat operator*(double sc, const SquareMat& mat) {
-	SquareMat result(mat.size);
-	for (int i = 0; i < mat.size; ++i)
-		for (int j = 0; j < mat.size; ++j)
-			result.matrix[i][j] = sc * mat.matrix[i][j];
-	return result;
+namespace matrix {
+	SquareMat operator*(double sc, const SquareMat& mat) {
+		MATRIX_OP(Scale, static_cast<double>(mat.count()));
+		SquareMat result(mat.size);
+		detail::kernels().mulScalar(mat.data, sc, result.data, mat.count());
+		return result;
+	}
+
+	SquareMat operator*(double sc, SquareMat&& mat) {
+		MATRIX_OP(Scale, static_cast<double>(mat.count()));
+		mat *= sc;
+		return std::move(mat);
+	}
 }
-SquareMat SquareMat::operator*(double sc) const {
+SquareMat SquareMat::operator*(double sc) const& {
+	MATRIX_OP(Scale, static_cast<double>(count()));
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			result.matrix[i][j] = matrix[i][j] * sc;
+	detail::kernels().mulScalar(data, sc, result.data, count());
 	return result;
 }
-SquareMat SquareMat::operator%(const SquareMat& b) const {
+SquareMat SquareMat::operator*(double sc) && {
+	MATRIX_OP(Scale, static_cast<double>(count()));
+	*this *= sc;
+	return std::move(*this);
+}
+SquareMat SquareMat::operator%(const SquareMat& b) const& {
+	MATRIX_OP(Modulo, static_cast<double>(count()));
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for modulo");
 
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j) {
-			double divisor = b.matrix[i][j];
-			if (divisor == 0.0) {
-				throw std::domain_error("Modulo by zero element in matrix");
-			}
-			double dividend = matrix[i][j];
-			result.matrix[i][j] = dividend - divisor * std::floor(dividend / divisor);
+	for (std::size_t i = 0; i < count(); ++i) {
+		double divisor = b.data[i];
+		if (divisor == 0.0) {
+			throw std::domain_error("Modulo by zero element in matrix");
 		}
+		double dividend = data[i];
+		result.data[i] = dividend - divisor * std::floor(dividend / divisor);
+	}
 	return result;
 }
-SquareMat SquareMat::operator%(int sc) const {
+SquareMat SquareMat::operator%(const SquareMat& b) && {
+	MATRIX_OP(Modulo, static_cast<double>(count()));
+	if (size != b.size)
+		throw std::invalid_argument("Matrix sizes must match for modulo");
+
+	beginWrite();
+	for (std::size_t i = 0; i < count(); ++i) {
+		double divisor = b.data[i];
+		if (divisor == 0.0) {
+			throw std::domain_error("Modulo by zero element in matrix");
+		}
+		data[i] = data[i] - divisor * std::floor(data[i] / divisor);
+	}
+	return std::move(*this);
+}
+SquareMat SquareMat::operator%(int sc) const& {
+	MATRIX_OP(Modulo, static_cast<double>(count()));
 	if (sc == 0)
 		throw std::invalid_argument("Modulo by zero is undefined");
 
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j) {
-			double val = matrix[i][j];
-			result.matrix[i][j] = val - sc * std::floor(val / sc);
-		}
+	for (std::size_t i = 0; i < count(); ++i) {
+		double val = data[i];
+		result.data[i] = val - sc * std::floor(val / sc);
+	}
 	return result;
 }
-SquareMat SquareMat::operator/(double sc) const {
+SquareMat SquareMat::operator%(int sc) && {
+	MATRIX_OP(Modulo, static_cast<double>(count()));
+	if (sc == 0)
+		throw std::invalid_argument("Modulo by zero is undefined");
+
+	beginWrite();
+	for (std::size_t i = 0; i < count(); ++i)
+		data[i] = data[i] - sc * std::floor(data[i] / sc);
+	return std::move(*this);
+}
+SquareMat SquareMat::operator/(double sc) const& {
+	MATRIX_OP(Divide, static_cast<double>(count()));
 	if (sc == 0.0)
 		throw std::invalid_argument("Division by zero is undefined");
 
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			result.matrix[i][j] = matrix[i][j] / sc;
+	detail::kernels().divScalar(data, sc, result.data, count());
 	return result;
 }
 static SquareMat identityMatrix(int n) {
@@ -165,168 +331,215 @@ static SquareMat identityMatrix(int n) {
 		id[i][i] = 1.0;
 	return id;
 }
+SquareMat SquareMat::operator/(double sc) && {
+	MATRIX_OP(Divide, static_cast<double>(count()));
+	*this /= sc;
+	return std::move(*this);
+}
+#ifdef MATRIX_INSTRUMENT
+// Products square-and-multiply needs for a^p, the textbook count reported as FLOPs
+static double squareMultiplyProducts(unsigned int p) {
+	double products = 0;
+	for (; p > 1; p >>= 1)
+		products += (p & 1) ? 2 : 1;
+	return products;
+}
+#endif
 SquareMat SquareMat::operator^(unsigned int power) const {
+	MATRIX_OP(Power, 2.0 * count() * size * squareMultiplyProducts(power));
 	if (power == 0)
 		return identityMatrix(size);
+	if (power == 1)
+		return *this;
 
-	SquareMat result = identityMatrix(size);
-	SquareMat base = *this;
-	unsigned int p = power;
-
-	while (p > 0) {
-		if (p & 1)
-			result = result * base;
-		base = base * base;
-		p >>= 1;
+	const detail::Structure structure = detail::structure(size, data);
+	SquareMat result(size);
+	if (structure == detail::Structure::Diagonal) {
+		detail::power(size, data, structure, power, result.data, nullptr, nullptr);
+		return result;
 	}
+	SquareMat work1(size);
+	SquareMat work2(size);
+	detail::power(size, data, structure, power, result.data, work1.data, work2.data);
 	return result;
 }
 SquareMat& SquareMat::operator++() {
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			++matrix[i][j];
+	MATRIX_OP(Increment, static_cast<double>(count()));
+	beginWrite();
+	detail::kernels().addScalar(data, 1.0, data, count());
 	return *this;
 }
 SquareMat SquareMat::operator++(int) {
-	SquareMat temp = *this;
-	++(*this);
-	return temp;
+	MATRIX_OP(Increment, static_cast<double>(count()));
+	// Write the incremented values to a fresh buffer and keep it, handing the old
+	// buffer back as the result: one pass and one allocation instead of copy + update
+	SquareMat next(size);
+	detail::kernels().addScalar(data, 1.0, next.data, count());
+	std::swap(*this, next);
+	return next;
 }
 SquareMat& SquareMat::operator--() {
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			--matrix[i][j];
+	MATRIX_OP(Decrement, static_cast<double>(count()));
+	beginWrite();
+	detail::kernels().addScalar(data, -1.0, data, count());
 	return *this;
 }
 SquareMat SquareMat::operator--(int) {
-	SquareMat temp = *this;
-	--(*this);
-	return temp;
-}
-SquareMat SquareMat::operator~() const {
+	MATRIX_OP(Decrement, static_cast<double>(count()));
+	SquareMat next(size);
+	detail::kernels().addScalar(data, -1.0, next.data, count());
+	std::swap(*this, next);
+	return next;
+}
+SquareMat SquareMat::operator~() && {
+	MATRIX_OP(Transpose, 0);
+	transposeInPlace();
+	return std::move(*this);
+}
+SquareMat SquareMat::operator~() const& {
+	MATRIX_OP(Transpose, 0);
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			result.matrix[j][i] = matrix[i][j];
+	detail::transpose(size, size, data, size, result.data, size);
 	return result;
 }
-int SquareMat::sum() const {
-	int res = 0;
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			res+=matrix[i][j];
+SquareMat& SquareMat::transposeInPlace() {
+	MATRIX_OP(Transpose, 0);
+	beginWrite();
+	detail::transposeInPlace(size, data);
+	return *this;
+}
+double SquareMat::sum() const {
+	MATRIX_OP(Sum, static_cast<double>(count()));
+	if (sumValid.load(std::memory_order_acquire))
+		return cachedSum.load(std::memory_order_relaxed);
+	double res = detail::reduce(detail::Reduction::Sum, data, count());
+	cachedSum.store(res, std::memory_order_relaxed);
+	sumValid.store(true, std::memory_order_release);
 	return res;
 }
+double SquareMat::min() const {
+	MATRIX_OP(Min, static_cast<double>(count()));
+	return detail::reduce(detail::Reduction::Min, data, count());
+}
+double SquareMat::max() const {
+	MATRIX_OP(Max, static_cast<double>(count()));
+	return detail::reduce(detail::Reduction::Max, data, count());
+}
+double SquareMat::frobeniusNorm() const {
+	MATRIX_OP(FrobeniusNorm, 2.0 * count());
+	return std::sqrt(detail::reduce(detail::Reduction::SumSquares, data, count()));
+}
+double SquareMat::trace() const {
+	MATRIX_OP(Trace, size);
+	return detail::reduceStrided(detail::Reduction::Sum, data, size, static_cast<std::size_t>(size) + 1);
+}
 bool SquareMat::operator==(const SquareMat& b) const {
+	MATRIX_OP(Compare, 0);
 	return sum() == b.sum();
 }
 bool SquareMat::operator!=(const SquareMat& b) const {
+	MATRIX_OP(Compare, 0);
 	return sum() != b.sum();
 }
 bool SquareMat::operator<(const SquareMat& b) const {
+	MATRIX_OP(Compare, 0);
 	return sum() < b.sum();
 }
 bool SquareMat::operator>(const SquareMat& b) const {
+	MATRIX_OP(Compare, 0);
 	return sum() > b.sum();
 }
 bool SquareMat::operator<=(const SquareMat& b) const {
+	MATRIX_OP(Compare, 0);
 	return sum() <= b.sum();
 }
 bool SquareMat::operator>=(const SquareMat& b) const {
+	MATRIX_OP(Compare, 0);
 	return sum() >= b.sum();
 }
 double SquareMat::operator!() const {
-	std::vector<std::vector<double>> matVec(size, std::vector<double>(size));
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			matVec[i][j] = matrix[i][j];
-
-	return determinantRecursive(matVec);
+	MATRIX_OP(Determinant, 2.0 / 3.0 * count() * size);
+	const double* m = data;
+	// Closed forms are exact for the small sizes and avoid factoring
+	if (size == 1)
+		return m[0];
+	if (size == 2)
+		return m[0] * m[3] - m[1] * m[2];
+	if (size == 3)
+		return m[0] * (m[4] * m[8] - m[5] * m[7])
+			- m[1] * (m[3] * m[8] - m[5] * m[6])
+			+ m[2] * (m[3] * m[7] - m[4] * m[6]);
+
+	return LUDecomposition(*this).determinant();
 }
 SquareMat& SquareMat::operator+=(const SquareMat& b) {
+	MATRIX_OP(AddAssign, static_cast<double>(count()));
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for addition");
 
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			matrix[i][j] += b.matrix[i][j];
+	beginWrite();
+	detail::kernels().add(data, b.data, data, count());
 
 	return *this;
 }
 SquareMat& SquareMat::operator-=(const SquareMat& b) {
+	MATRIX_OP(SubtractAssign, static_cast<double>(count()));
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for subtraction");
 
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			matrix[i][j] -= b.matrix[i][j];
+	beginWrite();
+	detail::kernels().sub(data, b.data, data, count());
 
 	return *this;
 }
 SquareMat& SquareMat::operator*=(const SquareMat& b) {
+	MATRIX_OP(MultiplyAssign, 2.0 * count() * size);
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for multiplication");
 
 	SquareMat result(size);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j) {
-			double sum = 0.0;
-			for (int k = 0; k < size; ++k)
-				sum += matrix[i][k] * b.matrix[k][j];
-			result.matrix[i][j] = sum;
-		}
-
-	*this = result;
+	detail::multiply(size, data, b.data, result.data);
+	*this = std::move(result);
 	return *this;
 }
 SquareMat& SquareMat::operator*=(double sc) {
-    for (int i = 0; i < size; ++i)
-        for (int j = 0; j < size; ++j)
-            matrix[i][j] *= sc;
-    return *this;
+	MATRIX_OP(ScaleAssign, static_cast<double>(count()));
+	beginWrite();
+	detail::kernels().mulScalar(data, sc, data, count());
+	return *this;
 }
 SquareMat& SquareMat::operator/=(double sc) {
+	MATRIX_OP(DivideAssign, static_cast<double>(count()));
 	if (sc == 0.0)
 		throw std::invalid_argument("Division by zero is undefined");
 
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			matrix[i][j] /= sc;
+	beginWrite();
+	detail::kernels().divScalar(data, sc, data, count());
 
 	return *this;
 }
 SquareMat& SquareMat::operator%=(const SquareMat& b) {
+	MATRIX_OP(ModuloAssign, static_cast<double>(count()));
 	if (size != b.size)
 		throw std::invalid_argument("Matrix sizes must match for modulo");
 
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j) {
-			if (b.matrix[i][j] == 0.0)
-				throw std::invalid_argument("Modulo by zero is undefined");
-			matrix[i][j] = std::fmod(matrix[i][j], b.matrix[i][j]);
-		}
+	beginWrite();
+	for (std::size_t i = 0; i < count(); ++i) {
+		if (b.data[i] == 0.0)
+			throw std::invalid_argument("Modulo by zero is undefined");
+		data[i] = std::fmod(data[i], b.data[i]);
+	}
 	return *this;
 }
 SquareMat& SquareMat::operator%=(int sc) {
+	MATRIX_OP(ModuloAssign, static_cast<double>(count()));
 	if (sc == 0)
 		throw std::invalid_argument("Modulo by zero is undefined");
 
 	double dsc = static_cast<double>(sc);
-	for (int i = 0; i < size; ++i)
-		for (int j = 0; j < size; ++j)
-			matrix[i][j] = std::fmod(matrix[i][j], dsc);
+	beginWrite();
+	for (std::size_t i = 0; i < count(); ++i)
+		data[i] = std::fmod(data[i], dsc);
 
 	return *this;
 }
-
-std::ostream& operator<<(std::ostream& os, const SquareMat& mat) {
-	for (int i = 0; i < mat.size; ++i) {
-		for (int j = 0; j < mat.size; ++j) {
-			os << mat.matrix[i][j];
-			if (j + 1 < mat.size)
-				os << " ";
-		}
-		os << "\n";
-	}
-	return os;
-}
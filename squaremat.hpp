@@ -2,71 +2,387 @@
 #ifndef SQUAREMAT_H
 #define SQUAREMAT_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 namespace matrix {
+	template <typename E>
+	class MatExpr;
+
+	/**
+	 * @brief Memory resource new matrices on this thread allocate from
+	 *
+	 * Defaults to std::pmr::get_default_resource(); a ResourceScope (arena.hpp)
+	 * temporarily redirects it, e.g. to a ScratchArena.
+	 * @return Current resource for this thread
+	 */
+	std::pmr::memory_resource* currentResource();
+
+	/**
+	 * @brief How SquareMat::mapFile() maps a matrix file into memory
+	 */
+	enum class MapMode {
+		CopyOnWrite, // Private pages; writes stay in memory and never reach the file
+		ReadOnly     // Shared read-only pages; the first write copies the matrix out
+	};
+
+	/**
+	 * @brief Square matrix with elements of type T
+	 *
+	 * The double specialization below is SquareMat, backed by the SIMD, GEMM,
+	 * Strassen, reduction and file engines. Other element types are declared in
+	 * basicmat.hpp and instantiated in libmat for float, std::int32_t,
+	 * std::int64_t, std::complex<double>, Half and BFloat16.
+	 */
+	template <typename T>
+	class BasicSquareMat;
+
+	using SquareMat = BasicSquareMat<double>;
+
+	/**
+	 * @brief Writable reference to one element of a SquareMat
+	 *
+	 * Returned by mat[i][j] on a non-const matrix. Reads convert to double; every
+	 * write also marks the owning matrix's cached sum as stale.
+	 */
+	class ElementRef {
+	private:
+		double* element;
+		std::atomic<bool>* sumValid;
+
+		ElementRef& set(double value) {
+			*element = value;
+			sumValid->store(false, std::memory_order_relaxed);
+			return *this;
+		}
+
+	public:
+		ElementRef(double* ptr, std::atomic<bool>* valid) : element(ptr), sumValid(valid) {}
+
+		operator double() const { return *element; }
+
+		ElementRef& operator=(double value) { return set(value); }
+		ElementRef& operator=(const ElementRef& other) { return set(*other.element); }
+		ElementRef& operator+=(double value) { return set(*element + value); }
+		ElementRef& operator-=(double value) { return set(*element - value); }
+		ElementRef& operator*=(double value) { return set(*element * value); }
+		ElementRef& operator/=(double value) { return set(*element / value); }
+		ElementRef& operator++() { return set(*element + 1.0); }
+		ElementRef& operator--() { return set(*element - 1.0); }
+
+		double operator++(int) {
+			double old = *element;
+			set(old + 1.0);
+			return old;
+		}
+
+		double operator--(int) {
+			double old = *element;
+			set(old - 1.0);
+			return old;
+		}
+	};
+
+	/**
+	 * @brief Non-owning view of a single row of a SquareMat
+	 *
+	 * Returned by operator[] of the matrix classes so that mat[i][j] keeps working
+	 * on top of the contiguous row-major storage. Writable double views hand out
+	 * ElementRef for element access; raw pointers from data(), begin() and end() may be written
+	 * through, so taking one marks the matrix's cached sum as stale.
+	 *
+	 * The cache is only invalidated when the pointer is taken: a raw pointer may
+	 * be written through until the matrix's sum() is next computed (directly or
+	 * by a comparison), after which it must be taken again before writing.
+	 */
+	template <typename T>
+	class RowView {
+	private:
+		T* row;
+		int length;
+		std::atomic<bool>* sumValid;
+
+		void touch() const {
+			if constexpr (!std::is_const_v<T>) {
+				if (sumValid)
+					sumValid->store(false, std::memory_order_relaxed);
+			}
+		}
+
+	public:
+		RowView(T* ptr, int n, std::atomic<bool>* valid = nullptr) : row(ptr), length(n), sumValid(valid) {}
+
+		/**
+		 * @brief Element access within the row
+		 * @param index Column index
+		 * @return Reference to the element; an ElementRef for writable double rows
+		 */
+		std::conditional_t<std::is_same_v<T, double>, ElementRef, T&> operator[](int index) const {
+			if constexpr (std::is_same_v<T, double>)
+				return ElementRef(row + index, sumValid);
+			else
+				return row[index];
+		}
+
+		/**
+		 * @brief Number of elements in the row
+		 * @return Row length
+		 */
+		std::size_t size() const { return static_cast<std::size_t>(length); }
+
+		T* data() const { touch(); return row; }
+		T* begin() const { touch(); return row; }
+		T* end() const { touch(); return row + length; }
+	};
+
 	/**
 	 * @brief A class representing a square matrix with various mathematical operations
+	 *
+	 * Elements are stored in a single 64-byte aligned row-major buffer, so an n x n
+	 * matrix costs exactly one allocation. The buffer comes from a polymorphic
+	 * memory resource: currentResource() unless one is passed explicitly. Like
+	 * std::pmr containers, copies allocate from currentResource(), move
+	 * construction carries the source's resource along, and assignment keeps the
+	 * destination's resource: a move only takes over the buffer when both
+	 * matrices use the same resource, and copies the elements otherwise. File
+	 * mappings (see mapFile()) are taken over by any move.
 	 */
-	class SquareMat {
+	template <>
+	class BasicSquareMat<double> {
 	private:
-		std::vector<std::vector<double>> matrix;
+		std::pmr::memory_resource* memory;
+		double* data;
 		int size;
+		// File mapping backing data (see mapFile()), released instead of the buffer
+		void* mapping = nullptr;
+		std::size_t mappedBytes = 0;
+		// The mapping's pages are read-only (MapMode::ReadOnly); writes detach() first
+		bool readOnly = false;
+		// sum() as of the last time it was computed, and whether the elements have
+		// been written since; copies and moves carry both along
+		mutable std::atomic<double> cachedSum{0.0};
+		mutable std::atomic<bool> sumValid{false};
 
 		/**
-		 * @brief Recursively calculates the determinant of a matrix
-		 * @param mat The matrix to calculate determinant for
-		 * @return The determinant value
+		 * @brief Allocates an aligned, zero-initialized buffer of n * n elements
+		 * @param n Matrix dimension
+		 * @param resource Resource to allocate from
+		 * @return Pointer to the buffer
 		 */
-		double determinantRecursive(const std::vector<std::vector<double>>& mat) const;
+		static double* allocate(int n, std::pmr::memory_resource* resource);
+
+		/**
+		 * @brief Returns the buffer to the resource it came from
+		 */
+		void release();
+
+		/**
+		 * @brief Number of elements in the matrix (size * size)
+		 */
+		std::size_t count() const { return static_cast<std::size_t>(size) * size; }
+
+		/**
+		 * @brief Moves a read-only mapping into owned storage; no-op otherwise
+		 */
+		void detach();
+
+		/**
+		 * @brief Makes the elements writable and marks the cached sum as stale;
+		 * called by every write to the elements
+		 */
+		void beginWrite() {
+			detach();
+			sumValid.store(false, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Takes over another matrix's cached sum along with its elements
+		 */
+		void copySum(const SquareMat& other);
+
+		/**
+		 * @brief Sets every element to Op::apply(element, e.at(i)); a read-only
+		 * mapping the expression may still be reading is evaluated into fresh
+		 * storage and swapped in afterwards
+		 */
+		template <typename Op, typename E>
+		SquareMat& assignElements(const E& e);
 
 	public:
-		SquareMat();
+		BasicSquareMat();
+
+		BasicSquareMat(int n);
+
+		/**
+		 * @brief Creates a zero matrix whose storage comes from the given resource
+		 * @param n Matrix dimension
+		 * @param resource Resource to allocate from; must outlive the matrix
+		 */
+		BasicSquareMat(int n, std::pmr::memory_resource* resource);
+
+		BasicSquareMat(const std::vector<std::vector<double>>& mat);
+
+		BasicSquareMat(const SquareMat& other);
+
+		/**
+		 * @brief Copies a matrix into storage from the given resource
+		 * @param other Matrix to copy
+		 * @param resource Resource to allocate from; must outlive the matrix
+		 */
+		BasicSquareMat(const SquareMat& other, std::pmr::memory_resource* resource);
+
+		BasicSquareMat(SquareMat&& other) noexcept;
+
+		SquareMat& operator=(const SquareMat& other);
+
+		SquareMat& operator=(SquareMat&& other);
+
+		~BasicSquareMat();
+
+		/**
+		 * @brief Evaluates a lazy expression (see expr.hpp) in a single fused loop
+		 * @param expr Expression to evaluate
+		 */
+		template <typename E>
+		BasicSquareMat(const MatExpr<E>& expr);
+
+		/**
+		 * @brief Evaluates a lazy expression directly into this matrix's storage
+		 * @param expr Expression to evaluate
+		 * @return Reference to this matrix
+		 */
+		template <typename E>
+		SquareMat& operator=(const MatExpr<E>& expr);
+
+		/**
+		 * @brief Adds a lazy expression in place without temporaries
+		 * @param expr Expression to add
+		 * @return Reference to this matrix
+		 */
+		template <typename E>
+		SquareMat& operator+=(const MatExpr<E>& expr);
+
+		/**
+		 * @brief Subtracts a lazy expression in place without temporaries
+		 * @param expr Expression to subtract
+		 * @return Reference to this matrix
+		 */
+		template <typename E>
+		SquareMat& operator-=(const MatExpr<E>& expr);
+
+		/**
+		 * @brief Alignment in bytes of the element buffer
+		 */
+		static constexpr std::size_t alignment = 64;
 
-		SquareMat(int n);
+		/**
+		 * @brief Returns the matrix dimension
+		 * @return Number of rows (and columns)
+		 */
+		int dim() const { return size; }
 
-		SquareMat(const std::vector<std::vector<double>>& mat);
+		/**
+		 * @brief Resource the element buffer was allocated from
+		 * @return Memory resource
+		 */
+		std::pmr::memory_resource* resource() const { return memory; }
 
 		/**
 		 * @brief Calculates the sum of all elements in the matrix
+		 *
+		 * Kahan-compensated SIMD lanes combined pairwise (see reduce.hpp), in
+		 * parallel for large matrices; the result is the same for any thread count
+		 * and instruction set. Computed once and cached until the elements are next
+		 * written, so the comparison operators cost O(1) on an unchanged matrix.
 		 * @return The sum of all matrix elements
 		 */
-		int sum() const;
+		double sum() const;
+
+		/**
+		 * @brief Smallest element, ignoring NaNs
+		 * @return Minimum element; +infinity if every element is NaN
+		 */
+		double min() const;
+
+		/**
+		 * @brief Largest element, ignoring NaNs
+		 * @return Maximum element; -infinity if every element is NaN
+		 */
+		double max() const;
+
+		/**
+		 * @brief Frobenius norm, the square root of the sum of squared elements
+		 * @return Norm, accumulated like sum()
+		 */
+		double frobeniusNorm() const;
+
+		/**
+		 * @brief Sum of the diagonal elements
+		 * @return Trace, accumulated like sum()
+		 */
+		double trace() const;
 
 		/**
 		 * @brief Access operator for matrix rows
 		 * @param index Row index
-		 * @return Reference to the row vector
+		 * @return View of the row
 		 */
-		std::vector<double>& operator[](int index);
+		RowView<double> operator[](int index);
 
 		/**
 		 * @brief Const access operator for matrix rows
 		 * @param index Row index
-		 * @return Const reference to the row vector
+		 * @return Read-only view of the row
 		 */
-		const std::vector<double>& operator[](int index) const;
+		RowView<const double> operator[](int index) const;
 
 		/**
 		 * @brief Adds two matrices
 		 * @param b Matrix to add
 		 * @return Result of addition
 		 */
-		SquareMat operator+(const SquareMat& b) const;
+		SquareMat operator+(const SquareMat& b) const&;
+
+		/**
+		 * @brief Rvalue overloads of addition; the result reuses the storage of an
+		 * expiring operand instead of allocating
+		 */
+		SquareMat operator+(const SquareMat& b) &&;
+		SquareMat operator+(SquareMat&& b) const&;
+		SquareMat operator+(SquareMat&& b) &&;
 
 		/**
 		 * @brief Subtracts two matrices
 		 * @param b Matrix to subtract
 		 * @return Result of subtraction
 		 */
-		SquareMat operator-(const SquareMat& b) const;
+		SquareMat operator-(const SquareMat& b) const&;
+
+		/**
+		 * @brief Rvalue overloads of subtraction; the result reuses the storage of an
+		 * expiring operand instead of allocating
+		 */
+		SquareMat operator-(const SquareMat& b) &&;
+		SquareMat operator-(SquareMat&& b) const&;
+		SquareMat operator-(SquareMat&& b) &&;
 
 		/**
 		 * @brief Negates all elements in the matrix
 		 * @return Negated matrix
 		 */
-		SquareMat operator-() const;
+		SquareMat operator-() const&;
+
+		/**
+		 * @brief Negates an expiring matrix in place
+		 * @return The negated matrix, reusing this storage
+		 */
+		SquareMat operator-() &&;
 
 		/**
 		 * @brief Multiplies two matrices
@@ -83,41 +399,94 @@ namespace matrix {
 		 */
 		friend SquareMat operator*(double sc, const SquareMat& mat);
 
+		/**
+		 * @brief Scales an expiring matrix in place (friend function)
+		 * @param sc Scalar value
+		 * @param mat Matrix to multiply; its storage is reused for the result
+		 * @return Result of multiplication
+		 */
+		friend SquareMat operator*(double sc, SquareMat&& mat);
+
 		/**
 		 * @brief Multiplies matrix by a scalar
 		 * @param sc Scalar value
 		 * @return Result of multiplication
 		 */
-		SquareMat operator*(double sc) const;
+		SquareMat operator*(double sc) const&;
+
+		/**
+		 * @brief Scales an expiring matrix in place
+		 * @param sc Scalar value
+		 * @return Result of multiplication, reusing this storage
+		 */
+		SquareMat operator*(double sc) &&;
 
 		/**
 		 * @brief Element-wise modulo operation between matrices
 		 * @param b Matrix for modulo operation
 		 * @return Result of modulo operation
 		 */
-		SquareMat operator%(const SquareMat& b) const;
+		SquareMat operator%(const SquareMat& b) const&;
+
+		/**
+		 * @brief Element-wise modulo of an expiring matrix, computed in place
+		 * @param b Matrix for modulo operation
+		 * @return Result of modulo operation, reusing this storage
+		 */
+		SquareMat operator%(const SquareMat& b) &&;
 
 		/**
 		 * @brief Element-wise modulo operation with scalar
 		 * @param sc Scalar value for modulo
 		 * @return Result of modulo operation
 		 */
-		SquareMat operator%(int sc) const;
+		SquareMat operator%(int sc) const&;
+
+		/**
+		 * @brief Scalar modulo of an expiring matrix, computed in place
+		 * @param sc Scalar value for modulo
+		 * @return Result of modulo operation, reusing this storage
+		 */
+		SquareMat operator%(int sc) &&;
 
 		/**
 		 * @brief Divides matrix by a scalar
 		 * @param sc Scalar value
 		 * @return Result of division
 		 */
-		SquareMat operator/(double sc) const;
+		SquareMat operator/(double sc) const&;
+
+		/**
+		 * @brief Divides an expiring matrix in place
+		 * @param sc Scalar value
+		 * @return Result of division, reusing this storage
+		 */
+		SquareMat operator/(double sc) &&;
 
 		/**
 		 * @brief Raises matrix to a power
+		 *
+		 * Diagonal inputs (including the identity) are raised element-wise and
+		 * strictly triangular ones vanish from power n on. Other inputs follow the
+		 * shortest addition chain that fits in the result and two workspaces (see
+		 * power.hpp); triangular inputs multiply only their nonzero blocks.
 		 * @param power Exponent value
 		 * @return Result of exponentiation
 		 */
 		SquareMat operator^(unsigned int power) const;
 
+		/**
+		 * @brief Exact modular power of an integer-valued matrix
+		 *
+		 * Reduces during every product (see ModMat in modmat.hpp) instead of
+		 * applying % to a power whose elements have long lost precision.
+		 * Defined in modmat.cpp.
+		 * @param exponent Exponent value
+		 * @param modulus Modulus in [1, 2^53]
+		 * @return Power with elements in [0, modulus)
+		 */
+		SquareMat powMod(unsigned long long exponent, std::uint64_t modulus) const;
+
 		/**
 		 * @brief Pre-increment operator
 		 * @return Reference to incremented matrix
@@ -146,7 +515,19 @@ namespace matrix {
 		 * @brief Transposes the matrix
 		 * @return Transposed matrix
 		 */
-		SquareMat operator~() const;
+		SquareMat operator~() const&;
+
+		/**
+		 * @brief Transposes an expiring matrix in place
+		 * @return Transposed matrix, reusing this storage
+		 */
+		SquareMat operator~() &&;
+
+		/**
+		 * @brief Transposes the matrix in place without allocating
+		 * @return Reference to this matrix
+		 */
+		SquareMat& transposeInPlace();
 
 		/**
 		 * @brief Equality comparison operator
@@ -192,6 +573,9 @@ namespace matrix {
 
 		/**
 		 * @brief Calculates the determinant of the matrix
+		 *
+		 * Uses closed forms up to 3 x 3 and an O(n^3) LU factorization beyond;
+		 * see LUDecomposition for the factors and a log-determinant.
 		 * @return Determinant value
 		 */
 		double operator!() const;
@@ -245,13 +629,68 @@ namespace matrix {
 		 */
 		SquareMat& operator%=(int sc);
 
+		/**
+		 * @brief Writes the matrix in the binary format (see binaryio.hpp)
+		 * @param os Binary output stream
+		 */
+		void writeBinary(std::ostream& os) const;
+
+		/**
+		 * @brief Writes the matrix to a binary file, replacing it
+		 * @param path File to write
+		 */
+		void save(const std::string& path) const;
+
+		/**
+		 * @brief Reads a matrix in the binary format and verifies its checksum
+		 * @param is Binary input stream
+		 * @return Matrix read
+		 */
+		static SquareMat readBinary(std::istream& is);
+
+		/**
+		 * @brief Uses a binary matrix file as storage without reading it
+		 *
+		 * Only the header is read; elements are paged in on first access. Under
+		 * MapMode::ReadOnly the first write, or non-const operator[], copies the
+		 * elements into owned storage and drops the mapping, so read through a
+		 * const reference to keep it.
+		 * @param path File to map
+		 * @param mode Copy-on-write or read-only mapping
+		 * @param verify Also check the payload checksum, which reads the whole file
+		 * @return Matrix backed by the mapping
+		 */
+		static SquareMat mapFile(const std::string& path, MapMode mode = MapMode::CopyOnWrite, bool verify = false);
+
+		/**
+		 * @brief Checks whether the matrix storage is a file mapping
+		 * @return True for matrices returned by mapFile()
+		 */
+		bool isMapped() const { return mapping != nullptr; }
+
 		/**
 		 * @brief Output stream operator
+		 *
+		 * Honors the stream's precision and float format like writing each element
+		 * with <<, but formats through std::to_chars when the flags and locale allow
+		 * it. Defined in textio.cpp; see writeText() for round-trip output.
 		 * @param os Output stream
 		 * @param mat Matrix to output
 		 * @return Reference to output stream
 		 */
 		friend std::ostream& operator<<(std::ostream& os, const SquareMat& mat);
 	};
+
+	/**
+	 * @brief Reads a matrix in the format operator<< writes
+	 *
+	 * The first non-empty line gives the dimension; lines are then consumed until
+	 * n * n numbers have been read. On malformed input failbit is set and mat is
+	 * left unchanged. Defined in textio.cpp.
+	 * @param is Input stream
+	 * @param mat Matrix to replace
+	 * @return Reference to input stream
+	 */
+	std::istream& operator>>(std::istream& is, SquareMat& mat);
 }
 #endif
@@ -0,0 +1,404 @@
+// ey.gellis@gmail.com
+#include "squaremat.hpp"
+#include "fixedmat.hpp"
+#include "batch.hpp"
+#include "strassen.hpp"
+#include "transpose.hpp"
+#include "binaryio.hpp"
+#include "textio.hpp"
+#include "reduce.hpp"
+using namespace matrix;
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    /**
+     * @brief Reference copy of the previous vector-of-vectors SquareMat storage,
+     * kept so the benchmark can report before/after numbers side by side.
+     */
+    struct LegacyMat {
+        std::vector<std::vector<double>> matrix;
+        int size;
+
+        explicit LegacyMat(int n) : matrix(n, std::vector<double>(n, 0.0)), size(n) {}
+
+        LegacyMat operator+(const LegacyMat& b) const {
+            LegacyMat result(size);
+            for (int i = 0; i < size; ++i)
+                for (int j = 0; j < size; ++j)
+                    result.matrix[i][j] = matrix[i][j] + b.matrix[i][j];
+            return result;
+        }
+
+        LegacyMat operator~() const {
+            LegacyMat result(size);
+            for (int i = 0; i < size; ++i)
+                for (int j = 0; j < size; ++j)
+                    result.matrix[j][i] = matrix[i][j];
+            return result;
+        }
+
+        LegacyMat operator*(const LegacyMat& b) const {
+            LegacyMat result(size);
+            for (int i = 0; i < size; ++i)
+                for (int j = 0; j < size; ++j) {
+                    double sum = 0.0;
+                    for (int k = 0; k < size; ++k)
+                        sum += matrix[i][k] * b.matrix[k][j];
+                    result.matrix[i][j] = sum;
+                }
+            return result;
+        }
+    };
+
+    volatile double sink;
+
+    template <typename M>
+    void fill(M& m, int n) {
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                m[i][j] = (i * 7 + j * 3) % 11 - 5.0;
+    }
+
+    /**
+     * @brief Runs fn until at least minSeconds have elapsed and returns seconds per call
+     */
+    double timeIt(const std::function<void()>& fn, double minSeconds = 0.2) {
+        using clock = std::chrono::steady_clock;
+        long iterations = 0;
+        auto start = clock::now();
+        double elapsed = 0.0;
+        do {
+            fn();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < minSeconds);
+        return elapsed / iterations;
+    }
+
+    void report(const char* op, int n, double legacy, double current) {
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << op << std::setw(8) << n
+                  << std::setw(16) << legacy * 1e6
+                  << std::setw(16) << current * 1e6
+                  << std::setw(10) << legacy / current << "x\n";
+    }
+
+    template <std::size_t N>
+    void benchFixed() {
+        // A batch of 1000 small products per timed call: SquareMat (before) vs FixedSquareMat (after)
+        const int batch = 1000;
+        std::vector<SquareMat> dynamic(batch, SquareMat(static_cast<int>(N)));
+        std::vector<FixedSquareMat<N>> fixed(batch);
+        for (int b = 0; b < batch; ++b) {
+            fill(dynamic[b], static_cast<int>(N));
+            for (std::size_t i = 0; i < N; ++i)
+                for (std::size_t j = 0; j < N; ++j)
+                    fixed[b](i, j) = dynamic[b][i][j] + b;
+        }
+        double before = timeIt([&] {
+            double acc = 0.0;
+            for (int b = 0; b + 1 < batch; ++b)
+                acc += (dynamic[b] * dynamic[b + 1])[0][0];
+            sink = acc;
+        });
+        double after = timeIt([&] {
+            double acc = 0.0;
+            for (int b = 0; b + 1 < batch; ++b)
+                acc += (fixed[b] * fixed[b + 1])(0, 0);
+            sink = acc;
+        });
+        report("fixed *", static_cast<int>(N), before, after);
+    }
+
+    void benchBatch(int n) {
+        // 100k independent products: a loop over SquareMat (before) vs one SquareMatBatch call (after)
+        const std::size_t count = 100000;
+        std::vector<SquareMat> dynamic(count, SquareMat(n));
+        SquareMatBatch a(n, count), b(n, count);
+        for (std::size_t m = 0; m < count; ++m) {
+            fill(dynamic[m], n);
+            a.set(m, dynamic[m]);
+            b.set(m, dynamic[m]);
+        }
+        double before = timeIt([&] {
+            double acc = 0.0;
+            for (std::size_t m = 0; m < count; ++m)
+                acc += (dynamic[m] * dynamic[m])[0][0];
+            sink = acc;
+        });
+        double after = timeIt([&] { SquareMatBatch r = a * b; sink = r(0, 0, 0); });
+        report("batch *", n, before, after);
+        before = timeIt([&] {
+            double acc = 0.0;
+            for (std::size_t m = 0; m < count; ++m)
+                acc += !dynamic[m];
+            sink = acc;
+        });
+        after = timeIt([&] { sink = a.determinants()[0]; });
+        report("batch !", n, before, after);
+    }
+
+    void benchTranspose(int n, const LegacyMat& la, const SquareMat& a) {
+        double legacy = timeIt([&] { LegacyMat r = ~la; sink = r.matrix[0][0]; });
+        double current = timeIt([&] { SquareMat r = ~a; sink = r[0][0]; });
+        report("~", n, legacy, current);
+
+        // Bandwidth of the kernels alone, into preallocated storage: one read and one
+        // write of every element, with memcpy as the ceiling
+        SquareMat out(n), in(a);
+        const double bytes = 2.0 * n * n * sizeof(double);
+        double copy = timeIt([&] { std::memcpy(out[0].data(), a[0].data(), bytes / 2); sink = out[0][0]; });
+        double outOfPlace = timeIt([&] { detail::transpose(n, n, a[0].data(), n, out[0].data(), n); sink = out[0][0]; });
+        double inPlace = timeIt([&] { in.transposeInPlace(); sink = in[0][0]; });
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << "GB/s" << std::setw(8) << n
+                  << "  memcpy " << bytes / copy * 1e-9
+                  << "  ~ " << bytes / outOfPlace * 1e-9
+                  << "  in-place " << bytes / inPlace * 1e-9 << "\n";
+    }
+
+    void benchLoad(int n, const SquareMat& a) {
+        // Getting a saved matrix back: rows into vector<vector> plus the converting
+        // constructor (before) vs mapping the file (after)
+        const std::string path = "squaremat_bench_load.bin";
+        a.save(path);
+        double before = timeIt([&] {
+            std::ifstream file(path, std::ios::binary);
+            file.seekg(sizeof(detail::FileHeader));
+            std::vector<std::vector<double>> rows(n, std::vector<double>(n));
+            for (auto& row : rows)
+                file.read(reinterpret_cast<char*>(row.data()), n * sizeof(double));
+            SquareMat m(rows);
+            sink = m[0][0];
+        });
+        double after = timeIt([&] { SquareMat m = SquareMat::mapFile(path); sink = m[0][0]; });
+        report("load", n, before, after);
+        std::remove(path.c_str());
+    }
+
+    void benchText(int n) {
+        SquareMat m(n);
+        std::mt19937_64 rng(n);
+        std::uniform_real_distribution<double> dist(-1e3, 1e3);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                m[i][j] = dist(rng);
+        const std::string text = toText(m);
+
+        // Parsing: istream >> double into vector<vector> (before) vs parseText (after)
+        double before = timeIt([&] {
+            std::istringstream in(text);
+            std::vector<std::vector<double>> rows(n, std::vector<double>(n));
+            for (auto& row : rows)
+                for (double& value : row)
+                    in >> value;
+            sink = rows[0][0];
+        });
+        double after = timeIt([&] { sink = parseText(text)[0][0]; });
+        report("parse", n, before, after);
+        const double parseRate = text.size() / after * 1e-9;
+
+        // Formatting: operator<< per element at full precision (before) vs writeText (after)
+        before = timeIt([&] {
+            std::ostringstream out;
+            out.precision(17);
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    out << m[i][j] << (j + 1 < n ? ' ' : '\n');
+            sink = out.str().size();
+        });
+        after = timeIt([&] { std::ostringstream out; writeText(out, m); sink = out.str().size(); });
+        report("format", n, before, after);
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << "GB/s" << std::setw(8) << n
+                  << "  parse " << parseRate << "  format " << text.size() / after * 1e-9 << "\n";
+    }
+
+    void benchSort(int n) {
+        // Sorting 100k matrices: comparisons that re-add every element (before) vs
+        // the cached sums (after); each run sorts a fresh copy of the same shuffle
+        const std::size_t count = 100000;
+        std::vector<SquareMat> mats(count, SquareMat(n));
+        std::mt19937 rng(n);
+        std::uniform_int_distribution<int> dist(-1000, 1000);
+        for (SquareMat& m : mats)
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    m[i][j] = dist(rng);
+        auto recomputed = [](const SquareMat& m) {
+            int res = 0;
+            for (int i = 0; i < m.dim(); ++i)
+                for (double x : m[i])
+                    res += x;
+            return res;
+        };
+        double before = timeIt([&] {
+            std::vector<SquareMat> v = mats;
+            std::sort(v.begin(), v.end(), [&](const SquareMat& x, const SquareMat& y) {
+                return recomputed(x) < recomputed(y);
+            });
+            sink = v[0][0][0];
+        });
+        double after = timeIt([&] {
+            std::vector<SquareMat> v = mats;
+            std::sort(v.begin(), v.end());
+            sink = v[0][0][0];
+        });
+        report("sort", n, before, after);
+    }
+
+    void benchReduce(int n, const SquareMat& a) {
+        // Summing every element: the former serial int accumulator (before) vs the
+        // compensated SIMD reduction behind sum(), called directly to skip its cache
+        const double* p = a[0].data();
+        const std::size_t count = static_cast<std::size_t>(n) * n;
+        double before = timeIt([&] {
+            int res = 0;
+            for (std::size_t i = 0; i < count; ++i)
+                res += p[i];
+            sink = res;
+        });
+        double after = timeIt([&] { sink = detail::reduce(detail::Reduction::Sum, p, count); });
+        report("sum", n, before, after);
+        double norm = timeIt([&] { sink = detail::reduce(detail::Reduction::SumSquares, p, count); });
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(10) << "GB/s" << std::setw(8) << n
+                  << "  sum " << count * sizeof(double) / after * 1e-9
+                  << "  norm " << count * sizeof(double) / norm * 1e-9 << "\n";
+    }
+
+    /**
+     * @brief The former operator^: right-to-left binary exponentiation with an
+     * allocating product per step, squaring once more after the last bit
+     */
+    SquareMat legacyPower(const SquareMat& m, unsigned int p) {
+        SquareMat result = m ^ 0;
+        SquareMat base = m;
+        while (p) {
+            if (p & 1)
+                result = result * base;
+            base = base * base;
+            p >>= 1;
+        }
+        return result;
+    }
+
+    void benchPower(int n) {
+        // mat ^ 1000000 on a dense, an upper triangular and a diagonal
+        // row-stochastic matrix, which keeps the powers finite
+        SquareMat dense(n), upper(n), diag(n);
+        std::mt19937_64 rng(n);
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        for (int i = 0; i < n; ++i) {
+            double sum = 0.0, upperSum = 0.0;
+            for (int j = 0; j < n; ++j) {
+                dense[i][j] = dist(rng);
+                sum += dense[i][j];
+                upperSum += j >= i ? dense[i][j] : 0.0;
+            }
+            for (int j = 0; j < n; ++j) {
+                if (j >= i)
+                    upper[i][j] = dense[i][j] / upperSum;
+                dense[i][j] /= sum;
+            }
+            diag[i][i] = 1.0;
+        }
+        const unsigned int p = 1000000;
+        double before = timeIt([&] { sink = legacyPower(dense, p)[0][0]; });
+        double after = timeIt([&] { sink = (dense ^ p)[0][0]; });
+        report("^ dense", n, before, after);
+        before = timeIt([&] { sink = legacyPower(upper, p)[0][0]; });
+        after = timeIt([&] { sink = (upper ^ p)[0][0]; });
+        report("^ upper", n, before, after);
+        before = timeIt([&] { sink = legacyPower(diag, p)[0][0]; });
+        after = timeIt([&] { sink = (diag ^ p)[0][0]; });
+        report("^ diag", n, before, after);
+    }
+
+    void benchStrassen(int n) {
+        // Same product through the blocked GEMM (before) and Strassen-Winograd (after)
+        SquareMat a(n), b(n);
+        fill(a, n);
+        fill(b, n);
+        setMultiplyAlgorithm(MultiplyAlgorithm::Classic);
+        double before = timeIt([&] { SquareMat r = a * b; sink = r[0][0]; });
+        setMultiplyAlgorithm(MultiplyAlgorithm::StrassenWinograd);
+        double after = timeIt([&] { SquareMat r = a * b; sink = r[0][0]; });
+        setMultiplyAlgorithm(MultiplyAlgorithm::Classic);
+        report("strassen", n, before, after);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(std::atoi(argv[i]));
+    if (sizes.empty())
+        sizes = {64, 512, 4096};
+
+    std::cout << std::setw(10) << "op" << std::setw(8) << "n"
+              << std::setw(16) << "before (us)" << std::setw(16) << "after (us)"
+              << std::setw(11) << "speedup\n";
+
+    for (int n : sizes) {
+        double legacy = timeIt([&] { LegacyMat m(n); sink = m.matrix[0][0]; });
+        double current = timeIt([&] { SquareMat m(n); sink = m[0][0]; });
+        report("construct", n, legacy, current);
+
+        LegacyMat la(n), lb(n);
+        SquareMat a(n), b(n);
+        fill(la.matrix, n);
+        fill(lb.matrix, n);
+        fill(a, n);
+        fill(b, n);
+
+        legacy = timeIt([&] { LegacyMat r = la + lb; sink = r.matrix[0][0]; });
+        current = timeIt([&] { SquareMat r = a + b; sink = r[0][0]; });
+        report("+", n, legacy, current);
+
+        legacy = timeIt([&] { LegacyMat r = la * lb; sink = r.matrix[0][0]; });
+        current = timeIt([&] { SquareMat r = a * b; sink = r[0][0]; });
+        report("*", n, legacy, current);
+
+        benchTranspose(n, la, a);
+
+        // A^T * B: materialized transpose (before) vs a view read during packing (after)
+        legacy = timeIt([&] { SquareMat r = ~a * b; sink = r[0][0]; });
+        current = timeIt([&] { SquareMat r = transposed(a) * b; sink = r[0][0]; });
+        report("~a * b", n, legacy, current);
+        legacy = timeIt([&] { SquareMat r = a * ~b; sink = r[0][0]; });
+        current = timeIt([&] { SquareMat r = a * transposed(b); sink = r[0][0]; });
+        report("a * ~b", n, legacy, current);
+
+        benchLoad(n, a);
+        benchText(n);
+        benchReduce(n, a);
+        if (n <= 1024)
+            benchPower(n);
+
+        if (n > strassenCrossover())
+            benchStrassen(n);
+    }
+
+    benchFixed<2>();
+    benchFixed<3>();
+    benchFixed<4>();
+    benchFixed<6>();
+    benchBatch(4);
+    benchBatch(8);
+    benchSort(4);
+    benchSort(16);
+    return 0;
+}
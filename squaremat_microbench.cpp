@@ -0,0 +1,278 @@
+// ey.gellis@gmail.com
+#include "benchmark.hpp"
+#include "squaremat.hpp"
+#include "basicmat.hpp"
+#include "modmat.hpp"
+#include "sparsemat.hpp"
+#include "structured.hpp"
+#include "kernels.hpp"
+#include "power.hpp"
+#include "strassen.hpp"
+#include "threadpool.hpp"
+#include "transpose.hpp"
+using namespace matrix;
+#include <complex>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+    SquareMat randomMat(int n, double lo, double hi, unsigned seed) {
+        SquareMat m(n);
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> dist(lo, hi);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                m[i][j] = dist(rng);
+        return m;
+    }
+
+    /**
+     * @brief Cyclic shift permutation; multiplying by it keeps magnitudes fixed,
+     * so repeated in-place products never reach denormals or infinities
+     */
+    SquareMat permutation(int n) {
+        SquareMat p(n);
+        for (int i = 0; i < n; ++i)
+            p[i][(i + 1) % n] = 1.0;
+        return p;
+    }
+
+    /**
+     * @brief Row-stochastic matrix, whose powers stay bounded
+     */
+    SquareMat stochastic(int n, unsigned seed) {
+        SquareMat m = randomMat(n, 0.0, 1.0, seed);
+        for (int i = 0; i < n; ++i) {
+            double rowSum = 0.0;
+            for (double x : m[i])
+                rowSum += x;
+            for (double& x : m[i])
+                x /= rowSum;
+        }
+        return m;
+    }
+
+    const char* isaName(detail::Isa isa) {
+        switch (isa) {
+        case detail::Isa::AVX512:
+            return "AVX512";
+        case detail::Isa::AVX2:
+            return "AVX2";
+        case detail::Isa::SSE2:
+            return "SSE2";
+        default:
+            return "Scalar";
+        }
+    }
+
+    /**
+     * @brief Every SquareMat operator at one size
+     *
+     * Flop counts are those of the textbook algorithm (2n^3 per product) and
+     * byte counts the minimum traffic: operands read once, result written once.
+     */
+    void runSize(bench::Suite& suite, int n) {
+        using bench::doNotOptimize;
+        const double e = static_cast<double>(n) * n;
+        const double bytes = e * sizeof(double);
+        const double cube = e * n;
+
+        const SquareMat a = randomMat(n, -1.0, 1.0, 1);
+        const SquareMat b = randomMat(n, 0.5, 1.5, 2);
+        const SquareMat perm = permutation(n);
+        SquareMat c = randomMat(n, -1.0, 1.0, 3);
+        SquareMat out(n);
+
+        suite.run("construct", n, 0, bytes, [&] { SquareMat m(n); doNotOptimize(m[0][0]); });
+        suite.run("copy", n, 0, 2 * bytes, [&] { SquareMat m(a); doNotOptimize(m[0][0]); });
+        suite.run("copy_assign", n, 0, 2 * bytes, [&] { out = a; doNotOptimize(out[0][0]); });
+        suite.run("element_read", n, 0, bytes, [&] {
+            double acc = 0.0;
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    acc += a[i][j];
+            doNotOptimize(acc);
+        });
+        suite.run("element_write", n, 0, bytes, [&] {
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    c[i][j] = j;
+            doNotOptimize(c[0][0]);
+        });
+
+        suite.run("add", n, e, 3 * bytes, [&] { SquareMat r = a + b; doNotOptimize(r[0][0]); });
+        suite.run("add_assign", n, e, 3 * bytes, [&] { c += b; doNotOptimize(c[0][0]); });
+        suite.run("sub", n, e, 3 * bytes, [&] { SquareMat r = a - b; doNotOptimize(r[0][0]); });
+        suite.run("sub_assign", n, e, 3 * bytes, [&] { c -= b; doNotOptimize(c[0][0]); });
+        suite.run("negate", n, e, 2 * bytes, [&] { SquareMat r = -a; doNotOptimize(r[0][0]); });
+        suite.run("scale", n, e, 2 * bytes, [&] { SquareMat r = a * 2.0; doNotOptimize(r[0][0]); });
+        suite.run("scale_left", n, e, 2 * bytes, [&] { SquareMat r = 2.0 * a; doNotOptimize(r[0][0]); });
+        suite.run("scale_assign", n, e, 2 * bytes, [&] { c *= 1.0; doNotOptimize(c[0][0]); });
+        suite.run("divide", n, e, 2 * bytes, [&] { SquareMat r = a / 2.0; doNotOptimize(r[0][0]); });
+        suite.run("divide_assign", n, e, 2 * bytes, [&] { c /= 1.0; doNotOptimize(c[0][0]); });
+        suite.run("mod", n, 4 * e, 3 * bytes, [&] { SquareMat r = a % b; doNotOptimize(r[0][0]); });
+        suite.run("mod_int", n, 4 * e, 2 * bytes, [&] { SquareMat r = a % 3; doNotOptimize(r[0][0]); });
+        suite.run("mod_assign", n, 4 * e, 3 * bytes, [&] { c %= b; doNotOptimize(c[0][0]); });
+        suite.run("mod_int_assign", n, 4 * e, 2 * bytes, [&] { c %= 3; doNotOptimize(c[0][0]); });
+        suite.run("pre_increment", n, e, 2 * bytes, [&] { ++c; doNotOptimize(c[0][0]); });
+        suite.run("post_increment", n, e, 2 * bytes, [&] { SquareMat r = c++; doNotOptimize(r[0][0]); });
+        suite.run("pre_decrement", n, e, 2 * bytes, [&] { --c; doNotOptimize(c[0][0]); });
+        suite.run("post_decrement", n, e, 2 * bytes, [&] { SquareMat r = c--; doNotOptimize(r[0][0]); });
+
+        suite.run("multiply", n, 2 * cube, 3 * bytes, [&] { SquareMat r = a * b; doNotOptimize(r[0][0]); });
+        suite.run("multiply_assign", n, 2 * cube, 3 * bytes, [&] { c *= perm; doNotOptimize(c[0][0]); });
+        suite.run("transposed_multiply", n, 2 * cube, 3 * bytes, [&] {
+            SquareMat r = transposed(a) * b;
+            doNotOptimize(r[0][0]);
+        });
+        suite.run("power_3", n, 4 * cube, 2 * bytes, [&] { SquareMat r = a ^ 3; doNotOptimize(r[0][0]); });
+        if (n <= 512) {
+            const SquareMat s = stochastic(n, 4);
+            suite.run("power_1000000", n, 2 * cube * detail::powerProducts(1000000), 2 * bytes, [&] {
+                SquareMat r = s ^ 1000000;
+                doNotOptimize(r[0][0]);
+            });
+        }
+        suite.run("determinant", n, 2.0 / 3.0 * cube, bytes, [&] { doNotOptimize(!a); });
+
+        suite.run("transpose", n, 0, 2 * bytes, [&] { SquareMat r = ~a; doNotOptimize(r[0][0]); });
+        suite.run("transpose_in_place", n, 0, 2 * bytes, [&] { c.transposeInPlace(); doNotOptimize(c[0][0]); });
+
+        // Warm sum caches make comparisons O(1); sum_cold dirties the cache first
+        suite.run("equal", n, 0, 0, [&] { doNotOptimize(a == b); });
+        suite.run("not_equal", n, 0, 0, [&] { doNotOptimize(a != b); });
+        suite.run("less", n, 0, 0, [&] { doNotOptimize(a < b); });
+        suite.run("greater", n, 0, 0, [&] { doNotOptimize(a > b); });
+        suite.run("less_equal", n, 0, 0, [&] { doNotOptimize(a <= b); });
+        suite.run("greater_equal", n, 0, 0, [&] { doNotOptimize(a >= b); });
+        suite.run("sum_cold", n, e, bytes, [&] { c[0][0] = 0.5; doNotOptimize(c.sum()); });
+        suite.run("min", n, e, bytes, [&] { doNotOptimize(a.min()); });
+        suite.run("max", n, e, bytes, [&] { doNotOptimize(a.max()); });
+        suite.run("frobenius_norm", n, 2 * e, bytes, [&] { doNotOptimize(a.frobeniusNorm()); });
+        suite.run("trace", n, n, n * sizeof(double), [&] { doNotOptimize(a.trace()); });
+
+        // Other element types, converted from the same operands
+        const BasicSquareMat<float> fa(a), fb(b);
+        const BasicSquareMat<std::int64_t> ia(a * 100.0), ib(b * 100.0);
+        const BasicSquareMat<BFloat16> ha(a), hb(b);
+        const BasicSquareMat<std::complex<double>> ca(a), cb(b);
+        const double fbytes = e * sizeof(float);
+        suite.run("add_f32", n, e, 3 * fbytes, [&] { BasicSquareMat<float> r = fa + fb; doNotOptimize(r[0][0]); });
+        suite.run("multiply_f32", n, 2 * cube, 3 * fbytes, [&] {
+            BasicSquareMat<float> r = fa * fb;
+            doNotOptimize(r[0][0]);
+        });
+        suite.run("multiply_bf16", n, 2 * cube, 1.5 * fbytes, [&] {
+            BasicSquareMat<BFloat16> r = ha * hb;
+            doNotOptimize(r[0][0]);
+        });
+        suite.run("multiply_i64", n, 2 * cube, 3 * bytes, [&] {
+            BasicSquareMat<std::int64_t> r = ia * ib;
+            doNotOptimize(r[0][0]);
+        });
+        suite.run("multiply_c64", n, 8 * cube, 6 * bytes, [&] {
+            BasicSquareMat<std::complex<double>> r = ca * cb;
+            doNotOptimize(r[0][0]);
+        });
+        suite.run("mod_int_i64", n, e, 2 * bytes, [&] { BasicSquareMat<std::int64_t> r = ia % 7; doNotOptimize(r[0][0]); });
+        if (n <= 64)
+            suite.run("determinant_i64", n, 2.0 / 3.0 * cube, bytes, [&] {
+                // Entries in [-100, 150] overflow 64 bits past a handful of rows
+                try {
+                    doNotOptimize(!ia);
+                } catch (const std::overflow_error&) {
+                }
+            });
+
+        // Modular products: the vector path below 2^31 and the 128-bit one above
+        const ModMat ma(ia, 1000000007), mb(ib, 1000000007);
+        const ModMat wa(ia, (1ull << 61) - 1), wb(ib, (1ull << 61) - 1);
+        suite.run("multiply_mod_1e9+7", n, 2 * cube, 3 * bytes, [&] { ModMat r = ma * mb; doNotOptimize(r[0][0]); });
+        suite.run("multiply_mod_2^61-1", n, 2 * cube, 3 * bytes, [&] { ModMat r = wa * wb; doNotOptimize(r[0][0]); });
+        if (n <= 256)
+            suite.run("pow_mod_1e18", n, 2 * cube * 87, 2 * bytes, [&] {
+                ModMat r = ma ^ 1000000000000000000ull;
+                doNotOptimize(r[0][0]);
+            });
+
+        // Sparse operands with about 1% nonzeros, and a dense product that
+        // dispatches to the same kernels
+        SquareMat thin(n);
+        std::mt19937_64 pick(11);
+        for (int i = 0; i < n; ++i)
+            for (int k = 0; k < std::max(1, n / 100); ++k)
+                thin[i][pick() % n] = a[i][k];
+        const SparseMat sa(thin), sb(~thin);
+        const double nnz = static_cast<double>(sa.nonZeros());
+        const std::vector<double> vec(a[0].begin(), a[0].end());
+        suite.run("spmv_1pct", n, 2 * nnz, nnz * 12 + 2 * n * sizeof(double), [&] {
+            std::vector<double> y = sa * vec;
+            doNotOptimize(y[0]);
+        });
+        suite.run("spmm_1pct", n, 2 * nnz * n, 2 * bytes, [&] { SquareMat r = sa * b; doNotOptimize(r[0][0]); });
+        suite.run("spgemm_1pct", n, 2 * nnz * nnz / n, 0, [&] { SparseMat r = sa * sb; doNotOptimize(r.nonZeros()); });
+        suite.run("multiply_dispatch_1pct", n, 2 * nnz * n, 3 * bytes, [&] {
+            SquareMat r = thin * b;
+            doNotOptimize(r[0][0]);
+        });
+
+        // Triangular and tridiagonal operands; dense products dispatch on the former
+        SquareMat tri(n), band(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = std::max(0, i - 1); j < n; ++j) {
+                if (j >= i)
+                    tri[i][j] = a[i][j];
+                if (j <= i + 1)
+                    band[i][j] = a[i][j];
+            }
+        const StructuredMat tridiagonal(band);
+        suite.run("multiply_upper", n, cube, 3 * bytes, [&] { SquareMat r = tri * b; doNotOptimize(r[0][0]); });
+        suite.run("multiply_upper_upper", n, cube / 3, 3 * bytes, [&] { SquareMat r = tri * tri; doNotOptimize(r[0][0]); });
+        suite.run("structured_banded_dense", n, 6.0 * e, 2 * bytes, [&] {
+            SquareMat r = tridiagonal * b;
+            doNotOptimize(r[0][0]);
+        });
+        // Squarings of bandwidth 3, 5 and 9 cost 2 * n * w^2 each
+        suite.run("structured_banded_pow8", n, 230.0 * n, 0, [&] {
+            StructuredMat r = tridiagonal ^ 8;
+            doNotOptimize(r.at(0, 0));
+        });
+
+        std::ostringstream text;
+        text << a;
+        const std::string formatted = text.str();
+        suite.run("stream_out", n, 0, static_cast<double>(formatted.size()), [&] {
+            std::ostringstream os;
+            os << a;
+            doNotOptimize(static_cast<long>(os.tellp()));
+        });
+        suite.run("stream_in", n, 0, static_cast<double>(formatted.size()), [&] {
+            std::istringstream is(formatted);
+            is >> out;
+            doNotOptimize(out[0][0]);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        const bench::Options options = bench::Options::parse(argc, argv);
+        bench::Suite suite(options);
+        for (int n : suite.sizes())
+            runSize(suite, n);
+        return suite.finish({
+            {"threads", std::to_string(threadCount())},
+            {"isa", isaName(detail::activeIsa())},
+            {"multiply_algorithm", multiplyAlgorithm() == MultiplyAlgorithm::Classic ? "classic" : "strassen-winograd"},
+        });
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << "\n";
+        return 2;
+    }
+}
@@ -2,8 +2,109 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include "squaremat.hpp"
+#include "kernels.hpp"
+#include "threadpool.hpp"
+#include "lu.hpp"
+#include "expr.hpp"
+#include "arena.hpp"
+#include "fixedmat.hpp"
+#include "batch.hpp"
+#include "strassen.hpp"
+#include "transpose.hpp"
+#include "binaryio.hpp"
+#include "tiled.hpp"
+#include "textio.hpp"
+#include "reduce.hpp"
+#include "power.hpp"
+#include "instrument.hpp"
+#include "basicmat.hpp"
+#include "modmat.hpp"
+#include "sparsemat.hpp"
+#include "structured.hpp"
 using namespace matrix;
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <cstdlib>
+#include <new>
 #include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+// Matrix buffers are the only aligned allocations in the library, so counting
+// aligned operator new calls counts matrix allocations exactly
+static int alignedAllocations = 0;
+
+void* operator new(std::size_t bytes, std::align_val_t align) {
+    ++alignedAllocations;
+    std::size_t alignment = static_cast<std::size_t>(align);
+    void* ptr = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+template <typename F>
+int countAllocations(F&& fn) {
+    int before = alignedAllocations;
+    fn();
+    return alignedAllocations - before;
+}
+
+// Textbook triple loop, the reference the product engines are checked against
+SquareMat naiveProduct(const SquareMat& a, const SquareMat& b) {
+    const int n = a.dim();
+    SquareMat r(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            double s = 0.0;
+            for (int k = 0; k < n; ++k)
+                s += a[i][k] * b[k][j];
+            r[i][j] = s;
+        }
+    return r;
+}
+
+// Same size and equal elements, where NaN matches NaN and -0.0 matches 0.0
+bool sameElements(const SquareMat& x, const SquareMat& y) {
+    bool equal = x.dim() == y.dim();
+    for (int i = 0; equal && i < x.dim(); ++i)
+        for (int j = 0; j < x.dim(); ++j)
+            equal = equal && (x[i][j] == y[i][j] || (std::isnan(x[i][j]) && std::isnan(y[i][j])));
+    return equal;
+}
+
+// Largest element-wise error within tolerance times the largest expected element
+bool nearlyEqual(const SquareMat& actual, const SquareMat& expected, double tolerance = 1e-12) {
+    double scale = 0.0, error = 0.0;
+    for (int i = 0; i < expected.dim(); ++i)
+        for (int j = 0; j < expected.dim(); ++j) {
+            scale = std::max(scale, std::abs(expected[i][j]));
+            error = std::max(error, std::abs(actual[i][j] - expected[i][j]));
+        }
+    return actual.dim() == expected.dim() && error <= tolerance * scale;
+}
 
 TEST_CASE("SquareMat Construction and Basic Operations") {
     SUBCASE("Constructor tests") {
@@ -137,3 +238,1670 @@ TEST_CASE("SquareMat Construction and Basic Operations") {
         CHECK(mat[1][1] == 8.0);
     }
 }
+
+TEST_CASE("Blocked multiplication matches the naive product") {
+    for (int n : {1, 7, 49, 131, 300}) {
+        SquareMat a(n), b(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                a[i][j] = (i * 3 + j) % 7 - 3.0;
+                b[i][j] = (i + j * 5) % 11 - 5.0;
+            }
+
+        SquareMat c = a * b;
+        CHECK(sameElements(c, naiveProduct(a, b)));
+
+        a *= b;
+        CHECK(a[n - 1][n - 1] == c[n - 1][n - 1]);
+    }
+}
+
+TEST_CASE("SIMD kernels match the scalar reference bit for bit") {
+    using namespace matrix::detail;
+    const std::size_t n = 1003;
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(-1e6, 1e6);
+    std::vector<double> a(n), b(n), expected(n), actual(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        a[i] = dist(rng);
+        b[i] = dist(rng);
+    }
+    a[0] = 0.0;
+    a[1] = -0.0;
+    const double sc = dist(rng);
+    const Kernels& ref = kernels(Isa::Scalar);
+
+    auto same = [&] { return std::memcmp(expected.data(), actual.data(), n * sizeof(double)) == 0; };
+
+    for (Isa isa : {Isa::SSE2, Isa::AVX2, Isa::AVX512}) {
+        if (!isaSupported(isa))
+            continue;
+        CAPTURE(static_cast<int>(isa));
+        const Kernels& k = kernels(isa);
+
+        ref.add(a.data(), b.data(), expected.data(), n);
+        k.add(a.data(), b.data(), actual.data(), n);
+        CHECK(same());
+        ref.sub(a.data(), b.data(), expected.data(), n);
+        k.sub(a.data(), b.data(), actual.data(), n);
+        CHECK(same());
+        ref.neg(a.data(), expected.data(), n);
+        k.neg(a.data(), actual.data(), n);
+        CHECK(same());
+        ref.addScalar(a.data(), sc, expected.data(), n);
+        k.addScalar(a.data(), sc, actual.data(), n);
+        CHECK(same());
+        ref.mulScalar(a.data(), sc, expected.data(), n);
+        k.mulScalar(a.data(), sc, actual.data(), n);
+        CHECK(same());
+        ref.divScalar(a.data(), sc, expected.data(), n);
+        k.divScalar(a.data(), sc, actual.data(), n);
+        CHECK(same());
+        expected = b;
+        actual = b;
+        ref.axpy(a.data(), sc, expected.data(), n);
+        k.axpy(a.data(), sc, actual.data(), n);
+        CHECK(same());
+    }
+
+    Isa original = activeIsa();
+    for (Isa isa : {Isa::Scalar, Isa::SSE2, Isa::AVX2, Isa::AVX512}) {
+        if (!isaSupported(isa))
+            continue;
+        setIsa(isa);
+        SquareMat m({{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}, {7.0, 8.0, 9.0}});
+        SquareMat r = (m + m - (-m)) / 3.0;
+        CHECK(r[2][2] == 9.0);
+        ++r;
+        r *= 2.0;
+        CHECK(r[0][0] == 4.0);
+    }
+    setIsa(original);
+}
+
+TEST_CASE("Parallel multiplication matches the serial path") {
+    const int n = 600;
+    SquareMat a(n), b(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            a[i][j] = (i * 5 + j) % 9 - 4.0;
+            b[i][j] = (i + j * 2) % 13 - 6.0;
+        }
+
+    int originalThreshold = parallelThreshold();
+    setThreadCount(1);
+    SquareMat serial = a * b;
+
+    setThreadCount(4);
+    setParallelThreshold(64);
+    CHECK(threadCount() == 4);
+    SquareMat parallel = a * b;
+    bool same = true;
+    for (int i = 0; i < n && same; ++i)
+        for (int j = 0; j < n && same; ++j)
+            same = serial[i][j] == parallel[i][j];
+    CHECK(same);
+
+    CHECK_THROWS_AS(matrix::detail::parallelFor(8, [](int i) {
+        if (i == 5)
+            throw std::runtime_error("task failed");
+    }), std::runtime_error);
+
+    setParallelThreshold(originalThreshold);
+    setThreadCount(0);
+}
+
+TEST_CASE("LU determinant") {
+    SquareMat m({
+        {2.0, -1.0, 0.0, 3.0},
+        {1.0, 4.0, 2.0, -2.0},
+        {0.0, 5.0, -3.0, 1.0},
+        {6.0, 1.0, 1.0, 0.0}
+    });
+    CHECK(!m == doctest::Approx(311.0));
+
+    LUDecomposition lu(m);
+    SquareMat product = lu.lower() * lu.upper();
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            CHECK(product[i][j] == doctest::Approx(m[lu.permutation()[i]][j]));
+
+    std::vector<double> x = lu.solve({1.0, 2.0, 3.0, 4.0});
+    for (int i = 0; i < 4; ++i) {
+        double row = 0.0;
+        for (int j = 0; j < 4; ++j)
+            row += m[i][j] * x[j];
+        CHECK(row == doctest::Approx(i + 1.0));
+    }
+
+    SquareMat singular({{1.0, 2.0, 3.0, 4.0}, {2.0, 4.0, 6.0, 8.0}, {0.0, 1.0, 0.0, 1.0}, {1.0, 0.0, 1.0, 0.0}});
+    CHECK(!singular == 0.0);
+    CHECK(LUDecomposition(singular).logDeterminant().sign == 0);
+
+    const int n = 300;
+    SquareMat big(n);
+    for (int i = 0; i < n; ++i)
+        big[i][n - 1 - i] = 1000.0;
+    CHECK(std::isinf(!big));
+    LogDeterminant logDet = LUDecomposition(big).logDeterminant();
+    CHECK(logDet.sign == 1);
+    CHECK(logDet.logAbs == doctest::Approx(n * std::log(1000.0)));
+}
+
+TEST_CASE("Lazy expressions evaluate in one pass") {
+    SquareMat a({{1.0, 2.0}, {3.0, 4.0}});
+    SquareMat b({{5.0, 6.0}, {7.0, 8.0}});
+    SquareMat c({{1.0, 1.0}, {1.0, 1.0}});
+
+    SquareMat r = lazy(a) + lazy(b) * 2.0 - lazy(c);
+    CHECK(r[0][0] == 10.0);
+    CHECK(r[1][1] == 19.0);
+
+    r = -(lazy(a) / 2.0) + 2.0 * lazy(c);
+    CHECK(r[0][1] == 1.0);
+    CHECK(r[1][0] == 0.5);
+
+    r = lazy(a) * lazy(b) + lazy(c);
+    CHECK(r[0][0] == 20.0);
+    CHECK(r[1][1] == 51.0);
+
+    r = (lazy(a) + lazy(c)) * lazy(b) - lazy(a);
+    CHECK(r[0][0] == 30.0);
+    CHECK(r[1][1] == 60.0);
+
+    r += lazy(a) - lazy(a);
+    CHECK(r[1][1] == 60.0);
+
+    a = lazy(a) + lazy(a);
+    CHECK(a[1][1] == 8.0);
+
+    SquareMat small(3);
+    CHECK_THROWS_AS(SquareMat(lazy(a) + lazy(small)), std::invalid_argument);
+    CHECK_THROWS_AS(SquareMat(lazy(a) * lazy(small)), std::invalid_argument);
+}
+
+TEST_CASE("Rvalue operands reuse storage") {
+    SquareMat a({{1.0, 2.0}, {3.0, 4.0}});
+    SquareMat b({{5.0, 6.0}, {7.0, 8.0}});
+
+    CHECK(countAllocations([&] { SquareMat r = a + b; }) == 1);
+    CHECK(countAllocations([&] { SquareMat r = a + b + a - b; }) == 1);
+    CHECK(countAllocations([&] { SquareMat r = a * 2.0 + b / 2.0; }) == 2);
+    CHECK(countAllocations([&] { SquareMat r = -(a - b) * 3.0; }) == 1);
+    CHECK(countAllocations([&] { SquareMat r = 2.0 * (a + b); }) == 1);
+    CHECK(countAllocations([&] { SquareMat r = ~(a + b) % 3; }) == 1);
+    CHECK(countAllocations([&] { SquareMat r = a * b; }) == 1);
+    CHECK(countAllocations([&] { SquareMat c = a; c *= b; }) == 2);
+    CHECK(countAllocations([&] { SquareMat c = a; SquareMat r = c++; }) == 2);
+    CHECK(countAllocations([&] { SquareMat c = a; c += b; c /= 2.0; }) == 1);
+    CHECK(countAllocations([&] { SquareMat r = a ^ 2; }) == 3);
+    CHECK(countAllocations([&] { SquareMat r = a ^ 1000; }) == 3);
+
+    SquareMat r = -(a - b) * 3.0;
+    CHECK(r[0][0] == 12.0);
+    r = a - (b + b);
+    CHECK(r[1][1] == -12.0);
+    r = ~(a + b) % 5;
+    CHECK(r[0][1] == 0.0);
+    CHECK(r[1][0] == 3.0);
+    r = 2.0 * (a + b);
+    CHECK(r[1][0] == 20.0);
+    SquareMat c = a;
+    r = c++;
+    CHECK(r[0][0] == 1.0);
+    CHECK(c[0][0] == 2.0);
+    r = a ^ 5;
+    SquareMat expected = a * a * a * a * a;
+    CHECK(r[1][1] == expected[1][1]);
+}
+
+TEST_CASE("Scratch arena removes steady-state allocations") {
+    SquareMat a({{1.0, 2.0}, {3.0, 4.0}});
+    SquareMat b({{5.0, 6.0}, {7.0, 8.0}});
+    SquareMat c({{1.0, 1.0}, {1.0, 1.0}});
+    ScratchArena arena(256);
+
+    double total = 0.0;
+    for (int iteration = 0; iteration < 5; ++iteration) {
+        int allocations = countAllocations([&] {
+            ResourceScope scope(&arena);
+            SquareMat r = (a + b * 2.0 - c) * a;
+            r = r ^ 3;
+            CHECK(r.resource() == &arena);
+            total += r[0][0];
+        });
+        arena.reset();
+        if (iteration > 0)
+            CHECK(allocations == 0);
+    }
+    CHECK(total == 5 * ((a + b * 2.0 - c) * a ^ 3)[0][0]);
+    CHECK(arena.systemAllocations() >= 1);
+
+    SquareMat outside(2);
+    CHECK(outside.resource() == std::pmr::get_default_resource());
+    {
+        ResourceScope scope(&ScratchArena::local());
+        SquareMat kept(a, std::pmr::get_default_resource());
+        CHECK(kept.resource() == std::pmr::get_default_resource());
+        SquareMat scratch = kept + b;
+        CHECK(scratch.resource() == &ScratchArena::local());
+        outside = scratch;
+    }
+    CHECK(outside.resource() == std::pmr::get_default_resource());
+    CHECK(outside[1][1] == 12.0);
+    ScratchArena::local().reset();
+
+    // Moving an arena temporary into a longer-lived matrix copies it instead
+    // of handing over arena memory that the next reset reclaims
+    SquareMat persistent(2);
+    {
+        ResourceScope scope(&arena);
+        persistent = a + b;
+        CHECK(persistent.resource() == std::pmr::get_default_resource());
+    }
+    arena.reset();
+    {
+        ResourceScope scope(&arena);
+        SquareMat overwrite(2);
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 2; ++j)
+                overwrite[i][j] = 42.0;
+    }
+    CHECK(persistent[1][0] == 10.0);
+    CHECK(persistent.sum() == 36.0);
+}
+
+TEST_CASE("Fixed-size matrices") {
+    constexpr Mat3 m({2.0, -1.0, 0.0, 1.0, 3.0, 2.0, 0.0, 4.0, 5.0});
+    static_assert((!m) == 19.0, "3x3 determinant is evaluated at compile time");
+    static_assert((m * Mat3::identity())(2, 1) == 4.0, "products are constexpr");
+    static_assert((m ^ 2)(0, 0) == 3.0, "powers are constexpr");
+
+    SquareMat dynamic = m.toSquareMat();
+    CHECK(!dynamic == doctest::Approx(!m));
+    SquareMat product = m * dynamic;
+    SquareMat expected = dynamic * dynamic;
+    CHECK(product[1][2] == expected[1][2]);
+    CHECK(Mat3(expected)(1, 2) == expected[1][2]);
+    CHECK_THROWS_AS(Mat2{dynamic}, std::invalid_argument);
+
+    Mat4 m4({4.0, 7.0, 2.0, 3.0, 0.0, 5.0, 1.0, 8.0, 3.0, 1.0, 6.0, 2.0, 1.0, 0.0, 2.0, 9.0});
+    Mat6 m6;
+    for (int i = 0; i < 6; ++i)
+        for (int j = 0; j < 6; ++j)
+            m6[i][j] = (i == j) ? 10.0 : (i * 6 + j) % 5 - 2.0;
+
+    CHECK(!m4 == doctest::Approx(!m4.toSquareMat()));
+    CHECK(!m6 == doctest::Approx(!m6.toSquareMat()));
+
+    auto nearIdentity = [](const auto& p) {
+        for (int i = 0; i < p.dim(); ++i)
+            for (int j = 0; j < p.dim(); ++j)
+                if (p(i, j) != doctest::Approx(i == j ? 1.0 : 0.0))
+                    return false;
+        return true;
+    };
+    CHECK(nearIdentity(m * m.inverse()));
+    CHECK(nearIdentity(m4 * m4.inverse()));
+    CHECK(nearIdentity(m6.inverse() * m6));
+    CHECK(nearIdentity(Mat2({1.0, 2.0, 3.0, 4.0}).inverse() * Mat2({1.0, 2.0, 3.0, 4.0})));
+    CHECK_THROWS_AS(Mat2({1.0, 2.0, 2.0, 4.0}).inverse(), std::domain_error);
+
+    Mat2 a({1.0, 2.0, 3.0, 4.0});
+    Mat2 b = a++;
+    CHECK(b(0, 0) == 1.0);
+    CHECK(a(0, 0) == 2.0);
+    CHECK((~a)(0, 1) == 4.0);
+    CHECK(a > b);
+    CHECK((a % 2)(1, 1) == 1.0);
+
+    // Same sign rules as SquareMat: % follows the divisor, %= the dividend
+    const Mat2 signs({-7.0, 7.0, -7.5, 5.0});
+    const Mat2 divisors({3.0, -3.0, 2.0, -4.0});
+    const SquareMat dynamicSigns = signs.toSquareMat(), dynamicDivisors = divisors.toSquareMat();
+    Mat2 truncated = signs;
+    truncated %= divisors;
+    SquareMat dynamicTruncated = dynamicSigns;
+    dynamicTruncated %= dynamicDivisors;
+    Mat2 truncatedScalar = signs;
+    truncatedScalar %= -3;
+    SquareMat dynamicScalar = dynamicSigns;
+    dynamicScalar %= -3;
+    const Mat2 floored = signs % divisors;
+    const SquareMat dynamicFloored = dynamicSigns % dynamicDivisors;
+    for (int i = 0; i < 2; ++i)
+        for (int j = 0; j < 2; ++j) {
+            CHECK(truncated(i, j) == dynamicTruncated[i][j]);
+            CHECK(truncatedScalar(i, j) == dynamicScalar[i][j]);
+            CHECK(floored(i, j) == dynamicFloored[i][j]);
+        }
+    CHECK(truncated(0, 0) == -1.0);
+    CHECK(floored(0, 0) == 2.0);
+    CHECK_THROWS_AS(truncated %= Mat2(), std::invalid_argument);
+}
+
+TEST_CASE("Batched small-matrix kernels") {
+    for (int n : {2, 3, 5}) {
+        const std::size_t count = 700;
+        SquareMatBatch a(n, count), b(n, count);
+        for (std::size_t m = 0; m < count; ++m)
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j) {
+                    a(m, i, j) = static_cast<double>((m + i * 3 + j * 7) % 9) - 4.0;
+                    b(m, i, j) = static_cast<double>((m * 5 + i + j) % 7) - 3.0;
+                }
+
+        SquareMatBatch sum = a + b;
+        SquareMatBatch product = a * b;
+        SquareMatBatch transposed = ~a;
+        SquareMatBatch cubed = a ^ 3;
+        std::vector<double> dets = a.determinants();
+
+        bool same = true;
+        for (std::size_t m = 0; m < count; m += 37) {
+            SquareMat am = a.get(m), bm = b.get(m);
+            SquareMat expectedProduct = am * bm;
+            SquareMat expectedCube = am * am * am;
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j) {
+                    same = same && sum(m, i, j) == am[i][j] + bm[i][j];
+                    same = same && product(m, i, j) == expectedProduct[i][j];
+                    same = same && transposed(m, i, j) == am[j][i];
+                    same = same && cubed(m, i, j) == expectedCube[i][j];
+                }
+            CHECK(dets[m] == doctest::Approx(!am).epsilon(1e-9));
+        }
+        CHECK(same);
+    }
+
+    SquareMatBatch batch(4, 2);
+    batch.set(1, SquareMat({{1.0, 2.0, 0.0, 0.0}, {2.0, 4.0, 0.0, 0.0}, {0.0, 0.0, 1.0, 0.0}, {0.0, 0.0, 0.0, 1.0}}));
+    batch.set(0, SquareMat({{0.0, 1.0, 0.0, 0.0}, {1.0, 0.0, 0.0, 0.0}, {0.0, 0.0, 2.0, 0.0}, {0.0, 0.0, 0.0, 3.0}}));
+    std::vector<double> dets = batch.determinants();
+    CHECK(dets[0] == -6.0);
+    CHECK(dets[1] == 0.0);
+    CHECK_THROWS_AS(batch.set(2, SquareMat(4)), std::out_of_range);
+    CHECK_THROWS_AS(batch + SquareMatBatch(4, 3), std::invalid_argument);
+
+    // Large enough to split across pool tasks, with a partial last group;
+    // every thread count must give the serial results
+    const int originalThreads = threadCount();
+    const std::size_t many = 8803;
+    SquareMatBatch big(4, many), other(4, many);
+    for (std::size_t m = 0; m < many; ++m)
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j) {
+                big(m, i, j) = static_cast<double>((m * 3 + i * 5 + j) % 11) - 5.0;
+                other(m, i, j) = static_cast<double>((m + i + j * 3) % 7) - 3.0;
+            }
+    setThreadCount(1);
+    const SquareMatBatch serialSum = big + other, serialProduct = big * other, serialCube = big ^ 3,
+                         serialTransposed = ~big;
+    const std::vector<double> serialDets = big.determinants();
+    for (int threads : {2, 4}) {
+        CAPTURE(threads);
+        setThreadCount(threads);
+        const SquareMatBatch sum = big + other, product = big * other, cube = big ^ 3, transposed = ~big;
+        CHECK(big.determinants() == serialDets);
+        bool same = true;
+        for (std::size_t m = 0; m < many; ++m)
+            for (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j) {
+                    same = same && sum(m, i, j) == serialSum(m, i, j);
+                    same = same && product(m, i, j) == serialProduct(m, i, j);
+                    same = same && cube(m, i, j) == serialCube(m, i, j);
+                    same = same && transposed(m, i, j) == serialTransposed(m, i, j);
+                }
+        CHECK(same);
+    }
+    setThreadCount(originalThreads);
+    const SquareMat last = big.get(many - 1), lastOther = other.get(many - 1);
+    const SquareMat lastProduct = last * lastOther;
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j) {
+            CHECK(serialSum(many - 1, i, j) == last[i][j] + lastOther[i][j]);
+            CHECK(serialProduct(many - 1, i, j) == lastProduct[i][j]);
+        }
+}
+
+TEST_CASE("Strassen-Winograd stays within its error bound") {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    const int crossover = 16;
+    setStrassenCrossover(crossover);
+
+    for (int n : {67, 128, 200}) {
+        CAPTURE(n);
+        SquareMat a(n), b(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                a[i][j] = dist(rng);
+                b[i][j] = dist(rng);
+            }
+
+        setMultiplyAlgorithm(MultiplyAlgorithm::Classic);
+        SquareMat expected = a * b;
+        SquareMat expectedCube = a ^ 3;
+        setMultiplyAlgorithm(MultiplyAlgorithm::StrassenWinograd);
+        SquareMat actual = a * b;
+        SquareMat cube = a ^ 3;
+        SquareMat accumulated(a);
+        accumulated *= b;
+        setMultiplyAlgorithm(MultiplyAlgorithm::Classic);
+
+        // Higham, Accuracy and Stability of Numerical Algorithms, Thm 23.3 (Winograd variant),
+        // taken over the padded dimension the recursion actually runs on
+        int base = n, levels = 0;
+        while (base > crossover) {
+            base = (base + 1) / 2;
+            ++levels;
+        }
+        const double padded = static_cast<double>(base << levels);
+        const double n0 = base;
+        const double u = std::numeric_limits<double>::epsilon() / 2;
+        const double bound = (std::pow(padded / n0, std::log2(18.0)) * (n0 * n0 + 6 * n0) - 6 * padded) * u;
+
+        double error = 0.0, cubeError = 0.0, cubeScale = 0.0;
+        bool sameInPlace = true;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                error = std::max(error, std::abs(actual[i][j] - expected[i][j]));
+                cubeError = std::max(cubeError, std::abs(cube[i][j] - expectedCube[i][j]));
+                cubeScale = std::max(cubeScale, std::abs(expectedCube[i][j]));
+                sameInPlace = sameInPlace && accumulated[i][j] == actual[i][j];
+            }
+        CHECK(error <= bound);
+        CHECK(error > 0.0);
+        CHECK(cubeError <= 1e-10 * cubeScale);
+        CHECK(sameInPlace);
+    }
+
+    setStrassenCrossover(0);
+    CHECK(strassenCrossover() == 1);
+    setStrassenCrossover(256);
+}
+
+TEST_CASE("Blocked transpose matches the naive one on every instruction set") {
+    using namespace matrix::detail;
+    Isa original = activeIsa();
+    for (Isa isa : {Isa::Scalar, Isa::SSE2, Isa::AVX2, Isa::AVX512}) {
+        if (!isaSupported(isa))
+            continue;
+        CAPTURE(static_cast<int>(isa));
+        setIsa(isa);
+        for (int n : {1, 3, 4, 5, 31, 33, 67, 130, 400}) {
+            CAPTURE(n);
+            SquareMat a(n);
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    a[i][j] = i * 1000.0 + j;
+            SquareMat out = ~a;
+            SquareMat in(a);
+            in.transposeInPlace();
+            bool same = true;
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    same = same && out[i][j] == a[j][i] && in[i][j] == a[j][i];
+            CHECK(same);
+        }
+
+        // Rectangular blocks with padded strides
+        const int rows = 37, cols = 70;
+        std::vector<double> src(rows * 80), dst(cols * 40, -1.0);
+        for (int i = 0; i < rows; ++i)
+            for (int j = 0; j < cols; ++j)
+                src[i * 80 + j] = i * 1000.0 + j;
+        transpose(rows, cols, src.data(), 80, dst.data(), 40);
+        bool same = true;
+        for (int j = 0; j < cols; ++j) {
+            for (int i = 0; i < rows; ++i)
+                same = same && dst[j * 40 + i] == src[i * 80 + j];
+            for (int i = rows; i < 40; ++i)
+                same = same && dst[j * 40 + i] == -1.0;
+        }
+        CHECK(same);
+    }
+    setIsa(original);
+
+    SquareMat m({{1.0, 2.0}, {3.0, 4.0}});
+    CHECK(&m.transposeInPlace() == &m);
+    CHECK(m[0][1] == 3.0);
+    CHECK(countAllocations([&] { m.transposeInPlace(); }) == 0);
+}
+
+TEST_CASE("Transposed views fuse into the product") {
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    for (int n : {5, 100, 300}) {
+        CAPTURE(n);
+        SquareMat a(n), b(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                a[i][j] = dist(rng);
+                b[i][j] = dist(rng);
+            }
+        SquareMat at = ~a, bt = ~b;
+
+        // Packing reads the view in transposed order, so the arithmetic is identical
+        SquareMat tn = transposed(a) * b, nt = a * transposed(b), tt = transposed(a) * transposed(b);
+        SquareMat etn = at * b, ent = a * bt, ett = at * bt;
+        bool same = true;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                same = same && tn[i][j] == etn[i][j] && nt[i][j] == ent[i][j] && tt[i][j] == ett[i][j];
+        CHECK(same);
+
+        setStrassenCrossover(16);
+        setMultiplyAlgorithm(MultiplyAlgorithm::StrassenWinograd);
+        SquareMat stn = transposed(a) * b;
+        setMultiplyAlgorithm(MultiplyAlgorithm::Classic);
+        setStrassenCrossover(256);
+        double error = 0.0;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                error = std::max(error, std::abs(stn[i][j] - etn[i][j]));
+        CHECK(error < 1e-10);
+
+        SquareMat r = transposed(a) * b;
+        CHECK(countAllocations([&] { r = transposed(a) * b; }) == 1);
+        CHECK(countAllocations([&] { r = ~a * b; }) == 2);
+    }
+
+    // Sparse and triangular operands reach the same kernels through a view
+    const int n = 100;
+    SquareMat sparse(n), upper(n), dense(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            sparse[i][j] = (i * 7 + j * 3) % 10 == 0 ? dist(rng) : 0.0;
+            upper[i][j] = j >= i ? dist(rng) : 0.0;
+            dense[i][j] = dist(rng);
+        }
+    CHECK(sameElements(transposed(sparse) * dense, ~sparse * dense));
+    CHECK(sameElements(dense * transposed(sparse), dense * ~sparse));
+    CHECK(sameElements(transposed(upper) * dense, ~upper * dense));
+    CHECK(sameElements(transposed(dense) * upper, ~dense * upper));
+    CHECK(sameElements(transposed(upper) * transposed(sparse), ~upper * ~sparse));
+    // Only diagonal scaling keeps a -0.0 element, which the GEMM's sums turn
+    // into +0.0; the sparse kernels, tried first, would do the same
+    const double sparseDensity = sparseThreshold();
+    setSparseThreshold(0.0);
+    SquareMat diagonal(n);
+    for (int i = 0; i < n; ++i)
+        diagonal[i][i] = i + 1.0;
+    dense[0][1] = -0.0;
+    dense[1][0] = -0.0;
+    CHECK(std::signbit((transposed(diagonal) * dense)[0][1]));
+    CHECK(std::signbit((dense * transposed(diagonal))[1][0]));
+    setSparseThreshold(sparseDensity);
+
+    SquareMat m({{1.0, 2.0}, {3.0, 4.0}});
+    TransposeView view = transposed(m);
+    CHECK(view(0, 1) == 3.0);
+    SquareMat materialized = view;
+    CHECK(materialized[1][0] == 2.0);
+    CHECK_THROWS_AS(transposed(m) * SquareMat(3), std::invalid_argument);
+}
+
+TEST_CASE("Binary files round-trip and map without reading") {
+    const int n = 150;
+    SquareMat a(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            a[i][j] = i * 0.5 - j / 3.0;
+
+    std::stringstream stream;
+    a.writeBinary(stream);
+    CHECK(stream.str().size() == sizeof(detail::FileHeader) + n * n * sizeof(double));
+    CHECK(sameElements(SquareMat::readBinary(stream), a));
+
+    const std::string path = "squaremat_test_map.bin";
+    a.save(path);
+    {
+        SquareMat mapped = SquareMat::mapFile(path, MapMode::ReadOnly, true);
+        const SquareMat& view = mapped;
+        CHECK(reinterpret_cast<std::uintptr_t>(view[0].data()) % SquareMat::alignment == 0);
+        CHECK(sameElements(view, a));
+        CHECK(sameElements(~~view, a));
+        CHECK(mapped.isMapped());
+
+        SquareMat moved = std::move(mapped);
+        CHECK(moved.isMapped());
+        moved = SquareMat(n);
+        CHECK_FALSE(moved.isMapped());
+        // Assigning a mapping keeps it mapped, whatever the destination's resource
+        moved = SquareMat::mapFile(path);
+        CHECK(moved.isMapped());
+        CHECK(sameElements(moved, a));
+        std::pmr::unsynchronized_pool_resource pool;
+        SquareMat pooled(n, &pool);
+        pooled = SquareMat::mapFile(path, MapMode::ReadOnly);
+        CHECK(pooled.isMapped());
+        CHECK(pooled.resource() == &pool);
+        pooled[0][0] = 1.0;
+        CHECK_FALSE(pooled.isMapped());
+        CHECK(pooled[0][1] == a[0][1]);
+    }
+    {
+        SquareMat cow = SquareMat::mapFile(path);
+        cow[0][0] = 42.0;
+        cow += cow;
+        CHECK(cow[0][0] == 84.0);
+        CHECK(cow.isMapped());
+    }
+    {
+        // Writes to a read-only mapping copy it out instead of faulting
+        SquareMat written = SquareMat::mapFile(path, MapMode::ReadOnly);
+        written[0][0] = 5.0;
+        CHECK_FALSE(written.isMapped());
+        CHECK(written[0][0] == 5.0);
+        CHECK(written[1][1] == a[1][1]);
+        SquareMat summed = SquareMat::mapFile(path, MapMode::ReadOnly);
+        summed += a;
+        CHECK(summed[2][3] == 2 * a[2][3]);
+        SquareMat transposed = SquareMat::mapFile(path, MapMode::ReadOnly);
+        transposed.transposeInPlace();
+        CHECK(transposed[0][1] == a[1][0]);
+        SquareMat expiring = SquareMat::mapFile(path, MapMode::ReadOnly);
+        const SquareMat reused = std::move(expiring) + a;
+        CHECK(reused[0][1] == 2 * a[0][1]);
+        CHECK((-SquareMat::mapFile(path, MapMode::ReadOnly))[0][1] == -a[0][1]);
+        CHECK((a - SquareMat::mapFile(path, MapMode::ReadOnly))[2][2] == 0.0);
+        // Expressions reading the mapping they are assigned to
+        SquareMat scaled = SquareMat::mapFile(path, MapMode::ReadOnly);
+        scaled = lazy(scaled) * 2.0;
+        CHECK_FALSE(scaled.isMapped());
+        CHECK(scaled[3][4] == 2 * a[3][4]);
+        SquareMat doubled = SquareMat::mapFile(path, MapMode::ReadOnly);
+        doubled += lazy(doubled);
+        CHECK(doubled[4][3] == 2 * a[4][3]);
+        SquareMat zeroed = SquareMat::mapFile(path, MapMode::ReadOnly);
+        zeroed -= lazy(zeroed) + lazy(a);
+        CHECK(zeroed[5][6] == -a[5][6]);
+    }
+    CHECK(sameElements(SquareMat::mapFile(path), a));
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(sizeof(detail::FileHeader) + 8);
+        double corrupt = 1e300;
+        file.write(reinterpret_cast<const char*>(&corrupt), sizeof(corrupt));
+    }
+    CHECK_NOTHROW(SquareMat::mapFile(path));
+    CHECK_THROWS_AS(SquareMat::mapFile(path, MapMode::ReadOnly, true), std::runtime_error);
+    std::ifstream corrupted(path, std::ios::binary);
+    CHECK_THROWS_AS(SquareMat::readBinary(corrupted), std::runtime_error);
+
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << "not a matrix file, just some text that is long enough for a header....";
+    }
+    CHECK_THROWS_AS(SquareMat::mapFile(path), std::invalid_argument);
+    std::remove(path.c_str());
+    CHECK_THROWS_AS(SquareMat::mapFile(path), std::system_error);
+}
+
+TEST_CASE("Tiled out-of-core matrices") {
+    const int n = 100, tile = 32;
+    // Three tiles per matrix, far less than the 16 each operand has
+    const std::size_t cache = 3 * tile * tile * sizeof(double);
+    std::mt19937 rng(15);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    SquareMat a(n), b(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            a[i][j] = dist(rng);
+            b[i][j] = dist(rng);
+        }
+
+    const std::string pathA = "squaremat_test_a.tiles", pathB = "squaremat_test_b.tiles";
+    const std::string pathC = "squaremat_test_c.tiles";
+    {
+        TiledSquareMat ta = TiledSquareMat::fromSquareMat(a, pathA, tile, cache);
+        TiledSquareMat tb = TiledSquareMat::fromSquareMat(b, pathB, tile, cache);
+        CHECK(ta.dim() == n);
+        CHECK(ta.tileSize() == tile);
+        CHECK(nearlyEqual(ta.toSquareMat(), a));
+
+        CHECK(nearlyEqual((ta * tb).toSquareMat(), a * b));
+        CHECK(nearlyEqual((ta * ta).toSquareMat(), a * a));
+        CHECK(nearlyEqual((ta + tb).toSquareMat(), a + b));
+        CHECK(nearlyEqual((~ta).toSquareMat(), ~a));
+
+        TiledSquareMat product = ta * tb;
+        const std::string scratch = product.path();
+        product.set(99, 0, 7.0);
+        CHECK(product.get(99, 0) == 7.0);
+        product.persist(pathC);
+        CHECK(std::ifstream(scratch).fail());
+
+        CHECK_THROWS_AS(ta.get(n, 0), std::out_of_range);
+        CHECK_THROWS_AS(ta + TiledSquareMat::fromSquareMat(a, pathC + ".other", 16, cache), std::invalid_argument);
+        std::remove((pathC + ".other").c_str());
+    }
+    {
+        TiledSquareMat reopened = TiledSquareMat::open(pathC, cache);
+        SquareMat expected = a * b;
+        expected[99][0] = 7.0;
+        CHECK(nearlyEqual(reopened.toSquareMat(), expected));
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    {
+        // A file size limit below the last tile row makes its write-back fail;
+        // the modified tile must stay cached rather than be reloaded stale
+        TiledSquareMat limited = TiledSquareMat::open(pathC, cache);
+        limited.set(99, 1, -3.0);
+        rlimit original;
+        getrlimit(RLIMIT_FSIZE, &original);
+        rlimit small = original;
+        small.rlim_cur = sizeof(detail::FileHeader) + 4 * tile * tile * sizeof(double);
+        const auto handler = std::signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &small);
+        bool failed = false;
+        for (int t = 0; t < 3; ++t)
+            try {
+                limited.get(t * tile, 0);
+            } catch (const std::system_error&) {
+                failed = true;
+            }
+        setrlimit(RLIMIT_FSIZE, &original);
+        std::signal(SIGXFSZ, handler);
+        CHECK(failed);
+        CHECK(limited.get(99, 1) == -3.0);
+        limited.persist(pathC);
+    }
+    CHECK(TiledSquareMat::open(pathC, cache).get(99, 1) == -3.0);
+#endif
+    CHECK_THROWS_AS(SquareMat::mapFile(pathC), std::invalid_argument);
+    a.save(pathC);
+    CHECK_THROWS_AS(TiledSquareMat::open(pathC), std::invalid_argument);
+    for (const std::string& path : {pathA, pathB, pathC})
+        std::remove(path.c_str());
+}
+
+TEST_CASE("Text reader and writer") {
+    auto legacy = [](std::ostream& os, const SquareMat& m) {
+        for (int i = 0; i < m.dim(); ++i) {
+            for (int j = 0; j < m.dim(); ++j) {
+                os << m[i][j];
+                if (j + 1 < m.dim())
+                    os << " ";
+            }
+            os << "\n";
+        }
+    };
+
+    std::mt19937_64 rng(16);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::uniform_int_distribution<int> exponent(-300, 300);
+    const int n = 300;
+    SquareMat a(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            a[i][j] = std::ldexp(dist(rng), exponent(rng));
+    a[0][0] = -0.0;
+    a[0][1] = 0.1 + 0.2;
+    a[0][2] = std::numeric_limits<double>::denorm_min();
+    a[0][3] = std::numeric_limits<double>::max();
+
+    // operator<< keeps producing exactly what streaming each element did
+    SquareMat small({{1.0 / 3.0, -2.5e-7}, {123456789.0, 0.1 + 0.2}});
+    for (int precision : {0, 3, 6, 17}) {
+        for (std::ios_base::fmtflags field : {std::ios_base::fmtflags(), std::ios_base::fixed, std::ios_base::scientific}) {
+            std::ostringstream expected, actual;
+            expected.precision(precision);
+            actual.precision(precision);
+            expected.setf(field, std::ios_base::floatfield);
+            actual.setf(field, std::ios_base::floatfield);
+            legacy(expected, small);
+            actual << small;
+            CHECK(actual.str() == expected.str());
+        }
+    }
+    std::ostringstream expected, actual;
+    expected << std::showpos;
+    actual << std::showpos;
+    legacy(expected, small);
+    actual << small;
+    CHECK(actual.str() == expected.str());
+
+    // Shortest round-trip output parses back bit for bit, serially and in chunks
+    CHECK(toText(small) == "0.3333333333333333 -2.5e-07\n123456789 0.30000000000000004\n");
+    const std::string text = toText(a);
+    const SquareMat parsed = parseText(text);
+    CHECK(sameElements(parsed, a));
+    CHECK(std::signbit(parsed[0][0]));
+    const int originalThreads = threadCount();
+    setThreadCount(4);
+    const SquareMat parsedInChunks = parseText(text);
+    CHECK(sameElements(parsedInChunks, a));
+    CHECK(std::signbit(parsedInChunks[0][0]));
+    std::ostringstream parallelOut;
+    writeText(parallelOut, a);
+    CHECK(parallelOut.str() == text);
+    setThreadCount(originalThreads);
+
+    std::istringstream stream("\n  1 2\n3 4\n\n5 6 7\n8 9 10\n11 12 13\n");
+    SquareMat first, second;
+    CHECK(static_cast<bool>(stream >> first));
+    CHECK(static_cast<bool>(stream >> second));
+    CHECK(first[1][0] == 3.0);
+    CHECK(second.dim() == 3);
+    CHECK(second[2][2] == 13.0);
+    CHECK_FALSE(static_cast<bool>(stream >> first));
+    CHECK(first.dim() == 2);
+
+    std::istringstream malformed("1 2\n3 x\n");
+    CHECK_FALSE(static_cast<bool>(malformed >> first));
+    CHECK(first[1][1] == 4.0);
+
+    std::istringstream whole("1.5 2\n3 4e1");
+    CHECK(readText(whole)[1][1] == 40.0);
+    CHECK_THROWS_AS(parseText(""), std::invalid_argument);
+    CHECK_THROWS_AS(parseText("1 2\n3"), std::invalid_argument);
+    CHECK_THROWS_AS(parseText("1 2\n3 4 5"), std::invalid_argument);
+    CHECK_THROWS_AS(parseText("1 2\n3 4,5"), std::invalid_argument);
+
+    const std::string path = "squaremat_test.txt";
+    {
+        std::ofstream file(path);
+        writeText(file, small);
+    }
+    CHECK(sameElements(loadText(path), small));
+    std::remove(path.c_str());
+    CHECK_THROWS_AS(loadText(path), std::system_error);
+}
+
+TEST_CASE("Cached sums follow every write") {
+    auto recomputed = [](const SquareMat& m) {
+        double res = 0.0;
+        for (int i = 0; i < m.dim(); ++i)
+            for (int j = 0; j < m.dim(); ++j)
+                res += m[i][j];
+        return res;
+    };
+
+    SquareMat a({{1, 2}, {3, 4}});
+    CHECK(a.sum() == 10);
+
+    // Element writes through the proxy, and through raw row pointers
+    a[0][0] = 5;
+    CHECK(a.sum() == 14);
+    a[1][1] += 2;
+    CHECK(a.sum() == 16);
+    CHECK(a[0][1]++ == 2.0);
+    CHECK(a.sum() == 17);
+    a[1][0] = a[0][0];
+    CHECK(a.sum() == 19);
+    for (double& x : a[1])
+        x = 0;
+    CHECK(a.sum() == 8);
+    a[0].data()[1] = 1;
+    CHECK(a.sum() == 6);
+    // Pointers are taken again after a sum, as documented on RowView
+    double* row = a[0].data();
+    row[0] = 4;
+    CHECK(a.sum() == 5);
+    row = a[0].data();
+    row[0] = 5;
+    CHECK(a.sum() == 6);
+
+    // Whole-matrix mutations, including rvalue operands whose storage is reused
+    ++a;
+    CHECK(a.sum() == recomputed(a));
+    a *= 3.0;
+    CHECK(a.sum() == recomputed(a));
+    a %= 4;
+    CHECK(a.sum() == recomputed(a));
+    a += SquareMat({{1, 1}, {1, 1}});
+    CHECK(a.sum() == recomputed(a));
+    a.transposeInPlace();
+    CHECK(a.sum() == recomputed(a));
+    SquareMat b({{1, 2}, {3, 4}});
+    CHECK(b.sum() == 10);
+    SquareMat c = a + std::move(b);
+    CHECK(c.sum() == recomputed(c));
+    CHECK(c.sum() == a.sum() + 10);
+    SquareMat d = -std::move(c);
+    CHECK(d.sum() == recomputed(d));
+    SquareMat e = std::move(d) % 3;
+    CHECK(e.sum() == recomputed(e));
+    SquareMat f(a);
+    f = a * a;
+    CHECK(f.sum() == recomputed(f));
+    f = a + a * 2.0;
+    CHECK(f.sum() == recomputed(f));
+
+    // A moved-from matrix is empty, and so is its sum
+    SquareMat source = a * 2.0;
+    const double before = source.sum();
+    REQUIRE(before != 0.0);
+    SquareMat taken = std::move(source);
+    CHECK(taken.sum() == before);
+    CHECK(source.sum() == 0.0);
+    SquareMat target(a);
+    target = std::move(taken);
+    CHECK(target.sum() == before);
+    CHECK(taken.sum() == 0.0);
+
+    // Sorting moves the cached sums along with the elements
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int> dist(-50, 50);
+    std::vector<SquareMat> mats(200, SquareMat(3));
+    for (SquareMat& m : mats)
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                m[i][j] = dist(rng);
+    std::sort(mats.begin(), mats.end());
+    for (std::size_t m = 0; m < mats.size(); ++m) {
+        CHECK(mats[m].sum() == recomputed(mats[m]));
+        if (m > 0)
+            CHECK(mats[m - 1] <= mats[m]);
+    }
+}
+
+TEST_CASE("Reductions are compensated and deterministic") {
+    using detail::Isa;
+    using detail::Reduction;
+
+    // The old int accumulator truncated every partial sum
+    CHECK(SquareMat({{0.5, 0.5}, {0.5, 0.5}}).sum() == 2.0);
+    SquareMat tenths(1000);
+    for (int i = 0; i < 1000; ++i)
+        for (int j = 0; j < 1000; ++j)
+            tenths[i][j] = 0.1;
+    CHECK(tenths.sum() == 100000.0);
+    CHECK(tenths.frobeniusNorm() == doctest::Approx(100.0).epsilon(1e-15));
+    CHECK(tenths.trace() == doctest::Approx(100.0).epsilon(1e-15));
+
+    std::mt19937_64 rng(18);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::uniform_int_distribution<int> exponent(-20, 20);
+    const int n = 601;
+    SquareMat a(n);
+    long double exact = 0.0L, exactSquares = 0.0L, exactTrace = 0.0L;
+    double lo = 1e300, hi = -1e300;
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            const double x = std::ldexp(dist(rng), exponent(rng));
+            a[i][j] = x;
+            exact += x;
+            exactSquares += static_cast<long double>(x) * x;
+            if (i == j)
+                exactTrace += x;
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+        }
+    CHECK(std::abs(a.sum() - static_cast<double>(exact)) <= 1e-12 * std::abs(static_cast<double>(exact)) + 1e-9);
+    CHECK(a.frobeniusNorm() == doctest::Approx(std::sqrt(static_cast<double>(exactSquares))).epsilon(1e-14));
+    CHECK(a.trace() == doctest::Approx(static_cast<double>(exactTrace)).epsilon(1e-12));
+    CHECK(a.min() == lo);
+    CHECK(a.max() == hi);
+
+    // Bit-identical on every instruction set and thread count, including the tail
+    // of a range that is not a multiple of the lane count
+    const double* elems = static_cast<const SquareMat&>(a)[0].data();
+    const std::size_t count = static_cast<std::size_t>(n) * n;
+    const Reduction ops[] = {Reduction::Sum, Reduction::SumSquares, Reduction::Min, Reduction::Max};
+    const Isa originalIsa = detail::activeIsa();
+    const int originalThreads = threadCount();
+    for (Reduction op : ops) {
+        detail::setIsa(Isa::Scalar);
+        setThreadCount(1);
+        const double reference = detail::reduce(op, elems, count);
+        const double referenceTail = detail::reduce(op, elems, 1001);
+        const double referenceStrided = detail::reduceStrided(op, elems, n, n + 1);
+        for (Isa isa : {Isa::Scalar, Isa::SSE2, Isa::AVX2, Isa::AVX512}) {
+            if (!detail::isaSupported(isa))
+                continue;
+            detail::setIsa(isa);
+            for (int threads : {1, 3, 4}) {
+                setThreadCount(threads);
+                CAPTURE(static_cast<int>(isa));
+                CAPTURE(threads);
+                CHECK(detail::reduce(op, elems, count) == reference);
+                CHECK(detail::reduce(op, elems, 1001) == referenceTail);
+                CHECK(detail::reduceStrided(op, elems, n, n + 1) == referenceStrided);
+            }
+        }
+    }
+    // frobeniusNorm() end to end, on sizes whose tails and block splits differ
+    std::mt19937_64 shapes(181);
+    for (int trial = 0; trial < 200; ++trial) {
+        SquareMat m(1 + static_cast<int>(shapes() % 90));
+        for (int i = 0; i < m.dim(); ++i)
+            for (int j = 0; j < m.dim(); ++j)
+                m[i][j] = std::ldexp(dist(shapes), exponent(shapes) + 20);
+        detail::setIsa(Isa::Scalar);
+        setThreadCount(1);
+        const double reference = m.frobeniusNorm();
+        for (Isa isa : {Isa::SSE2, Isa::AVX2, Isa::AVX512}) {
+            if (!detail::isaSupported(isa))
+                continue;
+            detail::setIsa(isa);
+            CAPTURE(trial);
+            CAPTURE(static_cast<int>(isa));
+            CHECK(m.frobeniusNorm() == reference);
+        }
+    }
+    detail::setIsa(originalIsa);
+    setThreadCount(originalThreads);
+
+    SquareMat withNan({{1.0, std::nan("")}, {-3.0, 2.0}});
+    CHECK(withNan.min() == -3.0);
+    CHECK(withNan.max() == 2.0);
+    CHECK(detail::reduce(Reduction::Sum, elems, 0) == 0.0);
+}
+
+TEST_CASE("Power engine") {
+    auto repeated = [](const SquareMat& m, unsigned int p) {
+        SquareMat r = m;
+        for (unsigned int k = 1; k < p; ++k)
+            r = r * m;
+        return r;
+    };
+
+    // Chains beat binary exponentiation where an addition chain is known to be
+    // shorter, and never lose to it
+    CHECK(detail::powerProducts(2) == 1);
+    CHECK(detail::powerProducts(15) == 5);
+    CHECK(detail::powerProducts(255) < 14);
+    CHECK(detail::powerProducts(65535) < 30);
+    CHECK(detail::powerProducts(1000000) < 25);
+    int longer = 0;
+    for (unsigned int p = 1; p < 5000; ++p) {
+        int bits = 0, ones = 0;
+        for (unsigned int q = p; q > 1; q >>= 1)
+            ++bits;
+        for (unsigned int q = p; q; q >>= 1)
+            ones += q & 1;
+        longer += detail::powerProducts(p) > bits + ones - 1;
+    }
+    CHECK(longer == 0);
+
+    // Row-stochastic matrices keep powers bounded; n spans several triangular blocks
+    std::mt19937_64 rng(19);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    const int n = 150;
+    SquareMat general(n), upper(n), lower(n);
+    for (int i = 0; i < n; ++i) {
+        double rowSum = 0.0, upperSum = 0.0, lowerSum = 0.0;
+        for (int j = 0; j < n; ++j) {
+            general[i][j] = dist(rng);
+            rowSum += general[i][j];
+            if (j >= i)
+                upperSum += general[i][j];
+            if (j <= i)
+                lowerSum += general[i][j];
+        }
+        for (int j = 0; j < n; ++j) {
+            if (j >= i)
+                upper[i][j] = general[i][j] / upperSum;
+            if (j <= i)
+                lower[i][j] = general[i][j] / lowerSum;
+            general[i][j] /= rowSum;
+        }
+    }
+    CHECK(detail::structure(n, static_cast<const SquareMat&>(general)[0].data()) == detail::Structure::General);
+    CHECK(detail::structure(n, static_cast<const SquareMat&>(upper)[0].data()) == detail::Structure::Upper);
+    CHECK(detail::structure(n, static_cast<const SquareMat&>(lower)[0].data()) == detail::Structure::Lower);
+    for (unsigned int p : {2u, 3u, 7u, 15u, 23u, 64u}) {
+        CAPTURE(p);
+        CHECK(nearlyEqual(general ^ p, repeated(general, p)));
+        CHECK(nearlyEqual(upper ^ p, repeated(upper, p)));
+        CHECK(nearlyEqual(lower ^ p, repeated(lower, p)));
+    }
+    const int originalThreads = threadCount();
+    const int originalThreshold = parallelThreshold();
+    setThreadCount(4);
+    setParallelThreshold(64);
+    CHECK(nearlyEqual(upper ^ 23, repeated(upper, 23)));
+    setThreadCount(originalThreads);
+    setParallelThreshold(originalThreshold);
+
+    // Closed forms: diagonal, identity, zero and nilpotent inputs
+    SquareMat diag({{2.0, 0.0, 0.0}, {0.0, -1.0, 0.0}, {0.0, 0.0, 0.5}});
+    SquareMat diagPower = diag ^ 10;
+    CHECK(diagPower[0][0] == 1024.0);
+    CHECK(diagPower[1][1] == 1.0);
+    CHECK(diagPower[2][2] == std::ldexp(1.0, -10));
+    CHECK(diagPower[0][1] == 0.0);
+    SquareMat identity = SquareMat(n) ^ 0;
+    CHECK(nearlyEqual(identity ^ 1000000, identity));
+    CHECK(countAllocations([&] { SquareMat r = identity ^ 1000000; }) == 1);
+    SquareMat strict({{0.0, 1.0, 2.0}, {0.0, 0.0, 3.0}, {0.0, 0.0, 0.0}});
+    CHECK((strict ^ 2)[0][2] == 3.0);
+    CHECK((strict ^ 3).frobeniusNorm() == 0.0);
+    CHECK((strict ^ 4000000000u).frobeniusNorm() == 0.0);
+
+    // Intermediate powers stay in the result and two workspaces
+    CHECK(countAllocations([&] { SquareMat r = general ^ 1000000; }) == 3);
+    CHECK(countAllocations([&] { SquareMat r = upper ^ 255; }) == 3);
+}
+
+TEST_CASE("Operator instrumentation") {
+    const auto stats = [](InstrumentedOp op) { return instrumentationSnapshot()[static_cast<std::size_t>(op)]; };
+    CHECK(instrumentationSnapshot().size() == static_cast<std::size_t>(InstrumentedOp::Count));
+    CHECK(std::string(stats(InstrumentedOp::Multiply).name) == "multiply");
+
+    resetInstrumentation();
+    const int n = 16;
+    SquareMat a(n);
+    SquareMat b(n);
+    a[0][0] = 2.0;
+    SquareMat product = a * b;
+    SquareMat sum = SquareMat(a) + b;
+    (void)!a;
+    std::thread([&] { SquareMat other = b * b; }).join();
+
+    const std::string text = prometheusText();
+    CHECK(text.find("# TYPE matrix_op_calls_total counter") != std::string::npos);
+    CHECK(text.find("# TYPE matrix_op_seconds_total counter") != std::string::npos);
+    if (!instrumentationEnabled()) {
+        for (const OpStats& s : instrumentationSnapshot())
+            CHECK(s.calls + s.nanoseconds + s.bytesAllocated + s.flops == 0);
+        return;
+    }
+
+    // Counts from the exited thread survive it; nested operators are not double counted
+    const OpStats multiply = stats(InstrumentedOp::Multiply);
+    CHECK(multiply.calls == 2);
+    CHECK(multiply.flops == 2 * 2 * n * n * n);
+    CHECK(multiply.bytesAllocated == 2 * n * n * sizeof(double));
+    CHECK(stats(InstrumentedOp::Add).calls == 1);
+    CHECK(stats(InstrumentedOp::AddAssign).calls == 0);
+    CHECK(stats(InstrumentedOp::Determinant).calls == 1);
+    CHECK(text.find("matrix_op_calls_total{op=\"multiply\"} 2\n") != std::string::npos);
+
+    resetInstrumentation();
+    CHECK(stats(InstrumentedOp::Multiply).calls == 0);
+    a *= 2.0;
+    CHECK(stats(InstrumentedOp::ScaleAssign).calls == 1);
+    CHECK(stats(InstrumentedOp::ScaleAssign).bytesAllocated == 0);
+    SquareMat viewed = transposed(a) * b;
+    CHECK(stats(InstrumentedOp::Multiply).calls == 1);
+    CHECK(stats(InstrumentedOp::Multiply).flops == 2 * n * n * n);
+}
+
+template <typename M, typename = void>
+struct HasLess : std::false_type {};
+template <typename M>
+struct HasLess<M, std::void_t<decltype(std::declval<const M&>() < std::declval<const M&>())>> : std::true_type {};
+
+TEST_CASE("Generic element types") {
+    static_assert(std::is_same_v<SquareMat, BasicSquareMat<double>>);
+    static_assert(HasLess<BasicSquareMat<float>>::value);
+    static_assert(!HasLess<BasicSquareMat<std::complex<double>>>::value);
+
+    // Float products agree with the double engine on every instruction set,
+    // at a size that exercises the vector tails
+    const int n = 37;
+    SquareMat da(n), db(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            da[i][j] = ((i * 7 + j * 3) % 11) - 5;
+            db[i][j] = ((i * 5 + j * 13) % 9) * 0.25 - 1.0;
+        }
+    const SquareMat dp = da * db;
+    const detail::Isa original = detail::activeIsa();
+    for (detail::Isa isa : {detail::Isa::Scalar, detail::Isa::SSE2, detail::Isa::AVX2, detail::Isa::AVX512}) {
+        if (!detail::isaSupported(isa))
+            continue;
+        CAPTURE(static_cast<int>(isa));
+        detail::setIsa(isa);
+        BasicSquareMat<float> fa(da), fb(db);
+        const BasicSquareMat<float> fp = fa * fb;
+        const BasicSquareMat<float> fs = (fa + fb) * 2.0f - fb;
+        bool close = true;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                close = close && fp[i][j] == static_cast<float>(dp[i][j]);
+                close = close && fs[i][j] == static_cast<float>(2.0 * da[i][j] + db[i][j]);
+            }
+        CHECK(close);
+        BasicSquareMat<std::int64_t> ia(da);
+        const BasicSquareMat<std::int64_t> ip = -(ia * ia) + ia;
+        CHECK(ip.sum() == static_cast<std::int64_t>((-(da * da) + da).sum()));
+    }
+
+    // With inexact operands every instruction set must still round the same
+    // way as the scalar path, so no multiply-add may be fused
+    std::mt19937 rng(22);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    BasicSquareMat<float> ra(n), rb(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            ra[i][j] = dist(rng);
+            rb[i][j] = dist(rng);
+        }
+    detail::setIsa(detail::Isa::Scalar);
+    const BasicSquareMat<float> scalarProduct = ra * rb;
+    for (detail::Isa isa : {detail::Isa::SSE2, detail::Isa::AVX2, detail::Isa::AVX512}) {
+        if (!detail::isaSupported(isa))
+            continue;
+        CAPTURE(static_cast<int>(isa));
+        detail::setIsa(isa);
+        const BasicSquareMat<float> product = ra * rb;
+        bool identical = true;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                identical = identical && product[i][j] == scalarProduct[i][j];
+        CHECK(identical);
+    }
+    detail::setIsa(original);
+
+    // Integer division and remainders are exact, with the same sign rules as
+    // SquareMat: % follows the divisor and %= the dividend
+    BasicSquareMat<std::int32_t> ints({{7, -7}, {9, -9}});
+    BasicSquareMat<std::int32_t> divisors({{3, 3}, {-4, -4}});
+    BasicSquareMat<std::int32_t> floored = ints % divisors;
+    CHECK(floored[0][0] == 1);
+    CHECK(floored[0][1] == 2);
+    CHECK(floored[1][0] == -3);
+    CHECK(floored[1][1] == -1);
+    CHECK((ints % -1).sum() == 0);
+    BasicSquareMat<std::int32_t> truncated = ints;
+    truncated %= divisors;
+    CHECK(truncated[0][1] == -1);
+    CHECK(truncated[1][0] == 1);
+    CHECK((ints / 2)[0][1] == -3);
+    CHECK_THROWS_AS(ints % BasicSquareMat<std::int32_t>(2), std::domain_error);
+    CHECK_THROWS_AS(ints / 0, std::invalid_argument);
+    // Dividing the minimum value by -1 wraps instead of trapping
+    const std::int32_t lowest = std::numeric_limits<std::int32_t>::min();
+    BasicSquareMat<std::int32_t> extremes({{lowest, 5}, {-6, lowest + 1}});
+    BasicSquareMat<std::int32_t> negated = extremes / -1;
+    CHECK(negated[0][0] == lowest);
+    CHECK(negated[0][1] == -5);
+    CHECK(negated[1][0] == 6);
+    CHECK(negated[1][1] == std::numeric_limits<std::int32_t>::max());
+    extremes /= -1;
+    CHECK(extremes[0][0] == lowest);
+    CHECK(extremes[1][0] == 6);
+    BasicSquareMat<std::int64_t> wide(1);
+    wide[0][0] = std::numeric_limits<std::int64_t>::min();
+    CHECK((wide / -1)[0][0] == std::numeric_limits<std::int64_t>::min());
+
+    // Bareiss determinants are exact where doubles round
+    BasicSquareMat<std::int64_t> big({{1000000007, 2}, {3, 1000000009}});
+    CHECK(!big == 1000000016000000057LL);
+    BasicSquareMat<std::int32_t> pivoting({{0, 2, 1}, {3, 0, 4}, {1, 5, 0}});
+    CHECK(!pivoting == 23);
+    BasicSquareMat<std::int32_t> singular({{1, 2}, {2, 4}});
+    CHECK(!singular == 0);
+    BasicSquareMat<std::int64_t> huge({{4000000000LL, 1}, {1, 4000000000LL}});
+    CHECK_THROWS_AS(!huge, std::overflow_error);
+    CHECK((ints ^ 3)[0][0] == 28);
+    CHECK((ints ^ 3)[1][1] == -36);
+
+    // Complex matrices: i * I squared is -I
+    using C = std::complex<double>;
+    BasicSquareMat<C> iI({{C(0, 1), C(0)}, {C(0), C(0, 1)}});
+    BasicSquareMat<C> square = iI ^ 2;
+    CHECK(square[0][0] == C(-1, 0));
+    CHECK(square[1][0] == C(0, 0));
+    CHECK(!iI == C(-1, 0));
+    CHECK(iI.frobeniusNorm() == doctest::Approx(std::sqrt(2.0)));
+    CHECK(iI != square);
+
+    // 16-bit storage rounds to nearest-even and computes in float
+    CHECK(Half(1.0f).bits() == 0x3c00);
+    CHECK(Half(65504.0f).bits() == 0x7bff);
+    CHECK(Half(65520.0f).bits() == 0x7c00);
+    CHECK(Half(std::ldexp(1.0f, -24)).bits() == 0x0001);
+    CHECK(Half(1.0f / 3.0f).bits() == 0x3555);
+    CHECK(static_cast<float>(Half::fromBits(0x0001)) == std::ldexp(1.0f, -24));
+    CHECK(std::isnan(static_cast<float>(Half(std::nanf("")))));
+    CHECK(BFloat16(1.0f).bits() == 0x3f80);
+    CHECK(BFloat16(1.0f + std::ldexp(1.0f, -8)).bits() == 0x3f80);
+    CHECK(BFloat16(1.0f + 3 * std::ldexp(1.0f, -8)).bits() == 0x3f82);
+    CHECK(sizeof(Half) == 2);
+    CHECK(sizeof(BFloat16) == 2);
+    BasicSquareMat<Half> ha(da);
+    BasicSquareMat<BFloat16> ba(da);
+    const BasicSquareMat<Half> hp = ha * ha;
+    const BasicSquareMat<BFloat16> bp = ba * ba;
+    const SquareMat dsq = da * da;
+    bool exact = true;
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            exact = exact && static_cast<float>(hp[i][j]) == static_cast<float>(dsq[i][j])
+                && static_cast<float>(bp[i][j]) == static_cast<float>(BFloat16(static_cast<float>(dsq[i][j])));
+    CHECK(exact);
+    CHECK((++ha).max() == 6.0f);
+
+    // Text round-trips through the same format as SquareMat
+    std::stringstream text;
+    text << big << iI;
+    BasicSquareMat<std::int64_t> bigBack;
+    BasicSquareMat<C> complexBack;
+    text >> bigBack >> complexBack;
+    CHECK(bigBack[1][1] == 1000000009);
+    CHECK(complexBack[1][1] == C(0, 1));
+
+    // Moved-from matrices copy as empty ones, and assignment keeps the
+    // destination's resource like SquareMat
+    BasicSquareMat<float> movedFrom(ra);
+    BasicSquareMat<float> taken = std::move(movedFrom);
+    const BasicSquareMat<float> emptyCopy(movedFrom);
+    CHECK(emptyCopy.dim() == 0);
+    ScratchArena arena(256);
+    BasicSquareMat<float> persistent(2);
+    {
+        ResourceScope scope(&arena);
+        persistent = BasicSquareMat<float>(taken) + taken;
+        CHECK(persistent.resource() == std::pmr::get_default_resource());
+    }
+    arena.reset();
+    {
+        ResourceScope scope(&arena);
+        BasicSquareMat<float> overwrite(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                overwrite[i][j] = 42.0f;
+    }
+    CHECK(persistent[3][4] == 2 * ra[3][4]);
+}
+
+TEST_CASE("Modular matrix engine") {
+    // Products against a per-term 128-bit reference, on both sides of the
+    // vector path's 2^31 limit and up to the largest modulus
+    const int n = 37;
+    std::mt19937_64 rng(23);
+    const std::uint64_t moduli[] = {1, 2, 7, 998244353, 1000000007, (1ull << 31) - 1, 1ull << 31,
+        (1ull << 32) + 15, (1ull << 61) - 1, 1ull << 62, 1ull << 63};
+    const detail::Isa original = detail::activeIsa();
+    for (std::uint64_t m : moduli) {
+        CAPTURE(m);
+        ModMat a(n, m), b(n, m);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                a.set(i, j, static_cast<std::int64_t>(rng() >> 1));
+                b.set(i, j, -static_cast<std::int64_t>(rng() >> 1));
+            }
+        ModMat expected(n, m);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                std::uint64_t acc = 0;
+                for (int k = 0; k < n; ++k)
+                    acc = static_cast<std::uint64_t>((static_cast<unsigned __int128>(a[i][k]) * b[k][j] + acc) % m);
+                expected.set(i, j, static_cast<std::int64_t>(acc));
+            }
+        for (detail::Isa isa : {detail::Isa::Scalar, detail::Isa::AVX2, detail::Isa::AVX512}) {
+            if (!detail::isaSupported(isa))
+                continue;
+            detail::setIsa(isa);
+            CHECK(a * b == expected);
+        }
+        detail::setIsa(original);
+        CHECK((a ^ 3) == a * a * a);
+        CHECK(((a + b) - b) == a);
+        CHECK((a ^ 0)[0][0] == 1 % m);
+    }
+
+    // Fibonacci numbers far past where doubles are exact
+    SquareMat fib({{1.0, 1.0}, {1.0, 0.0}});
+    CHECK(fib.powMod(1000000000000000000ull, 1000000007)[0][1] == 209783453.0);
+    const ModMat wide = ModMat(fib, (1ull << 61) - 1) ^ 1000000000000000000ull;
+    CHECK(wide[0][1] == 1024960830501646393ull);
+    CHECK((ModMat(fib, 1ull << 63) ^ 1000000000000000000ull)[0][1] == 3919126379787055675ull);
+    CHECK(wide.toInt64()[0][1] == 1024960830501646393ll);
+
+    // Residues of negative and extreme inputs, and rejected arguments
+    BasicSquareMat<std::int64_t> extremes({{std::numeric_limits<std::int64_t>::min(), -1}, {-7, 7}});
+    ModMat r(extremes, 10);
+    CHECK(r[0][0] == 2);
+    CHECK(r[0][1] == 9);
+    CHECK(r[1][0] == 3);
+    CHECK_THROWS_AS(ModMat(2, 0), std::invalid_argument);
+    CHECK_THROWS_AS(ModMat(2, (1ull << 63) + 1), std::invalid_argument);
+    CHECK_THROWS_AS(ModMat((SquareMat(1) ^ 0) * 0.5, 7), std::invalid_argument);
+    CHECK_THROWS_AS(ModMat(2, 7) * ModMat(2, 11), std::invalid_argument);
+    CHECK_THROWS_AS(fib.powMod(2, (1ull << 53) + 1), std::invalid_argument);
+    CHECK_THROWS_AS(wide.toSquareMat(), std::domain_error);
+}
+
+TEST_CASE("Sparse matrices") {
+    // Small integers keep every product and sum exact, so results must match
+    // the dense reference whatever order the kernels add in
+    const int n = 45;
+    std::mt19937 rng(31);
+    SquareMat a(n), c(n), dense(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            if (rng() % 16 == 0)
+                a[i][j] = static_cast<double>(rng() % 9) - 4.0;
+            if (rng() % 10 == 0)
+                c[i][j] = static_cast<double>(rng() % 7) + 1.0;
+            dense[i][j] = static_cast<double>(rng() % 11) - 5.0;
+        }
+    a[3][3] = 2.0;
+
+    std::size_t nonzeros = 0;
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            nonzeros += a[i][j] != 0.0;
+    for (SparseLayout layout : {SparseLayout::CSR, SparseLayout::CSC}) {
+        CAPTURE(static_cast<int>(layout));
+        const SparseMat s(a, layout), t(c, layout);
+        CHECK(s.layout() == layout);
+        CHECK(s.nonZeros() == nonzeros);
+        CHECK(s.offsets().size() == static_cast<std::size_t>(n) + 1);
+        CHECK(s.density() == doctest::Approx(static_cast<double>(nonzeros) / (n * n)));
+        CHECK(s.at(3, 3) == 2.0);
+        CHECK(sameElements(s.toDense(), a));
+        CHECK(sameElements((~s).toDense(), ~a));
+        CHECK((~s).layout() != layout);
+        CHECK((~s).at(7, 2) == a[2][7]);
+
+        std::vector<double> x(n);
+        for (int i = 0; i < n; ++i)
+            x[i] = i - 20.0;
+        const std::vector<double> y = s * x;
+        for (int i = 0; i < n; ++i) {
+            double expected = 0.0;
+            for (int j = 0; j < n; ++j)
+                expected += a[i][j] * x[j];
+            CHECK(y[i] == expected);
+        }
+
+        CHECK(sameElements(s * dense, naiveProduct(a, dense)));
+        CHECK(sameElements(dense * s, naiveProduct(dense, a)));
+        CHECK(sameElements((s * t).toDense(), naiveProduct(a, c)));
+        CHECK((s * t).layout() == layout);
+        CHECK(s * SparseMat(c) == s * SparseMat(c, SparseLayout::CSC));
+        CHECK(sameElements((s ^ 3).toDense(), naiveProduct(naiveProduct(a, a), a)));
+        CHECK(sameElements((s ^ 0).toDense(), SquareMat(n) ^ 0));
+        CHECK(sameElements((s + t).toDense(), a + c));
+        CHECK((s - s).nonZeros() == 0);
+        CHECK(sameElements(s + dense, a + dense));
+        CHECK(sameElements(dense + s, a + dense));
+        CHECK(sameElements((2.0 * s).toDense(), a * 2.0));
+        CHECK(s.toLayout(SparseLayout::CSR) == s.toLayout(SparseLayout::CSC));
+    }
+
+    // Entries in any order; duplicates add up and cancelled ones are dropped
+    const SparseMat built(3, {{2, 0, 1.0}, {0, 1, 4.0}, {2, 0, 2.5}, {1, 1, 3.0}, {1, 1, -3.0}});
+    CHECK(built.nonZeros() == 2);
+    CHECK(built.at(2, 0) == 3.5);
+    CHECK(built.at(1, 1) == 0.0);
+    CHECK(built.offsets()[3] == 2);
+    CHECK_THROWS_AS(SparseMat(3, {{3, 0, 1.0}}), std::out_of_range);
+    CHECK_THROWS_AS(built.at(0, 3), std::out_of_range);
+    CHECK_THROWS_AS(built * SparseMat(4), std::invalid_argument);
+    CHECK_THROWS_AS(built * std::vector<double>(2), std::invalid_argument);
+
+    // SquareMat products dispatch to the sparse kernels below the threshold
+    const double original = sparseThreshold();
+    setSparseThreshold(0.0);
+    const SquareMat classic = a * dense;
+    const SquareMat classicRight = dense * c;
+    setSparseThreshold(0.5);
+    CHECK(sameElements(a * dense, classic));
+    CHECK(sameElements(dense * c, classicRight));
+    SquareMat assigned = dense;
+    assigned *= c;
+    CHECK(sameElements(assigned, classicRight));
+    // ...but not when a skipped zero would meet an infinity
+    dense[0][0] = std::numeric_limits<double>::infinity();
+    const SquareMat withInf = a * dense;
+    for (int i = 0; i < n; ++i)
+        if (a[i][0] == 0.0)
+            CHECK(std::isnan(withInf[i][0]));
+    std::vector<double> elements(3000, 1.0);
+    CHECK(detail::allFinite(elements.data(), elements.size()));
+    elements.back() = std::nan("");
+    CHECK_FALSE(detail::allFinite(elements.data(), elements.size()));
+    CHECK_THROWS_AS(setSparseThreshold(1.5), std::invalid_argument);
+    setSparseThreshold(original);
+}
+
+TEST_CASE("Structured matrices") {
+    // Small integers keep every product exact, whatever order the kernels add in
+    const int n = 70;
+    std::mt19937 rng(43);
+    auto draw = [&rng]() { return static_cast<double>(rng() % 9) - 4.0; };
+    SquareMat upper(n), lower(n), diagonal(n), symmetric(n), banded(n), general(n);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            general[i][j] = draw();
+            if (j >= i)
+                upper[i][j] = draw();
+            if (j <= i)
+                lower[i][j] = draw();
+            if (j >= i)
+                symmetric[i][j] = symmetric[j][i] = draw();
+            if (j >= i - 2 && j <= i + 1)
+                banded[i][j] = draw();
+        }
+    for (int i = 0; i < n; ++i) {
+        diagonal[i][i] = i % 5 + 1.0;
+        upper[i][i] = lower[i][i] = i % 3 + 1.0;
+        banded[i][i] = 1.0;
+    }
+    banded[n - 1][n - 3] = 3.0;
+    banded[n - 2][n - 1] = 2.0;
+    const std::size_t triangle = static_cast<std::size_t>(n) * (n + 1) / 2;
+
+    // Detection picks the smallest packing
+    const StructuredMat u(upper), l(lower), d(diagonal), s(symmetric), b(banded), g(general);
+    CHECK(u.structure() == MatrixStructure::Upper);
+    CHECK(u.storedElements() == triangle);
+    CHECK(l.structure() == MatrixStructure::Lower);
+    CHECK(d.structure() == MatrixStructure::Diagonal);
+    CHECK(d.storedElements() == static_cast<std::size_t>(n));
+    CHECK(s.structure() == MatrixStructure::Symmetric);
+    CHECK(s.storedElements() == triangle);
+    CHECK(b.structure() == MatrixStructure::Banded);
+    CHECK(b.lowerBandwidth() == 2);
+    CHECK(b.upperBandwidth() == 1);
+    CHECK(b.storedElements() == 4 * static_cast<std::size_t>(n));
+    CHECK(g.structure() == MatrixStructure::General);
+    CHECK(StructuredMat(SquareMat(n) ^ 0).structure() == MatrixStructure::Diagonal);
+    // Upper and two-diagonal band storage both take 15 elements at n = 5; ties go to Upper
+    const StructuredMat tie(SquareMat({{1, 2, 3, 0, 0}, {0, 1, 2, 3, 0}, {0, 0, 1, 2, 3}, {0, 0, 0, 1, 2}, {0, 0, 0, 0, 1}}));
+    CHECK(tie.structure() == MatrixStructure::Upper);
+    CHECK(tie.storedElements() == 15);
+    CHECK(s.at(9, 2) == symmetric[9][2]);
+    CHECK(b.at(0, 3) == 0.0);
+    CHECK_THROWS_AS(b.at(n, 0), std::out_of_range);
+
+    // Declared structures ignore the elements outside them
+    const StructuredMat declaredUpper(general, MatrixStructure::Upper);
+    CHECK(declaredUpper.at(3, 7) == general[3][7]);
+    CHECK(declaredUpper.at(7, 3) == 0.0);
+    const StructuredMat declared(general, MatrixStructure::Banded, 1, 0);
+    CHECK(declared.at(5, 4) == general[5][4]);
+    CHECK(declared.at(4, 5) == 0.0);
+    CHECK(declared.storedElements() == 2 * static_cast<std::size_t>(n));
+    CHECK(StructuredMat(general, MatrixStructure::Symmetric).at(8, 1) == general[1][8]);
+    CHECK_THROWS_AS(StructuredMat(general, MatrixStructure::Banded, n, 0), std::invalid_argument);
+    CHECK_THROWS_AS(u * SquareMat(n + 1), std::invalid_argument);
+
+    const std::vector<std::pair<const SquareMat*, const StructuredMat*>> all = {
+        {&upper, &u}, {&lower, &l}, {&diagonal, &d}, {&symmetric, &s}, {&banded, &b}, {&general, &g}};
+    std::vector<double> x(n);
+    for (int i = 0; i < n; ++i)
+        x[i] = i - 30.0;
+    for (std::size_t p = 0; p < all.size(); ++p) {
+        CAPTURE(p);
+        const SquareMat& dense = *all[p].first;
+        const StructuredMat& packed = *all[p].second;
+        CHECK(sameElements(packed.toDense(), dense));
+        CHECK(sameElements(packed * general, naiveProduct(dense, general)));
+        CHECK(sameElements(general * packed, naiveProduct(general, dense)));
+        CHECK(sameElements((~packed).toDense(), ~dense));
+        CHECK(sameElements((packed * 3.0).toDense(), dense * 3.0));
+        const std::vector<double> y = packed * x;
+        for (int i = 0; i < n; ++i) {
+            double expected = 0.0;
+            for (int j = 0; j < n; ++j)
+                expected += dense[i][j] * x[j];
+            CHECK(y[i] == expected);
+        }
+        for (std::size_t q = 0; q < all.size(); ++q) {
+            CAPTURE(q);
+            CHECK(sameElements((packed * *all[q].second).toDense(), naiveProduct(dense, *all[q].first)));
+            CHECK(sameElements((packed + *all[q].second).toDense(), dense + *all[q].first));
+            CHECK(sameElements((packed - *all[q].second).toDense(), dense - *all[q].first));
+        }
+    }
+
+    // Results keep the structure the operands imply
+    CHECK((u * u).structure() == MatrixStructure::Upper);
+    CHECK((d * l).structure() == MatrixStructure::Lower);
+    CHECK((l * u).structure() == MatrixStructure::General);
+    CHECK((b * b).structure() == MatrixStructure::Banded);
+    CHECK((b * b).lowerBandwidth() == 4);
+    CHECK((b * b).upperBandwidth() == 2);
+    CHECK((~u).structure() == MatrixStructure::Lower);
+    CHECK((~b).lowerBandwidth() == 1);
+    CHECK((s + d).structure() == MatrixStructure::Symmetric);
+    CHECK((u + l).structure() == MatrixStructure::General);
+    CHECK((u + d).structure() == MatrixStructure::Upper);
+
+    CHECK(sameElements((b ^ 3).toDense(), naiveProduct(naiveProduct(banded, banded), banded)));
+    CHECK((b ^ 3).lowerBandwidth() == 6);
+    CHECK(sameElements((u ^ 2).toDense(), naiveProduct(upper, upper)));
+    CHECK((u ^ 2).structure() == MatrixStructure::Upper);
+    CHECK(sameElements((d ^ 3).toDense(), naiveProduct(naiveProduct(diagonal, diagonal), diagonal)));
+    CHECK((g ^ 0) == StructuredMat(SquareMat(n) ^ 0));
+    CHECK((g ^ 0).structure() == MatrixStructure::Diagonal);
+    double diagonalProduct = 1.0;
+    for (int i = 0; i < n; ++i)
+        diagonalProduct *= upper[i][i];
+    CHECK(!u == diagonalProduct);
+    CHECK(!(~u) == diagonalProduct);
+    CHECK(!b == doctest::Approx(!banded));
+    CHECK(u == StructuredMat(upper, MatrixStructure::General));
+    CHECK(u != l);
+
+    // SquareMat products dispatch to the structured kernels above one tile
+    const double original = sparseThreshold();
+    setSparseThreshold(0.0);
+    const int m = 150;
+    SquareMat big(m), bigUpper(m), bigLower(m), bigDiagonal(m);
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < m; ++j) {
+            big[i][j] = static_cast<double>(rng() % 7) - 3.0;
+            if (j >= i)
+                bigUpper[i][j] = static_cast<double>(rng() % 5) + 1.0;
+            if (j <= i)
+                bigLower[i][j] = static_cast<double>(rng() % 5) - 2.0;
+        }
+    for (int i = 0; i < m; ++i)
+        bigDiagonal[i][i] = i % 4 - 1.5;
+    CHECK(sameElements(bigUpper * big, naiveProduct(bigUpper, big)));
+    CHECK(sameElements(big * bigLower, naiveProduct(big, bigLower)));
+    CHECK(sameElements(bigLower * bigUpper, naiveProduct(bigLower, bigUpper)));
+    CHECK(sameElements(bigUpper * bigUpper, naiveProduct(bigUpper, bigUpper)));
+    CHECK(sameElements(bigDiagonal * big, naiveProduct(bigDiagonal, big)));
+    CHECK(sameElements(big * bigDiagonal, naiveProduct(big, bigDiagonal)));
+    SquareMat assigned = big;
+    assigned *= bigUpper;
+    CHECK(sameElements(assigned, naiveProduct(big, bigUpper)));
+    // ...but not when a skipped zero would meet an infinity
+    big[0][0] = std::numeric_limits<double>::infinity();
+    CHECK(std::isnan((bigUpper * big)[m - 1][0]));
+    CHECK(std::isnan((bigDiagonal * big)[1][0]));
+    setSparseThreshold(original);
+}
@@ -0,0 +1,187 @@
+// ey.gellis@gmail.com
+#include "strassen.hpp"
+#include "gemm.hpp"
+#include "transpose.hpp"
+#include "sparsemat.hpp"
+#include "structured.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace {
+	std::atomic<matrix::MultiplyAlgorithm> selected{matrix::MultiplyAlgorithm::Classic};
+	std::atomic<int> cutoff{256};
+
+	void addBlock(int h, const double* x, std::size_t ldx, const double* y, std::size_t ldy, double* out, std::size_t ldo) {
+		for (int i = 0; i < h; ++i)
+			for (int j = 0; j < h; ++j)
+				out[i * ldo + j] = x[i * ldx + j] + y[i * ldy + j];
+	}
+
+	void subBlock(int h, const double* x, std::size_t ldx, const double* y, std::size_t ldy, double* out, std::size_t ldo) {
+		for (int i = 0; i < h; ++i)
+			for (int j = 0; j < h; ++j)
+				out[i * ldo + j] = x[i * ldx + j] - y[i * ldy + j];
+	}
+
+	void baseCase(int n, const double* a, std::size_t lda, const double* b, std::size_t ldb, double* c, std::size_t ldc) {
+		for (int i = 0; i < n; ++i)
+			std::fill(c + i * ldc, c + i * ldc + n, 0.0);
+		matrix::detail::gemmStrided(n, a, lda, b, ldb, c, ldc);
+	}
+
+	/**
+	 * @brief One level of Strassen-Winograd with two temporaries per level
+	 *
+	 * Follows the 22-step schedule of Boyer, Dumas, Pernet and Zhou (2009): the
+	 * seven products land directly in the quadrants of C and in X, with X and Y
+	 * holding the operand sums, so a level needs only 2 (n/2)^2 of workspace.
+	 */
+	void winograd(int n, const double* a, std::size_t lda, const double* b, std::size_t ldb,
+		double* c, std::size_t ldc, double* work, int crossover) {
+		if (n <= crossover || n % 2 != 0) {
+			baseCase(n, a, lda, b, ldb, c, ldc);
+			return;
+		}
+
+		const int h = n / 2;
+		const std::size_t hh = static_cast<std::size_t>(h);
+		const double *a11 = a, *a12 = a + h, *a21 = a + h * lda, *a22 = a21 + h;
+		const double *b11 = b, *b12 = b + h, *b21 = b + h * ldb, *b22 = b21 + h;
+		double *c11 = c, *c12 = c + h, *c21 = c + h * ldc, *c22 = c21 + h;
+		double* x = work;
+		double* y = work + hh * hh;
+		double* next = y + hh * hh;
+
+		subBlock(h, a11, lda, a21, lda, x, hh);                 // S3 = A11 - A21
+		subBlock(h, b22, ldb, b12, ldb, y, hh);                 // T3 = B22 - B12
+		winograd(h, x, hh, y, hh, c21, ldc, next, crossover);   // P7 = S3 T3
+		addBlock(h, a21, lda, a22, lda, x, hh);                 // S1 = A21 + A22
+		subBlock(h, b12, ldb, b11, ldb, y, hh);                 // T1 = B12 - B11
+		winograd(h, x, hh, y, hh, c22, ldc, next, crossover);   // P5 = S1 T1
+		subBlock(h, x, hh, a11, lda, x, hh);                    // S2 = S1 - A11
+		subBlock(h, b22, ldb, y, hh, y, hh);                    // T2 = B22 - T1
+		winograd(h, x, hh, y, hh, c12, ldc, next, crossover);   // P6 = S2 T2
+		subBlock(h, a12, lda, x, hh, x, hh);                    // S4 = A12 - S2
+		winograd(h, x, hh, b22, ldb, c11, ldc, next, crossover); // P3 = S4 B22
+		winograd(h, a11, lda, b11, ldb, x, hh, next, crossover); // P1 = A11 B11
+		addBlock(h, x, hh, c12, ldc, c12, ldc);                 // U2 = P1 + P6
+		addBlock(h, c12, ldc, c21, ldc, c21, ldc);              // U3 = U2 + P7
+		addBlock(h, c12, ldc, c22, ldc, c12, ldc);              // U4 = U2 + P5
+		addBlock(h, c21, ldc, c22, ldc, c22, ldc);              // U7 = U3 + P5 = C22
+		addBlock(h, c12, ldc, c11, ldc, c12, ldc);              // U5 = U4 + P3 = C12
+		subBlock(h, y, hh, b21, ldb, y, hh);                    // T4 = T2 - B21
+		winograd(h, a22, lda, y, hh, c11, ldc, next, crossover); // P4 = A22 T4
+		subBlock(h, c21, ldc, c11, ldc, c21, ldc);              // U6 = U3 - P4 = C21
+		winograd(h, a12, lda, b21, ldb, c11, ldc, next, crossover); // P2 = A12 B21
+		addBlock(h, x, hh, c11, ldc, c11, ldc);                 // U1 = P1 + P2 = C11
+	}
+}
+
+namespace matrix {
+	void setMultiplyAlgorithm(MultiplyAlgorithm algorithm) {
+		selected.store(algorithm, std::memory_order_relaxed);
+	}
+
+	MultiplyAlgorithm multiplyAlgorithm() {
+		return selected.load(std::memory_order_relaxed);
+	}
+
+	void setStrassenCrossover(int n) {
+		cutoff.store(std::max(1, n), std::memory_order_relaxed);
+	}
+
+	int strassenCrossover() {
+		return cutoff.load(std::memory_order_relaxed);
+	}
+
+	namespace detail {
+		void multiply(int n, const double* a, const double* b, double* c) {
+			if (sparseMultiply(n, a, b, c) || structuredMultiply(n, a, b, c))
+				return;
+			multiply(n, a, false, b, false, c);
+		}
+
+		void multiply(int n, const double* a, bool transA, const double* b, bool transB, double* c) {
+			const std::size_t nn = static_cast<std::size_t>(n) * n;
+			// The sparse and structured paths read operands as stored. Density and
+			// triangularity survive transposition, so when either operand qualifies
+			// the transposed ones are copied out, O(n^2) next to the product, and
+			// the product dispatched like an untransposed one
+			if ((transA || transB) && (isSparse(n, a) || isSparse(n, b) || structure(n, a) != Structure::General
+				|| structure(n, b) != Structure::General)) {
+				thread_local std::vector<double> stored;
+				stored.resize((transA + transB) * nn);
+				double* next = stored.data();
+				if (transA) {
+					transpose(n, n, a, n, next, n);
+					a = next;
+					next += nn;
+				}
+				if (transB)
+					transpose(n, n, b, n, next, n);
+				multiply(n, a, transB ? next : b, c);
+				return;
+			}
+			const int crossover = strassenCrossover();
+			if (multiplyAlgorithm() == MultiplyAlgorithm::StrassenWinograd && n > crossover) {
+				thread_local std::vector<double> operands;
+				if (transA || transB)
+					operands.resize((transA + transB) * nn);
+				double* next = operands.data();
+				if (transA) {
+					transpose(n, n, a, n, next, n);
+					a = next;
+					next += nn;
+				}
+				if (transB) {
+					transpose(n, n, b, n, next, n);
+					b = next;
+				}
+				strassenWinograd(n, a, b, c, crossover);
+				return;
+			}
+			std::fill(c, c + nn, 0.0);
+			gemmStrided(n, a, n, transA, b, n, transB, c, n);
+		}
+
+		void strassenWinograd(int n, const double* a, const double* b, double* c, int crossover) {
+			// Pad to base << levels so every level splits evenly
+			int base = n;
+			int levels = 0;
+			while (base > crossover) {
+				base = (base + 1) / 2;
+				++levels;
+			}
+			const int m = base << levels;
+			const std::size_t mm = static_cast<std::size_t>(m) * m;
+
+			std::size_t temps = 0;
+			for (std::size_t h = m / 2; levels > 0 && h >= static_cast<std::size_t>(base); h /= 2)
+				temps += 2 * h * h;
+
+			thread_local std::vector<double> workspace;
+			const bool padded = m != n;
+			workspace.resize(temps + (padded ? 3 * mm : 0));
+			double* work = workspace.data();
+
+			if (!padded) {
+				winograd(n, a, n, b, n, c, n, work, crossover);
+				return;
+			}
+
+			double* pa = work + temps;
+			double* pb = pa + mm;
+			double* pc = pb + mm;
+			std::fill(pa, pa + 2 * mm, 0.0);
+			for (int i = 0; i < n; ++i) {
+				std::copy(a + static_cast<std::size_t>(i) * n, a + static_cast<std::size_t>(i + 1) * n, pa + static_cast<std::size_t>(i) * m);
+				std::copy(b + static_cast<std::size_t>(i) * n, b + static_cast<std::size_t>(i + 1) * n, pb + static_cast<std::size_t>(i) * m);
+			}
+			winograd(m, pa, m, pb, m, pc, m, work, crossover);
+			for (int i = 0; i < n; ++i)
+				std::copy(pc + static_cast<std::size_t>(i) * m, pc + static_cast<std::size_t>(i) * m + n, c + static_cast<std::size_t>(i) * n);
+		}
+	}
+}
@@ -0,0 +1,83 @@
+// ey.gellis@gmail.com
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+namespace matrix {
+	/**
+	 * @brief Algorithm used by SquareMat products (operator*, operator*= and operator^)
+	 */
+	enum class MultiplyAlgorithm {
+		Classic,         // Blocked O(n^3) GEMM
+		StrassenWinograd // Winograd's variant of Strassen above the crossover, GEMM below
+	};
+
+	/**
+	 * @brief Selects the product algorithm for all threads
+	 * @param algorithm Algorithm to use
+	 */
+	void setMultiplyAlgorithm(MultiplyAlgorithm algorithm);
+
+	/**
+	 * @brief Currently selected product algorithm
+	 * @return Selected algorithm
+	 */
+	MultiplyAlgorithm multiplyAlgorithm();
+
+	/**
+	 * @brief Sets the size at or below which Strassen-Winograd recursion stops and
+	 * the blocked GEMM takes over
+	 * @param n Crossover dimension
+	 */
+	void setStrassenCrossover(int n);
+
+	/**
+	 * @brief Current Strassen-Winograd crossover dimension
+	 * @return Crossover dimension
+	 */
+	int strassenCrossover();
+
+	namespace detail {
+		/**
+		 * @brief C = A * B for n x n row-major matrices with the selected algorithm
+		 *
+		 * Unlike gemm(), c is overwritten, not accumulated into. c must not alias a or b.
+		 * Operands below sparseThreshold() go through sparseMultiply() (sparsemat.hpp),
+		 * diagonal and triangular ones through structuredMultiply() (structured.hpp).
+		 * @param n Matrix dimension
+		 * @param a Left operand
+		 * @param b Right operand
+		 * @param c Destination
+		 */
+		void multiply(int n, const double* a, const double* b, double* c);
+
+		/**
+		 * @brief C = op(A) * op(B), where op transposes the operand when requested
+		 *
+		 * The classic path reads transposed operands in place; Strassen-Winograd
+		 * copies them into a reused per-thread buffer first, as do products that
+		 * multiply() would send to the sparse or structured kernels.
+		 * @param n Matrix dimension
+		 * @param a Left operand as stored
+		 * @param transA Whether to multiply by the transpose of a
+		 * @param b Right operand as stored
+		 * @param transB Whether to multiply by the transpose of b
+		 * @param c Destination, overwritten
+		 */
+		void multiply(int n, const double* a, bool transA, const double* b, bool transB, double* c);
+
+		/**
+		 * @brief C = A * B by Strassen-Winograd recursion down to crossover
+		 *
+		 * Odd sizes are zero-padded once at the top level. All temporaries for every
+		 * recursion level come from a single per-thread workspace that is reused
+		 * across calls.
+		 * @param n Matrix dimension
+		 * @param a Left operand
+		 * @param b Right operand
+		 * @param c Destination, overwritten
+		 * @param crossover Recursion cut-off
+		 */
+		void strassenWinograd(int n, const double* a, const double* b, double* c, int crossover);
+	}
+}
+#endif
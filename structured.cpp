@@ -0,0 +1,491 @@
+// ey.gellis@gmail.com
+#include "structured.hpp"
+#include "gemm.hpp"
+#include "kernels.hpp"
+#include "reduce.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace matrix;
+
+namespace {
+	// Edge of the C tiles structuredProduct() skips or restricts
+	constexpr int TILE = 64;
+
+	std::size_t triangle(int n) {
+		return static_cast<std::size_t>(n) * (n + 1) / 2;
+	}
+
+	std::size_t storage(int n, MatrixStructure structure, int lower, int upper) {
+		switch (structure) {
+		case MatrixStructure::Diagonal:
+			return static_cast<std::size_t>(n);
+		case MatrixStructure::Upper:
+		case MatrixStructure::Lower:
+		case MatrixStructure::Symmetric:
+			return triangle(n);
+		case MatrixStructure::Banded:
+			return static_cast<std::size_t>(lower + upper + 1) * n;
+		default:
+			return static_cast<std::size_t>(n) * n;
+		}
+	}
+
+	/**
+	 * @brief Packing that stores the fewest elements for the given bandwidths;
+	 * ties go to the earlier of Upper, Lower, Symmetric, Banded and General
+	 */
+	MatrixStructure cheapest(int n, int lower, int upper, bool symmetric) {
+		if (lower == 0 && upper == 0)
+			return MatrixStructure::Diagonal;
+		MatrixStructure best = MatrixStructure::General;
+		std::size_t stored = storage(n, best, lower, upper);
+		const auto consider = [&](MatrixStructure candidate) {
+			const std::size_t count = storage(n, candidate, lower, upper);
+			if (count < stored || (count == stored && best == MatrixStructure::General)) {
+				best = candidate;
+				stored = count;
+			}
+		};
+		// In tie order: a later candidate only wins by storing strictly fewer
+		if (lower == 0)
+			consider(MatrixStructure::Upper);
+		if (upper == 0)
+			consider(MatrixStructure::Lower);
+		if (symmetric)
+			consider(MatrixStructure::Symmetric);
+		consider(MatrixStructure::Banded);
+		return best;
+	}
+
+	/**
+	 * @brief Zero pattern structuredProduct() understands; symmetry is not one
+	 */
+	detail::Structure shapeOf(MatrixStructure structure) {
+		switch (structure) {
+		case MatrixStructure::Diagonal:
+			return detail::Structure::Diagonal;
+		case MatrixStructure::Upper:
+			return detail::Structure::Upper;
+		case MatrixStructure::Lower:
+			return detail::Structure::Lower;
+		default:
+			return detail::Structure::General;
+		}
+	}
+}
+
+namespace matrix {
+	StructuredMat::StructuredMat(int n, MatrixStructure structure, int lower, int upper)
+		: values(currentResource()), size(n), kind(structure), lowerBand(n - 1), upperBand(n - 1) {
+		if (n <= 0)
+			throw std::invalid_argument("Matrix size is not > 0");
+		switch (structure) {
+		case MatrixStructure::Diagonal:
+			lowerBand = upperBand = 0;
+			break;
+		case MatrixStructure::Upper:
+			lowerBand = 0;
+			break;
+		case MatrixStructure::Lower:
+			upperBand = 0;
+			break;
+		case MatrixStructure::Banded:
+			if (lower < 0 || upper < 0 || lower >= n || upper >= n)
+				throw std::invalid_argument("Bandwidths must be in [0, n)");
+			lowerBand = lower;
+			upperBand = upper;
+			break;
+		default:
+			break;
+		}
+		values.assign(storage(n, kind, lowerBand, upperBand), 0.0);
+	}
+
+	StructuredMat::StructuredMat(const SquareMat& mat) : values(currentResource()), size(mat.dim()) {
+		const int n = size;
+		const double* a = mat[0].data();
+		// Widen the bands to the outermost nonzero of each row, scanning only
+		// the elements outside the bands found so far
+		int lower = 0, upper = 0;
+		for (int i = 0; i < n; ++i) {
+			const double* ai = a + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < i - lower; ++j)
+				if (ai[j] != 0.0) {
+					lower = i - j;
+					break;
+				}
+			for (int j = n - 1; j > i + upper; --j)
+				if (ai[j] != 0.0) {
+					upper = j - i;
+					break;
+				}
+		}
+		bool symmetric = lower == upper && lower > 0;
+		for (int i = 0; symmetric && i < n; ++i)
+			for (int j = i + 1; symmetric && j <= std::min(n - 1, i + upper); ++j)
+				symmetric = a[static_cast<std::size_t>(i) * n + j] == a[static_cast<std::size_t>(j) * n + i];
+		*this = StructuredMat(n, cheapest(n, lower, upper, symmetric), lower, upper);
+		pack(a);
+	}
+
+	StructuredMat::StructuredMat(const SquareMat& mat, MatrixStructure structure, int lower, int upper)
+		: StructuredMat(mat.dim(), structure, lower, upper) {
+		pack(mat[0].data());
+	}
+
+	StructuredMat::StructuredMat(const StructuredMat& other)
+		: values(other.values, currentResource()), size(other.size), kind(other.kind), lowerBand(other.lowerBand),
+		  upperBand(other.upperBand) {}
+
+	int StructuredMat::first(int i) const {
+		switch (kind) {
+		case MatrixStructure::Diagonal:
+		case MatrixStructure::Upper:
+		case MatrixStructure::Symmetric:
+			return i;
+		case MatrixStructure::Banded:
+			return std::max(0, i - lowerBand);
+		default:
+			return 0;
+		}
+	}
+
+	int StructuredMat::last(int i) const {
+		switch (kind) {
+		case MatrixStructure::Diagonal:
+		case MatrixStructure::Lower:
+			return i + 1;
+		case MatrixStructure::Banded:
+			return std::min(size, i + upperBand + 1);
+		default:
+			return size;
+		}
+	}
+
+	const double* StructuredMat::row(int i) const {
+		const std::size_t r = static_cast<std::size_t>(i);
+		switch (kind) {
+		case MatrixStructure::Diagonal:
+			return values.data() + r;
+		case MatrixStructure::Upper:
+		case MatrixStructure::Symmetric:
+			// Rows before i hold n, n - 1, ..., n - i + 1 elements
+			return values.data() + r * size - r * (r - 1) / 2;
+		case MatrixStructure::Lower:
+			return values.data() + r * (r + 1) / 2;
+		case MatrixStructure::Banded:
+			// Every row has lower + upper + 1 slots; those outside the matrix stay zero
+			return values.data() + r * (lowerBand + upperBand + 1) + (first(i) - (i - lowerBand));
+		default:
+			return values.data() + r * size;
+		}
+	}
+
+	void StructuredMat::pack(const double* dense) {
+		for (int i = 0; i < size; ++i) {
+			const double* src = dense + static_cast<std::size_t>(i) * size;
+			std::copy(src + first(i), src + last(i), row(i));
+		}
+	}
+
+	void StructuredMat::requireSameSize(int n) const {
+		if (size != n)
+			throw std::invalid_argument("Matrix sizes must match");
+	}
+
+	double StructuredMat::at(int i, int j) const {
+		if (i < 0 || i >= size || j < 0 || j >= size)
+			throw std::out_of_range("Element index out of range");
+		if (kind == MatrixStructure::Symmetric && j < i)
+			std::swap(i, j);
+		if (j < first(i) || j >= last(i))
+			return 0.0;
+		return row(i)[j - first(i)];
+	}
+
+	SquareMat StructuredMat::toDense() const {
+		SquareMat result(size);
+		double* out = result[0].data();
+		const std::size_t n = static_cast<std::size_t>(size);
+		for (int i = 0; i < size; ++i)
+			std::copy(row(i), row(i) + (last(i) - first(i)), out + i * n + first(i));
+		if (kind == MatrixStructure::Symmetric)
+			for (std::size_t i = 0; i < n; ++i)
+				for (std::size_t j = i + 1; j < n; ++j)
+					out[j * n + i] = out[i * n + j];
+		return result;
+	}
+
+	std::vector<double> StructuredMat::operator*(const std::vector<double>& x) const {
+		if (x.size() != static_cast<std::size_t>(size))
+			throw std::invalid_argument("Vector length must match the matrix size");
+		std::vector<double> y(x.size(), 0.0);
+		for (int i = 0; i < size; ++i) {
+			const double* ri = row(i);
+			const int f = first(i);
+			double s = 0.0;
+			for (int j = f; j < last(i); ++j)
+				s += ri[j - f] * x[j];
+			y[i] += s;
+			// The mirrored lower half of a symmetric matrix
+			if (kind == MatrixStructure::Symmetric)
+				for (int j = i + 1; j < size; ++j)
+					y[j] += ri[j - f] * x[i];
+		}
+		return y;
+	}
+
+	SquareMat StructuredMat::operator*(const SquareMat& b) const {
+		requireSameSize(b.dim());
+		if (kind == MatrixStructure::General || kind == MatrixStructure::Symmetric)
+			return toDense() * b;
+		SquareMat result(size);
+		const double* in = b[0].data();
+		double* out = result[0].data();
+		const std::size_t n = static_cast<std::size_t>(size);
+		if (kind == MatrixStructure::Diagonal) {
+			for (std::size_t i = 0; i < n; ++i)
+				detail::kernels().mulScalar(in + i * n, values[i], out + i * n, n);
+		} else if (kind == MatrixStructure::Banded) {
+			const auto axpy = detail::kernels().axpy;
+			detail::forRows(size, [&](int begin, int end) {
+				for (int i = begin; i < end; ++i)
+					for (int k = first(i); k < last(i); ++k)
+						axpy(in + k * n, row(i)[k - first(i)], out + i * n, n);
+			});
+		} else {
+			const SquareMat dense = toDense();
+			detail::structuredProduct(size, shapeOf(kind), dense[0].data(), detail::Structure::General, in, out);
+		}
+		return result;
+	}
+
+	SquareMat operator*(const SquareMat& a, const StructuredMat& b) {
+		b.requireSameSize(a.dim());
+		if (b.kind == MatrixStructure::General || b.kind == MatrixStructure::Symmetric)
+			return a * b.toDense();
+		SquareMat result(b.size);
+		const double* in = a[0].data();
+		double* out = result[0].data();
+		const std::size_t n = static_cast<std::size_t>(b.size);
+		if (b.kind == MatrixStructure::Diagonal) {
+			for (std::size_t i = 0; i < n; ++i)
+				for (std::size_t j = 0; j < n; ++j)
+					out[i * n + j] = in[i * n + j] * b.values[j];
+		} else if (b.kind == MatrixStructure::Banded) {
+			// Row i of the result gathers row k of b's band scaled by a[i][k]
+			const auto axpy = detail::kernels().axpy;
+			detail::forRows(b.size, [&](int begin, int end) {
+				for (int i = begin; i < end; ++i)
+					for (int k = 0; k < b.size; ++k)
+						axpy(b.row(k), in[i * n + k], out + i * n + b.first(k), static_cast<std::size_t>(b.last(k) - b.first(k)));
+			});
+		} else {
+			const SquareMat dense = b.toDense();
+			detail::structuredProduct(b.size, detail::Structure::General, in, shapeOf(b.kind), dense[0].data(), out);
+		}
+		return result;
+	}
+
+	StructuredMat StructuredMat::operator*(const StructuredMat& b) const {
+		requireSameSize(b.size);
+		const int lower = std::min(size - 1, lowerBand + b.lowerBand);
+		const int upper = std::min(size - 1, upperBand + b.upperBand);
+		StructuredMat result(size, cheapest(size, lower, upper, false), lower, upper);
+
+		const bool segments = kind == MatrixStructure::Banded || kind == MatrixStructure::Diagonal ||
+			b.kind == MatrixStructure::Banded || b.kind == MatrixStructure::Diagonal;
+		if (!segments) {
+			// Triangular, symmetric and general operands multiply as dense tiles
+			const SquareMat left = toDense();
+			const SquareMat right = b.toDense();
+			SquareMat product(size);
+			if (shapeOf(kind) == detail::Structure::General && shapeOf(b.kind) == detail::Structure::General)
+				product = left * right;
+			else
+				detail::structuredProduct(size, shapeOf(kind), left[0].data(), shapeOf(b.kind), right[0].data(),
+					product[0].data());
+			result.pack(product[0].data());
+			return result;
+		}
+
+		// A symmetric operand stores only half of each row; expand it
+		if (kind == MatrixStructure::Symmetric)
+			return StructuredMat(toDense(), MatrixStructure::General) * b;
+		if (b.kind == MatrixStructure::Symmetric)
+			return *this * StructuredMat(b.toDense(), MatrixStructure::General);
+
+		// Row i of the product is the sum of b's row segments k scaled by this[i][k];
+		// every contribution lands inside the result's row, whose bands are the sums
+		const auto axpy = detail::kernels().axpy;
+		detail::forRows(size, [&](int begin, int end) {
+			std::vector<double> acc(static_cast<std::size_t>(size));
+			for (int i = begin; i < end; ++i) {
+				const int rf = result.first(i);
+				std::fill(acc.begin() + rf, acc.begin() + result.last(i), 0.0);
+				for (int k = first(i); k < last(i); ++k)
+					axpy(b.row(k), row(i)[k - first(i)], acc.data() + b.first(k), static_cast<std::size_t>(b.last(k) - b.first(k)));
+				std::copy(acc.begin() + rf, acc.begin() + result.last(i), result.row(i));
+			}
+		});
+		return result;
+	}
+
+	StructuredMat StructuredMat::operator*(double sc) const {
+		StructuredMat result(*this);
+		detail::kernels().mulScalar(values.data(), sc, result.values.data(), values.size());
+		return result;
+	}
+
+	StructuredMat StructuredMat::operator+(const StructuredMat& b) const {
+		requireSameSize(b.size);
+		const bool symmetric = (kind == MatrixStructure::Symmetric || kind == MatrixStructure::Diagonal) &&
+			(b.kind == MatrixStructure::Symmetric || b.kind == MatrixStructure::Diagonal);
+		const int lower = std::max(lowerBand, b.lowerBand);
+		const int upper = std::max(upperBand, b.upperBand);
+		if (kind == b.kind && lowerBand == b.lowerBand && upperBand == b.upperBand) {
+			StructuredMat result(*this);
+			detail::kernels().add(values.data(), b.values.data(), result.values.data(), values.size());
+			return result;
+		}
+		StructuredMat result(size, cheapest(size, lower, upper, symmetric), lower, upper);
+		for (int i = 0; i < size; ++i) {
+			double* out = result.row(i);
+			for (int j = result.first(i); j < result.last(i); ++j)
+				out[j - result.first(i)] = at(i, j) + b.at(i, j);
+		}
+		return result;
+	}
+
+	StructuredMat StructuredMat::operator-(const StructuredMat& b) const {
+		return *this + b * -1.0;
+	}
+
+	StructuredMat StructuredMat::operator~() const {
+		if (kind == MatrixStructure::Diagonal || kind == MatrixStructure::Symmetric)
+			return *this;
+		MatrixStructure transposed = kind;
+		if (kind == MatrixStructure::Upper)
+			transposed = MatrixStructure::Lower;
+		else if (kind == MatrixStructure::Lower)
+			transposed = MatrixStructure::Upper;
+		StructuredMat result(size, transposed, upperBand, lowerBand);
+		for (int i = 0; i < size; ++i) {
+			double* out = result.row(i);
+			for (int j = result.first(i); j < result.last(i); ++j)
+				out[j - result.first(i)] = at(j, i);
+		}
+		return result;
+	}
+
+	StructuredMat StructuredMat::operator^(unsigned int power) const {
+		if (power == 0) {
+			StructuredMat result(size, MatrixStructure::Diagonal, 0, 0);
+			std::fill(result.values.begin(), result.values.end(), 1.0);
+			return result;
+		}
+		if (kind == MatrixStructure::Diagonal) {
+			StructuredMat result(*this);
+			for (double& x : result.values)
+				x = std::pow(x, power);
+			return result;
+		}
+		if (kind != MatrixStructure::Banded)
+			return StructuredMat(toDense() ^ power, kind);
+		// Left-to-right square-and-multiply; the band widens with every product
+		StructuredMat result(*this);
+		int bit = 31 - __builtin_clz(power);
+		for (--bit; bit >= 0; --bit) {
+			result = result * result;
+			if (power >> bit & 1u)
+				result = result * *this;
+		}
+		return result;
+	}
+
+	double StructuredMat::operator!() const {
+		if (kind == MatrixStructure::Diagonal || kind == MatrixStructure::Upper || kind == MatrixStructure::Lower) {
+			double det = 1.0;
+			for (int i = 0; i < size; ++i)
+				det *= at(i, i);
+			return det;
+		}
+		return !toDense();
+	}
+
+	bool StructuredMat::operator==(const StructuredMat& b) const {
+		if (size != b.size)
+			return false;
+		for (int i = 0; i < size; ++i)
+			for (int j = 0; j < size; ++j)
+				if (at(i, j) != b.at(i, j))
+					return false;
+		return true;
+	}
+
+	namespace detail {
+		void structuredProduct(int n, Structure sa, const double* a, Structure sb, const double* b, double* c) {
+			// A's row i is zero left of i (upper) or right of it (lower); B's
+			// column j is zero below j (upper) or above it (lower)
+			const bool aUpper = sa == Structure::Upper || sa == Structure::Diagonal;
+			const bool aLower = sa == Structure::Lower || sa == Structure::Diagonal;
+			const bool bUpper = sb == Structure::Upper || sb == Structure::Diagonal;
+			const bool bLower = sb == Structure::Lower || sb == Structure::Diagonal;
+			// A general right operand gives the same inner range to a whole row of tiles
+			const int width = sb == Structure::General ? n : TILE;
+			const int rowTiles = (n + TILE - 1) / TILE;
+			const int colTiles = (n + width - 1) / width;
+			const std::size_t ld = static_cast<std::size_t>(n);
+			auto tile = [&](int task) {
+				const int i0 = task / colTiles * TILE;
+				const int j0 = task % colTiles * width;
+				const int m = std::min(TILE, n - i0);
+				const int w = std::min(width, n - j0);
+				double* cij = c + i0 * ld + j0;
+				for (int r = 0; r < m; ++r)
+					std::fill(cij + r * ld, cij + r * ld + w, 0.0);
+				const int k0 = std::max(aUpper ? i0 : 0, bLower ? j0 : 0);
+				const int k1 = std::min(aLower ? i0 + m : n, bUpper ? j0 + w : n);
+				if (k0 < k1)
+					gemmRect(m, w, k1 - k0, a + i0 * ld + k0, ld, b + k0 * ld + j0, ld, cij, ld);
+			};
+			if (n < parallelThreshold() || threadCount() == 1) {
+				for (int task = 0; task < rowTiles * colTiles; ++task)
+					tile(task);
+				return;
+			}
+			parallelFor(rowTiles * colTiles, tile);
+		}
+
+		bool structuredMultiply(int n, const double* a, const double* b, double* c) {
+			const Structure sa = structure(n, a);
+			const Structure sb = structure(n, b);
+			if (sa == Structure::General && sb == Structure::General)
+				return false;
+			// A skipped zero must not meet an infinity or NaN
+			const std::size_t count = static_cast<std::size_t>(n) * n;
+			if ((sa != Structure::General && !allFinite(b, count)) || (sb != Structure::General && !allFinite(a, count)))
+				return false;
+			const std::size_t ld = static_cast<std::size_t>(n);
+			if (sa == Structure::Diagonal) {
+				for (std::size_t i = 0; i < ld; ++i)
+					kernels().mulScalar(b + i * ld, a[i * (ld + 1)], c + i * ld, ld);
+				return true;
+			}
+			if (sb == Structure::Diagonal) {
+				for (std::size_t i = 0; i < ld; ++i)
+					for (std::size_t j = 0; j < ld; ++j)
+						c[i * ld + j] = a[i * ld + j] * b[j * (ld + 1)];
+				return true;
+			}
+			// A single tile saves nothing
+			if (n <= TILE)
+				return false;
+			structuredProduct(n, sa, a, sb, b, c);
+			return true;
+		}
+	}
+}
@@ -0,0 +1,214 @@
+// ey.gellis@gmail.com
+#ifndef STRUCTURED_H
+#define STRUCTURED_H
+
+#include "squaremat.hpp"
+#include "power.hpp"
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace matrix {
+	/**
+	 * @brief Zero or symmetry pattern a StructuredMat stores, and how it is packed
+	 */
+	enum class MatrixStructure {
+		General,   // Every element, row-major
+		Diagonal,  // The n diagonal elements
+		Upper,     // Upper triangle by rows, n(n+1)/2 elements
+		Lower,     // Lower triangle by rows, n(n+1)/2 elements
+		Symmetric, // Upper triangle by rows, mirrored below; n(n+1)/2 elements
+		Banded     // Diagonals -lower ... +upper by rows, (lower + upper + 1) * n elements
+	};
+
+	/**
+	 * @brief Square matrix stored and multiplied according to its structure
+	 *
+	 * The structure is either detected, picking whichever applicable packing
+	 * stores the fewest elements, or declared by the caller. Products skip the
+	 * structural zeros: diagonal factors scale rows or columns, triangular ones
+	 * multiply only the tiles on their side of the diagonal, and banded ones
+	 * touch only their band. Results of products and sums take the structure
+	 * their operands imply (an upper times an upper stays upper, bandwidths add
+	 * up under products). Storage comes from currentResource().
+	 */
+	class StructuredMat {
+	private:
+		std::pmr::vector<double> values;
+		int size;
+		MatrixStructure kind;
+		int lowerBand;
+		int upperBand;
+
+		StructuredMat(int n, MatrixStructure structure, int lower, int upper);
+
+		// Columns [first(i), last(i)) of row i are stored contiguously from row(i);
+		// for Symmetric that is the upper half only
+		int first(int i) const;
+		int last(int i) const;
+		const double* row(int i) const;
+		double* row(int i) { return const_cast<double*>(static_cast<const StructuredMat&>(*this).row(i)); }
+
+		void pack(const double* dense);
+		void requireSameSize(int n) const;
+
+	public:
+		/**
+		 * @brief Detects the structure of a dense matrix and packs it
+		 * @param mat Matrix to pack
+		 */
+		explicit StructuredMat(const SquareMat& mat);
+
+		/**
+		 * @brief Packs a dense matrix as the given structure
+		 *
+		 * Elements outside the structure are ignored rather than checked; a
+		 * Symmetric matrix is read from the upper triangle.
+		 * @param mat Matrix to pack
+		 * @param structure Declared structure
+		 * @param lower Lower bandwidth, for Banded only
+		 * @param upper Upper bandwidth, for Banded only
+		 */
+		StructuredMat(const SquareMat& mat, MatrixStructure structure, int lower = 0, int upper = 0);
+
+		StructuredMat(const StructuredMat& other);
+		StructuredMat(StructuredMat&& other) noexcept = default;
+		StructuredMat& operator=(const StructuredMat& other) = default;
+		StructuredMat& operator=(StructuredMat&& other) noexcept = default;
+
+		int dim() const { return size; }
+
+		MatrixStructure structure() const { return kind; }
+
+		/**
+		 * @brief Number of nonzero diagonals below the main one the structure allows
+		 */
+		int lowerBandwidth() const { return lowerBand; }
+
+		/**
+		 * @brief Number of nonzero diagonals above the main one the structure allows
+		 */
+		int upperBandwidth() const { return upperBand; }
+
+		/**
+		 * @brief Number of doubles in the packed storage
+		 */
+		std::size_t storedElements() const { return values.size(); }
+
+		/**
+		 * @brief Element at (i, j)
+		 * @param i Row index
+		 * @param j Column index
+		 * @return Stored value, or 0 outside the structure
+		 */
+		double at(int i, int j) const;
+
+		/**
+		 * @brief Expands the matrix into a SquareMat
+		 * @return Dense copy
+		 */
+		SquareMat toDense() const;
+
+		/**
+		 * @brief Matrix-vector product over the stored elements
+		 * @param x Vector of dim() elements
+		 * @return this * x
+		 */
+		std::vector<double> operator*(const std::vector<double>& x) const;
+
+		/**
+		 * @brief Structured-dense product
+		 * @param b Dense right operand
+		 * @return this * b
+		 */
+		SquareMat operator*(const SquareMat& b) const;
+
+		/**
+		 * @brief Dense-structured product
+		 * @param a Dense left operand
+		 * @param b Structured right operand
+		 * @return a * b
+		 */
+		friend SquareMat operator*(const SquareMat& a, const StructuredMat& b);
+
+		/**
+		 * @brief Product of two structured matrices
+		 * @param b Right operand
+		 * @return this * b, with the structure the operands imply
+		 */
+		StructuredMat operator*(const StructuredMat& b) const;
+
+		StructuredMat operator*(double sc) const;
+
+		friend StructuredMat operator*(double sc, const StructuredMat& mat) { return mat * sc; }
+
+		/**
+		 * @brief Sums keep the wider bandwidths, and symmetry if both operands have it
+		 */
+		StructuredMat operator+(const StructuredMat& b) const;
+		StructuredMat operator-(const StructuredMat& b) const;
+
+		/**
+		 * @brief Transpose; upper and lower structures and bandwidths swap
+		 * @return Transposed matrix
+		 */
+		StructuredMat operator~() const;
+
+		/**
+		 * @brief Raises the matrix to a power, keeping its structure where powers do
+		 *
+		 * Diagonal matrices are raised element-wise, triangular, symmetric and
+		 * general ones go through the power engine (see SquareMat::operator^),
+		 * and banded ones multiply within their growing band.
+		 * @param power Exponent value; 0 gives the identity
+		 * @return Result of exponentiation
+		 */
+		StructuredMat operator^(unsigned int power) const;
+
+		/**
+		 * @brief Determinant; the product of the diagonal for diagonal and
+		 * triangular matrices, an LU factorization otherwise
+		 * @return Determinant value
+		 */
+		double operator!() const;
+
+		/**
+		 * @brief Element-wise equality, regardless of structure
+		 */
+		bool operator==(const StructuredMat& b) const;
+		bool operator!=(const StructuredMat& b) const { return !(*this == b); }
+	};
+
+	namespace detail {
+		/**
+		 * @brief C = A * B for operands that are General, Upper, Lower or Diagonal
+		 *
+		 * C is computed in tiles, each from the inner range where both operands
+		 * can be nonzero, so one triangular operand halves the work and two of
+		 * the same orientation leave about a sixth. c is overwritten, including
+		 * tiles that are structurally zero, and must not alias a or b.
+		 * @param n Matrix dimension
+		 * @param sa Structure of a
+		 * @param a Left operand, row-major
+		 * @param sb Structure of b
+		 * @param b Right operand, row-major
+		 * @param c Destination
+		 */
+		void structuredProduct(int n, Structure sa, const double* a, Structure sb, const double* b, double* c);
+
+		/**
+		 * @brief C = A * B by diagonal scaling or structuredProduct() if either
+		 * operand is diagonal or triangular and the other is finite
+		 *
+		 * Called by multiply() before the dense algorithms. Detecting a general
+		 * matrix usually stops within its first two rows.
+		 * @param n Matrix dimension
+		 * @param a Left operand, row-major
+		 * @param b Right operand, row-major
+		 * @param c Destination; overwritten only when the call returns true
+		 * @return True if the product was computed
+		 */
+		bool structuredMultiply(int n, const double* a, const double* b, double* c);
+	}
+}
+#endif
@@ -0,0 +1,260 @@
+// ey.gellis@gmail.com
+#include "textio.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <fstream>
+#include <locale>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+using namespace matrix;
+
+namespace {
+	// Inputs and outputs below this many bytes or elements are handled serially
+	constexpr std::size_t PARALLEL_BYTES = std::size_t(1) << 20;
+	constexpr std::size_t PARALLEL_ELEMENTS = std::size_t(1) << 16;
+	// Rows formatted by one task of writeText()
+	constexpr int FORMAT_ROWS = 64;
+	// Largest stream precision the to_chars path of operator<< handles
+	constexpr int MAX_PRECISION = 100;
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	const char* skipSpace(const char* p, const char* end) {
+		while (p != end && isSpace(*p))
+			++p;
+		return p;
+	}
+
+	const char* skipToken(const char* p, const char* end) {
+		while (p != end && !isSpace(*p))
+			++p;
+		return p;
+	}
+
+	std::size_t countTokens(const char* p, const char* end) {
+		std::size_t count = 0;
+		while ((p = skipSpace(p, end)) != end) {
+			++count;
+			p = skipToken(p, end);
+		}
+		return count;
+	}
+
+	/**
+	 * @brief Parses the count whitespace-separated numbers of [p, end) into out
+	 */
+	void parseRange(const char* p, const char* end, double* out, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			p = skipSpace(p, end);
+			if (p == end)
+				throw std::invalid_argument("Matrix text has too few values");
+			std::from_chars_result r = std::from_chars(p, end, out[i]);
+			if (r.ec != std::errc() || (r.ptr != end && !isSpace(*r.ptr)))
+				throw std::invalid_argument("Malformed number in matrix text");
+			p = r.ptr;
+		}
+		if (skipSpace(p, end) != end)
+			throw std::invalid_argument("Matrix text has too many values");
+	}
+
+	/**
+	 * @brief How numbers are rendered: shortest round-trip, or printf-style with
+	 * a format and precision (what an ostream with default flags produces)
+	 */
+	struct NumberStyle {
+		bool shortest;
+		std::chars_format format;
+		int precision;
+	};
+
+	void formatRows(const double* data, int n, int first, int last, const NumberStyle& style, std::string& out) {
+		// Enough for any double in fixed notation at MAX_PRECISION
+		char buffer[320 + MAX_PRECISION];
+		out.clear();
+		for (int i = first; i < last; ++i) {
+			const double* row = data + static_cast<std::size_t>(i) * n;
+			for (int j = 0; j < n; ++j) {
+				std::to_chars_result r = style.shortest
+					? std::to_chars(buffer, buffer + sizeof(buffer), row[j])
+					: std::to_chars(buffer, buffer + sizeof(buffer), row[j], style.format, style.precision);
+				out.append(buffer, r.ptr);
+				out.push_back(j + 1 < n ? ' ' : '\n');
+			}
+		}
+	}
+
+	/**
+	 * @brief Formats all rows, in parallel windows for large matrices, writing
+	 * each window to the stream in order
+	 */
+	void writeRows(std::ostream& os, const double* data, int n, const NumberStyle& style) {
+		if (static_cast<std::size_t>(n) * n < PARALLEL_ELEMENTS || threadCount() == 1) {
+			std::string text;
+			formatRows(data, n, 0, n, style, text);
+			os.write(text.data(), static_cast<std::streamsize>(text.size()));
+			return;
+		}
+		std::vector<std::string> pieces(static_cast<std::size_t>(threadCount()) * 2);
+		const int window = static_cast<int>(pieces.size()) * FORMAT_ROWS;
+		for (int first = 0; first < n; first += window) {
+			const int tasks = (std::min(window, n - first) + FORMAT_ROWS - 1) / FORMAT_ROWS;
+			detail::parallelFor(tasks, [&](int task) {
+				int begin = first + task * FORMAT_ROWS;
+				formatRows(data, n, begin, std::min(begin + FORMAT_ROWS, n), style, pieces[task]);
+			});
+			for (int task = 0; task < tasks; ++task)
+				os.write(pieces[task].data(), static_cast<std::streamsize>(pieces[task].size()));
+		}
+	}
+
+	/**
+	 * @brief Picks the to_chars equivalent of the stream's formatting state
+	 * @return False if the flags or locale need the iostream path
+	 */
+	bool streamStyle(const std::ostream& os, NumberStyle& style) {
+		const std::ios_base::fmtflags flags = os.flags();
+		if (os.width() != 0 || os.precision() > MAX_PRECISION
+			|| (flags & (std::ios_base::showpos | std::ios_base::showpoint | std::ios_base::uppercase)))
+			return false;
+		const std::numpunct<char>& punct = std::use_facet<std::numpunct<char>>(os.getloc());
+		if (punct.decimal_point() != '.' || !punct.grouping().empty())
+			return false;
+
+		const std::ios_base::fmtflags field = flags & std::ios_base::floatfield;
+		style.shortest = false;
+		style.precision = static_cast<int>(os.precision());
+		if (field == std::ios_base::fixed)
+			style.format = std::chars_format::fixed;
+		else if (field == std::ios_base::scientific)
+			style.format = std::chars_format::scientific;
+		else if (field == std::ios_base::fmtflags())
+			style.format = std::chars_format::general;
+		else
+			return false;
+		return true;
+	}
+}
+
+namespace matrix {
+	std::ostream& operator<<(std::ostream& os, const SquareMat& mat) {
+		NumberStyle style;
+		if (streamStyle(os, style)) {
+			writeRows(os, mat.data, mat.size, style);
+			return os;
+		}
+		for (int i = 0; i < mat.size; ++i) {
+			for (int j = 0; j < mat.size; ++j) {
+				os << mat.data[static_cast<std::size_t>(i) * mat.size + j];
+				if (j + 1 < mat.size)
+					os << " ";
+			}
+			os << "\n";
+		}
+		return os;
+	}
+
+	std::istream& operator>>(std::istream& is, SquareMat& mat) {
+		std::string text, line;
+		std::size_t n = 0;
+		while (n == 0) {
+			if (!std::getline(is, line)) {
+				is.setstate(std::ios_base::failbit);
+				return is;
+			}
+			n = countTokens(line.data(), line.data() + line.size());
+		}
+		text = line;
+		text.push_back('\n');
+		for (std::size_t have = n; have < n * n && std::getline(is, line);) {
+			have += countTokens(line.data(), line.data() + line.size());
+			text += line;
+			text.push_back('\n');
+		}
+		try {
+			mat = parseText(text);
+		} catch (const std::invalid_argument&) {
+			is.setstate(std::ios_base::failbit);
+		}
+		return is;
+	}
+
+	void writeText(std::ostream& os, const SquareMat& mat) {
+		writeRows(os, mat[0].data(), mat.dim(), NumberStyle{true, std::chars_format::general, 0});
+		if (!os)
+			throw std::runtime_error("Failed to write matrix");
+	}
+
+	std::string toText(const SquareMat& mat) {
+		std::string text;
+		formatRows(mat[0].data(), mat.dim(), 0, mat.dim(), NumberStyle{true, std::chars_format::general, 0}, text);
+		return text;
+	}
+
+	SquareMat parseText(std::string_view text) {
+		const char* begin = text.data();
+		const char* end = begin + text.size();
+
+		const char* first = skipSpace(begin, end);
+		if (first == end)
+			throw std::invalid_argument("Matrix text is empty");
+		const char* lineEnd = std::find(first, end, '\n');
+		const std::size_t n = countTokens(first, lineEnd);
+		if (n > static_cast<std::size_t>(INT_MAX))
+			throw std::invalid_argument("Matrix text is too large");
+
+		SquareMat result(static_cast<int>(n));
+		double* out = result[0].data();
+		const std::size_t total = n * n;
+		if (text.size() < PARALLEL_BYTES || threadCount() == 1) {
+			parseRange(first, end, out, total);
+			return result;
+		}
+
+		// Chunk boundaries are moved forward to whitespace so no number is split;
+		// counting each chunk's values first gives every chunk its output offset
+		const int chunks = threadCount() * 4;
+		std::vector<const char*> bounds(chunks + 1, end);
+		bounds[0] = first;
+		for (int c = 1; c < chunks; ++c)
+			bounds[c] = std::max(bounds[c - 1], skipToken(first + (end - first) * c / chunks, end));
+		std::vector<std::size_t> offsets(chunks + 1, 0);
+		detail::parallelFor(chunks, [&](int c) { offsets[c + 1] = countTokens(bounds[c], bounds[c + 1]); });
+		for (int c = 0; c < chunks; ++c)
+			offsets[c + 1] += offsets[c];
+		if (offsets[chunks] < total)
+			throw std::invalid_argument("Matrix text has too few values");
+		if (offsets[chunks] > total)
+			throw std::invalid_argument("Matrix text has too many values");
+
+		detail::parallelFor(chunks, [&](int c) {
+			parseRange(bounds[c], bounds[c + 1], out + offsets[c], offsets[c + 1] - offsets[c]);
+		});
+		return result;
+	}
+
+	SquareMat readText(std::istream& is) {
+		std::string text;
+		std::vector<char> buffer(std::size_t(1) << 20);
+		while (is.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || is.gcount() > 0)
+			text.append(buffer.data(), static_cast<std::size_t>(is.gcount()));
+		return parseText(text);
+	}
+
+	SquareMat loadText(const std::string& path) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+		std::string text(static_cast<std::size_t>(file.tellg()), '\0');
+		file.seekg(0);
+		if (!file.read(text.data(), static_cast<std::streamsize>(text.size())))
+			throw std::runtime_error("Failed to read " + path);
+		return parseText(text);
+	}
+}
@@ -0,0 +1,57 @@
+// ey.gellis@gmail.com
+#ifndef TEXTIO_H
+#define TEXTIO_H
+
+#include "squaremat.hpp"
+#include <ostream>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace matrix {
+	/**
+	 * @brief Writes a matrix as whitespace-separated text with shortest round-trip
+	 * numbers, one row per line
+	 *
+	 * Unlike operator<<, which honors the stream's precision, every value is
+	 * written with the fewest digits that parse back to the same double. Large
+	 * matrices are formatted in parallel and written in order.
+	 * @param os Output stream
+	 * @param mat Matrix to write
+	 */
+	void writeText(std::ostream& os, const SquareMat& mat);
+
+	/**
+	 * @brief writeText() into a string
+	 * @param mat Matrix to format
+	 * @return Formatted text
+	 */
+	std::string toText(const SquareMat& mat);
+
+	/**
+	 * @brief Parses the text format written by operator<< and writeText()
+	 *
+	 * The number of values on the first non-empty line gives the dimension, and
+	 * exactly n * n values must follow in total; any whitespace separates them.
+	 * Parsing is locale-independent (std::from_chars), and large inputs are split
+	 * at whitespace into chunks that are parsed in parallel.
+	 * @param text Text to parse
+	 * @return Parsed matrix
+	 */
+	SquareMat parseText(std::string_view text);
+
+	/**
+	 * @brief Reads the rest of a stream and parses it with parseText()
+	 * @param is Input stream
+	 * @return Parsed matrix
+	 */
+	SquareMat readText(std::istream& is);
+
+	/**
+	 * @brief Reads a whole text file and parses it with parseText()
+	 * @param path File to read
+	 * @return Parsed matrix
+	 */
+	SquareMat loadText(const std::string& path);
+}
+#endif
@@ -0,0 +1,231 @@
+// ey.gellis@gmail.com
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+	/**
+	 * @brief Persistent pool where each worker owns a deque and steals from the
+	 * others once its own runs dry
+	 */
+	class ThreadPool {
+	private:
+		struct Queue {
+			std::mutex lock;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+		std::mutex sleepLock;
+		std::condition_variable wake;
+		std::atomic<long> pending{0};
+		std::atomic<unsigned> nextQueue{0};
+		bool stopping = false;
+
+		bool tryPop(std::size_t self, std::function<void()>& task) {
+			{
+				Queue& own = *queues[self];
+				std::lock_guard<std::mutex> guard(own.lock);
+				if (!own.tasks.empty()) {
+					task = std::move(own.tasks.back());
+					own.tasks.pop_back();
+					return true;
+				}
+			}
+			for (std::size_t i = 1; i < queues.size(); ++i) {
+				Queue& victim = *queues[(self + i) % queues.size()];
+				std::lock_guard<std::mutex> guard(victim.lock);
+				if (!victim.tasks.empty()) {
+					task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void workerLoop(std::size_t self) {
+			std::function<void()> task;
+			while (true) {
+				if (tryPop(self, task)) {
+					pending.fetch_sub(1, std::memory_order_relaxed);
+					task();
+					continue;
+				}
+				std::unique_lock<std::mutex> guard(sleepLock);
+				wake.wait(guard, [&] { return stopping || pending.load(std::memory_order_relaxed) > 0; });
+				if (stopping)
+					return;
+			}
+		}
+
+	public:
+		ThreadPool(int threads, bool pin) {
+			// The caller participates in every parallelFor, so it gets the last queue
+			for (int i = 0; i < threads; ++i)
+				queues.push_back(std::make_unique<Queue>());
+			for (int i = 0; i + 1 < threads; ++i) {
+				workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<std::size_t>(i));
+#ifdef __linux__
+				if (pin) {
+					cpu_set_t set;
+					CPU_ZERO(&set);
+					CPU_SET(i % CPU_SETSIZE, &set);
+					pthread_setaffinity_np(workers.back().native_handle(), sizeof(set), &set);
+				}
+#else
+				(void)pin;
+#endif
+			}
+		}
+
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+
+		std::size_t size() const { return queues.size(); }
+
+		void submit(std::function<void()> task) {
+			std::size_t target = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+			{
+				std::lock_guard<std::mutex> guard(queues[target]->lock);
+				queues[target]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+				pending.fetch_add(1, std::memory_order_relaxed);
+			}
+			wake.notify_one();
+		}
+
+		/**
+		 * @brief Lets the calling thread run one queued task, stealing if needed
+		 * @return True if a task was run
+		 */
+		bool helpOne() {
+			std::function<void()> task;
+			if (!tryPop(queues.size() - 1, task))
+				return false;
+			pending.fetch_sub(1, std::memory_order_relaxed);
+			task();
+			return true;
+		}
+	};
+
+	std::mutex configLock;
+	std::unique_ptr<ThreadPool> pool;
+	int configuredThreads = 0;
+	bool pinThreads = false;
+	std::atomic<int> threshold{256};
+	thread_local bool insideTask = false;
+
+	int resolvedThreads() {
+		if (configuredThreads > 0)
+			return configuredThreads;
+		// hardware_concurrency() reads /sys on every call with glibc, and this sits
+		// on the path of every product and reduction
+		static const int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+		return hardware;
+	}
+
+	ThreadPool& sharedPool() {
+		std::lock_guard<std::mutex> guard(configLock);
+		if (!pool)
+			pool = std::make_unique<ThreadPool>(resolvedThreads(), pinThreads);
+		return *pool;
+	}
+
+	void resetPool() {
+		std::lock_guard<std::mutex> guard(configLock);
+		pool.reset();
+	}
+}
+
+namespace matrix {
+	void setThreadCount(int n) {
+		{
+			std::lock_guard<std::mutex> guard(configLock);
+			configuredThreads = std::max(0, n);
+		}
+		resetPool();
+	}
+
+	int threadCount() {
+		std::lock_guard<std::mutex> guard(configLock);
+		return resolvedThreads();
+	}
+
+	void setThreadAffinity(bool pin) {
+		{
+			std::lock_guard<std::mutex> guard(configLock);
+			pinThreads = pin;
+		}
+		resetPool();
+	}
+
+	void setParallelThreshold(int n) {
+		threshold.store(std::max(1, n), std::memory_order_relaxed);
+	}
+
+	int parallelThreshold() {
+		return threshold.load(std::memory_order_relaxed);
+	}
+
+	namespace detail {
+		void parallelFor(int tasks, const std::function<void(int)>& body) {
+			if (tasks <= 0)
+				return;
+			if (tasks == 1 || insideTask || threadCount() == 1) {
+				for (int i = 0; i < tasks; ++i)
+					body(i);
+				return;
+			}
+
+			ThreadPool& workers = sharedPool();
+			std::atomic<int> remaining{tasks};
+			std::mutex errorLock;
+			std::exception_ptr error;
+
+			for (int i = 0; i < tasks; ++i) {
+				workers.submit([&, i] {
+					insideTask = true;
+					try {
+						body(i);
+					} catch (...) {
+						std::lock_guard<std::mutex> guard(errorLock);
+						if (!error)
+							error = std::current_exception();
+					}
+					insideTask = false;
+					remaining.fetch_sub(1, std::memory_order_acq_rel);
+				});
+			}
+
+			while (remaining.load(std::memory_order_acquire) > 0) {
+				if (!workers.helpOne())
+					std::this_thread::yield();
+			}
+			if (error)
+				std::rethrow_exception(error);
+		}
+	}
+}
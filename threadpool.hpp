@@ -0,0 +1,78 @@
+// ey.gellis@gmail.com
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <functional>
+
+namespace matrix {
+	/**
+	 * @brief Sets the number of worker threads used by parallel kernels
+	 *
+	 * The library pool is rebuilt on the next parallel call. Must not be called
+	 * while another thread is running matrix operations.
+	 * @param n Thread count; 0 selects std::thread::hardware_concurrency()
+	 */
+	void setThreadCount(int n);
+
+	/**
+	 * @brief Number of threads parallel kernels run on (including the caller)
+	 * @return Configured thread count
+	 */
+	int threadCount();
+
+	/**
+	 * @brief Pins worker i to logical CPU i (Linux only; ignored elsewhere)
+	 * @param pin True to pin workers, false to let the scheduler place them
+	 */
+	void setThreadAffinity(bool pin);
+
+	/**
+	 * @brief Sets the smallest matrix dimension that is multiplied in parallel
+	 * @param n Dimension threshold; products of smaller matrices stay serial
+	 */
+	void setParallelThreshold(int n);
+
+	/**
+	 * @brief Smallest matrix dimension that is multiplied in parallel
+	 * @return Dimension threshold
+	 */
+	int parallelThreshold();
+
+	namespace detail {
+		/**
+		 * @brief Runs body(0) ... body(tasks - 1) on the library's work-stealing pool
+		 *
+		 * The calling thread takes part in the work and the call returns once every
+		 * task has finished. The first exception thrown by a task is rethrown.
+		 * Nested calls from inside a task run serially.
+		 * @param tasks Number of tasks
+		 * @param body Task body, called with the task index
+		 */
+		void parallelFor(int tasks, const std::function<void(int)>& body);
+
+		/**
+		 * @brief Rows per task of forRows()
+		 */
+		constexpr int ROW_BLOCK = 32;
+
+		/**
+		 * @brief Runs rows(first, last) over [0, n) in ROW_BLOCK-row tasks on the
+		 * pool from parallelThreshold() up, or as a single call below it
+		 * @param n Number of rows
+		 * @param rows Body, called with a half-open range of rows
+		 */
+		template <typename Rows>
+		void forRows(int n, const Rows& rows) {
+			const int blocks = (n + ROW_BLOCK - 1) / ROW_BLOCK;
+			if (n < parallelThreshold() || threadCount() == 1 || blocks == 1) {
+				rows(0, n);
+				return;
+			}
+			parallelFor(blocks, [&](int block) {
+				rows(block * ROW_BLOCK, std::min(block * ROW_BLOCK + ROW_BLOCK, n));
+			});
+		}
+	}
+}
+#endif
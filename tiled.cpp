@@ -0,0 +1,599 @@
+// ey.gellis@gmail.com
+#include "tiled.hpp"
+#include "binaryio.hpp"
+#include "gemm.hpp"
+#include "kernels.hpp"
+#include "transpose.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATRIX_POSIX 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace matrix;
+
+namespace {
+	// Background threads per matrix that load prefetched tiles
+	constexpr int IO_THREADS = 2;
+	// Two pinned operands (a * a) plus one prefetched tile
+	constexpr std::size_t MIN_CACHED_TILES = 3;
+
+	[[noreturn]] void throwErrno(const std::string& what) {
+		throw std::system_error(errno, std::generic_category(), what);
+	}
+
+#ifdef MATRIX_POSIX
+	void readAt(int fd, void* out, std::size_t bytes, std::size_t offset) {
+		char* p = static_cast<char*>(out);
+		while (bytes > 0) {
+			ssize_t got = pread(fd, p, bytes, static_cast<off_t>(offset));
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got < 0)
+				throwErrno("Cannot read matrix tile");
+			if (got == 0)
+				throw std::invalid_argument("Matrix file is truncated");
+			p += got;
+			bytes -= static_cast<std::size_t>(got);
+			offset += static_cast<std::size_t>(got);
+		}
+	}
+
+	void writeAt(int fd, const void* in, std::size_t bytes, std::size_t offset) {
+		const char* p = static_cast<const char*>(in);
+		while (bytes > 0) {
+			ssize_t put = pwrite(fd, p, bytes, static_cast<off_t>(offset));
+			if (put < 0 && errno == EINTR)
+				continue;
+			if (put < 0)
+				throwErrno("Cannot write matrix tile");
+			p += put;
+			bytes -= static_cast<std::size_t>(put);
+			offset += static_cast<std::size_t>(put);
+		}
+	}
+#else
+	[[noreturn]] void unsupported() {
+		throw std::runtime_error("Tiled matrices are not supported on this platform");
+	}
+#endif
+}
+
+namespace matrix {
+	namespace detail {
+		/**
+		 * @brief Tile file plus its bounded LRU cache and prefetch threads
+		 *
+		 * A slot is busy while its tile is being written back or loaded; the mutex
+		 * is not held during that I/O. Pinned slots are never evicted.
+		 */
+		class TileStore {
+		public:
+			const int n;
+			const int tile;
+			const int tilesPerSide;
+			const std::size_t tileElems;
+			const std::size_t cacheBytes;
+
+			TileStore(int file, std::string name, bool temp, int dim, int tileDim, std::size_t budget)
+				: n(dim), tile(tileDim), tilesPerSide((dim + tileDim - 1) / tileDim),
+				  tileElems(static_cast<std::size_t>(tileDim) * tileDim), cacheBytes(budget), fd(file),
+				  path(std::move(name)), temporary(temp) {
+				std::size_t capacity = std::max(MIN_CACHED_TILES, cacheBytes / (tileElems * sizeof(double)));
+				capacity = std::min(capacity, static_cast<std::size_t>(tilesPerSide) * tilesPerSide + 1);
+				slots.resize(capacity);
+				for (std::size_t s = 0; s < capacity; ++s)
+					slotOrder.push_back(lru.insert(lru.end(), static_cast<int>(s)));
+			}
+
+			~TileStore() {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				work.notify_all();
+				for (std::thread& t : io)
+					t.join();
+				try {
+					if (!temporary)
+						flush();
+				} catch (...) {
+				}
+#ifdef MATRIX_POSIX
+				::close(fd);
+				if (temporary)
+					::unlink(path.c_str());
+#endif
+			}
+
+			const std::string& name() const { return path; }
+
+			/**
+			 * @brief Pins a tile in the cache, loading it (or zeroing it when load is
+			 * false, for tiles about to be overwritten) if it is not resident
+			 */
+			double* acquire(int index, bool load) {
+				std::unique_lock<std::mutex> lock(mutex);
+				while (true) {
+					if (incoming.count(index)) {
+						changed.wait(lock);
+						continue;
+					}
+					auto found = where.find(index);
+					if (found != where.end()) {
+						Slot& s = slots[found->second];
+						if (s.busy) {
+							changed.wait(lock);
+							continue;
+						}
+						++s.pins;
+						touch(found->second);
+						return s.data.data();
+					}
+					int victim = evictable();
+					if (victim < 0) {
+						changed.wait(lock);
+						continue;
+					}
+					fill(lock, victim, index, load, 1);
+					return slots[victim].data.data();
+				}
+			}
+
+			void release(int index, bool dirty) {
+				std::lock_guard<std::mutex> lock(mutex);
+				Slot& s = slots[where.at(index)];
+				--s.pins;
+				s.dirty = s.dirty || dirty;
+				changed.notify_all();
+			}
+
+			/**
+			 * @brief Queues a tile for loading on the I/O threads; never blocks
+			 */
+			void prefetch(int index) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (where.count(index) || incoming.count(index)
+					|| std::find(queue.begin(), queue.end(), index) != queue.end())
+					return;
+				if (io.empty())
+					for (int t = 0; t < IO_THREADS; ++t)
+						io.emplace_back([this] { ioLoop(); });
+				queue.push_back(index);
+				work.notify_one();
+			}
+
+			void flush() {
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&] {
+					return std::none_of(slots.begin(), slots.end(), [](const Slot& s) { return s.busy; });
+				});
+				for (Slot& s : slots)
+					if (s.tile >= 0 && s.dirty) {
+						writeTile(s.tile, s.data.data());
+						s.dirty = false;
+					}
+			}
+
+			void persist(const std::string& newPath) {
+				flush();
+#ifdef MATRIX_POSIX
+				if (std::rename(path.c_str(), newPath.c_str()) != 0)
+					throwErrno("Cannot rename " + path);
+#endif
+				path = newPath;
+				temporary = false;
+			}
+
+			void readTile(int index, double* out) {
+#ifdef MATRIX_POSIX
+				readAt(fd, out, tileElems * sizeof(double), offset(index));
+#else
+				(void)index;
+				(void)out;
+				unsupported();
+#endif
+			}
+
+			void writeTile(int index, const double* in) {
+#ifdef MATRIX_POSIX
+				writeAt(fd, in, tileElems * sizeof(double), offset(index));
+#else
+				(void)index;
+				(void)in;
+				unsupported();
+#endif
+			}
+
+		private:
+			struct Slot {
+				int tile = -1;
+				int pins = 0;
+				bool dirty = false;
+				bool busy = false;
+				std::vector<double> data;
+			};
+
+			int fd;
+			std::string path;
+			bool temporary;
+
+			std::mutex mutex;
+			std::condition_variable changed;
+			std::vector<Slot> slots;
+			std::list<int> lru; // Slot indices, most recently used first
+			std::vector<std::list<int>::iterator> slotOrder;
+			std::unordered_map<int, int> where; // Tile index -> slot
+			std::unordered_set<int> incoming;   // Tiles waiting for their slot's write-back
+
+			std::condition_variable work;
+			std::deque<int> queue;
+			std::vector<std::thread> io;
+			bool stopping = false;
+
+			std::size_t offset(int index) const {
+				return sizeof(FileHeader) + static_cast<std::size_t>(index) * tileElems * sizeof(double);
+			}
+
+			void touch(int slot) {
+				lru.splice(lru.begin(), lru, slotOrder[slot]);
+			}
+
+			int evictable() const {
+				for (auto it = lru.rbegin(); it != lru.rend(); ++it) {
+					const Slot& s = slots[*it];
+					if (s.pins == 0 && !s.busy)
+						return *it;
+				}
+				return -1;
+			}
+
+			/**
+			 * @brief Moves tile index into slot, writing back the previous occupant
+			 *
+			 * The previous occupant stays resident, busy and dirty until it is on
+			 * disk, so a failed write-back loses nothing. Called and returns with
+			 * the lock held, including when it throws.
+			 */
+			void fill(std::unique_lock<std::mutex>& lock, int slot, int index, bool load, int pins) {
+				Slot& s = slots[slot];
+				s.busy = true;
+				if (s.tile >= 0 && s.dirty) {
+					incoming.insert(index);
+					lock.unlock();
+					try {
+						writeTile(s.tile, s.data.data());
+					} catch (...) {
+						lock.lock();
+						incoming.erase(index);
+						s.busy = false;
+						changed.notify_all();
+						throw;
+					}
+					lock.lock();
+					incoming.erase(index);
+					s.dirty = false;
+				}
+				if (s.tile >= 0)
+					where.erase(s.tile);
+				s.tile = index;
+				s.pins = pins;
+				s.dirty = !load;
+				where[index] = slot;
+				touch(slot);
+				if (s.data.empty())
+					s.data.resize(tileElems);
+
+				lock.unlock();
+				try {
+					if (load)
+						readTile(index, s.data.data());
+					else
+						std::fill(s.data.begin(), s.data.end(), 0.0);
+				} catch (...) {
+					lock.lock();
+					where.erase(index);
+					s.tile = -1;
+					s.pins = 0;
+					s.busy = false;
+					s.dirty = false;
+					changed.notify_all();
+					throw;
+				}
+				lock.lock();
+				s.busy = false;
+				changed.notify_all();
+			}
+
+			void ioLoop() {
+				std::unique_lock<std::mutex> lock(mutex);
+				while (true) {
+					work.wait(lock, [&] { return stopping || !queue.empty(); });
+					if (stopping)
+						return;
+					int index = queue.front();
+					queue.pop_front();
+					if (where.count(index) || incoming.count(index))
+						continue;
+					int victim = evictable();
+					if (victim < 0)
+						continue;
+					try {
+						fill(lock, victim, index, true, 0);
+					} catch (...) {
+						// A failed prefetch is retried, and reported, by acquire()
+					}
+				}
+			}
+		};
+	}
+}
+
+namespace {
+	/**
+	 * @brief Pins a tile for the lifetime of the reference
+	 */
+	class TileRef {
+	private:
+		detail::TileStore& store;
+		int index;
+		bool dirty;
+
+	public:
+		double* data;
+
+		TileRef(detail::TileStore& s, int i, bool load = true, bool write = false)
+			: store(s), index(i), dirty(write), data(s.acquire(i, load)) {}
+		~TileRef() { store.release(index, dirty); }
+		TileRef(const TileRef&) = delete;
+		TileRef& operator=(const TileRef&) = delete;
+	};
+
+	std::unique_ptr<detail::TileStore> createStore(int fd, const std::string& path, bool temporary, int n,
+		int tileSize, std::size_t cacheBytes) {
+		auto store = std::make_unique<detail::TileStore>(fd, path, temporary, n, tileSize, cacheBytes);
+#ifdef MATRIX_POSIX
+		// Tiled files carry no checksum: tiles are rewritten in place at any time
+		detail::FileHeader header = detail::makeHeader(n, detail::LAYOUT_TILED);
+		header.tileSize = static_cast<std::uint32_t>(tileSize);
+		writeAt(fd, &header, sizeof(header), 0);
+		// Tiles start out as a sparse, zero-filled extent
+		const std::size_t tiles = static_cast<std::size_t>(store->tilesPerSide) * store->tilesPerSide;
+		if (ftruncate(fd, static_cast<off_t>(sizeof(header) + tiles * store->tileElems * sizeof(double))) != 0)
+			throwErrno("Cannot size " + path);
+#endif
+		return store;
+	}
+}
+
+TiledSquareMat::TiledSquareMat(std::unique_ptr<detail::TileStore> s) : store(std::move(s)) {}
+
+TiledSquareMat::TiledSquareMat(const std::string& path, int n, int tileSize, std::size_t cacheBytes) {
+	if (n <= 0)
+		throw std::invalid_argument("Matrix size is not > 0");
+	if (tileSize <= 0)
+		throw std::invalid_argument("Tile size is not > 0");
+#ifdef MATRIX_POSIX
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		throwErrno("Cannot create " + path);
+	store = createStore(fd, path, false, n, tileSize, cacheBytes);
+#else
+	(void)path;
+	(void)cacheBytes;
+	unsupported();
+#endif
+}
+
+TiledSquareMat TiledSquareMat::open(const std::string& path, std::size_t cacheBytes) {
+#ifdef MATRIX_POSIX
+	int fd = ::open(path.c_str(), O_RDWR);
+	if (fd < 0)
+		throwErrno("Cannot open " + path);
+	detail::FileHeader header;
+	int n;
+	try {
+		readAt(fd, &header, sizeof(header), 0);
+		n = detail::checkHeader(header, detail::LAYOUT_TILED);
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+	auto store = std::make_unique<detail::TileStore>(fd, path, false, n, static_cast<int>(header.tileSize), cacheBytes);
+	struct stat info;
+	const std::size_t tiles = static_cast<std::size_t>(store->tilesPerSide) * store->tilesPerSide;
+	if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(header) + tiles * store->tileElems * sizeof(double))
+		throw std::invalid_argument("Matrix file is truncated");
+	return TiledSquareMat(std::move(store));
+#else
+	(void)path;
+	(void)cacheBytes;
+	unsupported();
+#endif
+}
+
+TiledSquareMat TiledSquareMat::fromSquareMat(const SquareMat& mat, const std::string& path, int tileSize,
+	std::size_t cacheBytes) {
+	TiledSquareMat result(path, mat.dim(), tileSize, cacheBytes);
+	detail::TileStore& s = *result.store;
+	for (int ti = 0; ti < s.tilesPerSide; ++ti)
+		for (int tj = 0; tj < s.tilesPerSide; ++tj) {
+			TileRef t(s, ti * s.tilesPerSide + tj, false, true);
+			const int rows = std::min(s.tile, s.n - ti * s.tile);
+			const int cols = std::min(s.tile, s.n - tj * s.tile);
+			for (int r = 0; r < rows; ++r) {
+				const double* src = mat[ti * s.tile + r].data() + tj * s.tile;
+				std::copy(src, src + cols, t.data + static_cast<std::size_t>(r) * s.tile);
+			}
+		}
+	result.flush();
+	return result;
+}
+
+TiledSquareMat::TiledSquareMat(TiledSquareMat&& other) noexcept = default;
+
+TiledSquareMat& TiledSquareMat::operator=(TiledSquareMat&& other) noexcept = default;
+
+TiledSquareMat::~TiledSquareMat() = default;
+
+int TiledSquareMat::dim() const {
+	return store->n;
+}
+
+int TiledSquareMat::tileSize() const {
+	return store->tile;
+}
+
+const std::string& TiledSquareMat::path() const {
+	return store->name();
+}
+
+double TiledSquareMat::get(int i, int j) const {
+	if (i < 0 || i >= store->n || j < 0 || j >= store->n)
+		throw std::out_of_range("Element index out of range");
+	const int t = store->tile;
+	TileRef ref(*store, (i / t) * store->tilesPerSide + j / t);
+	return ref.data[static_cast<std::size_t>(i % t) * t + j % t];
+}
+
+void TiledSquareMat::set(int i, int j, double value) {
+	if (i < 0 || i >= store->n || j < 0 || j >= store->n)
+		throw std::out_of_range("Element index out of range");
+	const int t = store->tile;
+	TileRef ref(*store, (i / t) * store->tilesPerSide + j / t, true, true);
+	ref.data[static_cast<std::size_t>(i % t) * t + j % t] = value;
+}
+
+SquareMat TiledSquareMat::toSquareMat() const {
+	detail::TileStore& s = *store;
+	const int tiles = s.tilesPerSide * s.tilesPerSide;
+	SquareMat result(s.n);
+	for (int index = 0; index < tiles; ++index) {
+		if (index + 1 < tiles)
+			s.prefetch(index + 1);
+		const int ti = index / s.tilesPerSide;
+		const int tj = index % s.tilesPerSide;
+		TileRef t(s, index);
+		const int rows = std::min(s.tile, s.n - ti * s.tile);
+		const int cols = std::min(s.tile, s.n - tj * s.tile);
+		for (int r = 0; r < rows; ++r) {
+			const double* src = t.data + static_cast<std::size_t>(r) * s.tile;
+			std::copy(src, src + cols, result[ti * s.tile + r].data() + tj * s.tile);
+		}
+	}
+	return result;
+}
+
+void TiledSquareMat::flush() {
+	store->flush();
+}
+
+void TiledSquareMat::persist(const std::string& newPath) {
+	store->persist(newPath);
+}
+
+TiledSquareMat TiledSquareMat::scratch() const {
+#ifdef MATRIX_POSIX
+	std::string name = store->name() + ".XXXXXX";
+	std::vector<char> buffer(name.begin(), name.end());
+	buffer.push_back('\0');
+	int fd = mkstemp(buffer.data());
+	if (fd < 0)
+		throwErrno("Cannot create a temporary file next to " + store->name());
+	return TiledSquareMat(createStore(fd, buffer.data(), true, store->n, store->tile, store->cacheBytes));
+#else
+	unsupported();
+#endif
+}
+
+void TiledSquareMat::checkCompatible(const TiledSquareMat& b, const char* operation) const {
+	if (store->n != b.store->n)
+		throw std::invalid_argument(std::string("Matrix sizes must match for ") + operation);
+	if (store->tile != b.store->tile)
+		throw std::invalid_argument(std::string("Tile sizes must match for ") + operation);
+}
+
+TiledSquareMat TiledSquareMat::operator*(const TiledSquareMat& b) const {
+	checkCompatible(b, "multiplication");
+	TiledSquareMat result = scratch();
+	detail::TileStore& sa = *store;
+	detail::TileStore& sb = *b.store;
+	const int nt = sa.tilesPerSide;
+	const int t = sa.tile;
+
+	for (int i = 0; i < nt; ++i)
+		for (int j = 0; j < nt; ++j) {
+			TileRef c(*result.store, i * nt + j, false, true);
+			for (int k = 0; k < nt; ++k) {
+				// Operands of the next step: the next k, or the start of the next C tile
+				if (k + 1 < nt) {
+					sa.prefetch(i * nt + k + 1);
+					sb.prefetch((k + 1) * nt + j);
+				} else if (j + 1 < nt) {
+					sa.prefetch(i * nt);
+					sb.prefetch(j + 1);
+				} else if (i + 1 < nt) {
+					sa.prefetch((i + 1) * nt);
+					sb.prefetch(0);
+				}
+				TileRef ta(sa, i * nt + k);
+				TileRef tb(sb, k * nt + j);
+				detail::gemmStrided(t, ta.data, t, tb.data, t, c.data, t);
+			}
+		}
+	return result;
+}
+
+TiledSquareMat TiledSquareMat::operator+(const TiledSquareMat& b) const {
+	checkCompatible(b, "addition");
+	TiledSquareMat result = scratch();
+	detail::TileStore& sa = *store;
+	detail::TileStore& sb = *b.store;
+	const int tiles = sa.tilesPerSide * sa.tilesPerSide;
+
+	for (int index = 0; index < tiles; ++index) {
+		if (index + 1 < tiles) {
+			sa.prefetch(index + 1);
+			sb.prefetch(index + 1);
+		}
+		TileRef ta(sa, index);
+		TileRef tb(sb, index);
+		TileRef c(*result.store, index, false, true);
+		detail::kernels().add(ta.data, tb.data, c.data, sa.tileElems);
+	}
+	return result;
+}
+
+TiledSquareMat TiledSquareMat::operator~() const {
+	TiledSquareMat result = scratch();
+	detail::TileStore& sa = *store;
+	const int nt = sa.tilesPerSide;
+	const int t = sa.tile;
+
+	for (int index = 0; index < nt * nt; ++index) {
+		const int i = index / nt;
+		const int j = index % nt;
+		if (index + 1 < nt * nt)
+			sa.prefetch(((index + 1) % nt) * nt + (index + 1) / nt);
+		TileRef src(sa, j * nt + i);
+		TileRef dst(*result.store, index, false, true);
+		detail::transpose(t, t, src.data, t, dst.data, t);
+	}
+	return result;
+}
@@ -0,0 +1,157 @@
+// ey.gellis@gmail.com
+#ifndef TILED_H
+#define TILED_H
+
+#include "squaremat.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace matrix {
+	namespace detail {
+		class TileStore;
+	}
+
+	/**
+	 * @brief Disk-backed square matrix for data that does not fit in memory
+	 *
+	 * Elements live in a file of square tiles (the binary format of binaryio.hpp
+	 * with LAYOUT_TILED), each tile stored row-major and edge tiles zero padded.
+	 * Only a bounded LRU cache of tiles is resident; dirty tiles are written back
+	 * on eviction, flush() and destruction. Operations stream over tiles and ask
+	 * background I/O threads to prefetch the next operands while the current ones
+	 * are being computed.
+	 *
+	 * Results of operators live in temporary files next to the left operand's file
+	 * and are deleted with the result unless persist() gives them a name.
+	 */
+	class TiledSquareMat {
+	private:
+		std::unique_ptr<detail::TileStore> store;
+
+		explicit TiledSquareMat(std::unique_ptr<detail::TileStore> s);
+
+		/**
+		 * @brief Temporary zero matrix shaped and cached like this one
+		 */
+		TiledSquareMat scratch() const;
+
+		/**
+		 * @brief Throws std::invalid_argument unless b has the same size and tiling
+		 */
+		void checkCompatible(const TiledSquareMat& b, const char* operation) const;
+
+	public:
+		/**
+		 * @brief Default tile dimension; a tile of doubles is 2 MiB
+		 */
+		static constexpr int DEFAULT_TILE = 512;
+
+		/**
+		 * @brief Default memory budget of each matrix's tile cache
+		 */
+		static constexpr std::size_t DEFAULT_CACHE_BYTES = std::size_t(256) << 20;
+
+		/**
+		 * @brief Creates a zero matrix in a new file, replacing any existing one
+		 * @param path File to create
+		 * @param n Matrix dimension
+		 * @param tileSize Tile dimension
+		 * @param cacheBytes Memory budget for cached tiles; at least three tiles are
+		 * always kept so products of a matrix with itself can progress
+		 */
+		TiledSquareMat(const std::string& path, int n, int tileSize = DEFAULT_TILE,
+			std::size_t cacheBytes = DEFAULT_CACHE_BYTES);
+
+		/**
+		 * @brief Opens an existing tiled matrix file for reading and writing
+		 * @param path File to open
+		 * @param cacheBytes Memory budget for cached tiles
+		 * @return Matrix backed by the file
+		 */
+		static TiledSquareMat open(const std::string& path, std::size_t cacheBytes = DEFAULT_CACHE_BYTES);
+
+		/**
+		 * @brief Writes an in-memory matrix out as a tiled file
+		 * @param mat Matrix to copy
+		 * @param path File to create
+		 * @param tileSize Tile dimension
+		 * @param cacheBytes Memory budget for cached tiles
+		 * @return Matrix backed by the new file
+		 */
+		static TiledSquareMat fromSquareMat(const SquareMat& mat, const std::string& path,
+			int tileSize = DEFAULT_TILE, std::size_t cacheBytes = DEFAULT_CACHE_BYTES);
+
+		TiledSquareMat(TiledSquareMat&& other) noexcept;
+
+		TiledSquareMat& operator=(TiledSquareMat&& other) noexcept;
+
+		/**
+		 * @brief Writes back dirty tiles, closes the file and deletes it if temporary
+		 */
+		~TiledSquareMat();
+
+		int dim() const;
+
+		int tileSize() const;
+
+		/**
+		 * @brief File backing the matrix
+		 */
+		const std::string& path() const;
+
+		/**
+		 * @brief Reads one element through the tile cache
+		 * @param i Row index
+		 * @param j Column index
+		 * @return Element value
+		 */
+		double get(int i, int j) const;
+
+		/**
+		 * @brief Writes one element through the tile cache
+		 * @param i Row index
+		 * @param j Column index
+		 * @param value New value
+		 */
+		void set(int i, int j, double value);
+
+		/**
+		 * @brief Loads the whole matrix into memory
+		 * @return In-memory copy
+		 */
+		SquareMat toSquareMat() const;
+
+		/**
+		 * @brief Writes every dirty cached tile back to the file
+		 */
+		void flush();
+
+		/**
+		 * @brief Keeps the backing file under a new name instead of deleting it
+		 * @param newPath Name to move the file to
+		 */
+		void persist(const std::string& newPath);
+
+		/**
+		 * @brief Tile-by-tile product; C(I,J) accumulates A(I,K) * B(K,J) over K
+		 * @param b Right operand with the same size and tiling
+		 * @return Product in a temporary file
+		 */
+		TiledSquareMat operator*(const TiledSquareMat& b) const;
+
+		/**
+		 * @brief Tile-by-tile sum
+		 * @param b Matrix with the same size and tiling
+		 * @return Sum in a temporary file
+		 */
+		TiledSquareMat operator+(const TiledSquareMat& b) const;
+
+		/**
+		 * @brief Transpose; tile (I,J) of the result is tile (J,I) transposed
+		 * @return Transposed matrix in a temporary file
+		 */
+		TiledSquareMat operator~() const;
+	};
+}
+#endif
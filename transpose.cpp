@@ -0,0 +1,267 @@
+// ey.gellis@gmail.com
+#include "transpose.hpp"
+#include "kernels.hpp"
+#include "strassen.hpp"
+#include "instrument.hpp"
+#include <stdexcept>
+#include <cstdint>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATRIX_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+	using matrix::detail::Isa;
+
+	// Blocks with both sides at or below LEAF (32 x 32 doubles = 8 KiB) are
+	// handled tile by tile; larger ones are split in halves rounded to TILE.
+	constexpr int TILE = 4;
+	constexpr int LEAF = 32;
+	// Out-of-place destinations larger than this bypass the cache with
+	// non-temporal stores, avoiding the read-for-ownership of every line
+	constexpr std::size_t STREAM_BYTES = std::size_t(1) << 20;
+
+	// dst(4x4) = src(4x4)^T; safe when src == dst
+	typedef void (*TileFn)(const double* src, std::size_t lds, double* dst, std::size_t ldd);
+	// x(4x4) <- y^T and y(4x4) <- x^T, for mirrored tiles
+	typedef void (*SwapFn)(double* x, double* y, std::size_t ld);
+
+	void tileScalar(const double* src, std::size_t lds, double* dst, std::size_t ldd) {
+		double t[TILE][TILE];
+		for (int i = 0; i < TILE; ++i)
+			for (int j = 0; j < TILE; ++j)
+				t[j][i] = src[i * lds + j];
+		for (int i = 0; i < TILE; ++i)
+			for (int j = 0; j < TILE; ++j)
+				dst[i * ldd + j] = t[i][j];
+	}
+
+	void swapScalar(double* x, double* y, std::size_t ld) {
+		for (int i = 0; i < TILE; ++i)
+			for (int j = 0; j < TILE; ++j)
+				std::swap(x[i * ld + j], y[j * ld + i]);
+	}
+
+#ifdef MATRIX_X86
+	// 4x4 as four 2x2 register transposes
+	__attribute__((target("sse2"))) void tileSse2(const double* src, std::size_t lds, double* dst, std::size_t ldd) {
+		__m128d r[TILE][2];
+		for (int i = 0; i < TILE; ++i) {
+			r[i][0] = _mm_loadu_pd(src + i * lds);
+			r[i][1] = _mm_loadu_pd(src + i * lds + 2);
+		}
+		for (int i = 0; i < TILE; i += 2)
+			for (int h = 0; h < 2; ++h) {
+				// rows i, i+1 of src, columns 2h, 2h+1 -> rows 2h, 2h+1 of dst, columns i, i+1
+				_mm_storeu_pd(dst + (2 * h) * ldd + i, _mm_unpacklo_pd(r[i][h], r[i + 1][h]));
+				_mm_storeu_pd(dst + (2 * h + 1) * ldd + i, _mm_unpackhi_pd(r[i][h], r[i + 1][h]));
+			}
+	}
+
+	__attribute__((target("sse2"))) void swapSse2(double* x, double* y, std::size_t ld) {
+		double t[TILE * TILE];
+		tileSse2(x, ld, t, TILE);
+		tileSse2(y, ld, x, ld);
+		for (int i = 0; i < TILE; ++i)
+			for (int j = 0; j < TILE; ++j)
+				y[i * ld + j] = t[i * TILE + j];
+	}
+
+	__attribute__((target("avx2"))) inline void transpose4(__m256d& r0, __m256d& r1, __m256d& r2, __m256d& r3) {
+		const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+		const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+		const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+		const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+		r0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+		r1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+		r2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+		r3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+	}
+
+	__attribute__((target("avx2"))) void tileAvx2(const double* src, std::size_t lds, double* dst, std::size_t ldd) {
+		__m256d r0 = _mm256_loadu_pd(src);
+		__m256d r1 = _mm256_loadu_pd(src + lds);
+		__m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+		__m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+		transpose4(r0, r1, r2, r3);
+		_mm256_storeu_pd(dst, r0);
+		_mm256_storeu_pd(dst + ldd, r1);
+		_mm256_storeu_pd(dst + 2 * ldd, r2);
+		_mm256_storeu_pd(dst + 3 * ldd, r3);
+	}
+
+	// tileAvx2 with non-temporal stores; dst and ldd must keep rows 32-byte aligned
+	__attribute__((target("avx2"))) void streamAvx2(const double* src, std::size_t lds, double* dst, std::size_t ldd) {
+		__m256d r0 = _mm256_loadu_pd(src);
+		__m256d r1 = _mm256_loadu_pd(src + lds);
+		__m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+		__m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+		transpose4(r0, r1, r2, r3);
+		_mm256_stream_pd(dst, r0);
+		_mm256_stream_pd(dst + ldd, r1);
+		_mm256_stream_pd(dst + 2 * ldd, r2);
+		_mm256_stream_pd(dst + 3 * ldd, r3);
+	}
+
+	__attribute__((target("avx2"))) void swapAvx2(double* x, double* y, std::size_t ld) {
+		__m256d x0 = _mm256_loadu_pd(x);
+		__m256d x1 = _mm256_loadu_pd(x + ld);
+		__m256d x2 = _mm256_loadu_pd(x + 2 * ld);
+		__m256d x3 = _mm256_loadu_pd(x + 3 * ld);
+		__m256d y0 = _mm256_loadu_pd(y);
+		__m256d y1 = _mm256_loadu_pd(y + ld);
+		__m256d y2 = _mm256_loadu_pd(y + 2 * ld);
+		__m256d y3 = _mm256_loadu_pd(y + 3 * ld);
+		transpose4(x0, x1, x2, x3);
+		transpose4(y0, y1, y2, y3);
+		_mm256_storeu_pd(x, y0);
+		_mm256_storeu_pd(x + ld, y1);
+		_mm256_storeu_pd(x + 2 * ld, y2);
+		_mm256_storeu_pd(x + 3 * ld, y3);
+		_mm256_storeu_pd(y, x0);
+		_mm256_storeu_pd(y + ld, x1);
+		_mm256_storeu_pd(y + 2 * ld, x2);
+		_mm256_storeu_pd(y + 3 * ld, x3);
+	}
+#endif
+
+	struct TileKernels {
+		TileFn tile;
+		TileFn stream; // nullptr when the instruction set has no streaming variant
+		SwapFn swap;
+	};
+
+	TileKernels tileKernels() {
+		switch (matrix::detail::activeIsa()) {
+#ifdef MATRIX_X86
+		case Isa::AVX512:
+		case Isa::AVX2:
+			return {tileAvx2, streamAvx2, swapAvx2};
+		case Isa::SSE2:
+			return {tileSse2, nullptr, swapSse2};
+#endif
+		default:
+			return {tileScalar, nullptr, swapScalar};
+		}
+	}
+
+	matrix::SquareMat product(const matrix::SquareMat& a, bool transA, const matrix::SquareMat& b, bool transB) {
+		const int n = a.dim();
+		MATRIX_OP(Multiply, 2.0 * n * n * n);
+		if (n != b.dim())
+			throw std::invalid_argument("Matrix sizes must match for multiplication");
+
+		matrix::SquareMat result(n);
+		matrix::detail::multiply(n, a[0].data(), transA, b[0].data(), transB, result[0].data());
+		return result;
+	}
+
+	int half(int n) {
+		return (n / 2 + TILE - 1) / TILE * TILE;
+	}
+
+	void transposeBlock(const TileKernels& k, int rows, int cols, const double* src, std::size_t lds,
+		double* dst, std::size_t ldd) {
+		if (rows > LEAF || cols > LEAF) {
+			if (rows >= cols) {
+				const int h = half(rows);
+				transposeBlock(k, h, cols, src, lds, dst, ldd);
+				transposeBlock(k, rows - h, cols, src + h * lds, lds, dst + h, ldd);
+			} else {
+				const int h = half(cols);
+				transposeBlock(k, rows, h, src, lds, dst, ldd);
+				transposeBlock(k, rows, cols - h, src + h, lds, dst + h * ldd, ldd);
+			}
+			return;
+		}
+		const int rows4 = rows / TILE * TILE;
+		const int cols4 = cols / TILE * TILE;
+		for (int j = 0; j < cols4; j += TILE)
+			for (int i = 0; i < rows4; i += TILE)
+				k.tile(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+		for (int i = 0; i < rows; ++i)
+			for (int j = (i < rows4 ? cols4 : 0); j < cols; ++j)
+				dst[j * ldd + i] = src[i * lds + j];
+	}
+
+	// x is rows x cols, y is the mirrored cols x rows block: x <- y^T, y <- x^T
+	void swapBlock(const TileKernels& k, int rows, int cols, double* x, double* y, std::size_t ld) {
+		if (rows > LEAF || cols > LEAF) {
+			if (rows >= cols) {
+				const int h = half(rows);
+				swapBlock(k, h, cols, x, y, ld);
+				swapBlock(k, rows - h, cols, x + h * ld, y + h, ld);
+			} else {
+				const int h = half(cols);
+				swapBlock(k, rows, h, x, y, ld);
+				swapBlock(k, rows, cols - h, x + h, y + h * ld, ld);
+			}
+			return;
+		}
+		const int rows4 = rows / TILE * TILE;
+		const int cols4 = cols / TILE * TILE;
+		for (int i = 0; i < rows4; i += TILE)
+			for (int j = 0; j < cols4; j += TILE)
+				k.swap(x + i * ld + j, y + j * ld + i, ld);
+		for (int i = 0; i < rows; ++i)
+			for (int j = (i < rows4 ? cols4 : 0); j < cols; ++j)
+				std::swap(x[i * ld + j], y[j * ld + i]);
+	}
+
+	void inPlaceBlock(const TileKernels& k, int n, double* a, std::size_t ld) {
+		if (n > LEAF) {
+			const int h = half(n);
+			inPlaceBlock(k, h, a, ld);
+			inPlaceBlock(k, n - h, a + h * ld + h, ld);
+			swapBlock(k, h, n - h, a + h, a + h * ld, ld);
+			return;
+		}
+		const int n4 = n / TILE * TILE;
+		for (int i = 0; i < n4; i += TILE) {
+			k.tile(a + i * ld + i, ld, a + i * ld + i, ld);
+			for (int j = i + TILE; j < n4; j += TILE)
+				k.swap(a + i * ld + j, a + j * ld + i, ld);
+		}
+		for (int i = 0; i < n; ++i)
+			for (int j = (i < n4 ? n4 : i + 1); j < n; ++j)
+				std::swap(a[i * ld + j], a[j * ld + i]);
+	}
+}
+
+namespace matrix {
+	namespace detail {
+		void transpose(int rows, int cols, const double* src, std::size_t lds, double* dst, std::size_t ldd) {
+			TileKernels k = tileKernels();
+			const bool large = static_cast<std::size_t>(rows) * cols * sizeof(double) > STREAM_BYTES;
+			const bool aligned = reinterpret_cast<std::uintptr_t>(dst) % 32 == 0 && ldd % TILE == 0;
+			if (k.stream && large && aligned) {
+				// Every tile starts at a multiple of TILE, so its stores stay aligned
+				k.tile = k.stream;
+				transposeBlock(k, rows, cols, src, lds, dst, ldd);
+#ifdef MATRIX_X86
+				_mm_sfence();
+#endif
+				return;
+			}
+			transposeBlock(k, rows, cols, src, lds, dst, ldd);
+		}
+
+		void transposeInPlace(int n, double* a) {
+			inPlaceBlock(tileKernels(), n, a, static_cast<std::size_t>(n));
+		}
+	}
+
+	SquareMat operator*(const TransposeView& a, const SquareMat& b) {
+		return product(a.matrix(), true, b, false);
+	}
+
+	SquareMat operator*(const SquareMat& a, const TransposeView& b) {
+		return product(a, false, b.matrix(), true);
+	}
+
+	SquareMat operator*(const TransposeView& a, const TransposeView& b) {
+		return product(a.matrix(), true, b.matrix(), true);
+	}
+}
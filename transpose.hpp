@@ -0,0 +1,102 @@
+// ey.gellis@gmail.com
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include "squaremat.hpp"
+#include <cstddef>
+
+namespace matrix {
+	/**
+	 * @brief Zero-copy transpose of a SquareMat
+	 *
+	 * Products with a view read the underlying storage in transposed order while
+	 * packing, so transposed(a) * b costs the same as a * b and never builds a^T.
+	 * Anywhere else the view converts to a materialized SquareMat.
+	 */
+	class TransposeView {
+	private:
+		const SquareMat* mat;
+
+	public:
+		explicit TransposeView(const SquareMat& m) : mat(&m) {}
+
+		int dim() const { return mat->dim(); }
+
+		/**
+		 * @brief Element (i, j) of the transpose
+		 */
+		double operator()(int i, int j) const { return (*mat)[j][i]; }
+
+		/**
+		 * @brief Matrix the view transposes
+		 */
+		const SquareMat& matrix() const { return *mat; }
+
+		/**
+		 * @brief Materializes the transpose
+		 */
+		operator SquareMat() const { return ~*mat; }
+	};
+
+	/**
+	 * @brief Views a matrix as its transpose without copying
+	 *
+	 * Example: SquareMat g = transposed(a) * a; The matrix must outlive the view.
+	 * @param mat Matrix to view
+	 * @return Transposed view
+	 */
+	inline TransposeView transposed(const SquareMat& mat) { return TransposeView(mat); }
+	TransposeView transposed(SquareMat&&) = delete;
+
+	/**
+	 * @brief A^T * B without materializing A^T
+	 * @param a Transposed left operand
+	 * @param b Right operand
+	 * @return Product matrix
+	 */
+	SquareMat operator*(const TransposeView& a, const SquareMat& b);
+
+	/**
+	 * @brief A * B^T without materializing B^T
+	 * @param a Left operand
+	 * @param b Transposed right operand
+	 * @return Product matrix
+	 */
+	SquareMat operator*(const SquareMat& a, const TransposeView& b);
+
+	/**
+	 * @brief A^T * B^T without materializing either transpose
+	 * @param a Transposed left operand
+	 * @param b Transposed right operand
+	 * @return Product matrix
+	 */
+	SquareMat operator*(const TransposeView& a, const TransposeView& b);
+
+	namespace detail {
+		/**
+		 * @brief Cache-oblivious out-of-place transpose, dst = src^T
+		 *
+		 * Recursively halves the longer side until blocks fit in L1, then moves
+		 * 4x4 tiles through registers so both the loads and the stores are
+		 * contiguous. src and dst must not overlap.
+		 * @param rows Rows of src
+		 * @param cols Columns of src
+		 * @param src Source, row-major
+		 * @param lds Row stride of src, in elements
+		 * @param dst Destination (cols x rows), row-major
+		 * @param ldd Row stride of dst, in elements
+		 */
+		void transpose(int rows, int cols, const double* src, std::size_t lds, double* dst, std::size_t ldd);
+
+		/**
+		 * @brief In-place transpose of a contiguous n x n row-major matrix
+		 *
+		 * Transposes the diagonal blocks in place and swaps mirrored off-diagonal
+		 * blocks across the diagonal, using no extra memory.
+		 * @param n Matrix dimension
+		 * @param a Matrix data
+		 */
+		void transposeInPlace(int n, double* a);
+	}
+}
+#endif